@@ -0,0 +1,162 @@
+/*
+ * Epoll event rate benchmark
+ *
+ * Watches a number of UNIX socket pairs with epoll while writer threads send
+ * one byte to randomly chosen sockets as fast as they can. The reader drains
+ * every socket reported ready and prints, for each number of sockets, the
+ * number of events and of epoll_wait() returns per second. With
+ * EPOLL_CTL_MODERATE, the reader is woken up once per batch of ready sockets
+ * instead of once per event.
+ *
+ * Build: gcc -O2 -o epoll-bench epoll-bench.c -lpthread
+ * Usage: epoll-bench [seconds] [writers] [min events] [max usecs]
+ *                    [sockets...]
+ *
+ * Each socket pair takes two descriptors, raise "ulimit -n" accordingly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#ifndef EPOLL_CTL_MODERATE
+#define EPOLL_CTL_MODERATE 4
+#endif
+
+#define MAX_EVENTS 256
+
+static volatile int stop;
+static int *socks;
+static int nr_socks;
+
+static void *writer(void *arg)
+{
+	unsigned int seed = (unsigned long)arg;
+	char c = 0;
+
+	while (!stop) {
+		int i = rand_r(&seed) % nr_socks;
+
+		/* the socket may be full when the reader lags, just skip it */
+		if (write(socks[2 * i + 1], &c, 1) < 0)
+			continue;
+	}
+	return NULL;
+}
+
+static void run(int sockets, int seconds, int nr_writers,
+		int min_events, int max_usecs)
+{
+	struct epoll_event ev, events[MAX_EVENTS];
+	unsigned long nr_events = 0, nr_waits = 0;
+	pthread_t *threads;
+	char buf[4096];
+	time_t end;
+	int epfd, i, n;
+
+	nr_socks = sockets;
+	socks = calloc(2 * sockets, sizeof(*socks));
+	threads = calloc(nr_writers, sizeof(*threads));
+	if (!socks || !threads) {
+		perror("calloc");
+		exit(1);
+	}
+	epfd = epoll_create(sockets);
+	if (epfd < 0) {
+		perror("epoll_create");
+		exit(1);
+	}
+	if (min_events) {
+		ev.events = min_events;
+		ev.data.u64 = max_usecs;
+		if (epoll_ctl(epfd, EPOLL_CTL_MODERATE, 0, &ev) < 0) {
+			perror("EPOLL_CTL_MODERATE");
+			exit(1);
+		}
+	}
+	for (i = 0; i < sockets; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, &socks[2 * i]) < 0) {
+			perror("socketpair");
+			exit(1);
+		}
+		fcntl(socks[2 * i], F_SETFL, O_NONBLOCK);
+		fcntl(socks[2 * i + 1], F_SETFL, O_NONBLOCK);
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.fd = socks[2 * i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, socks[2 * i], &ev) < 0) {
+			perror("epoll_ctl");
+			exit(1);
+		}
+	}
+
+	stop = 0;
+	for (i = 0; i < nr_writers; i++) {
+		if (pthread_create(&threads[i], NULL, writer,
+				   (void *)(unsigned long)(i + 1))) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	end = time(NULL) + seconds;
+	while (time(NULL) < end) {
+		n = epoll_wait(epfd, events, MAX_EVENTS, 100);
+		if (n < 0) {
+			perror("epoll_wait");
+			exit(1);
+		}
+		nr_waits++;
+		nr_events += n;
+		for (i = 0; i < n; i++)
+			while (read(events[i].data.fd, buf, sizeof(buf)) > 0)
+				;
+	}
+
+	stop = 1;
+	for (i = 0; i < nr_writers; i++)
+		pthread_join(threads[i], NULL);
+	for (i = 0; i < 2 * sockets; i++)
+		close(socks[i]);
+	close(epfd);
+	free(threads);
+	free(socks);
+
+	printf("%8d sockets: %10lu events/s %10lu waits/s %6.1f events/wait\n",
+	       sockets, nr_events / seconds, nr_waits / seconds,
+	       nr_waits ? (double)nr_events / nr_waits : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+	static const int def_sockets[] = { 16, 64, 256, 448 };
+	int seconds = argc > 1 ? atoi(argv[1]) : 5;
+	int nr_writers = argc > 2 ? atoi(argv[2]) : 2;
+	int min_events = argc > 3 ? atoi(argv[3]) : 0;
+	int max_usecs = argc > 4 ? atoi(argv[4]) : 0;
+	int i;
+
+	if (seconds <= 0 || nr_writers <= 0 || min_events < 0 ||
+	    max_usecs < 0) {
+		fprintf(stderr, "usage: %s [seconds] [writers] [min events] "
+			"[max usecs] [sockets...]\n", argv[0]);
+		return 1;
+	}
+
+	printf("%d writers, moderation: %d events / %d usecs\n",
+	       nr_writers, min_events, max_usecs);
+	if (argc > 5) {
+		for (i = 5; i < argc; i++)
+			run(atoi(argv[i]), seconds, nr_writers,
+			    min_events, max_usecs);
+	} else {
+		for (i = 0; i < sizeof(def_sockets) / sizeof(def_sockets[0]); i++)
+			run(def_sockets[i], seconds, nr_writers,
+			    min_events, max_usecs);
+	}
+	return 0;
+}
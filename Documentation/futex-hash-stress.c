@@ -0,0 +1,140 @@
+/*
+ * Futex hash stress test
+ *
+ * Forks several processes, each running pairs of threads which pass a token
+ * back and forth with a pthread mutex and condition variable, and prints the
+ * number of handoffs per second. With many processes and threads, waiters
+ * of unrelated processes would collide in a single global futex hash;
+ * /sys/kernel/debug/futex_stats shows how the operations were split
+ * between the global and the private hashes.
+ *
+ * Build: gcc -O2 -o futex-hash-stress futex-hash-stress.c -lpthread
+ * Usage: futex-hash-stress [processes] [thread pairs] [seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+struct pair {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int turn;
+	unsigned long handoffs;
+};
+
+static volatile int stop;
+
+struct player {
+	struct pair *pair;
+	int id;
+};
+
+static void *player(void *arg)
+{
+	struct player *p = arg;
+	struct pair *pair = p->pair;
+
+	pthread_mutex_lock(&pair->lock);
+	while (!stop) {
+		while (pair->turn != p->id && !stop)
+			pthread_cond_wait(&pair->cond, &pair->lock);
+		pair->turn = !p->id;
+		pair->handoffs++;
+		pthread_cond_signal(&pair->cond);
+	}
+	pthread_cond_broadcast(&pair->cond);
+	pthread_mutex_unlock(&pair->lock);
+	return NULL;
+}
+
+static unsigned long run_process(int nr_pairs, int seconds)
+{
+	struct pair *pairs;
+	struct player *players;
+	pthread_t *threads;
+	unsigned long total = 0;
+	int i;
+
+	pairs = calloc(nr_pairs, sizeof(*pairs));
+	players = calloc(2 * nr_pairs, sizeof(*players));
+	threads = calloc(2 * nr_pairs, sizeof(*threads));
+	if (!pairs || !players || !threads) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (i = 0; i < 2 * nr_pairs; i++) {
+		struct pair *pair = &pairs[i / 2];
+
+		if (!(i & 1)) {
+			pthread_mutex_init(&pair->lock, NULL);
+			pthread_cond_init(&pair->cond, NULL);
+		}
+		players[i].pair = pair;
+		players[i].id = i & 1;
+		if (pthread_create(&threads[i], NULL, player, &players[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < 2 * nr_pairs; i++) {
+		pthread_mutex_lock(&pairs[i / 2].lock);
+		pthread_cond_broadcast(&pairs[i / 2].cond);
+		pthread_mutex_unlock(&pairs[i / 2].lock);
+		pthread_join(threads[i], NULL);
+	}
+	for (i = 0; i < nr_pairs; i++)
+		total += pairs[i].handoffs;
+	return total;
+}
+
+int main(int argc, char **argv)
+{
+	int nr_procs = argc > 1 ? atoi(argv[1]) : 8;
+	int nr_pairs = argc > 2 ? atoi(argv[2]) : 16;
+	int seconds = argc > 3 ? atoi(argv[3]) : 10;
+	unsigned long *results, total = 0;
+	int i;
+
+	if (nr_procs <= 0 || nr_pairs <= 0 || seconds <= 0) {
+		fprintf(stderr, "usage: %s [processes] [thread pairs] "
+			"[seconds]\n", argv[0]);
+		return 1;
+	}
+
+	results = mmap(NULL, nr_procs * sizeof(*results),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+		       -1, 0);
+	if (results == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	for (i = 0; i < nr_procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pid) {
+			results[i] = run_process(nr_pairs, seconds);
+			_exit(0);
+		}
+	}
+	for (i = 0; i < nr_procs; i++)
+		wait(NULL);
+
+	for (i = 0; i < nr_procs; i++)
+		total += results[i];
+	printf("%d processes, %d thread pairs each, %d s: "
+	       "%lu handoffs/s\n", nr_procs, nr_pairs, seconds,
+	       total / seconds);
+	return 0;
+}
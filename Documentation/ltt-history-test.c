@@ -0,0 +1,111 @@
+/*
+ * LTTng flight recorder history test
+ *
+ * Keeps the history files of a trace open while the history is discarded,
+ * then reads them: they must still return the frozen pool, and opening them
+ * again must fail. The trace must be allocated in flight recorder mode and
+ * started, as described in Documentation/lttng.txt.
+ *
+ * Build: gcc -O2 -o ltt-history-test ltt-history-test.c
+ * Usage: ltt-history-test <ltt debugfs dir> <trace> <channel>_<cpu> [kB]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char *ltt_dir, *trace;
+
+static int control(const char *file, const char *value)
+{
+	char path[256];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "%s/control/%s/%s", ltt_dir, trace, file);
+	fd = open(path, O_WRONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+	ret = write(fd, value, strlen(value));
+	if (ret < 0)
+		perror(path);
+	close(fd);
+	return ret < 0 ? -1 : 0;
+}
+
+static int open_history(const char *file)
+{
+	char path[256];
+
+	snprintf(path, sizeof(path), "%s/history/%s/%s", ltt_dir, trace, file);
+	return open(path, O_RDONLY);
+}
+
+static long read_all(int fd, const char *name)
+{
+	char buf[4096];
+	long total = 0;
+	ssize_t ret;
+
+	while ((ret = read(fd, buf, sizeof(buf))) > 0)
+		total += ret;
+	if (ret < 0) {
+		fprintf(stderr, "read %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+	return total;
+}
+
+int main(int argc, char **argv)
+{
+	const char *size = argc > 4 ? argv[4] : "32768";
+	long data, stats;
+	int fd, stats_fd;
+
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s <ltt debugfs dir> <trace> "
+			"<channel>_<cpu> [kB]\n", argv[0]);
+		return 2;
+	}
+	ltt_dir = argv[1];
+	trace = argv[2];
+
+	if (control("history", size))
+		return 1;
+	sleep(5);
+	if (control("snapshot", "1"))
+		return 1;
+
+	fd = open_history(argv[3]);
+	stats_fd = open_history("stats");
+	if (fd < 0 || stats_fd < 0) {
+		perror("open history");
+		return 1;
+	}
+
+	/* Discard the history with the files still open */
+	if (control("history", "0"))
+		return 1;
+
+	data = read_all(fd, argv[3]);
+	stats = read_all(stats_fd, "stats");
+	close(fd);
+	close(stats_fd);
+	if (data < 0 || stats <= 0)
+		return 1;
+
+	fd = open_history(argv[3]);
+	if (fd >= 0 || errno != ENOENT) {
+		fprintf(stderr, "history file still opens after discard\n");
+		if (fd >= 0)
+			close(fd);
+		return 1;
+	}
+
+	printf("read %ld bytes of history after discard: ok\n", data);
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Swap memory pressure test
+ *
+ * Allocates more anonymous memory than the machine has, fills every page
+ * with data that compresses roughly 3:1 (a pattern derived from the page
+ * number, followed by random bytes), then walks it again a number of
+ * times, checking each page and rewriting part of them. Pages are pushed
+ * out to swap and brought back in, and any page which does not read back
+ * the way it was written is reported. At the end, the memory is freed in
+ * halves so that the swap slot freeing path is exercised too.
+ *
+ * Build: gcc -O2 -o swap-pressure swap-pressure.c
+ * Usage: swap-pressure [megabytes] [passes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+static unsigned long page_size;
+
+static void fill_page(unsigned char *p, unsigned long nr, unsigned int gen)
+{
+	unsigned long *w = (unsigned long *)p;
+	unsigned long i, words = page_size / sizeof(*w);
+	unsigned int seed = nr * 31 + gen;
+
+	/* two thirds pattern, one third noise */
+	for (i = 0; i < words * 2 / 3; i++)
+		w[i] = nr ^ ((unsigned long)gen << 24) ^ (i & 0xf);
+	for (; i < words; i++)
+		w[i] = rand_r(&seed);
+}
+
+static int check_page(unsigned char *p, unsigned long nr, unsigned int gen,
+		      unsigned char *ref)
+{
+	fill_page(ref, nr, gen);
+	return memcmp(p, ref, page_size);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long mb = argc > 1 ? strtoul(argv[1], NULL, 0) : 256;
+	int passes = argc > 2 ? atoi(argv[2]) : 3;
+	unsigned long nr_pages, i, bad = 0;
+	unsigned char *mem, *ref;
+	unsigned int *gen;
+	time_t start;
+	int pass;
+
+	if (!mb || passes <= 0) {
+		fprintf(stderr, "usage: %s [megabytes] [passes]\n", argv[0]);
+		return 1;
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	nr_pages = (mb << 20) / page_size;
+	mem = mmap(NULL, nr_pages * page_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	gen = calloc(nr_pages, sizeof(*gen));
+	ref = malloc(page_size);
+	if (mem == MAP_FAILED || !gen || !ref) {
+		perror("allocation");
+		return 1;
+	}
+
+	start = time(NULL);
+	for (i = 0; i < nr_pages; i++)
+		fill_page(mem + i * page_size, i, 0);
+	printf("filled %lu MB in %ld s\n", mb, (long)(time(NULL) - start));
+
+	for (pass = 1; pass <= passes; pass++) {
+		start = time(NULL);
+		for (i = 0; i < nr_pages; i++) {
+			unsigned char *p = mem + i * page_size;
+
+			if (check_page(p, i, gen[i], ref)) {
+				if (bad++ < 10)
+					fprintf(stderr, "page %lu corrupted "
+						"(generation %u)\n", i, gen[i]);
+			}
+			/* rewrite one page in four */
+			if (!((i + pass) & 3)) {
+				gen[i] = pass;
+				fill_page(p, i, pass);
+			}
+		}
+		printf("pass %d: %lu MB checked in %ld s, %lu bad pages\n",
+		       pass, mb, (long)(time(NULL) - start), bad);
+	}
+
+	/* free the first half, then touch the second one again */
+	munmap(mem, nr_pages / 2 * page_size);
+	for (i = nr_pages / 2; i < nr_pages; i++)
+		if (check_page(mem + i * page_size, i, gen[i], ref))
+			bad++;
+	munmap(mem + nr_pages / 2 * page_size,
+	       (nr_pages - nr_pages / 2) * page_size);
+
+	printf("%s: %lu bad pages\n", bad ? "FAILED" : "passed", bad);
+	return bad ? 1 : 0;
+}
@@ -93,6 +93,8 @@
 #include <linux/rcupdate.h>
 #include <linux/kprobes.h>
 #include <linux/io.h>
+#include <linux/sort.h>
+#include <linux/stringify.h>
 
 #include <asm/cacheflush.h>
 
@@ -100,40 +102,55 @@
 #define BREAKPOINT_INS_LEN	1
 #define NR_NOPS			10
 
-static unsigned long target_after_int3;	/* EIP of the target after the int3 */
-static unsigned long bypass_eip;	/* EIP of the bypass. */
-static unsigned long bypass_after_int3;	/* EIP after the end-of-bypass int3 */
-static unsigned long after_imv;	/*
+/*
+ * Each bypass slot holds a copy of the instruction being updated padded with
+ * nops, followed by an int3, within 16 bytes.
+ */
+#define IMV_SLOT_SIZE		16
+
+/*
+ * Sites being updated by the current batch, sorted by instruction address.
+ * Read by the int3 handler, only written when the die notifier is not
+ * registered.
+ */
+struct imv_patch {
+	unsigned long insn;		/* Instruction address */
+	unsigned long after_imv;	/*
 					 * EIP where to resume after the
 					 * single-stepping.
 					 */
+	const struct __imv *imv;
+};
+
+static struct imv_patch imv_patches[IMV_BATCH_MAX];
+static int imv_nr_patches;
+static unsigned long bypass_slots;	/* EIP of the first bypass slot */
 
 /*
- * Internal bypass used during value update. The bypass is skipped by the
- * function in which it is inserted.
+ * Internal bypass slots used during value update. The bypass is skipped by
+ * the function in which it is inserted.
  * No need to be aligned because we exclude readers from the site during
  * update.
- * Layout is:
- * (10x nop) int3
+ * Slot layout is:
+ * (10x nop) int3 (5x nop)
  * (maximum size is 2 bytes opcode + 8 bytes immediate value for long on x86_64)
  * The nops are the target replaced by the instruction to single-step.
- * Align on 16 bytes to make sure the nops fit within a single page so remapping
- * it can be done easily.
+ * Align on 16 bytes to make sure each slot fits within a single page so
+ * remapping it can be done easily.
  */
-static inline void _imv_bypass(unsigned long *bypassaddr,
-	unsigned long *breaknextaddr)
+static noinline void _imv_bypass(unsigned long *bypassaddr)
 {
 		asm volatile("jmp 2f;\n\t"
 				".align 16;\n\t"
 				"0:\n\t"
+				".rept " __stringify(IMV_BATCH_MAX) ";\n\t"
 				".space 10, 0x90;\n\t"
-				"1:\n\t"
 				"int3;\n\t"
+				".space 5, 0x90;\n\t"
+				".endr;\n\t"
 				"2:\n\t"
 				"mov $(0b),%0;\n\t"
-				"mov $((1b)+1),%1;\n\t"
-				: "=r" (*bypassaddr),
-				  "=r" (*breaknextaddr));
+				: "=r" (*bypassaddr));
 }
 
 static void imv_synchronize_core(void *info)
@@ -142,6 +159,22 @@ static void imv_synchronize_core(void *info)
 	sync_core();	/* use cpuid to stop speculative execution */
 }
 
+static int imv_patch_find(unsigned long insn)
+{
+	int low = 0, high = imv_nr_patches - 1, mid;
+
+	while (low <= high) {
+		mid = (low + high) / 2;
+		if (imv_patches[mid].insn == insn)
+			return mid;
+		if (imv_patches[mid].insn < insn)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+	return -1;
+}
+
 /*
  * The eip value points right after the breakpoint instruction, in the second
  * byte of the movl.
@@ -154,22 +187,33 @@ static int imv_notifier(struct notifier_block *nb,
 {
 	enum die_val die_val = (enum die_val) val;
 	struct die_args *args = data;
+	unsigned long ip;
+	int i;
 
 	if (!args->regs || user_mode_vm(args->regs))
 		return NOTIFY_DONE;
 
-	if (die_val == DIE_INT3) {
-		if (args->regs->ip == target_after_int3) {
-			preempt_disable();
-			args->regs->ip = bypass_eip;
-			return NOTIFY_STOP;
-		} else if (args->regs->ip == bypass_after_int3) {
-			args->regs->ip = after_imv;
-			preempt_enable();
-			return NOTIFY_STOP;
-		}
+	if (die_val != DIE_INT3)
+		return NOTIFY_DONE;
+
+	ip = args->regs->ip;
+	if (ip > bypass_slots
+	    && ip <= bypass_slots + imv_nr_patches * IMV_SLOT_SIZE) {
+		/* End of a bypass slot */
+		i = (ip - bypass_slots) / IMV_SLOT_SIZE;
+		if (ip != bypass_slots + i * IMV_SLOT_SIZE + NR_NOPS
+				+ BREAKPOINT_INS_LEN)
+			return NOTIFY_DONE;
+		args->regs->ip = imv_patches[i].after_imv;
+		preempt_enable();
+		return NOTIFY_STOP;
 	}
-	return NOTIFY_DONE;
+	i = imv_patch_find(ip - BREAKPOINT_INS_LEN);
+	if (i < 0)
+		return NOTIFY_DONE;
+	preempt_disable();
+	args->regs->ip = bypass_slots + i * IMV_SLOT_SIZE;
+	return NOTIFY_STOP;
 }
 
 static struct notifier_block imv_notify = {
@@ -177,29 +221,29 @@ static struct notifier_block imv_notify = {
 	.priority = 0x7fffffff,	/* we need to be notified first */
 };
 
+static inline unsigned long imv_insn(const struct __imv *imv)
+{
+	return imv->imv - (imv->insn_size - imv->size);
+}
+
 /**
- * arch_imv_update - update one immediate value
- * @imv: pointer of type const struct __imv to update
+ * arch_imv_check - check if an immediate value must be updated
+ * @imv: pointer of type const struct __imv to check
  * @early: early boot (1) or normal (0)
  *
- * Update one immediate value. Must be called with imv_mutex held.
+ * Returns 1 if the site must be patched, 0 if it is up to date, and a
+ * negative error value if it cannot be patched.
  */
-__kprobes int arch_imv_update(const struct __imv *imv, int early)
+__kprobes int arch_imv_check(const struct __imv *imv, int early)
 {
-	int ret;
-	unsigned char opcode_size = imv->insn_size - imv->size;
-	unsigned long insn = imv->imv - opcode_size;
-	unsigned long len;
-	void *buffer;
-
 #ifdef CONFIG_KPROBES
 	/*
 	 * Fail if a kprobe has been set on this instruction.
 	 * (TODO: we could eventually do better and modify all the (possibly
 	 * nested) kprobes for this site if kprobes had an API for this.
 	 */
-	if (unlikely(!early
-			&& *(unsigned char *)insn == BREAKPOINT_INSTRUCTION)) {
+	if (unlikely(!early && *(unsigned char *)imv_insn(imv)
+			== BREAKPOINT_INSTRUCTION)) {
 		printk(KERN_WARNING "Immediate value in conflict with kprobe. "
 				    "Variable at %p, "
 				    "instruction at %p, size %hu\n",
@@ -234,68 +278,143 @@ __kprobes int arch_imv_update(const struct __imv *imv, int early)
 #endif
 	default:return -EINVAL;
 	}
+	return 1;
+}
 
-	if (!early) {
-		/* bypass is 10 bytes long for x86_64 long */
-		WARN_ON(imv->insn_size > 10);
-		_imv_bypass(&bypass_eip, &bypass_after_int3);
+static int imv_patch_cmp(const void *a, const void *b)
+{
+	const struct imv_patch *pa = a, *pb = b;
+
+	if (pa->insn < pb->insn)
+		return -1;
+	if (pa->insn > pb->insn)
+		return 1;
+	return 0;
+}
+
+/**
+ * arch_imv_update_batch - update an array of immediate values
+ * @imvs: sites to update
+ * @nr: number of sites, at most IMV_BATCH_MAX
+ * @early: early boot (1) or normal (0)
+ *
+ * Update all the sites with a single breakpoint round: every site gets a
+ * breakpoint redirecting to its own bypass slot, all the immediate values are
+ * written, and then all the original first bytes are put back. This costs
+ * two IPIs to every CPU and one synchronize_sched() for the whole batch.
+ * Must be called with imv_mutex and text_mutex held. Returns the number of
+ * sites which could not be updated.
+ */
+__kprobes int arch_imv_update_batch(const struct __imv **imvs, int nr,
+		int early)
+{
+	unsigned char buffer[NR_NOPS];
+	const struct __imv *imv;
+	unsigned long insn;
+	int i, ret, errors = 0, nr_patches = 0;
 
-		after_imv = imv->imv + imv->size;
-		len = NR_NOPS - imv->insn_size;
+	BUG_ON(nr > IMV_BATCH_MAX);
 
-		/* Allocate buffer to prepare new bypass */
-		buffer = kmalloc(imv->insn_size + len, GFP_KERNEL);
+	if (early) {
+		for (i = 0; i < nr; i++)
+			text_poke_early((void *)imvs[i]->imv,
+				(void *)imvs[i]->var, imvs[i]->size);
+		return 0;
+	}
+
+	for (i = 0; i < nr; i++) {
+		imv = imvs[i];
+		/* bypass is 10 bytes long for x86_64 long */
+		if (WARN_ON(imv->insn_size > NR_NOPS)) {
+			errors++;
+			continue;
+		}
+		imv_patches[nr_patches].insn = imv_insn(imv);
+		imv_patches[nr_patches].after_imv = imv->imv + imv->size;
+		imv_patches[nr_patches].imv = imv;
+		nr_patches++;
+	}
+	if (!nr_patches)
+		return errors;
+	sort(imv_patches, nr_patches, sizeof(struct imv_patch),
+	     imv_patch_cmp, NULL);
+
+	_imv_bypass(&bypass_slots);
+	for (i = 0; i < nr_patches; i++) {
+		imv = imv_patches[i].imv;
+		insn = imv_patches[i].insn;
 		memcpy(buffer, (void *)insn, imv->insn_size);
 		/*
 		 * Fill the rest with nops.
 		 */
-		add_nops(buffer + imv->insn_size, len);
-		text_poke((void *)bypass_eip, buffer, imv->insn_size + len);
-		kfree(buffer);
+		add_nops(buffer + imv->insn_size, NR_NOPS - imv->insn_size);
+		text_poke((void *)(bypass_slots + i * IMV_SLOT_SIZE), buffer,
+			  NR_NOPS);
+	}
+	imv_nr_patches = nr_patches;
 
-		target_after_int3 = insn + BREAKPOINT_INS_LEN;
-		/* register_die_notifier has memory barriers */
-		register_die_notifier(&imv_notify);
-		/* The breakpoint will single-step the bypass */
-		text_poke((void *)insn,
+	/* register_die_notifier has memory barriers */
+	register_die_notifier(&imv_notify);
+	/* The breakpoints will single-step the bypasses */
+	for (i = 0; i < nr_patches; i++)
+		text_poke((void *)imv_patches[i].insn,
 			((unsigned char[]){BREAKPOINT_INSTRUCTION}), 1);
-		/*
-		 * Make sure the breakpoint is set before we continue (visible
-		 * to other CPUs and interrupts).
-		 */
-		smp_wmb();
-		/*
-		 * Execute smp_rmb() and serializing instruction on each CPU.
-		 */
-		ret = on_each_cpu(imv_synchronize_core, NULL, 1);
-		BUG_ON(ret != 0);
+	/*
+	 * Make sure the breakpoints are set before we continue (visible
+	 * to other CPUs and interrupts).
+	 */
+	smp_wmb();
+	/*
+	 * Execute smp_rmb() and serializing instruction on each CPU.
+	 */
+	ret = on_each_cpu(imv_synchronize_core, NULL, 1);
+	BUG_ON(ret != 0);
 
-		text_poke((void *)(insn + opcode_size), (void *)imv->var,
-				imv->size);
-		/*
-		 * Make sure the value can be seen from other CPUs and
-		 * interrupts.
-		 */
-		smp_wmb();
-		/*
-		 * Execute smp_rmb() on each CPU.
-		 */
-		ret = on_each_cpu(imv_synchronize_core, NULL, 1);
-		BUG_ON(ret != 0);
-		text_poke((void *)insn, (unsigned char *)bypass_eip, 1);
-		/*
-		 * Wait for all int3 handlers to end (interrupts are disabled in
-		 * int3). This CPU is clearly not in a int3 handler, because
-		 * int3 handler is not preemptible and there cannot be any more
-		 * int3 handler called for this site, because we placed the
-		 * original instruction back.  synchronize_sched has memory
-		 * barriers.
-		 */
-		synchronize_sched();
-		unregister_die_notifier(&imv_notify);
-		/* unregister_die_notifier has memory barriers */
-	} else
-		text_poke_early((void *)imv->imv, (void *)imv->var,
-			imv->size);
-	return 0;
+	for (i = 0; i < nr_patches; i++) {
+		imv = imv_patches[i].imv;
+		text_poke((void *)imv->imv, (void *)imv->var, imv->size);
+	}
+	/*
+	 * Make sure the values can be seen from other CPUs and
+	 * interrupts.
+	 */
+	smp_wmb();
+	/*
+	 * Execute smp_rmb() on each CPU.
+	 */
+	ret = on_each_cpu(imv_synchronize_core, NULL, 1);
+	BUG_ON(ret != 0);
+	for (i = 0; i < nr_patches; i++)
+		text_poke((void *)imv_patches[i].insn,
+			(unsigned char *)(bypass_slots + i * IMV_SLOT_SIZE), 1);
+	/*
+	 * Wait for all int3 handlers to end (interrupts are disabled in
+	 * int3). This CPU is clearly not in a int3 handler, because
+	 * int3 handler is not preemptible and there cannot be any more
+	 * int3 handler called for these sites, because we placed the
+	 * original instructions back.  synchronize_sched has memory
+	 * barriers.
+	 */
+	synchronize_sched();
+	unregister_die_notifier(&imv_notify);
+	/* unregister_die_notifier has memory barriers */
+	imv_nr_patches = 0;
+	return errors;
+}
+
+/**
+ * arch_imv_update - update one immediate value
+ * @imv: pointer of type const struct __imv to update
+ * @early: early boot (1) or normal (0)
+ *
+ * Update one immediate value. Must be called with imv_mutex held.
+ */
+__kprobes int arch_imv_update(const struct __imv *imv, int early)
+{
+	int ret;
+
+	ret = arch_imv_check(imv, early);
+	if (ret <= 0)
+		return ret;
+	return arch_imv_update_batch(&imv, 1, early) ? -EINVAL : 0;
 }
@@ -0,0 +1,190 @@
+/*
+ * Compressed RAM block device
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Per-device attributes in /sys/block/zramX: the disk size, which can be
+ * changed until the device is first used, a reset knob, and the I/O and
+ * memory statistics.
+ */
+
+#include <linux/device.h>
+#include <linux/genhd.h>
+#include <linux/blkdev.h>
+#include <linux/kernel.h>
+
+#include "zram_drv.h"
+
+#ifdef CONFIG_SYSFS
+
+static struct zram *dev_to_zram(struct device *dev)
+{
+	return dev_to_disk(dev)->private_data;
+}
+
+static ssize_t disksize_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n", (unsigned long long)zram->disksize);
+}
+
+static ssize_t disksize_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	u64 disksize;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = strict_strtoull(buf, 10, &disksize);
+	if (ret)
+		return ret;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		pr_info("zram: cannot change disksize for initialized device\n");
+		return -EBUSY;
+	}
+	zram_set_disksize(zram, disksize);
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t initstate_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%u\n", zram->init_done);
+}
+
+static ssize_t reset_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned long do_reset;
+	struct zram *zram;
+	struct block_device *bdev;
+
+	zram = dev_to_zram(dev);
+	bdev = bdget_disk(zram->disk, 0);
+	if (!bdev)
+		return -ENOMEM;
+
+	/* Do not reset an active device! */
+	if (bdev->bd_openers) {
+		bdput(bdev);
+		return -EBUSY;
+	}
+
+	ret = strict_strtoul(buf, 10, &do_reset);
+	if (!ret && !do_reset)
+		ret = -EINVAL;
+	if (ret) {
+		bdput(bdev);
+		return ret;
+	}
+
+	/* Make sure all pending I/O is finished */
+	fsync_bdev(bdev);
+	bdput(bdev);
+
+	if (zram->init_done)
+		zram_reset_device(zram);
+
+	return len;
+}
+
+#define ZRAM_STAT_SHOW(name, expr)					\
+static ssize_t name##_show(struct device *dev,				\
+		struct device_attribute *attr, char *buf)		\
+{									\
+	struct zram *zram = dev_to_zram(dev);				\
+									\
+	return sprintf(buf, "%llu\n", (unsigned long long)(expr));	\
+}
+
+ZRAM_STAT_SHOW(num_reads, zram_stat_read(zram, &zram->stats.num_reads))
+ZRAM_STAT_SHOW(num_writes, zram_stat_read(zram, &zram->stats.num_writes))
+ZRAM_STAT_SHOW(failed_reads,
+	       zram_stat_read(zram, &zram->stats.failed_reads))
+ZRAM_STAT_SHOW(failed_writes,
+	       zram_stat_read(zram, &zram->stats.failed_writes))
+ZRAM_STAT_SHOW(invalid_io, zram_stat_read(zram, &zram->stats.invalid_io))
+ZRAM_STAT_SHOW(notify_free, zram_stat_read(zram, &zram->stats.notify_free))
+ZRAM_STAT_SHOW(discards, zram_stat_read(zram, &zram->stats.discards))
+ZRAM_STAT_SHOW(zero_pages, zram_stat_read(zram, &zram->stats.pages_zero))
+ZRAM_STAT_SHOW(good_compress,
+	       zram_stat_read(zram, &zram->stats.good_compress))
+ZRAM_STAT_SHOW(incompressible,
+	       zram_stat_read(zram, &zram->stats.pages_expand))
+ZRAM_STAT_SHOW(orig_data_size,
+	       zram_stat_read(zram, &zram->stats.pages_stored) << PAGE_SHIFT)
+ZRAM_STAT_SHOW(compr_data_size,
+	       zram_stat_read(zram, &zram->stats.compr_size))
+
+static ssize_t mem_used_total_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	u64 val = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		val = xv_get_total_size_bytes(zram->mem_pool) +
+			(zram_stat_read(zram, &zram->stats.pages_expand)
+				<< PAGE_SHIFT);
+	}
+	mutex_unlock(&zram->init_lock);
+
+	return sprintf(buf, "%llu\n", (unsigned long long)val);
+}
+
+static DEVICE_ATTR(disksize, S_IRUGO | S_IWUSR,
+		disksize_show, disksize_store);
+static DEVICE_ATTR(initstate, S_IRUGO, initstate_show, NULL);
+static DEVICE_ATTR(reset, S_IWUSR, NULL, reset_store);
+static DEVICE_ATTR(num_reads, S_IRUGO, num_reads_show, NULL);
+static DEVICE_ATTR(num_writes, S_IRUGO, num_writes_show, NULL);
+static DEVICE_ATTR(failed_reads, S_IRUGO, failed_reads_show, NULL);
+static DEVICE_ATTR(failed_writes, S_IRUGO, failed_writes_show, NULL);
+static DEVICE_ATTR(invalid_io, S_IRUGO, invalid_io_show, NULL);
+static DEVICE_ATTR(notify_free, S_IRUGO, notify_free_show, NULL);
+static DEVICE_ATTR(discards, S_IRUGO, discards_show, NULL);
+static DEVICE_ATTR(zero_pages, S_IRUGO, zero_pages_show, NULL);
+static DEVICE_ATTR(good_compress, S_IRUGO, good_compress_show, NULL);
+static DEVICE_ATTR(incompressible, S_IRUGO, incompressible_show, NULL);
+static DEVICE_ATTR(orig_data_size, S_IRUGO, orig_data_size_show, NULL);
+static DEVICE_ATTR(compr_data_size, S_IRUGO, compr_data_size_show, NULL);
+static DEVICE_ATTR(mem_used_total, S_IRUGO, mem_used_total_show, NULL);
+
+static struct attribute *zram_disk_attrs[] = {
+	&dev_attr_disksize.attr,
+	&dev_attr_initstate.attr,
+	&dev_attr_reset.attr,
+	&dev_attr_num_reads.attr,
+	&dev_attr_num_writes.attr,
+	&dev_attr_failed_reads.attr,
+	&dev_attr_failed_writes.attr,
+	&dev_attr_invalid_io.attr,
+	&dev_attr_notify_free.attr,
+	&dev_attr_discards.attr,
+	&dev_attr_zero_pages.attr,
+	&dev_attr_good_compress.attr,
+	&dev_attr_incompressible.attr,
+	&dev_attr_orig_data_size.attr,
+	&dev_attr_compr_data_size.attr,
+	&dev_attr_mem_used_total.attr,
+	NULL,
+};
+
+struct attribute_group zram_disk_attr_group = {
+	.attrs = zram_disk_attrs,
+};
+
+#endif	/* CONFIG_SYSFS */
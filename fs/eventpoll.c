@@ -33,6 +33,7 @@
 #include <linux/bitops.h>
 #include <linux/mutex.h>
 #include <linux/anon_inodes.h>
+#include <linux/hrtimer.h>
 #include <asm/uaccess.h>
 #include <asm/system.h>
 #include <asm/io.h>
@@ -86,6 +87,12 @@
 
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
 
+/* Number of events gathered before each copy to userspace */
+#define EP_SEND_BATCH 16
+
+/* Maximum event moderation latency, in usecs */
+#define EP_MAX_MOD_USECS USEC_PER_SEC
+
 struct epoll_filefd {
 	struct file *file;
 	int fd;
@@ -184,6 +191,21 @@ struct eventpoll {
 
 	/* The user that created the eventpoll descriptor */
 	struct user_struct *user;
+
+	/*
+	 * Event moderation set by EPOLL_CTL_MODERATE: minimum number of ready
+	 * descriptors before waking up a waiter (0 when not moderated), and
+	 * maximum latency after the first one. All protected by ->lock.
+	 */
+	unsigned int mod_events;
+	ktime_t mod_latency;
+	struct hrtimer mod_timer;
+
+	/* Descriptors queued in the ready list since the last transfer */
+	unsigned int nr_ready;
+
+	/* A waiter was woken up and did not run yet */
+	int woken;
 };
 
 /* Wait structure used by the poll hooks */
@@ -434,6 +456,52 @@ static void ep_unregister_pollwait(struct eventpoll *ep, struct epitem *epi)
 	}
 }
 
+/*
+ * Wakes up one epoll_wait() caller. When the wakeups are moderated, they are
+ * also coalesced: no other waiter is woken up until the woken one runs and
+ * goes to collect the ready list. Must be called with "ep->lock" held.
+ */
+static void ep_wake_up_waiter(struct eventpoll *ep)
+{
+	if (ep->woken)
+		return;
+	if (ep->mod_events)
+		ep->woken = 1;
+	wake_up_locked(&ep->wq);
+}
+
+/*
+ * Called from the poll callback when a descriptor became ready. With event
+ * moderation, the waiter is only woken up once "ep->mod_events" descriptors
+ * are ready, or when the moderation timer armed by the first one expires,
+ * like interrupt moderation on a NIC. Must be called with "ep->lock" held.
+ */
+static void ep_wake_up_locked(struct eventpoll *ep)
+{
+	if (ep->mod_events && ep->nr_ready < ep->mod_events) {
+		if (!ep->woken && !hrtimer_active(&ep->mod_timer))
+			hrtimer_start(&ep->mod_timer, ep->mod_latency,
+				      HRTIMER_MODE_REL);
+		return;
+	}
+	if (ep->mod_events)
+		hrtimer_try_to_cancel(&ep->mod_timer);
+	ep_wake_up_waiter(ep);
+}
+
+static enum hrtimer_restart ep_mod_timer_fn(struct hrtimer *timer)
+{
+	struct eventpoll *ep = container_of(timer, struct eventpoll, mod_timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&ep->lock, flags);
+	if (!list_empty(&ep->rdllist) && waitqueue_active(&ep->wq))
+		ep_wake_up_waiter(ep);
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
 /**
  * ep_scan_ready_list - Scans the ready list in a way that makes possible for
  *                      the scan code, to call f_op->poll(). Also allows for
@@ -514,7 +582,7 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 		 * the ->poll() wait list (delayed after we release the lock).
 		 */
 		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+			ep_wake_up_waiter(ep);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
@@ -609,6 +677,10 @@ static void ep_free(struct eventpoll *ep)
 	}
 
 	mutex_unlock(&epmutex);
+
+	/* No poll callback can arm the moderation timer anymore */
+	hrtimer_cancel(&ep->mod_timer);
+
 	mutex_destroy(&ep->mtx);
 	free_uid(ep->user);
 	kfree(ep);
@@ -742,6 +814,8 @@ static int ep_alloc(struct eventpoll **pep)
 	ep->rbr = RB_ROOT;
 	ep->ovflist = EP_UNACTIVE_PTR;
 	ep->user = user;
+	hrtimer_init(&ep->mod_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ep->mod_timer.function = ep_mod_timer_fn;
 
 	*pep = ep;
 
@@ -828,15 +902,17 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	}
 
 	/* If this file is already in the ready list we exit soon */
-	if (!ep_is_linked(&epi->rdllink))
+	if (!ep_is_linked(&epi->rdllink)) {
 		list_add_tail(&epi->rdllink, &ep->rdllist);
+		ep->nr_ready++;
+	}
 
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
 	 * wait list.
 	 */
 	if (waitqueue_active(&ep->wq))
-		wake_up_locked(&ep->wq);
+		ep_wake_up_locked(ep);
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
@@ -1043,60 +1119,81 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	return 0;
 }
 
+/*
+ * Called for each event copied to userspace. The caller holds "mtx", so no
+ * operations coming from userspace can change the item.
+ */
+static void ep_event_sent(struct eventpoll *ep, struct epitem *epi)
+{
+	if (epi->event.events & EPOLLONESHOT)
+		epi->event.events &= EP_PRIVATE_BITS;
+	else if (!(epi->event.events & EPOLLET)) {
+		/*
+		 * If this file has been added with Level Trigger mode, we need
+		 * to insert back inside the ready list, so that the next call
+		 * to epoll_wait() will check again the events availability.
+		 * At this point, noone can insert into ep->rdllist besides
+		 * us. The epoll_ctl() callers are locked out by
+		 * ep_scan_ready_list() holding "mtx" and the poll callback
+		 * will queue them in ep->ovflist.
+		 */
+		list_add_tail(&epi->rdllink, &ep->rdllist);
+	}
+}
+
 static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 			       void *priv)
 {
 	struct ep_send_events_data *esed = priv;
-	int eventcnt;
+	int eventcnt, nr, done, i;
 	unsigned int revents;
-	struct epitem *epi;
-	struct epoll_event __user *uevent;
+	unsigned long left;
+	struct epitem *epi, *batch[EP_SEND_BATCH];
+	struct epoll_event kevents[EP_SEND_BATCH];
 
 	/*
 	 * We can loop without lock because we are passed a task private list.
 	 * Items cannot vanish during the loop because ep_scan_ready_list() is
 	 * holding "mtx" during this call.
+	 *
+	 * The events are gathered in batches of EP_SEND_BATCH and each batch
+	 * is copied to userspace at once. The items of the events which could
+	 * not be copied are put back at the head of the list, in order.
 	 */
-	for (eventcnt = 0, uevent = esed->events;
-	     !list_empty(head) && eventcnt < esed->maxevents;) {
-		epi = list_first_entry(head, struct epitem, rdllink);
+	for (eventcnt = 0;;) {
+		for (nr = 0; nr < EP_SEND_BATCH && !list_empty(head) &&
+			     eventcnt + nr < esed->maxevents;) {
+			epi = list_first_entry(head, struct epitem, rdllink);
 
-		list_del_init(&epi->rdllink);
+			list_del_init(&epi->rdllink);
 
-		revents = epi->ffd.file->f_op->poll(epi->ffd.file, NULL) &
-			epi->event.events;
+			revents = epi->ffd.file->f_op->poll(epi->ffd.file, NULL) &
+				epi->event.events;
 
-		/*
-		 * If the event mask intersect the caller-requested one,
-		 * deliver the event to userspace. Again, ep_scan_ready_list()
-		 * is holding "mtx", so no operations coming from userspace
-		 * can change the item.
-		 */
-		if (revents) {
-			if (__put_user(revents, &uevent->events) ||
-			    __put_user(epi->event.data, &uevent->data)) {
-				list_add(&epi->rdllink, head);
-				return eventcnt ? eventcnt : -EFAULT;
-			}
-			eventcnt++;
-			uevent++;
-			if (epi->event.events & EPOLLONESHOT)
-				epi->event.events &= EP_PRIVATE_BITS;
-			else if (!(epi->event.events & EPOLLET)) {
-				/*
-				 * If this file has been added with Level
-				 * Trigger mode, we need to insert back inside
-				 * the ready list, so that the next call to
-				 * epoll_wait() will check again the events
-				 * availability. At this point, noone can insert
-				 * into ep->rdllist besides us. The epoll_ctl()
-				 * callers are locked out by
-				 * ep_scan_ready_list() holding "mtx" and the
-				 * poll callback will queue them in ep->ovflist.
-				 */
-				list_add_tail(&epi->rdllink, &ep->rdllist);
+			/*
+			 * If the event mask intersect the caller-requested
+			 * one, deliver the event to userspace.
+			 */
+			if (revents) {
+				kevents[nr].events = revents;
+				kevents[nr].data = epi->event.data;
+				batch[nr++] = epi;
 			}
 		}
+		if (!nr)
+			break;
+
+		left = __copy_to_user(esed->events + eventcnt, kevents,
+				      nr * sizeof(struct epoll_event));
+		done = nr - DIV_ROUND_UP(left, sizeof(struct epoll_event));
+		for (i = 0; i < done; i++)
+			ep_event_sent(ep, batch[i]);
+		eventcnt += done;
+		if (done < nr) {
+			for (i = nr - 1; i >= done; i--)
+				list_add(&batch[i]->rdllink, head);
+			return eventcnt ? eventcnt : -EFAULT;
+		}
 	}
 
 	return eventcnt;
@@ -1160,6 +1257,7 @@ retry:
 			spin_unlock_irqrestore(&ep->lock, flags);
 			jtimeout = schedule_timeout(jtimeout);
 			spin_lock_irqsave(&ep->lock, flags);
+			ep->woken = 0;
 		}
 		__remove_wait_queue(&ep->wq, &wait);
 
@@ -1167,6 +1265,8 @@ retry:
 	}
 	/* Is it worth to try to dig for events ? */
 	eavail = !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
+	if (eavail)
+		ep->nr_ready = 0;
 
 	spin_unlock_irqrestore(&ep->lock, flags);
 
@@ -1182,6 +1282,31 @@ retry:
 	return res;
 }
 
+/*
+ * Sets the event moderation of the eventpoll, for EPOLL_CTL_MODERATE:
+ * "events" is the minimum number of ready descriptors and "data" the maximum
+ * latency in usecs. A minimum of 0 disables the moderation.
+ */
+static int ep_moderate(struct eventpoll *ep, struct epoll_event *epds)
+{
+	unsigned long flags;
+
+	if (epds->events > 1 &&
+	    (!epds->data || epds->data > EP_MAX_MOD_USECS))
+		return -EINVAL;
+
+	spin_lock_irqsave(&ep->lock, flags);
+	ep->mod_events = epds->events;
+	ep->mod_latency = ns_to_ktime(epds->data * NSEC_PER_USEC);
+	/* Do not leave a waiter behind the previous settings */
+	ep->woken = 0;
+	if (!list_empty(&ep->rdllist) && waitqueue_active(&ep->wq))
+		ep_wake_up_waiter(ep);
+	spin_unlock_irqrestore(&ep->lock, flags);
+
+	return 0;
+}
+
 /*
  * Open an eventpoll file descriptor.
  */
@@ -1246,6 +1371,14 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	if (!file)
 		goto error_return;
 
+	/* Event moderation applies to the eventpoll itself, "fd" is unused */
+	if (op == EPOLL_CTL_MODERATE) {
+		error = -EINVAL;
+		if (is_file_epoll(file))
+			error = ep_moderate(file->private_data, &epds);
+		goto error_fput;
+	}
+
 	/* Get the "struct file *" for the target file */
 	tfile = fget(fd);
 	if (!tfile)
@@ -192,8 +192,8 @@ ssize_t splice_to_pipe(struct pipe_inode_info *pipe,
 			break;
 		}
 
-		if (pipe->nrbufs < PIPE_BUFFERS) {
-			int newbuf = (pipe->curbuf + pipe->nrbufs) & (PIPE_BUFFERS - 1);
+		if (pipe->nrbufs < pipe->buffers) {
+			int newbuf = (pipe->curbuf + pipe->nrbufs) & (pipe->buffers - 1);
 			struct pipe_buffer *buf = pipe->bufs + newbuf;
 
 			buf->page = spd->pages[page_nr];
@@ -213,7 +213,7 @@ ssize_t splice_to_pipe(struct pipe_inode_info *pipe,
 
 			if (!--spd->nr_pages)
 				break;
-			if (pipe->nrbufs < PIPE_BUFFERS)
+			if (pipe->nrbufs < pipe->buffers)
 				continue;
 
 			break;
@@ -782,7 +782,7 @@ int splice_from_pipe_feed(struct pipe_inode_info *pipe, struct splice_desc *sd,
 		if (!buf->len) {
 			buf->ops = NULL;
 			ops->release(pipe, buf);
-			pipe->curbuf = (pipe->curbuf + 1) & (PIPE_BUFFERS - 1);
+			pipe->curbuf = (pipe->curbuf + 1) & (pipe->buffers - 1);
 			pipe->nrbufs--;
 			if (pipe->inode)
 				sd->need_wakeup = true;
@@ -1207,7 +1207,7 @@ out_release:
 	 * If we did an incomplete transfer we must release
 	 * the pipe buffers in question:
 	 */
-	for (i = 0; i < PIPE_BUFFERS; i++) {
+	for (i = 0; i < pipe->buffers; i++) {
 		struct pipe_buffer *buf = pipe->bufs + i;
 
 		if (buf->ops) {
@@ -1362,10 +1362,13 @@ static long do_splice(struct file *in, loff_t __user *off_in,
  * our ones pages[] map instead of splitting that operation into pieces.
  * Could easily be exported as a generic helper for other users, in which
  * case one would probably want to add a 'max_nr_pages' parameter as well.
+ * When gifting, the ranges must be page aligned and the user address of
+ * each page is stored in @addrs.
  */
 static int get_iovec_page_array(const struct iovec __user *iov,
 				unsigned int nr_vecs, struct page **pages,
-				struct partial_page *partial, int aligned)
+				struct partial_page *partial,
+				unsigned long *addrs)
 {
 	int buffers = 0, error = 0;
 
@@ -1404,7 +1407,7 @@ static int get_iovec_page_array(const struct iovec __user *iov,
 		 * length a multiple of the PAGE_SIZE.
 		 */
 		error = -EINVAL;
-		if (aligned && (off || len & ~PAGE_MASK))
+		if (addrs && (off || len & ~PAGE_MASK))
 			break;
 
 		npages = (off + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
@@ -1425,6 +1428,9 @@ static int get_iovec_page_array(const struct iovec __user *iov,
 
 			partial[buffers].offset = off;
 			partial[buffers].len = plen;
+			if (addrs)
+				addrs[buffers] = (unsigned long) base +
+						 (i << PAGE_SHIFT);
 
 			off = 0;
 			len -= plen;
@@ -1578,10 +1584,63 @@ static long vmsplice_to_user(struct file *file, const struct iovec __user *iov,
 	return ret;
 }
 
+/*
+ * Moves the gifted pages which made it into the pipe out of the address
+ * space of the caller, so that the pipe holds the last reference to them
+ * and a consumer can steal them instead of copying. Only private anonymous
+ * pages mapped once are moved, their range reads back as zero-filled
+ * memory afterwards. The other pages stay mapped, as with a regular
+ * vmsplice. The pages may already have been consumed and freed, they are
+ * only dereferenced once found mapped at their user address again.
+ */
+static void vmsplice_move_gifts(struct page **pages, unsigned long *addrs,
+				int nr_pages)
+{
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma = NULL, *zap_vma = NULL;
+	unsigned long start = 0, end = 0;
+	struct page *page;
+	int i, movable;
+
+	down_read(&mm->mmap_sem);
+	for (i = 0; i <= nr_pages; i++) {
+		movable = 0;
+		if (i < nr_pages) {
+			if (!vma || addrs[i] < vma->vm_start ||
+			    addrs[i] >= vma->vm_end)
+				vma = find_vma(mm, addrs[i]);
+			if (vma && vma->vm_start <= addrs[i] &&
+			    !(vma->vm_flags & (VM_SHARED | VM_LOCKED |
+					       VM_HUGETLB | VM_IO | VM_PFNMAP))) {
+				page = follow_page(vma, addrs[i], 0);
+				movable = page == pages[i] && PageAnon(page) &&
+					  page_mapcount(page) == 1;
+			}
+			/* extend the current range */
+			if (movable && vma == zap_vma && addrs[i] == end) {
+				end += PAGE_SIZE;
+				continue;
+			}
+		}
+		if (start != end)
+			zap_page_range(zap_vma, start, end - start, NULL);
+		start = end = 0;
+		if (movable) {
+			zap_vma = vma;
+			start = addrs[i];
+			end = start + PAGE_SIZE;
+		}
+	}
+	up_read(&mm->mmap_sem);
+}
+
 /*
  * vmsplice splices a user address range into a pipe. It can be thought of
  * as splice-from-memory, where the regular splice is splice-from-file (or
  * to file). In both cases the output is a pipe, naturally.
+ *
+ * With SPLICE_F_GIFT, the pages spliced into the pipe are moved out of the
+ * caller's address space when possible, see vmsplice_move_gifts().
  */
 static long vmsplice_to_pipe(struct file *file, const struct iovec __user *iov,
 			     unsigned long nr_segs, unsigned int flags)
@@ -1589,6 +1648,8 @@ static long vmsplice_to_pipe(struct file *file, const struct iovec __user *iov,
 	struct pipe_inode_info *pipe;
 	struct page *pages[PIPE_BUFFERS];
 	struct partial_page partial[PIPE_BUFFERS];
+	unsigned long addrs[PIPE_BUFFERS];
+	long ret;
 	struct splice_pipe_desc spd = {
 		.pages = pages,
 		.partial = partial,
@@ -1602,11 +1663,17 @@ static long vmsplice_to_pipe(struct file *file, const struct iovec __user *iov,
 		return -EBADF;
 
 	spd.nr_pages = get_iovec_page_array(iov, nr_segs, pages, partial,
-					    flags & SPLICE_F_GIFT);
+				(flags & SPLICE_F_GIFT) ? addrs : NULL);
 	if (spd.nr_pages <= 0)
 		return spd.nr_pages;
 
-	return splice_to_pipe(pipe, &spd);
+	ret = splice_to_pipe(pipe, &spd);
+
+	/* Gifts are whole pages, the first ret / PAGE_SIZE went in */
+	if ((flags & SPLICE_F_GIFT) && ret > 0)
+		vmsplice_move_gifts(pages, addrs, ret >> PAGE_SHIFT);
+
+	return ret;
 }
 
 /*
@@ -1732,13 +1799,13 @@ static int opipe_prep(struct pipe_inode_info *pipe, unsigned int flags)
 	 * Check ->nrbufs without the inode lock first. This function
 	 * is speculative anyways, so missing one is ok.
 	 */
-	if (pipe->nrbufs < PIPE_BUFFERS)
+	if (pipe->nrbufs < pipe->buffers)
 		return 0;
 
 	ret = 0;
 	pipe_lock(pipe);
 
-	while (pipe->nrbufs >= PIPE_BUFFERS) {
+	while (pipe->nrbufs >= pipe->buffers) {
 		if (!pipe->readers) {
 			send_sig(SIGPIPE, current, 0);
 			ret = -EPIPE;
@@ -1804,7 +1871,7 @@ retry:
 		 * Cannot make any progress, because either the input
 		 * pipe is empty or the output pipe is full.
 		 */
-		if (!ipipe->nrbufs || opipe->nrbufs >= PIPE_BUFFERS) {
+		if (!ipipe->nrbufs || opipe->nrbufs >= opipe->buffers) {
 			/* Already processed some buffers, break */
 			if (ret)
 				break;
@@ -1825,7 +1892,7 @@ retry:
 		}
 
 		ibuf = ipipe->bufs + ipipe->curbuf;
-		nbuf = (opipe->curbuf + opipe->nrbufs) % PIPE_BUFFERS;
+		nbuf = (opipe->curbuf + opipe->nrbufs) & (opipe->buffers - 1);
 		obuf = opipe->bufs + nbuf;
 
 		if (len >= ibuf->len) {
@@ -1835,7 +1902,7 @@ retry:
 			*obuf = *ibuf;
 			ibuf->ops = NULL;
 			opipe->nrbufs++;
-			ipipe->curbuf = (ipipe->curbuf + 1) % PIPE_BUFFERS;
+			ipipe->curbuf = (ipipe->curbuf + 1) & (ipipe->buffers - 1);
 			ipipe->nrbufs--;
 			input_wakeup = true;
 		} else {
@@ -1908,11 +1975,11 @@ static int link_pipe(struct pipe_inode_info *ipipe,
 		 * If we have iterated all input buffers or ran out of
 		 * output room, break.
 		 */
-		if (i >= ipipe->nrbufs || opipe->nrbufs >= PIPE_BUFFERS)
+		if (i >= ipipe->nrbufs || opipe->nrbufs >= opipe->buffers)
 			break;
 
-		ibuf = ipipe->bufs + ((ipipe->curbuf + i) & (PIPE_BUFFERS - 1));
-		nbuf = (opipe->curbuf + opipe->nrbufs) & (PIPE_BUFFERS - 1);
+		ibuf = ipipe->bufs + ((ipipe->curbuf + i) & (ipipe->buffers - 1));
+		nbuf = (opipe->curbuf + opipe->nrbufs) & (opipe->buffers - 1);
 
 		/*
 		 * Get a reference to this pipe buffer,
@@ -0,0 +1,75 @@
+/*
+ * Helpers shared by the benchmark and stress test modules.
+ *
+ * Copyright (C) 2009 Mathieu Desnoyers <mathieu.desnoyers@polymtl.ca>
+ *
+ * Dual LGPL v2.1/GPL v2 license.
+ *
+ * Latencies are kept in log2 buckets of nanoseconds: bucket i counts the
+ * samples in [2^(i-1), 2^i), bucket 0 the samples of 0 ns. A histogram is
+ * updated by a single thread, or per cpu, and summed with bench_hist_add()
+ * when the results are reported.
+ *
+ * A benchmark runs a set of variants (locks, FIFOs...) one after the other
+ * from a control kthread started by bench_start(). For each variant, the run
+ * callback sets up its per thread state and calls bench_run_threads(), which
+ * runs a worker kthread per array element, spread round-robin over the online
+ * CPUs, for the requested time. Workers loop until bench_should_stop() and
+ * return. Unloading the module stops the control kthread with bench_stop(),
+ * which makes the current bench_run_threads() return -EINTR.
+ */
+#ifndef _LINUX_BENCH_H
+#define _LINUX_BENCH_H
+
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/compiler.h>
+
+struct task_struct;
+
+#define BENCH_HIST_SIZE	64
+
+struct bench_hist {
+	unsigned long count;
+	u64 max;
+	unsigned long bucket[BENCH_HIST_SIZE];
+};
+
+static inline void bench_hist_record(struct bench_hist *hist, u64 ns)
+{
+	hist->count++;
+	hist->bucket[min(fls64(ns), BENCH_HIST_SIZE - 1)]++;
+	if (ns > hist->max)
+		hist->max = ns;
+}
+
+extern void bench_hist_add(struct bench_hist *dst,
+			   const struct bench_hist *src);
+extern u64 bench_hist_percentile(const struct bench_hist *hist,
+				 unsigned int permille);
+
+struct bench {
+	const char *name;		/* Log prefix */
+	const char *thread_name;	/* Control and worker kthread names */
+	const char * const *variant_names;
+	int nr_variants;
+	int (*run)(int variant);	/* -EINTR stops the benchmark */
+	u64 elapsed;			/* ns the last workers ran */
+
+	/* Private */
+	unsigned long variants;
+	struct task_struct *control;
+	int stop;
+};
+
+static inline int bench_should_stop(struct bench *bench)
+{
+	return ACCESS_ONCE(bench->stop);
+}
+
+extern int bench_run_threads(struct bench *bench, void (*fn)(void *data),
+			     void *base, int nr, size_t size, int run_time);
+extern int bench_start(struct bench *bench, unsigned long variants);
+extern void bench_stop(struct bench *bench);
+
+#endif /* _LINUX_BENCH_H */
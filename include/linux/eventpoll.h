@@ -25,6 +25,14 @@
 #define EPOLL_CTL_ADD 1
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
+/*
+ * Moderates the wakeups of the epoll_wait() callers: "events" holds the
+ * minimum number of ready descriptors to wake up a waiter, "data" the
+ * maximum latency in microseconds after the first one became ready. Any
+ * minimum other than 0 also coalesces the wakeups, so that a burst of
+ * events wakes up a single waiter. The target fd is ignored.
+ */
+#define EPOLL_CTL_MODERATE 4
 
 /* Set the One Shot behaviour for the target file descriptor */
 #define EPOLLONESHOT (1 << 30)
@@ -13,6 +13,11 @@
 
 #include <asm/immediate.h>
 
+/*
+ * Maximum number of sites patched in a single pass.
+ */
+#define IMV_BATCH_MAX	256
+
 /**
  * imv_set - set immediate variable (with locking)
  * @name: immediate value name
@@ -24,16 +29,23 @@
 #define imv_set(name, i)						\
 	do {								\
 		name##__imv = (i);					\
-		core_imv_update();					\
-		module_imv_update();					\
+		imv_update();						\
 	} while (0)
 
 /*
  * Internal update functions.
  */
+extern void imv_update(void);
 extern void core_imv_update(void);
 extern void imv_update_range(const struct __imv *begin,
 	const struct __imv *end);
+extern void imv_batch_begin(void);
+extern void imv_batch_add_range(const struct __imv *begin,
+	const struct __imv *end);
+extern void imv_batch_end(void);
+extern int arch_imv_check(const struct __imv *imv, int early);
+extern int arch_imv_update_batch(const struct __imv **imvs, int nr,
+	int early);
 extern void imv_unref_core_init(void);
 extern void imv_unref(struct __imv *begin, struct __imv *end, void *start,
 		unsigned long size);
@@ -62,6 +74,7 @@ extern void imv_unref(struct __imv *begin, struct __imv *end, void *start,
  */
 #define imv_set(name, i)		(name##__imv = (i))
 
+static inline void imv_update(void) { }
 static inline void core_imv_update(void) { }
 static inline void imv_unref_core_init(void) { }
 
@@ -0,0 +1,160 @@
+/*
+ * A multi-producer record FIFO.
+ *
+ * Copyright (C) 2009 Mathieu Desnoyers <mathieu.desnoyers@polymtl.ca>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Companion of struct kfifo for callers with several concurrent producers,
+ * e.g. interrupt handlers running on different CPUs. Producers reserve space
+ * for a variable-length record with a cmpxchg on the head index, fill it and
+ * commit it, without taking any lock. Records are consumed in order, one by
+ * one or in batches; a single consumer needs no locking, several consumers
+ * are serialized by the fifo lock.
+ *
+ * The buffer uses the kfifo power-of-two layout with free-running indices.
+ * Each record starts with a 32-bit header holding its length and a commit
+ * flag, and is padded to 4 bytes. A record never wraps: when it does not fit
+ * before the end of the buffer, the end is filled with a padding record.
+ * Freed space is cleared by the consumer, so an uncommitted header always
+ * reads as such.
+ */
+#ifndef _LINUX_KFIFO_MP_H
+#define _LINUX_KFIFO_MP_H
+
+#include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/cache.h>
+
+#define KFIFO_MP_COMMITTED	(1U << 31)
+#define KFIFO_MP_PAD		(1U << 30)
+#define KFIFO_MP_LEN_MASK	(KFIFO_MP_PAD - 1)
+
+struct kfifo_mp {
+	unsigned char *buffer;	/* the buffer holding the records */
+	unsigned int size;	/* the size of the allocated buffer */
+	spinlock_t *lock;	/* serializes concurrent consumers */
+	/* producers reserve at offset (head % size) */
+	unsigned int head ____cacheline_aligned_in_smp;
+	/* the consumer frees from offset (tail % size) */
+	unsigned int tail ____cacheline_aligned_in_smp;
+};
+
+/*
+ * Called by the batched consumers for each record, with the record payload
+ * and its length.
+ */
+typedef void (*kfifo_mp_func_t)(void *priv, const void *rec, unsigned int len);
+
+extern struct kfifo_mp *kfifo_mp_init(unsigned char *buffer,
+				      unsigned int size, gfp_t gfp_mask,
+				      spinlock_t *lock);
+extern struct kfifo_mp *kfifo_mp_alloc(unsigned int size, gfp_t gfp_mask,
+				       spinlock_t *lock);
+extern void kfifo_mp_free(struct kfifo_mp *fifo);
+extern void *kfifo_mp_reserve(struct kfifo_mp *fifo, unsigned int len);
+extern unsigned int kfifo_mp_put(struct kfifo_mp *fifo,
+				 const void *buffer, unsigned int len);
+extern int __kfifo_mp_get(struct kfifo_mp *fifo,
+			  void *buffer, unsigned int len);
+extern unsigned int __kfifo_mp_consume(struct kfifo_mp *fifo,
+				       unsigned int max,
+				       kfifo_mp_func_t func, void *priv);
+
+/**
+ * kfifo_mp_rec_size - returns the space taken by a record in the FIFO
+ * @len: the length of the record payload.
+ */
+static inline unsigned int kfifo_mp_rec_size(unsigned int len)
+{
+	return sizeof(u32) + ALIGN(len, sizeof(u32));
+}
+
+/**
+ * kfifo_mp_commit - makes a reserved record visible to the consumers
+ * @fifo: the fifo to be used.
+ * @rec: the record returned by kfifo_mp_reserve().
+ *
+ * The record contents must be written before this call.
+ */
+static inline void kfifo_mp_commit(struct kfifo_mp *fifo, void *rec)
+{
+	u32 *hdr = (u32 *)rec - 1;
+
+	/*
+	 * Ensure that the record contents are written -before-
+	 * the consumer can see the commit flag.
+	 */
+
+	smp_wmb();
+
+	ACCESS_ONCE(*hdr) = *hdr | KFIFO_MP_COMMITTED;
+}
+
+/**
+ * kfifo_mp_get - gets one record from the FIFO
+ * @fifo: the fifo to be used.
+ * @buffer: where the record must be copied.
+ * @len: the size of the destination buffer.
+ *
+ * Returns the length of the record copied in @buffer, 0 if there is no
+ * committed record at the head of the FIFO, or -EMSGSIZE if the record does
+ * not fit in @buffer, in which case it is left in the FIFO.
+ */
+static inline int kfifo_mp_get(struct kfifo_mp *fifo,
+			       void *buffer, unsigned int len)
+{
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(fifo->lock, flags);
+
+	ret = __kfifo_mp_get(fifo, buffer, len);
+
+	spin_unlock_irqrestore(fifo->lock, flags);
+
+	return ret;
+}
+
+/**
+ * kfifo_mp_consume - consumes a batch of records
+ * @fifo: the fifo to be used.
+ * @max: the maximum number of records to consume.
+ * @func: called for each record.
+ * @priv: passed to @func.
+ *
+ * Calls @func on up to @max committed records, in order, then frees them all
+ * at once. @func is called with the fifo lock held and interrupts off.
+ * Returns the number of records consumed.
+ */
+static inline unsigned int kfifo_mp_consume(struct kfifo_mp *fifo,
+					    unsigned int max,
+					    kfifo_mp_func_t func, void *priv)
+{
+	unsigned long flags;
+	unsigned int ret;
+
+	spin_lock_irqsave(fifo->lock, flags);
+
+	ret = __kfifo_mp_consume(fifo, max, func, priv);
+
+	spin_unlock_irqrestore(fifo->lock, flags);
+
+	return ret;
+}
+
+/**
+ * __kfifo_mp_len - returns the number of bytes used in the FIFO
+ * @fifo: the fifo to be used.
+ *
+ * This includes the records reserved but not committed yet.
+ */
+static inline unsigned int __kfifo_mp_len(struct kfifo_mp *fifo)
+{
+	return ACCESS_ONCE(fifo->head) - ACCESS_ONCE(fifo->tail);
+}
+
+#endif
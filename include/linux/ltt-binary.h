@@ -0,0 +1,47 @@
+#ifndef _LINUX_LTT_BINARY_H
+#define _LINUX_LTT_BINARY_H
+
+/*
+ * LTTng merged binary stream format.
+ *
+ * Copyright (C) 2009 Mathieu Desnoyers
+ *
+ * Dual LGPL v2.1/GPL v2 license.
+ *
+ * /debugfs/ltt/ascii/<trace>/binary gives the events of all the channels and
+ * CPUs of a trace, ordered by timestamp. The stream starts with a
+ * struct ltt_binary_stream_header, followed by records. Each record is a
+ * struct ltt_binary_event_header, pad bytes and the payload, as serialized in
+ * the trace buffers. The pad bytes place the payload at the same offset,
+ * modulo the alignment, as in the trace buffer, so the payload fields can be
+ * decoded with the trace alignment rules. All fields are in host byte order.
+ *
+ * Before the first event of a given (channel, event) pair, a metadata record
+ * describes it: its cpu field is LTT_BINARY_METADATA and its payload holds
+ * the channel name, the marker name and the marker format string, each
+ * followed by a null byte.
+ */
+
+#include <linux/types.h>
+
+#define LTT_BINARY_MAGIC	0x4C545442	/* "LTTB" */
+#define LTT_BINARY_METADATA	0xFFFF
+
+struct ltt_binary_stream_header {
+	__u32 magic;
+	__u8 alignment;		/* Payload alignment, 0 if not aligned */
+	__u8 header_size;	/* sizeof(struct ltt_binary_event_header) */
+	__u16 reserved;
+};
+
+struct ltt_binary_event_header {
+	__u64 tsc;		/* Full 64-bit timestamp, 0 for metadata */
+	__u32 size;		/* Payload size */
+	__u16 channel;		/* Channel id */
+	__u16 event;		/* Event id within the channel */
+	__u16 cpu;		/* LTT_BINARY_METADATA for metadata records */
+	__u8 pad;		/* Bytes between the header and the payload */
+	__u8 reserved;
+} __attribute__((packed));
+
+#endif /* _LINUX_LTT_BINARY_H */
@@ -9,9 +9,12 @@
 #ifndef LTT_CORE_H
 #define LTT_CORE_H
 
+#include <stdarg.h>
 #include <linux/list.h>
 #include <linux/percpu.h>
 
+struct marker;
+
 /* ltt's root dir in debugfs */
 #define LTT_ROOT        "ltt"
 
@@ -39,7 +42,14 @@ void put_ltt_root(void);
 /* Keep track of trap nesting inside LTT */
 DECLARE_PER_CPU(unsigned int, ltt_nesting);
 
-typedef int (*ltt_run_filter_functor)(void *trace, uint16_t eID);
+/*
+ * Event filter, called for each active trace before space is reserved for the
+ * event. The payload is either available as the marker variable argument list
+ * (args) or, for specialized probes, as a pre-serialized binary blob (data).
+ * The unused one is NULL. Returns 0 if the event must be discarded.
+ */
+typedef int (*ltt_run_filter_functor)(void *trace, const struct marker *mdata,
+				      const void *data, va_list *args);
 
 extern ltt_run_filter_functor ltt_run_filter;
 
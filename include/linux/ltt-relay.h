@@ -301,4 +301,73 @@ ssize_t ltt_relay_file_splice_read(struct file *in, loff_t *ppos,
 				   struct pipe_inode_info *pipe, size_t len,
 				   unsigned int flags);
 
+/*
+ * Kernel streaming consumer. Each sub-buffer is sent on the socket after a
+ * header, or after one header per datagram for datagram sockets. Header fields
+ * are in network byte order and the channel name follows the header.
+ */
+#define LTT_STREAM_MAGIC	0x4C545453	/* "LTTS" */
+
+struct ltt_stream_header {
+	__be32 magic;
+	__be16 cpu;
+	__be16 name_len;	/* Length of the channel name */
+	__be32 sb_size;		/* Size of the sub-buffer */
+	__be32 offset;		/* Offset of the payload in the sub-buffer */
+	__be32 len;		/* Length of the payload */
+};
+
+struct socket;
+
+extern int ltt_relay_stream_start(struct ltt_trace *trace,
+				  struct socket *sock);
+extern int ltt_relay_stream_stop(struct ltt_trace *trace);
+
+/*
+ * /debugfs/ltt/stats/<trace>/binary holds one record per allocated channel
+ * buffer, in host byte order. The channel name is null-padded and truncated to
+ * LTT_STATS_NAME_LEN - 1 characters.
+ */
+#define LTT_STATS_NAME_LEN	32
+
+struct ltt_relay_stats_record {
+	char channel[LTT_STATS_NAME_LEN];
+	__u32 cpu;
+	__u32 overwrite;	/* Flight recorder channel */
+	__u64 events;		/* Events committed */
+	__u64 bytes;		/* Bytes reserved for events */
+	__u64 switches;		/* Sub-buffers closed */
+	__u64 slow_path;	/* Reservations through the slow path */
+	__u64 commit_mismatch;	/* Sub-buffers found not fully committed */
+	__u64 overruns;		/* Unread sub-buffers overwritten */
+	__u64 events_lost;
+	__u64 corrupted_subbuffers;
+	__u64 reader_lag;	/* Bytes written but not consumed yet */
+	__u64 buf_size;
+};
+
+#ifdef CONFIG_LTT_RELAY_STATS
+extern int ltt_relay_stats_create_dir(struct ltt_trace *trace);
+extern void ltt_relay_stats_remove_dir(struct ltt_trace *trace);
+#else
+static inline int ltt_relay_stats_create_dir(struct ltt_trace *trace)
+{
+	return 0;
+}
+
+static inline void ltt_relay_stats_remove_dir(struct ltt_trace *trace)
+{
+}
+#endif
+
+#ifdef CONFIG_LTT_RELAY_HISTORY
+extern int ltt_relay_history_start(struct ltt_trace *trace, size_t max_size);
+extern int ltt_relay_history_snapshot(struct ltt_trace *trace);
+extern void ltt_relay_history_free(struct ltt_trace *trace);
+#else
+static inline void ltt_relay_history_free(struct ltt_trace *trace)
+{
+}
+#endif
+
 #endif /* _LINUX_LTT_RELAY_H */
@@ -64,6 +64,56 @@ size_t ltt_serialize_data(struct ltt_chanbuf *buf, size_t buf_offset,
 			  void *serialize_private, int *largest_align,
 			  const char *fmt, va_list *args);
 
+enum ltt_type {
+	LTT_TYPE_SIGNED_INT,
+	LTT_TYPE_UNSIGNED_INT,
+	LTT_TYPE_STRING,
+	LTT_TYPE_NONE,
+};
+
+/*
+ * Description of a marker format string field, as returned by
+ * ltt_fmt_get_fields(). The field name is the last whitespace-terminated word
+ * preceding the field type specifiers, e.g. "irq_id" in "irq_id #2u%u". It
+ * points within the format string and is not NUL-terminated.
+ */
+struct ltt_fmt_field {
+	const char *name;
+	unsigned int name_len;
+	enum ltt_type c_type;		/* Type of the C argument */
+	char c_size;
+	enum ltt_type trace_type;	/* Type written in the trace */
+	char trace_size;
+};
+
+extern int ltt_fmt_get_fields(const char *fmt, struct ltt_fmt_field *fields,
+			      int max_fields);
+
+/*
+ * Serialization plan : marker format string parsed once when the marker is
+ * registered, so the serializer does not walk the format string for each
+ * event. Plans are immutable once published in the marker and freed after an
+ * RCU-sched grace period.
+ */
+struct ltt_plan_field {
+	u8 c_type;			/* enum ltt_type */
+	u8 c_size;
+	u8 trace_type;			/* enum ltt_type */
+	u8 trace_size;
+};
+
+struct ltt_serialize_plan {
+	struct rcu_head rcu;
+	struct list_head list;		/* Deferred free list */
+	unsigned int nr_fields;
+	unsigned int nr_strings;	/* Payload size is variable if non-zero */
+	size_t data_size;		/* Payload size if there are no strings */
+	int largest_align;		/* Payload alignment */
+	struct ltt_plan_field fields[0];
+};
+
+extern struct ltt_serialize_plan *ltt_serialize_plan_create(const char *fmt);
+
 struct ltt_available_probe {
 	const char *name;		/* probe name */
 	const char *format;
@@ -207,11 +257,15 @@ struct ltt_trace {
 	struct {
 		struct dentry			*trace_root;
 		struct dentry			*ascii_root;
+		struct dentry			*stats_root;
 	} dentry;
 	struct kref kref; /* Each channel has a kref of the trace struct */
 	struct ltt_transport *transport;
 	struct kref ltt_transport_kref;
 	wait_queue_head_t kref_wq; /* Place for ltt_trace_destroy to sleep */
+	int filter_reject;	/* Discard events of markers without filter */
+	struct ltt_relay_stream *stream;	/* Kernel streaming consumer */
+	struct ltt_relay_history *history;	/* Compressed flight recorder */
 	char trace_name[NAME_MAX];
 } ____cacheline_aligned;
 
@@ -602,6 +656,7 @@ union ltt_control_args {
 
 int _ltt_trace_setup(const char *trace_name);
 int ltt_trace_setup(const char *trace_name);
+struct ltt_trace *_ltt_trace_find(const char *trace_name);
 struct ltt_trace *_ltt_trace_find_setup(const char *trace_name);
 int ltt_trace_set_type(const char *trace_name, const char *trace_type);
 int ltt_trace_set_channel_subbufsize(const char *trace_name,
@@ -0,0 +1,59 @@
+#ifndef _LINUX_LTT_USERSPACE_EVENT_H
+#define _LINUX_LTT_USERSPACE_EVENT_H
+
+/*
+ * LTTng userspace event ring ABI.
+ *
+ * Copyright (C) 2008 Mathieu Desnoyers
+ *
+ * Dual LGPL v2.1/GPL v2 license.
+ *
+ * Each open of /debugfs/ltt/userspace_ring owns a ring, created by mapping the
+ * file. The mapping length must be one page for the control structure
+ * followed by a power of two number of pages for the records, up to
+ * LTT_URING_MAX_DATA_SIZE bytes. Userspace
+ * appends records at head and the kernel drains them into the "userspace"
+ * channel, periodically, on LTT_URING_FLUSH and when the file is released.
+ *
+ * head and tail are free-running byte counts. The producer writes a record at
+ * (head % data_size), then publishes it by updating head with release
+ * semantics. Space is free up to tail + data_size. Records are 8-byte aligned
+ * and never wrap around the end of the data area : the producer fills the end
+ * of the area with a LTT_UREC_PAD record instead.
+ */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+struct ltt_uring_ctl {
+	__u32 head;		/* Producer position, written by userspace */
+	__u32 tail;		/* Consumer position, written by the kernel */
+	__u32 data_size;	/* Size of the record area, written by the kernel */
+	__u32 lost;		/* Malformed or oversized records dropped */
+};
+
+/* Largest record area of a ring */
+#define LTT_URING_MAX_DATA_SIZE	(4U << 20)
+
+#define LTT_UREC_ALIGN		8
+/* Larger records are dropped */
+#define LTT_UREC_MAX_SIZE	2048
+
+enum ltt_urec_type {
+	LTT_UREC_PAD,		/* Skipped */
+	LTT_UREC_STRING,	/* __u64 timestamp, then a string */
+	LTT_UREC_U64,		/* __u64 timestamp, then up to 4 __u64 values */
+};
+
+#define LTT_UREC_U64_MAX	4
+
+struct ltt_urec_header {
+	__u16 size;		/* Record size, header included */
+	__u16 type;		/* enum ltt_urec_type */
+	__u32 id;		/* Event identifier, chosen by userspace */
+};
+
+/* Drain the ring of the file descriptor into the trace */
+#define LTT_URING_FLUSH		_IO(0xF6, 0x00)
+
+#endif /* _LINUX_LTT_USERSPACE_EVENT_H */
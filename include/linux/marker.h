@@ -19,6 +19,7 @@
 struct module;
 struct marker;
 struct marker_probe_array;
+struct ltt_serialize_plan;
 
 /**
  * marker_probe_func - Type of a marker probe function
@@ -58,6 +59,8 @@ struct marker {
 	struct marker_probe_array *multi;
 	const char *tp_name;	/* Optional tracepoint name */
 	void *tp_cb;		/* Optional tracepoint callback */
+				/* Serialization plan, dynamic */
+	struct ltt_serialize_plan *plan;
 } __attribute__((aligned(8)));
 
 #ifdef CONFIG_MARKERS
@@ -74,7 +77,7 @@ struct marker {
 						sizeof(#name)],		\
 		  0, 0, 0, 0, marker_probe_cb,				\
 		  { __mark_empty_function, NULL},			\
-		  NULL, tp_name_str, tp_cb }
+		  NULL, tp_name_str, tp_cb, NULL }
 
 #define DEFINE_MARKER(channel, name, format)				\
 		_DEFINE_MARKER(channel, name, NULL, NULL, format)
@@ -3,6 +3,10 @@
 
 #define PIPEFS_MAGIC 0x50495045
 
+/*
+ * Default number of pipe buffers, and maximum number of pages filled into a
+ * pipe by a single splice_to_pipe() call.
+ */
 #define PIPE_BUFFERS (16)
 
 #define PIPE_BUF_FLAG_LRU	0x01	/* page is on the LRU */
@@ -40,6 +44,7 @@ struct pipe_buffer {
  *	@fasync_readers: reader side fasync
  *	@fasync_writers: writer side fasync
  *	@inode: inode this pipe is attached to
+ *	@buffers: the number of pipe buffers, a power of 2
  *	@bufs: the circular array of pipe buffers
  **/
 struct pipe_inode_info {
@@ -54,7 +59,8 @@ struct pipe_inode_info {
 	struct fasync_struct *fasync_readers;
 	struct fasync_struct *fasync_writers;
 	struct inode *inode;
-	struct pipe_buffer bufs[PIPE_BUFFERS];
+	unsigned int buffers;
+	struct pipe_buffer *bufs;
 };
 
 /*
@@ -146,6 +152,10 @@ struct pipe_inode_info * alloc_pipe_info(struct inode * inode);
 void free_pipe_info(struct inode * inode);
 void __free_pipe_info(struct pipe_inode_info *);
 
+/* Maximum pipe size settable by unprivileged users, for F_SETPIPE_SZ */
+extern unsigned int pipe_max_size, pipe_min_size;
+long pipe_fcntl(struct file *, unsigned int, unsigned long arg);
+
 /* Generic pipe buffer ops functions */
 void *generic_pipe_buf_map(struct pipe_inode_info *, struct pipe_buffer *, int);
 void generic_pipe_buf_unmap(struct pipe_inode_info *, struct pipe_buffer *, void *);
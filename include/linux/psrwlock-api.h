@@ -179,9 +179,10 @@ void pswrite_lock(psrwlock_t *rwlock, enum psrw_prio wctx, u32 rctx)
 	write_context_disable(wctx, rctx);
 	/* no other reader nor writer present, try to take the lock */
 	uc = atomic_cmpxchg(&rwlock->uc, 0, UC_WRITER);
-	if (likely(!uc))
+	if (likely(!uc)) {
+		psrwlock_set_owner(rwlock);
 		return;
-	else
+	} else
 		pswrite_lock_slow(uc, rwlock);
 }
 
@@ -194,9 +195,10 @@ int pswrite_lock_interruptible(psrwlock_t *rwlock,
 	write_context_disable(wctx, rctx);
 	/* no other reader nor writer present, try to take the lock */
 	uc = atomic_cmpxchg(&rwlock->uc, 0, UC_WRITER);
-	if (likely(!uc))
+	if (likely(!uc)) {
+		psrwlock_set_owner(rwlock);
 		return 0;
-	else
+	} else
 		return pswrite_lock_interruptible_slow(uc, rwlock);
 }
 
@@ -208,9 +210,10 @@ int pswrite_trylock(psrwlock_t *rwlock, enum psrw_prio wctx, u32 rctx)
 	write_context_disable(wctx, rctx);
 	/* no other reader nor writer present, try to take the lock */
 	uc = atomic_cmpxchg(&rwlock->uc, 0, UC_WRITER);
-	if (likely(!uc))
+	if (likely(!uc)) {
+		psrwlock_set_owner(rwlock);
 		return 1;
-	else
+	} else
 		return pswrite_trylock_slow(uc, rwlock);
 }
 
@@ -224,6 +227,7 @@ void pswrite_unlock(psrwlock_t *rwlock, enum psrw_prio wctx, u32 rctx)
 	 * the lock. Will take the slow path if there are active readers, if
 	 * UC_SLOW_WRITER is set or if there are threads in the wait queue.
 	 */
+	psrwlock_clear_owner(rwlock);
 	uc = atomic_cmpxchg(&rwlock->uc, UC_WRITER, 0);
 	if (likely(uc == UC_WRITER)) {
 		write_context_enable(wctx, rctx);
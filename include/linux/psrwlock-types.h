@@ -66,8 +66,10 @@ typedef struct psrwlock {
 	enum psrw_prio wctx;		/* Allowed write execution ctx */
 	struct list_head wait_list_r;	/* Preemptable readers wait queue */
 	struct list_head wait_list_w;	/* Preemptable writers wait queue */
-#ifdef CONFIG_DEBUG_PSRWLOCK
+#if defined(CONFIG_DEBUG_PSRWLOCK) || defined(CONFIG_SMP)
 	struct thread_info	*owner;
+#endif
+#ifdef CONFIG_DEBUG_PSRWLOCK
 	const char 		*name;
 	void			*magic;
 #endif
@@ -200,6 +200,31 @@ static inline void write_context_enable(enum psrw_prio wctx, u32 rctx)
 		psrwlock_preempt_enable();
 }
 
+/*
+ * Writer owner tracking for adaptive spinning: waiters in preemptable context
+ * keep busy-looping while the writer holding the lock runs on another CPU. The
+ * debug build tracks the owner itself and does not spin.
+ */
+#if defined(CONFIG_SMP) && !defined(CONFIG_DEBUG_PSRWLOCK)
+static inline void psrwlock_set_owner(psrwlock_t *rwlock)
+{
+	rwlock->owner = current_thread_info();
+}
+
+static inline void psrwlock_clear_owner(psrwlock_t *rwlock)
+{
+	rwlock->owner = NULL;
+}
+#else
+static inline void psrwlock_set_owner(psrwlock_t *rwlock)
+{
+}
+
+static inline void psrwlock_clear_owner(psrwlock_t *rwlock)
+{
+}
+#endif
+
 /*
  * psrwlock_preempt_check must have a uc parameter read with a memory
  * barrier making sure the slow path variable writes and the UC_WQ_ACTIVE flag
@@ -75,6 +75,13 @@ struct kmem_cache {
 	int objsize;		/* The size of an object without meta data */
 	int offset;		/* Free pointer offset. */
 	struct kmem_cache_order_objects oo;
+#ifdef CONFIG_SLUB_PROFILE
+	/*
+	 * Checked on every fastpath operation, keep it in the first
+	 * cache line. NULL unless profiling was enabled via sysfs.
+	 */
+	struct kmem_cache_profile *profile;
+#endif
 
 	/*
 	 * Avoid an extra cache line for UP, SMP and for the node local to
@@ -14,4 +14,16 @@
 #else
 #include <asm-generic/trace-clock.h>
 #endif /* CONFIG_HAVE_TRACE_CLOCK */
+
+#ifdef CONFIG_HAVE_TRACE_CLOCK_SYNTHETIC_TSC
+#include <linux/percpu.h>
+
+/*
+ * Incremented each time the synthetic TSC of the CPU is resynchronized with
+ * the 32-bit hardware clock, which happens at least once per half period of the
+ * hardware clock. Two trace_clock_read32() values read on a CPU within the same
+ * epoch are therefore less than one hardware clock period apart.
+ */
+DECLARE_PER_CPU(unsigned int, synthetic_tsc_epoch);
+#endif /* CONFIG_HAVE_TRACE_CLOCK_SYNTHETIC_TSC */
 #endif /* _LINUX_TRACE_CLOCK_H */
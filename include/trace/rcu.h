@@ -40,4 +40,16 @@ DECLARE_TRACE(rcu_tree_call_rcu_bh,
 	TP_PROTO(struct rcu_head *head, unsigned long ip),
 	TP_ARGS(head, ip));
 
+DECLARE_TRACE(rcu_tree_gp_start,
+	TP_PROTO(const char *flavor, long gpnum),
+	TP_ARGS(flavor, gpnum));
+
+DECLARE_TRACE(rcu_tree_gp_end,
+	TP_PROTO(const char *flavor, long gpnum, unsigned long duration),
+	TP_ARGS(flavor, gpnum, duration));
+
+DECLARE_TRACE(rcu_tree_batch,
+	TP_PROTO(const char *flavor, int cpu, int count, long qlen),
+	TP_ARGS(flavor, cpu, count, qlen));
+
 #endif
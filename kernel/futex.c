@@ -59,6 +59,9 @@
 #include <linux/magic.h>
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
+#include <linux/vmalloc.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/futex.h>
 
@@ -68,6 +71,12 @@ int __read_mostly futex_cmpxchg_enabled;
 
 #define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
 
+/*
+ * Size bounds of the private hashes, see futex_private_hash_grow().
+ */
+#define FUTEX_PRIVATE_HASHBITS_MIN	4
+#define FUTEX_PRIVATE_HASHBITS_MAX	(CONFIG_BASE_SMALL ? 6 : 10)
+
 /*
  * Priority Inheritance state:
  */
@@ -134,17 +143,188 @@ struct futex_hash_bucket {
 
 static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
 
+/*
+ * Multi-threaded processes get their own hash for their PROCESS_PRIVATE
+ * futexes, so their waiters do not share buckets with unrelated processes.
+ * It is allocated when the mm gets a second user and grown as threads are
+ * created. Growing moves the waiters of the old hash to the new one, bucket
+ * by bucket; the old hash is kept until the mm goes away since waiters may
+ * still be looking at its locks through q->lock_ptr. While the move is in
+ * progress, whoever locks a bucket of the new hash first moves the waiters
+ * of the old bucket its key hashed to, see futex_private_hash_drain().
+ *
+ * PI futexes (and requeue_pi) always use the global hash: their futex_q and
+ * pi_state must not move under them.
+ */
+struct futex_private_hash {
+	unsigned int hash_bits;
+	int moving;				/* Waiters left in retired */
+	struct futex_private_hash *retired;	/* Smaller, replaced hash */
+	struct futex_hash_bucket queues[0];
+};
+
+static DEFINE_MUTEX(futex_hash_mutex);		/* Serializes hash growth */
+
+enum futex_stat_item {
+	FUTEX_STAT_WAIT,	/* Waiters queued, including aborted waits */
+	FUTEX_STAT_WAKE,	/* Waiters woken */
+	FUTEX_STAT_CONTENDED,	/* Hash bucket lock found held */
+	FUTEX_STAT_COLLISION,	/* Waiters on other futexes walked over */
+	FUTEX_STAT_RETRY,	/* Lookups retried because the hash grew */
+	NR_FUTEX_STATS,
+};
+
+static const char *futex_stat_name[NR_FUTEX_STATS] = {
+	[FUTEX_STAT_WAIT] = "wait",
+	[FUTEX_STAT_WAKE] = "wake",
+	[FUTEX_STAT_CONTENDED] = "contended",
+	[FUTEX_STAT_COLLISION] = "collision",
+	[FUTEX_STAT_RETRY] = "retry",
+};
+
+/* Counted apart for the global hash (0) and the private hashes (1) */
+static DEFINE_PER_CPU(unsigned long [2][NR_FUTEX_STATS], futex_stats);
+static atomic_t futex_private_hashes;
+static atomic_t futex_private_grows;
+static atomic_long_t futex_private_moved;
+
+/* Tasks in FUTEX_LOCK_PI or FUTEX_WAIT_REQUEUE_PI, see futex_pi_queued() */
+static atomic_t futex_pi_waiters;
+
+/*
+ * Must be called with preemption disabled, e.g. with a hash bucket locked.
+ */
+#define futex_stat_add(fph, item, nr)				\
+	(__get_cpu_var(futex_stats)[(fph) != NULL][item] += (nr))
+
 /*
  * We hash on the keys returned from get_futex_key (see below).
  */
-static struct futex_hash_bucket *hash_futex(union futex_key *key)
+static struct futex_hash_bucket *
+__hash_futex(union futex_key *key, struct futex_private_hash *fph)
 {
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
+
+	if (fph)
+		return &fph->queues[hash & ((1 << fph->hash_bits)-1)];
 	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
 }
 
+static struct futex_hash_bucket *hash_futex(union futex_key *key)
+{
+	return __hash_futex(key, NULL);
+}
+
+/*
+ * Return the private hash @key goes in, or NULL for the global hash.
+ */
+static struct futex_private_hash *
+futex_key_private_hash(union futex_key *key, int pi)
+{
+	struct futex_private_hash *fph;
+
+	if (pi || (key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED)))
+		return NULL;
+	fph = ACCESS_ONCE(key->private.mm->futex_hash);
+	smp_read_barrier_depends();
+	return fph;
+}
+
+static inline void futex_spin_lock(struct futex_hash_bucket *hb,
+				   struct futex_private_hash *fph, int subclass)
+{
+	if (likely(spin_trylock(&hb->lock)))
+		return;
+	spin_lock_nested(&hb->lock, subclass);
+	futex_stat_add(fph, FUTEX_STAT_CONTENDED, 1);
+}
+
+/*
+ * Once the bucket is locked, a private hash must still be the current one of
+ * the mm: a bucket of a replaced hash is locked after its waiters are moved,
+ * so nothing must be queued on it anymore.
+ */
+static inline int futex_hash_stale(union futex_key *key,
+				   struct futex_private_hash *fph)
+{
+	if (likely(!fph || fph == ACCESS_ONCE(key->private.mm->futex_hash)))
+		return 0;
+	futex_stat_add(fph, FUTEX_STAT_RETRY, 1);
+	return 1;
+}
+
+/*
+ * Move the waiters of the bucket @ohb of a replaced hash to @new.
+ * Only non-PI waiters are found in a private hash.
+ */
+static long futex_private_bucket_move(struct futex_hash_bucket *ohb,
+				      struct futex_private_hash *new)
+{
+	struct futex_hash_bucket *nhb;
+	struct futex_q *this, *next;
+	long moved = 0;
+
+	spin_lock(&ohb->lock);
+	plist_for_each_entry_safe(this, next, &ohb->chain, list) {
+		WARN_ON(this->pi_state || this->rt_waiter);
+		nhb = __hash_futex(&this->key, new);
+		spin_lock_nested(&nhb->lock, SINGLE_DEPTH_NESTING);
+		plist_del(&this->list, &ohb->chain);
+		plist_add(&this->list, &nhb->chain);
+		this->lock_ptr = &nhb->lock;
+#ifdef CONFIG_DEBUG_PI_LIST
+		this->list.plist.lock = &nhb->lock;
+#endif
+		spin_unlock(&nhb->lock);
+		moved++;
+	}
+	spin_unlock(&ohb->lock);
+	return moved;
+}
+
+/*
+ * The waiters of @key may still sit in the hash @fph replaced, if it is
+ * being grown. Move them over before looking at the bucket of @fph: nothing
+ * gets queued on the old bucket once @fph is published, so it stays empty
+ * afterwards. Must be called without any bucket locked.
+ */
+static inline void futex_private_hash_drain(union futex_key *key,
+					    struct futex_private_hash *fph)
+{
+	if (likely(!fph || !ACCESS_ONCE(fph->moving)))
+		return;
+	smp_rmb();
+	atomic_long_add(futex_private_bucket_move(__hash_futex(key,
+					fph->retired), fph),
+			&futex_private_moved);
+}
+
+/*
+ * Lock the hash bucket of @key, in the private hash of the mm unless @pi.
+ */
+static struct futex_hash_bucket *
+futex_lock_hb(union futex_key *key, int pi, struct futex_private_hash **fphp)
+{
+	struct futex_private_hash *fph;
+	struct futex_hash_bucket *hb;
+
+	do {
+		fph = futex_key_private_hash(key, pi);
+		futex_private_hash_drain(key, fph);
+		hb = __hash_futex(key, fph);
+		futex_spin_lock(hb, fph, 0);
+		if (!futex_hash_stale(key, fph))
+			break;
+		spin_unlock(&hb->lock);
+	} while (1);
+
+	if (fphp)
+		*fphp = fph;
+	return hb;
+}
+
 /*
  * Return 1 if two futex_keys are equal, 0 otherwise.
  */
@@ -846,15 +1026,16 @@ static int unlock_futex_pi(u32 __user *uaddr, u32 uval)
  * Express the locking dependencies for lockdep:
  */
 static inline void
-double_lock_hb(struct futex_hash_bucket *hb1, struct futex_hash_bucket *hb2)
+double_lock_hb(struct futex_hash_bucket *hb1, struct futex_hash_bucket *hb2,
+	       struct futex_private_hash *fph)
 {
 	if (hb1 <= hb2) {
-		spin_lock(&hb1->lock);
+		futex_spin_lock(hb1, fph, 0);
 		if (hb1 < hb2)
-			spin_lock_nested(&hb2->lock, SINGLE_DEPTH_NESTING);
+			futex_spin_lock(hb2, fph, SINGLE_DEPTH_NESTING);
 	} else { /* hb1 > hb2 */
-		spin_lock(&hb2->lock);
-		spin_lock_nested(&hb1->lock, SINGLE_DEPTH_NESTING);
+		futex_spin_lock(hb2, fph, 0);
+		futex_spin_lock(hb1, fph, SINGLE_DEPTH_NESTING);
 	}
 }
 
@@ -866,16 +1047,73 @@ double_unlock_hb(struct futex_hash_bucket *hb1, struct futex_hash_bucket *hb2)
 		spin_unlock(&hb2->lock);
 }
 
+/*
+ * PI waiters, including FUTEX_WAIT_REQUEUE_PI ones, are queued in the global
+ * hash even when their key goes in a private hash. Non-PI operations must
+ * still find them to fail with -EINVAL, as they do when both kinds of waiters
+ * share a bucket. Must be called without any bucket locked.
+ */
+static int futex_pi_queued(union futex_key *key)
+{
+	struct futex_hash_bucket *hb;
+	struct futex_q *this;
+	int ret = 0;
+
+	if (likely(!atomic_read(&futex_pi_waiters)) ||
+	    !futex_key_private_hash(key, 0))
+		return 0;
+
+	hb = hash_futex(key);
+	spin_lock(&hb->lock);
+	plist_for_each_entry(this, &hb->chain, list) {
+		if (match_futex(&this->key, key) &&
+		    (this->pi_state || this->rt_waiter)) {
+			ret = 1;
+			break;
+		}
+	}
+	spin_unlock(&hb->lock);
+	return ret;
+}
+
+/*
+ * Lock the hash buckets of two keys of the same kind, both private or both
+ * shared, see futex_lock_hb().
+ */
+static void
+futex_double_lock_hb(union futex_key *key1, union futex_key *key2, int pi,
+		     struct futex_hash_bucket **hb1,
+		     struct futex_hash_bucket **hb2,
+		     struct futex_private_hash **fphp)
+{
+	struct futex_private_hash *fph;
+
+	do {
+		fph = futex_key_private_hash(key1, pi);
+		futex_private_hash_drain(key1, fph);
+		futex_private_hash_drain(key2, fph);
+		*hb1 = __hash_futex(key1, fph);
+		*hb2 = __hash_futex(key2, fph);
+		double_lock_hb(*hb1, *hb2, fph);
+		if (!futex_hash_stale(key1, fph))
+			break;
+		double_unlock_hb(*hb1, *hb2);
+	} while (1);
+
+	*fphp = fph;
+}
+
 /*
  * Wake up waiters matching bitset queued on this futex (uaddr).
  */
 static int futex_wake(u32 __user *uaddr, int fshared, int nr_wake, u32 bitset)
 {
+	struct futex_private_hash *fph;
 	struct futex_hash_bucket *hb;
 	struct futex_q *this, *next;
 	struct plist_head *head;
 	union futex_key key = FUTEX_KEY_INIT;
-	int ret;
+	int ret, collisions = 0;
 
 	if (!bitset)
 		return -EINVAL;
@@ -884,8 +1122,12 @@ static int futex_wake(u32 __user *uaddr, int fshared, int nr_wake, u32 bitset)
 	if (unlikely(ret != 0))
 		goto out;
 
-	hb = hash_futex(&key);
-	spin_lock(&hb->lock);
+	if (futex_pi_queued(&key)) {
+		ret = -EINVAL;
+		goto out_put_key;
+	}
+
+	hb = futex_lock_hb(&key, 0, &fph);
 	head = &hb->chain;
 
 	plist_for_each_entry_safe(this, next, head, list) {
@@ -902,10 +1144,16 @@ static int futex_wake(u32 __user *uaddr, int fshared, int nr_wake, u32 bitset)
 			wake_futex(this);
 			if (++ret >= nr_wake)
 				break;
+		} else {
+			collisions++;
 		}
 	}
 
+	if (ret > 0)
+		futex_stat_add(fph, FUTEX_STAT_WAKE, ret);
+	futex_stat_add(fph, FUTEX_STAT_COLLISION, collisions);
 	spin_unlock(&hb->lock);
+out_put_key:
 	put_futex_key(fshared, &key);
 out:
 	return ret;
@@ -920,10 +1168,11 @@ futex_wake_op(u32 __user *uaddr1, int fshared, u32 __user *uaddr2,
 	      int nr_wake, int nr_wake2, int op)
 {
 	union futex_key key1 = FUTEX_KEY_INIT, key2 = FUTEX_KEY_INIT;
+	struct futex_private_hash *fph;
 	struct futex_hash_bucket *hb1, *hb2;
 	struct plist_head *head;
 	struct futex_q *this, *next;
-	int ret, op_ret;
+	int ret, op_ret, collisions = 0;
 
 retry:
 	ret = get_futex_key(uaddr1, fshared, &key1);
@@ -933,11 +1182,8 @@ retry:
 	if (unlikely(ret != 0))
 		goto out_put_key1;
 
-	hb1 = hash_futex(&key1);
-	hb2 = hash_futex(&key2);
-
 retry_private:
-	double_lock_hb(hb1, hb2);
+	futex_double_lock_hb(&key1, &key2, 0, &hb1, &hb2, &fph);
 	op_ret = futex_atomic_op_inuser(op, uaddr2);
 	if (unlikely(op_ret < 0)) {
 
@@ -976,6 +1222,8 @@ retry_private:
 			wake_futex(this);
 			if (++ret >= nr_wake)
 				break;
+		} else {
+			collisions++;
 		}
 	}
 
@@ -988,11 +1236,15 @@ retry_private:
 				wake_futex(this);
 				if (++op_ret >= nr_wake2)
 					break;
+			} else {
+				collisions++;
 			}
 		}
 		ret += op_ret;
 	}
 
+	futex_stat_add(fph, FUTEX_STAT_WAKE, ret);
+	futex_stat_add(fph, FUTEX_STAT_COLLISION, collisions);
 	double_unlock_hb(hb1, hb2);
 out_put_keys:
 	put_futex_key(fshared, &key2);
@@ -1152,6 +1404,7 @@ static int futex_requeue(u32 __user *uaddr1, int fshared, u32 __user *uaddr2,
 	union futex_key key1 = FUTEX_KEY_INIT, key2 = FUTEX_KEY_INIT;
 	int drop_count = 0, task_count = 0, ret;
 	struct futex_pi_state *pi_state = NULL;
+	struct futex_private_hash *fph;
 	struct futex_hash_bucket *hb1, *hb2;
 	struct plist_head *head1;
 	struct futex_q *this, *next;
@@ -1195,11 +1448,13 @@ retry:
 	if (unlikely(ret != 0))
 		goto out_put_key1;
 
-	hb1 = hash_futex(&key1);
-	hb2 = hash_futex(&key2);
+	if (!requeue_pi && futex_pi_queued(&key1)) {
+		ret = -EINVAL;
+		goto out_put_keys;
+	}
 
 retry_private:
-	double_lock_hb(hb1, hb2);
+	futex_double_lock_hb(&key1, &key2, requeue_pi, &hb1, &hb2, &fph);
 
 	if (likely(cmpval != NULL)) {
 		u32 curval;
@@ -1300,6 +1555,7 @@ retry_private:
 		 */
 		if (++task_count <= nr_wake && !requeue_pi) {
 			wake_futex(this);
+			futex_stat_add(fph, FUTEX_STAT_WAKE, 1);
 			continue;
 		}
 
@@ -1358,16 +1614,20 @@ out:
 	return ret ? ret : task_count;
 }
 
-/* The key must be already stored in q->key. */
-static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
+/*
+ * The key must be already stored in q->key. @pi is set for the PI futex
+ * operations, which always use the global hash.
+ */
+static inline struct futex_hash_bucket *queue_lock(struct futex_q *q, int pi)
 {
+	struct futex_private_hash *fph;
 	struct futex_hash_bucket *hb;
 
 	get_futex_key_refs(&q->key);
-	hb = hash_futex(&q->key);
+	hb = futex_lock_hb(&q->key, pi, &fph);
 	q->lock_ptr = &hb->lock;
 
-	spin_lock(&hb->lock);
+	futex_stat_add(fph, FUTEX_STAT_WAIT, 1);
 	return hb;
 }
 
@@ -1755,7 +2015,7 @@ retry:
 		return ret;
 
 retry_private:
-	*hb = queue_lock(q);
+	*hb = queue_lock(q, q->rt_waiter != NULL);
 
 	ret = get_futex_value_locked(&uval, uaddr);
 
@@ -1921,7 +2181,7 @@ retry:
 		goto out;
 
 retry_private:
-	hb = queue_lock(&q);
+	hb = queue_lock(&q, 1);
 
 	ret = futex_lock_pi_atomic(uaddr, hb, &q.key, &q.pi_state, current, 0);
 	if (unlikely(ret)) {
@@ -2575,8 +2835,11 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 		ret = futex_wake_op(uaddr, fshared, uaddr2, val, val2, val3);
 		break;
 	case FUTEX_LOCK_PI:
-		if (futex_cmpxchg_enabled)
+		if (futex_cmpxchg_enabled) {
+			atomic_inc(&futex_pi_waiters);
 			ret = futex_lock_pi(uaddr, fshared, val, timeout, 0);
+			atomic_dec(&futex_pi_waiters);
+		}
 		break;
 	case FUTEX_UNLOCK_PI:
 		if (futex_cmpxchg_enabled)
@@ -2588,8 +2851,10 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 		break;
 	case FUTEX_WAIT_REQUEUE_PI:
 		val3 = FUTEX_BITSET_MATCH_ANY;
+		atomic_inc(&futex_pi_waiters);
 		ret = futex_wait_requeue_pi(uaddr, fshared, val, timeout, val3,
 					    clockrt, uaddr2);
+		atomic_dec(&futex_pi_waiters);
 		break;
 	case FUTEX_CMP_REQUEUE_PI:
 		ret = futex_requeue(uaddr, fshared, uaddr2, val, val2, &val3,
@@ -2635,6 +2900,178 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 	return do_futex(uaddr, op, val, tp, uaddr2, val2, val3);
 }
 
+static struct futex_private_hash *futex_private_hash_alloc(int hash_bits)
+{
+	struct futex_private_hash *fph;
+	size_t size;
+	int i;
+
+	size = sizeof(*fph) + (sizeof(struct futex_hash_bucket) << hash_bits);
+	if (size > PAGE_SIZE)
+		fph = vmalloc(size);
+	else
+		fph = kmalloc(size, GFP_KERNEL);
+	if (!fph)
+		return NULL;
+
+	fph->hash_bits = hash_bits;
+	fph->moving = 0;
+	fph->retired = NULL;
+	for (i = 0; i < (1 << hash_bits); i++) {
+		plist_head_init(&fph->queues[i].chain, &fph->queues[i].lock);
+		spin_lock_init(&fph->queues[i].lock);
+	}
+	return fph;
+}
+
+static void futex_private_hash_release(struct futex_private_hash *fph)
+{
+	if (is_vmalloc_addr(fph))
+		vfree(fph);
+	else
+		kfree(fph);
+}
+
+/*
+ * Move the waiters of @old to @new, which is already the hash of the mm.
+ * Lookups may move some buckets themselves meanwhile.
+ */
+static void futex_private_hash_move(struct futex_private_hash *old,
+				    struct futex_private_hash *new)
+{
+	long moved = 0;
+	int i;
+
+	for (i = 0; i < (1 << old->hash_bits); i++)
+		moved += futex_private_bucket_move(&old->queues[i], new);
+	atomic_long_add(moved, &futex_private_moved);
+
+	/* Pairs with the bucket locks of the next lookups */
+	smp_wmb();
+	new->moving = 0;
+}
+
+/**
+ * futex_private_hash_grow() - Size the private futex hash of an mm
+ * @mm:		the mm
+ * @threads:	the number of tasks about to share @mm
+ *
+ * Called when a task sharing @mm is created. Allocates the private hash of
+ * @mm, or replaces it with a larger one, to get about four buckets per
+ * thread. Returns -ENOMEM if @mm had no private hash and none could be
+ * allocated; failing to grow an existing hash is harmless.
+ */
+int futex_private_hash_grow(struct mm_struct *mm, int threads)
+{
+	struct futex_private_hash *old, *new;
+	int hash_bits;
+
+	hash_bits = order_base_2(threads * 4);
+	hash_bits = clamp(hash_bits, FUTEX_PRIVATE_HASHBITS_MIN,
+			  FUTEX_PRIVATE_HASHBITS_MAX);
+	old = ACCESS_ONCE(mm->futex_hash);
+	if (old && old->hash_bits >= hash_bits)
+		return 0;
+
+	new = futex_private_hash_alloc(hash_bits);
+	if (!new)
+		return old ? 0 : -ENOMEM;
+
+	mutex_lock(&futex_hash_mutex);
+	old = mm->futex_hash;
+	if (old && old->hash_bits >= hash_bits) {
+		mutex_unlock(&futex_hash_mutex);
+		futex_private_hash_release(new);
+		return 0;
+	}
+	new->retired = old;
+	new->moving = old != NULL;
+	/*
+	 * Initialize the buckets -before- publishing the hash. Once it is
+	 * published, nothing gets queued on the old hash anymore, see
+	 * futex_hash_stale(), and lookups drain the old buckets they need
+	 * until futex_private_hash_move() is done.
+	 */
+	smp_wmb();
+	mm->futex_hash = new;
+	if (old) {
+		futex_private_hash_move(old, new);
+		atomic_inc(&futex_private_grows);
+	} else {
+		atomic_inc(&futex_private_hashes);
+	}
+	mutex_unlock(&futex_hash_mutex);
+	return 0;
+}
+
+/*
+ * Called when the last user of @mm is gone.
+ */
+void futex_private_hash_free(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph = mm->futex_hash, *retired;
+
+	if (!fph)
+		return;
+	mm->futex_hash = NULL;
+	atomic_dec(&futex_private_hashes);
+	while (fph) {
+		retired = fph->retired;
+		futex_private_hash_release(fph);
+		fph = retired;
+	}
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int futex_stats_show(struct seq_file *m, void *v)
+{
+	unsigned long stats[2][NR_FUTEX_STATS];
+	int cpu, i, j;
+
+	memset(stats, 0, sizeof(stats));
+	for_each_possible_cpu(cpu)
+		for (i = 0; i < 2; i++)
+			for (j = 0; j < NR_FUTEX_STATS; j++)
+				stats[i][j] += per_cpu(futex_stats, cpu)[i][j];
+
+	seq_printf(m, "%-10s", "#hash");
+	for (j = 0; j < NR_FUTEX_STATS; j++)
+		seq_printf(m, " %s", futex_stat_name[j]);
+	seq_printf(m, "\n");
+	for (i = 0; i < 2; i++) {
+		seq_printf(m, "%-10s", i ? "private" : "global");
+		for (j = 0; j < NR_FUTEX_STATS; j++)
+			seq_printf(m, " %lu", stats[i][j]);
+		seq_printf(m, "\n");
+	}
+	seq_printf(m, "private hashes: %d grown: %d waiters moved: %ld\n",
+		   atomic_read(&futex_private_hashes),
+		   atomic_read(&futex_private_grows),
+		   atomic_long_read(&futex_private_moved));
+	return 0;
+}
+
+static int futex_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, futex_stats_show, NULL);
+}
+
+static const struct file_operations futex_stats_fops = {
+	.open = futex_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init futex_debugfs_init(void)
+{
+	debugfs_create_file("futex_stats", S_IRUGO, NULL, NULL,
+			    &futex_stats_fops);
+	return 0;
+}
+__initcall(futex_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
 static int __init futex_init(void)
 {
 	u32 curval;
@@ -8,6 +8,9 @@
 #include <linux/immediate.h>
 #include <linux/memory.h>
 #include <linux/cpu.h>
+#include <linux/hrtimer.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/sections.h>
 
@@ -21,49 +24,188 @@ extern struct __imv __stop___imv[];
 
 /*
  * imv_mutex nests inside module_mutex. imv_mutex protects builtin
- * immediates and module immediates.
+ * immediates, module immediates and the update batch.
  */
 static DEFINE_MUTEX(imv_mutex);
 
+/*
+ * Sites waiting to be patched. Updates are applied in batches so the
+ * architecture can patch many sites with a single synchronization round.
+ */
+static const struct __imv *imv_batch[IMV_BATCH_MAX];
+static int imv_batch_nr;
+
+/*
+ * Update statistics, protected by imv_mutex. A pass is one call to
+ * arch_imv_update_batch().
+ */
+static struct imv_stats {
+	unsigned long updates;		/* Batches ended */
+	unsigned long passes;
+	unsigned long sites;		/* Sites patched */
+	unsigned long errors;
+	u64 total_ns;
+	u64 last_ns;
+	u64 max_ns;
+	unsigned long last_sites;
+} imv_stats;
+
+static ktime_t imv_batch_start;
+
 /**
- * imv_update_range - Update immediate values in a range
+ * arch_imv_check - check if an immediate value must be updated
+ * @imv: pointer of type const struct __imv to check
+ * @early: early boot (1) or normal (0)
+ *
+ * Returns 1 if the site must be patched, 0 if it is up to date, and a
+ * negative error value if it cannot be patched. Architectures which do not
+ * implement it let arch_imv_update() do the check.
+ */
+int __weak arch_imv_check(const struct __imv *imv, int early)
+{
+	return 1;
+}
+
+/**
+ * arch_imv_update_batch - update an array of immediate values
+ * @imvs: sites to update
+ * @nr: number of sites
+ * @early: early boot (1) or normal (0)
+ *
+ * Must be called with imv_mutex and text_mutex held. Returns the number of
+ * sites which could not be updated.
+ */
+int __weak arch_imv_update_batch(const struct __imv **imvs, int nr, int early)
+{
+	int i, errors = 0;
+
+	for (i = 0; i < nr; i++) {
+		if (arch_imv_update(imvs[i], early)) {
+			errors++;
+			if (!early)
+				printk(KERN_WARNING
+					"Invalid immediate value. "
+					"Variable at %p, "
+					"instruction at %p, size %hu\n",
+					(void *)imvs[i]->imv,
+					(void *)imvs[i]->var, imvs[i]->size);
+		}
+	}
+	return errors;
+}
+
+static void imv_batch_flush(void)
+{
+	if (!imv_batch_nr)
+		return;
+	/* workaround on_each_cpu cpu hotplug race */
+	get_online_cpus();
+	mutex_lock(&text_mutex);
+	imv_stats.errors += arch_imv_update_batch(imv_batch, imv_batch_nr,
+						  !imv_early_boot_complete);
+	mutex_unlock(&text_mutex);
+	put_online_cpus();
+	imv_stats.passes++;
+	imv_stats.sites += imv_batch_nr;
+	imv_stats.last_sites += imv_batch_nr;
+	imv_batch_nr = 0;
+}
+
+/**
+ * imv_batch_begin - start a batch of immediate value updates
+ *
+ * Takes imv_mutex. Sites are added with imv_batch_add_range() and patched at
+ * the latest by imv_batch_end().
+ */
+void imv_batch_begin(void)
+{
+	mutex_lock(&imv_mutex);
+	if (imv_early_boot_complete)
+		imv_batch_start = ktime_get();
+	imv_stats.last_sites = 0;
+}
+EXPORT_SYMBOL_GPL(imv_batch_begin);
+
+/**
+ * imv_batch_add_range - queue the out of date immediate values of a range
  * @begin: pointer to the beginning of the range
  * @end: pointer to the end of the range
  *
- * Updates a range of immediates.
+ * Must be called between imv_batch_begin() and imv_batch_end().
  */
-void imv_update_range(const struct __imv *begin,
+void imv_batch_add_range(const struct __imv *begin,
 		const struct __imv *end)
 {
 	const struct __imv *iter;
 	int ret;
 
-	mutex_lock(&imv_mutex);
 	for (iter = begin; iter < end; iter++) {
 		if (!iter->imv) /* Skip removed __init immediate values */
 			continue;
-		/* workaround on_each_cpu cpu hotplug race */
-		get_online_cpus();
-		mutex_lock(&text_mutex);
-		ret = arch_imv_update(iter, !imv_early_boot_complete);
-		mutex_unlock(&text_mutex);
-		put_online_cpus();
-		if (imv_early_boot_complete && ret)
-			printk(KERN_WARNING
-				"Invalid immediate value. "
-				"Variable at %p, "
-				"instruction at %p, size %hu\n",
-				(void *)iter->imv,
-				(void *)iter->var, iter->size);
+		ret = arch_imv_check(iter, !imv_early_boot_complete);
+		if (!ret)
+			continue;
+		if (ret < 0) {
+			imv_stats.errors++;
+			if (imv_early_boot_complete)
+				printk(KERN_WARNING
+					"Invalid immediate value. "
+					"Variable at %p, "
+					"instruction at %p, size %hu\n",
+					(void *)iter->imv,
+					(void *)iter->var, iter->size);
+			continue;
+		}
+		imv_batch[imv_batch_nr++] = iter;
+		if (imv_batch_nr == IMV_BATCH_MAX)
+			imv_batch_flush();
 	}
+}
+EXPORT_SYMBOL_GPL(imv_batch_add_range);
+
+/**
+ * imv_batch_end - apply a batch of immediate value updates
+ *
+ * Patches the queued sites and releases imv_mutex.
+ */
+void imv_batch_end(void)
+{
+	u64 delta;
+
+	imv_batch_flush();
+	imv_stats.updates++;
+	/* Timekeeping is not initialized at early boot */
+	if (!imv_early_boot_complete) {
+		mutex_unlock(&imv_mutex);
+		return;
+	}
+	delta = ktime_to_ns(ktime_sub(ktime_get(), imv_batch_start));
+	imv_stats.total_ns += delta;
+	imv_stats.last_ns = delta;
+	if (delta > imv_stats.max_ns)
+		imv_stats.max_ns = delta;
 	mutex_unlock(&imv_mutex);
 }
-EXPORT_SYMBOL_GPL(imv_update_range);
+EXPORT_SYMBOL_GPL(imv_batch_end);
 
 /**
- * imv_update - update all immediate values in the kernel
+ * imv_update_range - Update immediate values in a range
+ * @begin: pointer to the beginning of the range
+ * @end: pointer to the end of the range
  *
- * Iterate on the kernel core and modules to update the immediate values.
+ * Updates a range of immediates.
+ */
+void imv_update_range(const struct __imv *begin,
+		const struct __imv *end)
+{
+	imv_batch_begin();
+	imv_batch_add_range(begin, end);
+	imv_batch_end();
+}
+EXPORT_SYMBOL_GPL(imv_update_range);
+
+/**
+ * core_imv_update - update all immediate values in the core kernel
  */
 void core_imv_update(void)
 {
@@ -72,6 +214,27 @@ void core_imv_update(void)
 }
 EXPORT_SYMBOL_GPL(core_imv_update);
 
+/**
+ * imv_update - update all immediate values in the kernel
+ *
+ * Iterate on the kernel core and modules to update the immediate values, and
+ * patch all the changed sites in as few passes as possible.
+ */
+void imv_update(void)
+{
+#ifdef CONFIG_MODULES
+	mutex_lock(&module_mutex);
+#endif
+	imv_batch_begin();
+	imv_batch_add_range(__start___imv, __stop___imv);
+	_module_imv_update();
+	imv_batch_end();
+#ifdef CONFIG_MODULES
+	mutex_unlock(&module_mutex);
+#endif
+}
+EXPORT_SYMBOL_GPL(imv_update);
+
 /**
  * imv_unref
  * @begin: pointer to the beginning of the range
@@ -104,6 +267,46 @@ void __init imv_init_complete(void)
 	imv_early_boot_complete = 1;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static int imv_stats_show(struct seq_file *m, void *v)
+{
+	mutex_lock(&imv_mutex);
+	seq_printf(m, "updates %lu\n", imv_stats.updates);
+	seq_printf(m, "passes %lu\n", imv_stats.passes);
+	seq_printf(m, "sites %lu\n", imv_stats.sites);
+	seq_printf(m, "errors %lu\n", imv_stats.errors);
+	seq_printf(m, "total_ns %llu\n",
+		   (unsigned long long)imv_stats.total_ns);
+	seq_printf(m, "last_ns %llu\n",
+		   (unsigned long long)imv_stats.last_ns);
+	seq_printf(m, "last_sites %lu\n", imv_stats.last_sites);
+	seq_printf(m, "max_ns %llu\n",
+		   (unsigned long long)imv_stats.max_ns);
+	mutex_unlock(&imv_mutex);
+	return 0;
+}
+
+static int imv_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, imv_stats_show, NULL);
+}
+
+static const struct file_operations imv_stats_fops = {
+	.open = imv_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init imv_debugfs_init(void)
+{
+	debugfs_create_file("immediate_stats", S_IRUGO, NULL, NULL,
+			    &imv_stats_fops);
+	return 0;
+}
+__initcall(imv_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
 #ifdef CONFIG_MODULES
 
 int imv_module_notify(struct notifier_block *self,
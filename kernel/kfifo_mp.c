@@ -0,0 +1,299 @@
+/*
+ * A multi-producer record FIFO.
+ *
+ * Copyright (C) 2009 Mathieu Desnoyers <mathieu.desnoyers@polymtl.ca>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * See include/linux/kfifo_mp.h for the record layout.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/kfifo_mp.h>
+#include <linux/log2.h>
+
+/**
+ * kfifo_mp_init - allocates a new FIFO using a preallocated buffer
+ * @buffer: the preallocated buffer to be used, aligned on 4 bytes.
+ * @size: the size of the internal buffer, this have to be a power of 2.
+ * @gfp_mask: get_free_pages mask, passed to kmalloc()
+ * @lock: the lock serializing concurrent consumers
+ *
+ * The buffer is cleared. Do NOT pass the fifo to kfifo_mp_free() after use!
+ * Simply free the &struct kfifo_mp with kfree().
+ */
+struct kfifo_mp *kfifo_mp_init(unsigned char *buffer, unsigned int size,
+			       gfp_t gfp_mask, spinlock_t *lock)
+{
+	struct kfifo_mp *fifo;
+
+	/* size must be a power of 2, large enough for a record header */
+	BUG_ON(!is_power_of_2(size) || size < 2 * sizeof(u32));
+	BUG_ON((unsigned long)buffer & (sizeof(u32) - 1));
+
+	fifo = kmalloc(sizeof(struct kfifo_mp), gfp_mask);
+	if (!fifo)
+		return ERR_PTR(-ENOMEM);
+
+	memset(buffer, 0, size);
+	fifo->buffer = buffer;
+	fifo->size = size;
+	fifo->head = fifo->tail = 0;
+	fifo->lock = lock;
+
+	return fifo;
+}
+EXPORT_SYMBOL(kfifo_mp_init);
+
+/**
+ * kfifo_mp_alloc - allocates a new FIFO and its internal buffer
+ * @size: the size of the internal buffer to be allocated.
+ * @gfp_mask: get_free_pages mask, passed to kmalloc()
+ * @lock: the lock serializing concurrent consumers
+ *
+ * The size will be rounded-up to a power of 2.
+ */
+struct kfifo_mp *kfifo_mp_alloc(unsigned int size, gfp_t gfp_mask,
+				spinlock_t *lock)
+{
+	unsigned char *buffer;
+	struct kfifo_mp *ret;
+
+	if (!is_power_of_2(size)) {
+		BUG_ON(size > 0x80000000);
+		size = roundup_pow_of_two(size);
+	}
+
+	buffer = kmalloc(size, gfp_mask);
+	if (!buffer)
+		return ERR_PTR(-ENOMEM);
+
+	ret = kfifo_mp_init(buffer, size, gfp_mask, lock);
+
+	if (IS_ERR(ret))
+		kfree(buffer);
+
+	return ret;
+}
+EXPORT_SYMBOL(kfifo_mp_alloc);
+
+/**
+ * kfifo_mp_free - frees the FIFO
+ * @fifo: the fifo to be freed.
+ */
+void kfifo_mp_free(struct kfifo_mp *fifo)
+{
+	kfree(fifo->buffer);
+	kfree(fifo);
+}
+EXPORT_SYMBOL(kfifo_mp_free);
+
+/**
+ * kfifo_mp_reserve - reserves space for a record in the FIFO
+ * @fifo: the fifo to be used.
+ * @len: the length of the record.
+ *
+ * Returns where the @len bytes of the record must be written, or NULL if
+ * the FIFO is full or the record is larger than half the FIFO. The record
+ * must then be passed to kfifo_mp_commit().
+ *
+ * Any number of producers can reserve concurrently without locking, from
+ * any context. The consumers wait for the records in order, so a record
+ * should be committed promptly, without sleeping in between.
+ */
+void *kfifo_mp_reserve(struct kfifo_mp *fifo, unsigned int len)
+{
+	unsigned int head, tail, used, off, pad, rec_size;
+	u32 *hdr;
+
+	if (len > fifo->size / 2)
+		return NULL;
+	rec_size = kfifo_mp_rec_size(len);
+	if (rec_size > fifo->size / 2)
+		return NULL;
+
+	for (;;) {
+		/*
+		 * Sample the tail -before- the head, so the head is never
+		 * older than the tail.
+		 */
+		tail = ACCESS_ONCE(fifo->tail);
+		smp_rmb();
+		head = ACCESS_ONCE(fifo->head);
+		used = head - tail;
+		/* the FIFO was consumed and refilled in between, resample */
+		if (unlikely(used > fifo->size))
+			continue;
+		off = head & (fifo->size - 1);
+		/* records never wrap, pad up to the end of the buffer */
+		pad = 0;
+		if (fifo->size - off < rec_size)
+			pad = fifo->size - off;
+		if (pad + rec_size > fifo->size - used)
+			return NULL;
+		/*
+		 * The cmpxchg orders the tail read -before- we start writing
+		 * into the space it freed.
+		 */
+		if (cmpxchg(&fifo->head, head, head + pad + rec_size) == head)
+			break;
+	}
+
+	if (pad) {
+		hdr = (u32 *)(fifo->buffer + off);
+		ACCESS_ONCE(*hdr) = KFIFO_MP_COMMITTED | KFIFO_MP_PAD | pad;
+		off = 0;
+	}
+	hdr = (u32 *)(fifo->buffer + off);
+	*hdr = len;
+	return hdr + 1;
+}
+EXPORT_SYMBOL(kfifo_mp_reserve);
+
+/**
+ * kfifo_mp_put - puts a record into the FIFO
+ * @fifo: the fifo to be used.
+ * @buffer: the record to be added.
+ * @len: the length of the record.
+ *
+ * Returns @len, or 0 if the record could not be reserved. Producers do not
+ * need any locking.
+ */
+unsigned int kfifo_mp_put(struct kfifo_mp *fifo,
+			  const void *buffer, unsigned int len)
+{
+	void *rec;
+
+	rec = kfifo_mp_reserve(fifo, len);
+	if (!rec)
+		return 0;
+	memcpy(rec, buffer, len);
+	kfifo_mp_commit(fifo, rec);
+	return len;
+}
+EXPORT_SYMBOL(kfifo_mp_put);
+
+/*
+ * Returns the header of the first committed record from @pos, skipping the
+ * padding records, or NULL. @pos is moved to the returned record.
+ */
+static u32 *kfifo_mp_next(struct kfifo_mp *fifo, unsigned int *pos)
+{
+	u32 *hdr, val;
+
+	for (;;) {
+		if (*pos - fifo->tail >= fifo->size)
+			return NULL;
+		hdr = (u32 *)(fifo->buffer + (*pos & (fifo->size - 1)));
+		val = ACCESS_ONCE(*hdr);
+		if (!(val & KFIFO_MP_COMMITTED))
+			return NULL;
+		if (!(val & KFIFO_MP_PAD))
+			break;
+		*pos += val & KFIFO_MP_LEN_MASK;
+	}
+
+	/*
+	 * Ensure that we sample the commit flag -before- we
+	 * read the record contents.
+	 */
+
+	smp_rmb();
+
+	return hdr;
+}
+
+/*
+ * Clears the space used by the consumed records, up to @pos, and gives it
+ * back to the producers.
+ */
+static void kfifo_mp_release(struct kfifo_mp *fifo, unsigned int pos)
+{
+	unsigned int off = fifo->tail & (fifo->size - 1);
+	unsigned int len = pos - fifo->tail;
+	unsigned int l;
+
+	l = min(len, fifo->size - off);
+	memset(fifo->buffer + off, 0, l);
+	memset(fifo->buffer, 0, len - l);
+
+	/*
+	 * Ensure that we clear the records -before-
+	 * we update the fifo->tail index.
+	 */
+
+	smp_mb();
+
+	ACCESS_ONCE(fifo->tail) = pos;
+}
+
+/**
+ * __kfifo_mp_get - gets one record from the FIFO, no locking version
+ * @fifo: the fifo to be used.
+ * @buffer: where the record must be copied.
+ * @len: the size of the destination buffer.
+ *
+ * See kfifo_mp_get(). With only one consumer, you don't need extra locking
+ * to use this function.
+ */
+int __kfifo_mp_get(struct kfifo_mp *fifo, void *buffer, unsigned int len)
+{
+	unsigned int pos = fifo->tail, rec_len;
+	u32 *hdr;
+	int ret = 0;
+
+	hdr = kfifo_mp_next(fifo, &pos);
+	if (hdr) {
+		rec_len = *hdr & KFIFO_MP_LEN_MASK;
+		if (rec_len > len) {
+			ret = -EMSGSIZE;
+		} else {
+			memcpy(buffer, hdr + 1, rec_len);
+			pos += kfifo_mp_rec_size(rec_len);
+			ret = rec_len;
+		}
+	}
+	if (pos != fifo->tail)
+		kfifo_mp_release(fifo, pos);
+
+	return ret;
+}
+EXPORT_SYMBOL(__kfifo_mp_get);
+
+/**
+ * __kfifo_mp_consume - consumes a batch of records, no locking version
+ * @fifo: the fifo to be used.
+ * @max: the maximum number of records to consume.
+ * @func: called for each record.
+ * @priv: passed to @func.
+ *
+ * See kfifo_mp_consume(). The records are read in place and their space is
+ * given back to the producers once, after the last one. With only one
+ * consumer, you don't need extra locking to use this function.
+ */
+unsigned int __kfifo_mp_consume(struct kfifo_mp *fifo, unsigned int max,
+				kfifo_mp_func_t func, void *priv)
+{
+	unsigned int pos = fifo->tail, rec_len, n;
+	u32 *hdr;
+
+	for (n = 0; n < max; n++) {
+		hdr = kfifo_mp_next(fifo, &pos);
+		if (!hdr)
+			break;
+		rec_len = *hdr & KFIFO_MP_LEN_MASK;
+		func(priv, hdr + 1, rec_len);
+		pos += kfifo_mp_rec_size(rec_len);
+	}
+	if (pos != fifo->tail)
+		kfifo_mp_release(fifo, pos);
+
+	return n;
+}
+EXPORT_SYMBOL(__kfifo_mp_consume);
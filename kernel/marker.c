@@ -20,6 +20,7 @@
 #include <linux/types.h>
 #include <linux/jhash.h>
 #include <linux/hash.h>
+#include <linux/log2.h>
 #include <linux/list.h>
 #include <linux/rcupdate.h>
 #include <linux/marker.h>
@@ -63,6 +64,32 @@ EXPORT_SYMBOL_GPL(unlock_markers);
 static struct hlist_head marker_table[MARKER_TABLE_SIZE];
 static struct hlist_head id_table[MARKER_TABLE_SIZE];
 
+/*
+ * Dense (channel_id, event_id) to marker entry map, so the lookups from the
+ * trace readers do not take markers_mutex. Slots are set and cleared in place
+ * with markers_mutex held as event IDs are assigned and released; the map is
+ * only reallocated, and replaced with RCU, when an ID does not fit or when the
+ * IDs are compacted. NULL if the last allocation failed, in which case lookups
+ * walk id_table.
+ */
+struct marker_id_map {
+	struct rcu_head rcu;
+	unsigned int nr_channels;
+	struct marker_id_map_chan {
+		unsigned int nr_events;
+		struct marker_entry **events;
+	} chan[0];
+};
+
+static struct marker_id_map *marker_id_map;
+
+/*
+ * Serialization plans of removed marker entries. Marker sites keep a pointer
+ * to the plan until they are disabled, so the plans are only handed to RCU
+ * after marker_update_probes(). Protected by markers_mutex.
+ */
+static LIST_HEAD(marker_plan_free_list);
+
 struct marker_probe_array {
 	struct rcu_head rcu;
 	struct marker_probe_closure c[0];
@@ -79,6 +106,7 @@ struct marker_probe_array {
 struct marker_entry {
 	struct hlist_node hlist;
 	struct hlist_node id_list;
+	struct rcu_head rcu;	/* Lockless ID lookups may still use it */
 	char *format;
 	char *name;
 			/* Probe wrapper */
@@ -88,6 +116,7 @@ struct marker_entry {
 	int refcount;	/* Number of times armed. 0 if disarmed. */
 	u16 channel_id;
 	u16 event_id;
+	struct ltt_serialize_plan *plan;	/* NULL if no format */
 	unsigned char ptype:1;
 	unsigned char format_allocated:1;
 	char channel[0];	/* Contains channel'\0'name'\0'format'\0' */
@@ -231,6 +260,164 @@ static void free_old_closure(struct rcu_head *head)
 	kfree(multi);
 }
 
+static void free_old_plan(struct rcu_head *head)
+{
+	kfree(container_of(head, struct ltt_serialize_plan, rcu));
+}
+
+static void free_old_entry(struct rcu_head *head)
+{
+	struct marker_entry *e = container_of(head, struct marker_entry, rcu);
+
+	if (e->format_allocated)
+		kfree(e->format);
+	kfree(e);
+}
+
+static void free_old_id_map(struct rcu_head *head)
+{
+	kfree(container_of(head, struct marker_id_map, rcu));
+}
+
+static void marker_id_map_replace(struct marker_id_map *map)
+{
+	struct marker_id_map *old = marker_id_map;
+
+	if (!map)
+		printk(KERN_WARNING "Markers: cannot allocate event ID map, "
+		       "falling back on hash table lookups\n");
+	rcu_assign_pointer(marker_id_map, map);
+	if (old)
+		call_rcu_sched(&old->rcu, free_old_id_map);
+}
+
+/*
+ * Allocate a map with room for nr_events[i] events in channel i and point the
+ * per channel slot arrays into it.
+ */
+static struct marker_id_map *marker_id_map_alloc(unsigned int nr_channels,
+						 const unsigned int *nr_events)
+{
+	struct marker_id_map *map;
+	struct marker_entry **slot;
+	unsigned int i, nr_slots = 0;
+	size_t size;
+
+	size = sizeof(*map) + nr_channels * sizeof(map->chan[0]);
+	for (i = 0; i < nr_channels; i++)
+		nr_slots += nr_events[i];
+	map = kzalloc(size + nr_slots * sizeof(*slot), GFP_KERNEL);
+	if (!map)
+		return NULL;
+	map->nr_channels = nr_channels;
+	slot = (struct marker_entry **)((char *)map + size);
+	for (i = 0; i < nr_channels; i++) {
+		map->chan[i].nr_events = nr_events[i];
+		map->chan[i].events = slot;
+		slot += nr_events[i];
+	}
+	return map;
+}
+
+/*
+ * Rebuild the event ID map from the ID hash table. Used when the IDs are
+ * compacted and to recover from a failed allocation. Must be called with
+ * markers_mutex held.
+ */
+static void marker_id_map_rebuild(void)
+{
+	struct marker_id_map *map = NULL;
+	struct marker_entry *e;
+	struct hlist_head *head;
+	struct hlist_node *node;
+	unsigned int i, nr_channels = 0, *nr_events;
+
+	for (i = 0; i < MARKER_TABLE_SIZE; i++) {
+		head = &id_table[i];
+		hlist_for_each_entry(e, node, head, id_list)
+			nr_channels = max_t(unsigned int, nr_channels,
+					    e->channel_id + 1);
+	}
+	nr_events = kcalloc(max(nr_channels, 1U), sizeof(*nr_events),
+			    GFP_KERNEL);
+	if (!nr_events)
+		goto end;
+	for (i = 0; i < MARKER_TABLE_SIZE; i++) {
+		head = &id_table[i];
+		hlist_for_each_entry(e, node, head, id_list)
+			nr_events[e->channel_id] =
+				max_t(unsigned int, nr_events[e->channel_id],
+				      e->event_id + 1);
+	}
+	map = marker_id_map_alloc(nr_channels, nr_events);
+	kfree(nr_events);
+	if (!map)
+		goto end;
+	for (i = 0; i < MARKER_TABLE_SIZE; i++) {
+		head = &id_table[i];
+		hlist_for_each_entry(e, node, head, id_list)
+			map->chan[e->channel_id].events[e->event_id] = e;
+	}
+end:
+	marker_id_map_replace(map);
+}
+
+/*
+ * Copy the map into a larger one with room for (channel_id, event_id). The
+ * channel grows to the next power of two so that registering the events of a
+ * channel one at a time only reallocates the map a logarithmic number of
+ * times. Must be called with markers_mutex held.
+ */
+static void marker_id_map_grow(u16 channel_id, u16 event_id)
+{
+	struct marker_id_map *old = marker_id_map, *map = NULL;
+	unsigned int i, nr_channels, *nr_events;
+
+	nr_channels = max_t(unsigned int, old->nr_channels, channel_id + 1);
+	nr_events = kcalloc(nr_channels, sizeof(*nr_events), GFP_KERNEL);
+	if (!nr_events)
+		goto end;
+	for (i = 0; i < old->nr_channels; i++)
+		nr_events[i] = old->chan[i].nr_events;
+	nr_events[channel_id] = max_t(unsigned int, nr_events[channel_id],
+				      roundup_pow_of_two(event_id + 1));
+	map = marker_id_map_alloc(nr_channels, nr_events);
+	kfree(nr_events);
+	if (!map)
+		goto end;
+	for (i = 0; i < old->nr_channels; i++)
+		memcpy(map->chan[i].events, old->chan[i].events,
+		       old->chan[i].nr_events * sizeof(*map->chan[i].events));
+end:
+	marker_id_map_replace(map);
+}
+
+/*
+ * Point the map slot of a marker entry to it, or clear it when e is going
+ * away. Must be called with markers_mutex held.
+ */
+static void marker_id_map_set(struct marker_entry *e, int clear)
+{
+	struct marker_id_map *map = marker_id_map;
+
+	if (!map) {
+		if (!clear)
+			marker_id_map_rebuild();
+		return;
+	}
+	if (e->channel_id >= map->nr_channels
+	    || e->event_id >= map->chan[e->channel_id].nr_events) {
+		if (clear)
+			return;
+		marker_id_map_grow(e->channel_id, e->event_id);
+		map = marker_id_map;
+		if (!map)
+			return;
+	}
+	rcu_assign_pointer(map->chan[e->channel_id].events[e->event_id],
+			   clear ? NULL : e);
+}
+
 static void debug_print_probes(struct marker_entry *entry)
 {
 	int i;
@@ -442,12 +629,14 @@ static struct marker_entry *add_marker(const char *channel, const char *name,
 			e->call = marker_probe_cb_noarg;
 		else
 			e->call = marker_probe_cb;
+		e->plan = ltt_serialize_plan_create(e->format);
 		trace_mark(metadata, core_marker_format,
 			   "channel %s name %s format %s",
 			   e->channel, e->name, e->format);
 	} else {
 		e->format = NULL;
 		e->call = marker_probe_cb;
+		e->plan = NULL;
 	}
 	e->single.func = __mark_empty_function;
 	e->single.probe_private = NULL;
@@ -493,14 +682,17 @@ static int remove_marker(const char *channel, const char *name, int registered,
 		return 0;
 
 	hlist_del(&e->hlist);
-	hlist_del(&e->id_list);
+	hlist_del_rcu(&e->id_list);
+	/* Compaction rebuilds the map once all IDs are reassigned */
+	if (!compacting)
+		marker_id_map_set(e, 1);
 	if (registered) {
 		ret = ltt_channels_unregister(e->channel, compacting);
 		WARN_ON(ret);
 	}
-	if (e->format_allocated)
-		kfree(e->format);
-	kfree(e);
+	if (e->plan)
+		list_add(&e->plan->list, &marker_plan_free_list);
+	call_rcu_sched(&e->rcu, free_old_entry);
 	return 0;
 }
 
@@ -513,6 +705,11 @@ static int marker_set_format(struct marker_entry *entry, const char *format)
 	if (!entry->format)
 		return -ENOMEM;
 	entry->format_allocated = 1;
+	/*
+	 * A missing plan only means the serializer parses the format string
+	 * for each event.
+	 */
+	entry->plan = ltt_serialize_plan_create(entry->format);
 
 	trace_mark(metadata, core_marker_format,
 		   "channel %s name %s format %s",
@@ -554,6 +751,7 @@ static int set_marker(struct marker_entry *entry, struct marker *elem,
 	elem->call = entry->call;
 	elem->channel_id = entry->channel_id;
 	elem->event_id = entry->event_id;
+	elem->plan = entry->plan;
 	/*
 	 * Sanity check :
 	 * We only update the single probe private data when the ptr is
@@ -648,9 +846,9 @@ static void disable_marker(struct marker *elem)
 	smp_wmb();
 	elem->ptype = 0;	/* single probe */
 	/*
-	 * Leave the private data and channel_id/event_id there, because removal
-	 * is racy and should be done only after an RCU period. These are never
-	 * used until the next initialization anyway.
+	 * Leave the private data, channel_id/event_id and plan there, because
+	 * removal is racy and should be done only after an RCU period. These
+	 * are never used until the next initialization anyway.
 	 */
 }
 
@@ -770,14 +968,22 @@ void marker_update_probe_range(struct marker *begin,
  */
 void marker_update_probes(void)
 {
+	struct ltt_serialize_plan *plan, *tmp;
+
 	/* Core kernel markers */
 	marker_update_probe_range(__start___markers, __stop___markers);
 	/* Markers in modules. */
 	module_update_markers();
 	tracepoint_probe_update_all();
 	/* Update immediate values */
-	core_imv_update();
-	module_imv_update();
+	imv_update();
+	/* Sites of removed markers are now disabled */
+	mutex_lock(&markers_mutex);
+	list_for_each_entry_safe(plan, tmp, &marker_plan_free_list, list) {
+		list_del(&plan->list);
+		call_rcu_sched(&plan->rcu, free_old_plan);
+	}
+	mutex_unlock(&markers_mutex);
 }
 
 /**
@@ -821,9 +1027,10 @@ int marker_probe_register(const char *channel, const char *name,
 		if (ret < 0)
 			goto error_unregister_channel;
 		entry->event_id = ret;
-		hlist_add_head(&entry->id_list, id_table + hash_32(
+		hlist_add_head_rcu(&entry->id_list, id_table + hash_32(
 				(entry->channel_id << 16) | entry->event_id,
 				MARKER_HASH_BITS));
+		marker_id_map_set(entry, 0);
 		ret = 0;
 		trace_mark(metadata, core_marker_id,
 			   "channel %s name %s event_id %hu "
@@ -1038,26 +1245,43 @@ void *marker_get_private_data(const char *channel, const char *name,
 }
 EXPORT_SYMBOL_GPL(marker_get_private_data);
 
+/*
+ * Must be called within rcu_read_lock_sched(). The entry is only freed after
+ * a grace period once removed, so it stays valid until the caller leaves the
+ * read-side critical section.
+ */
 static struct marker_entry *get_entry_from_id(u16 channel_id, u16 event_id)
 {
+	struct marker_id_map *map;
+	struct marker_id_map_chan *chan;
 	struct hlist_head *head;
 	struct hlist_node *node;
-	struct marker_entry *e, *found = NULL;
-	u32 hash = hash_32((channel_id << 16) | event_id, MARKER_HASH_BITS);
+	struct marker_entry *e;
+	u32 hash;
 
-	mutex_lock(&markers_mutex);
-	head = id_table + hash;
-	hlist_for_each_entry(e, node, head, id_list) {
-		if (e->channel_id == channel_id && e->event_id == event_id) {
-			found = e;
-			break;
-		}
+	map = rcu_dereference(marker_id_map);
+	if (likely(map)) {
+		if (channel_id >= map->nr_channels)
+			return NULL;
+		chan = &map->chan[channel_id];
+		if (event_id >= chan->nr_events)
+			return NULL;
+		return rcu_dereference(chan->events[event_id]);
 	}
-	mutex_unlock(&markers_mutex);
-	return found;
+
+	hash = hash_32((channel_id << 16) | event_id, MARKER_HASH_BITS);
+	head = id_table + hash;
+	hlist_for_each_entry_rcu(e, node, head, id_list)
+		if (e->channel_id == channel_id && e->event_id == event_id)
+			return e;
+	return NULL;
 }
 
-/* must call when ids/marker_entry are kept alive */
+/*
+ * The returned name and format belong to the marker entry: they may only be
+ * used until the caller leaves the rcu_read_lock_sched() section it called
+ * these from.
+ */
 const char *marker_get_name_from_id(u16 channel_id, u16 event_id)
 {
 	struct marker_entry *e = get_entry_from_id(channel_id, event_id);
@@ -1113,11 +1337,12 @@ void markers_compact_event_ids(void)
 	for (i = 0; i < MARKER_TABLE_SIZE; i++) {
 		head = &marker_table[i];
 		hlist_for_each_entry(entry, node, head, hlist) {
-			hlist_add_head(&entry->id_list, id_table + hash_32(
+			hlist_add_head_rcu(&entry->id_list, id_table + hash_32(
 					(entry->channel_id << 16)
 					| entry->event_id, MARKER_HASH_BITS));
 		}
 	}
+	marker_id_map_rebuild();
 }
 
 /**
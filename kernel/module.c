@@ -3282,10 +3282,11 @@ int module_get_iter_tracepoints(struct tracepoint_iter *iter)
 
 #ifdef USE_IMMEDIATE
 /**
- * _module_imv_update - update all immediate values in the kernel
+ * _module_imv_update - queue the module immediate values updates
  *
- * Iterate on the kernel core and modules to update the immediate values.
- * Module_mutex must be held be the caller.
+ * Iterate on the modules to add their out of date immediate values to the
+ * current update batch. Module_mutex must be held be the caller, within
+ * imv_batch_begin() and imv_batch_end().
  */
 void _module_imv_update(void)
 {
@@ -3294,7 +3295,7 @@ void _module_imv_update(void)
 	list_for_each_entry(mod, &modules, list) {
 		if (mod->taints)
 			continue;
-		imv_update_range(mod->immediate,
+		imv_batch_add_range(mod->immediate,
 			mod->immediate + mod->num_immediate);
 	}
 }
@@ -3309,7 +3310,9 @@ EXPORT_SYMBOL_GPL(_module_imv_update);
 void module_imv_update(void)
 {
 	mutex_lock(&module_mutex);
+	imv_batch_begin();
 	_module_imv_update();
+	imv_batch_end();
 	mutex_unlock(&module_mutex);
 }
 EXPORT_SYMBOL_GPL(module_imv_update);
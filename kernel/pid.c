@@ -491,6 +491,7 @@ struct pid *find_ge_pid(int nr, struct pid_namespace *ns)
 
 	return pid;
 }
+EXPORT_SYMBOL_GPL(find_ge_pid);
 
 /*
  * The pid hash table is scaled according to the amount of memory in the
@@ -47,14 +47,15 @@
 #include <linux/cpu.h>
 #include <linux/mutex.h>
 #include <linux/time.h>
+#include <linux/kthread.h>
 #include <trace/rcu.h>
 
 #include "rcutree.h"
 
 /* Data structures. */
 
-#define RCU_STATE_INITIALIZER(name) { \
-	.level = { &name.node[0] }, \
+#define RCU_STATE_INITIALIZER(structname, flavor) { \
+	.level = { &structname.node[0] }, \
 	.levelcnt = { \
 		NUM_RCU_LVL_0,  /* root of hierarchy. */ \
 		NUM_RCU_LVL_1, \
@@ -64,19 +65,22 @@
 	.signaled = RCU_GP_IDLE, \
 	.gpnum = -300, \
 	.completed = -300, \
-	.onofflock = __SPIN_LOCK_UNLOCKED(&name.onofflock), \
+	.onofflock = __SPIN_LOCK_UNLOCKED(&structname.onofflock), \
 	.orphan_cbs_list = NULL, \
-	.orphan_cbs_tail = &name.orphan_cbs_list, \
+	.orphan_cbs_tail = &structname.orphan_cbs_list, \
 	.orphan_qlen = 0, \
-	.fqslock = __SPIN_LOCK_UNLOCKED(&name.fqslock), \
+	.fqslock = __SPIN_LOCK_UNLOCKED(&structname.fqslock), \
 	.n_force_qs = 0, \
 	.n_force_qs_ngp = 0, \
+	.name = flavor, \
 }
 
-struct rcu_state rcu_sched_state = RCU_STATE_INITIALIZER(rcu_sched_state);
+struct rcu_state rcu_sched_state =
+	RCU_STATE_INITIALIZER(rcu_sched_state, "rcu_sched");
 DEFINE_PER_CPU(struct rcu_data, rcu_sched_data);
 
-struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh_state);
+struct rcu_state rcu_bh_state =
+	RCU_STATE_INITIALIZER(rcu_bh_state, "rcu_bh");
 DEFINE_PER_CPU(struct rcu_data, rcu_bh_data);
 
 
@@ -134,6 +138,9 @@ module_param(qlowmark, int, 0);
 DEFINE_TRACE(rcu_tree_call_rcu);
 DEFINE_TRACE(rcu_tree_call_rcu_bh);
 DEFINE_TRACE(rcu_tree_callback);
+DEFINE_TRACE(rcu_tree_gp_start);
+DEFINE_TRACE(rcu_tree_gp_end);
+DEFINE_TRACE(rcu_tree_batch);
 
 static void force_quiescent_state(struct rcu_state *rsp, int relaxed);
 static int rcu_pending(int cpu);
@@ -689,6 +696,8 @@ rcu_start_gp(struct rcu_state *rsp, unsigned long flags)
 	WARN_ON_ONCE(rsp->signaled == RCU_GP_INIT);
 	rsp->signaled = RCU_GP_INIT; /* Hold off force_quiescent_state. */
 	rsp->jiffies_force_qs = jiffies + RCU_JIFFIES_TILL_FORCE_QS;
+	rsp->gp_started = jiffies;
+	trace_rcu_tree_gp_start(rsp->name, rsp->gpnum);
 	record_gp_stall_check_time(rsp);
 	dyntick_record_completed(rsp, rsp->completed - 1);
 
@@ -753,7 +762,15 @@ rcu_start_gp(struct rcu_state *rsp, unsigned long flags)
 static void cpu_quiet_msk_finish(struct rcu_state *rsp, unsigned long flags)
 	__releases(rcu_get_root(rsp)->lock)
 {
+	unsigned long duration = jiffies - rsp->gp_started;
+
 	WARN_ON_ONCE(!rcu_gp_in_progress(rsp));
+	rsp->n_gps++;
+	rsp->gp_last = duration;
+	if (duration > rsp->gp_max)
+		rsp->gp_max = duration;
+	rsp->gp_total += duration;
+	trace_rcu_tree_gp_end(rsp->name, rsp->gpnum, duration);
 	rsp->completed = rsp->gpnum;
 	rsp->signaled = RCU_GP_IDLE;
 	rcu_start_gp(rsp, flags);  /* releases root node's rnp->lock. */
@@ -1018,9 +1035,9 @@ static void rcu_offline_cpu(int cpu)
 
 /*
  * Invoke any RCU callbacks that have made it to the end of their grace
- * period.  Thottle as specified by rdp->blimit.
+ * period.  Thottle as specified by bl, normally rdp->blimit.
  */
-static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
+static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp, long bl)
 {
 	unsigned long flags;
 	struct rcu_head *next, *list, **tail;
@@ -1056,7 +1073,7 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 #endif
 		list->func(list);
 		list = next;
-		if (++count >= rdp->blimit)
+		if (++count >= bl)
 			break;
 	}
 
@@ -1064,6 +1081,9 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 
 	/* Update count, and requeue any remaining callbacks. */
 	rdp->qlen -= count;
+	rdp->n_cbs_invoked += count;
+	rdp->n_batches++;
+	trace_rcu_tree_batch(rsp->name, rdp->cpu, count, rdp->qlen);
 	if (list != NULL) {
 		*tail = rdp->nxtlist;
 		rdp->nxtlist = list;
@@ -1086,12 +1106,173 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 		rdp->qlen_last_fqs_check = rdp->qlen;
 
 	local_irq_restore(flags);
+}
+
+#ifdef CONFIG_RCU_CB_OFFLOAD
+
+static int offload_blimit = 16;	/* Maximum callbacks per rcuc batch. */
+
+module_param(offload_blimit, int, 0);
+
+static DEFINE_PER_CPU(struct task_struct *, rcu_cb_task);
+
+/*
+ * Hand the current CPU's ready callbacks over to its rcuc kthread.  Until
+ * that kthread exists, early at boot or while the CPU comes online, the
+ * callbacks are invoked from softirq as usual.
+ */
+static void rcu_invoke_callbacks(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+	struct task_struct *t = __get_cpu_var(rcu_cb_task);
+
+	if (t != NULL) {
+		wake_up_process(t);
+		return;
+	}
+	rcu_do_batch(rsp, rdp, rdp->blimit);
+
+	/* Re-raise the RCU softirq if there are callbacks remaining. */
+	if (cpu_has_callbacks_ready_to_invoke(rdp))
+		raise_softirq(RCU_SOFTIRQ);
+}
+
+/*
+ * Invoke one batch of the ready callbacks of the specified rcu_data
+ * structure from the rcuc kthread, returning 1 if some remain.  The batch
+ * is bounded by offload_blimit even when the queue overflowed qhimark, as
+ * the kthread simply comes back for more after rescheduling.  Caller must
+ * have bottom halves disabled.
+ */
+static int rcu_offload_batch(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+	unsigned long invoked = rdp->n_cbs_invoked;
+
+	rcu_do_batch(rsp, rdp, min_t(long, rdp->blimit, offload_blimit));
+	rdp->n_cbs_offloaded += rdp->n_cbs_invoked - invoked;
+	return cpu_has_callbacks_ready_to_invoke(rdp);
+}
+
+/*
+ * Does the specified CPU have callbacks ready for its rcuc kthread?
+ */
+static int rcu_cb_kthread_pending(int cpu)
+{
+	return cpu_has_callbacks_ready_to_invoke(&per_cpu(rcu_sched_data, cpu)) ||
+	       cpu_has_callbacks_ready_to_invoke(&per_cpu(rcu_bh_data, cpu)) ||
+	       rcu_preempt_cbs_ready(cpu);
+}
+
+/*
+ * Per-CPU kthread invoking the RCU callbacks whose grace period ended.
+ * Each batch runs with bottom halves disabled, as callbacks are written
+ * for softirq context, and the kthread reschedules between batches so
+ * that a burst of callbacks does not hold off interrupts, softirqs or
+ * other tasks for long.
+ */
+static int rcu_cb_kthread(void *arg)
+{
+	int cpu = (long)arg;
+	int more;
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		if (!rcu_cb_kthread_pending(cpu))
+			schedule();
+		__set_current_state(TASK_RUNNING);
+		do {
+			local_bh_disable();
+			more = rcu_offload_batch(&rcu_sched_state,
+						 &per_cpu(rcu_sched_data, cpu));
+			more |= rcu_offload_batch(&rcu_bh_state,
+						  &per_cpu(rcu_bh_data, cpu));
+			more |= rcu_preempt_offload_batch(cpu);
+			local_bh_enable();
+			cond_resched();
+		} while (more && !kthread_should_stop());
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int __cpuinit rcu_cb_cpu_notify(struct notifier_block *self,
+				       unsigned long action, void *hcpu)
+{
+	int cpu = (long)hcpu;
+	struct task_struct *t;
+
+	switch (action) {
+	case CPU_UP_PREPARE:
+	case CPU_UP_PREPARE_FROZEN:
+		t = kthread_create(rcu_cb_kthread, hcpu, "rcuc/%d", cpu);
+		if (IS_ERR(t)) {
+			printk(KERN_ERR "rcuc for %i failed\n", cpu);
+			return NOTIFY_BAD;
+		}
+		kthread_bind(t, cpu);
+		per_cpu(rcu_cb_task, cpu) = t;
+		break;
+	case CPU_ONLINE:
+	case CPU_ONLINE_FROZEN:
+		wake_up_process(per_cpu(rcu_cb_task, cpu));
+		break;
+#ifdef CONFIG_HOTPLUG_CPU
+	case CPU_UP_CANCELED:
+	case CPU_UP_CANCELED_FROZEN:
+		if (!per_cpu(rcu_cb_task, cpu))
+			break;
+		/* Unbind so it can run.  Fall thru. */
+		kthread_bind(per_cpu(rcu_cb_task, cpu),
+			     cpumask_any(cpu_online_mask));
+	case CPU_DEAD:
+	case CPU_DEAD_FROZEN:
+		/*
+		 * The callbacks of the dead CPU were already sent to the
+		 * orphanage by CPU_DYING, so there is nothing left to do.
+		 */
+		t = per_cpu(rcu_cb_task, cpu);
+		per_cpu(rcu_cb_task, cpu) = NULL;
+		kthread_stop(t);
+		break;
+#endif /* #ifdef CONFIG_HOTPLUG_CPU */
+	}
+	return NOTIFY_OK;
+}
+
+static struct notifier_block __cpuinitdata rcu_cb_nb = {
+	.notifier_call = rcu_cb_cpu_notify,
+};
+
+static __init int rcu_cb_offload_init(void)
+{
+	void *cpu = (void *)(long)smp_processor_id();
+	int err = rcu_cb_cpu_notify(&rcu_cb_nb, CPU_UP_PREPARE, cpu);
+
+	BUG_ON(err == NOTIFY_BAD);
+	rcu_cb_cpu_notify(&rcu_cb_nb, CPU_ONLINE, cpu);
+	register_cpu_notifier(&rcu_cb_nb);
+	printk(KERN_INFO "RCU callbacks offloaded to rcuc kthreads, "
+	       "batch limit %d.\n", offload_blimit);
+	return 0;
+}
+early_initcall(rcu_cb_offload_init);
+
+#else /* #ifdef CONFIG_RCU_CB_OFFLOAD */
+
+/*
+ * Invoke the current CPU's ready callbacks from softirq.
+ */
+static void rcu_invoke_callbacks(struct rcu_state *rsp, struct rcu_data *rdp)
+{
+	rcu_do_batch(rsp, rdp, rdp->blimit);
 
 	/* Re-raise the RCU softirq if there are callbacks remaining. */
 	if (cpu_has_callbacks_ready_to_invoke(rdp))
 		raise_softirq(RCU_SOFTIRQ);
 }
 
+#endif /* #else #ifdef CONFIG_RCU_CB_OFFLOAD */
+
 /*
  * Check to see if this CPU is in a non-context-switch quiescent state
  * (user mode or idle loop for rcu, non-softirq execution for rcu_bh).
@@ -1308,7 +1489,8 @@ __rcu_process_callbacks(struct rcu_state *rsp, struct rcu_data *rdp)
 	}
 
 	/* If there are callbacks ready, invoke them. */
-	rcu_do_batch(rsp, rdp);
+	if (cpu_has_callbacks_ready_to_invoke(rdp))
+		rcu_invoke_callbacks(rsp, rdp);
 }
 
 /*
@@ -1393,6 +1575,8 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 		rdp->qlen_last_fqs_check = rdp->qlen;
 	} else if ((long)(ACCESS_ONCE(rsp->jiffies_force_qs) - jiffies) < 0)
 		force_quiescent_state(rsp, 1);
+	if (rdp->qlen > rdp->qlen_max)
+		rdp->qlen_max = rdp->qlen;
 	local_irq_restore(flags);
 }
 
@@ -1735,6 +1919,7 @@ static void __init rcu_init_one(struct rcu_state *rsp)
 	int cpustride = 1;
 	int i;
 	int j;
+	int k;
 	struct rcu_node *rnp;
 
 	/* Initialize the level-tracking arrays. */
@@ -1769,8 +1954,8 @@ static void __init rcu_init_one(struct rcu_state *rsp)
 					      j / rsp->levelspread[i - 1];
 			}
 			rnp->level = i;
-			INIT_LIST_HEAD(&rnp->blocked_tasks[0]);
-			INIT_LIST_HEAD(&rnp->blocked_tasks[1]);
+			for (k = 0; k < ARRAY_SIZE(rnp->blocked_tasks); k++)
+				INIT_LIST_HEAD(&rnp->blocked_tasks[k]);
 		}
 	}
 	spin_lock_init(&rcu_get_root(rsp)->lock);
@@ -102,11 +102,14 @@ struct rcu_node {
 	u8	grpnum;		/* CPU/group number for next level up. */
 	u8	level;		/* root is at level 0. */
 	struct rcu_node *parent;
-	struct list_head blocked_tasks[2];
+	struct list_head blocked_tasks[4];
 				/* Tasks blocked in RCU read-side critsect. */
 				/*  Grace period number (->gpnum) x blocked */
-				/*  by tasks on the (x & 0x1) element of the */
-				/*  blocked_tasks[] array. */
+				/*  by tasks on the (x & 0x1) and */
+				/*  (x & 0x1) + 2 elements of the */
+				/*  blocked_tasks[] array.  The last two */
+				/*  elements also block the current */
+				/*  expedited grace period. */
 } ____cacheline_internodealigned_in_smp;
 
 /*
@@ -175,6 +178,7 @@ struct rcu_data {
 	unsigned long	n_force_qs_snap;
 					/* did other CPU force QS recently? */
 	long		blimit;		/* Upper limit on a processed batch */
+	long		qlen_max;	/* High-water mark of ->qlen. */
 
 #ifdef CONFIG_NO_HZ
 	/* 3) dynticks interface. */
@@ -200,6 +204,13 @@ struct rcu_data {
 	long n_rp_need_fqs;
 	long n_rp_need_nothing;
 
+	/* 6) callback invocation statistics. */
+	unsigned long n_cbs_invoked;	/* Callbacks invoked since boot. */
+	unsigned long n_batches;	/* Non-empty rcu_do_batch() calls. */
+#ifdef CONFIG_RCU_CB_OFFLOAD
+	unsigned long n_cbs_offloaded;	/* Of which invoked by rcuc kthread. */
+#endif /* #ifdef CONFIG_RCU_CB_OFFLOAD */
+
 	int cpu;
 };
 
@@ -249,6 +260,12 @@ struct rcu_state {
 						/* Force QS state. */
 	long	gpnum;				/* Current gp number. */
 	long	completed;			/* # of last completed gp. */
+	unsigned long gp_started;		/* Time at which GP started, */
+						/*  in jiffies. */
+	unsigned long n_gps;			/* GPs completed since boot. */
+	unsigned long gp_last;			/* Duration of the last, */
+	unsigned long gp_max;			/*  longest and all GPs, */
+	unsigned long gp_total;			/*  in jiffies. */
 
 	/* End  of fields guarded by root rcu_node's lock. */
 
@@ -280,6 +297,10 @@ struct rcu_state {
 #endif /* #ifdef CONFIG_RCU_CPU_STALL_DETECTOR */
 	long dynticks_completed;		/* Value of completed @ snap. */
 						/*  Protected by fqslock. */
+	unsigned long n_exp_gps;		/* Expedited GPs since boot, */
+	unsigned long n_exp_shared;		/*  and expedited requests */
+						/*  satisfied by another's. */
+	char *name;				/* Name of structure. */
 };
 
 #ifdef RCU_TREE_NONCORE
@@ -323,5 +344,9 @@ static int rcu_preempt_needs_cpu(int cpu);
 static void __cpuinit rcu_preempt_init_percpu_data(int cpu);
 static void rcu_preempt_send_cbs_to_orphanage(void);
 static void __init __rcu_init_preempt(void);
+#ifdef CONFIG_RCU_CB_OFFLOAD
+static int rcu_preempt_cbs_ready(int cpu);
+static int rcu_preempt_offload_batch(int cpu);
+#endif /* #ifdef CONFIG_RCU_CB_OFFLOAD */
 
 #endif /* #else #ifdef RCU_TREE_NONCORE */
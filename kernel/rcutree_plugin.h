@@ -27,9 +27,14 @@
 
 #ifdef CONFIG_TREE_PREEMPT_RCU
 
-struct rcu_state rcu_preempt_state = RCU_STATE_INITIALIZER(rcu_preempt_state);
+struct rcu_state rcu_preempt_state =
+	RCU_STATE_INITIALIZER(rcu_preempt_state, "rcu_preempt");
 DEFINE_PER_CPU(struct rcu_data, rcu_preempt_data);
 
+static DEFINE_MUTEX(sync_rcu_preempt_exp_mutex);
+static DECLARE_WAIT_QUEUE_HEAD(sync_rcu_preempt_exp_wq);
+static long sync_rcu_preempt_exp_count;
+
 /*
  * Tell them what RCU they are running.
  */
@@ -157,12 +162,27 @@ EXPORT_SYMBOL_GPL(__rcu_read_lock);
  */
 static int rcu_preempted_readers(struct rcu_node *rnp)
 {
-	return !list_empty(&rnp->blocked_tasks[rnp->gpnum & 0x1]);
+	int phase = rnp->gpnum & 0x1;
+
+	return !list_empty(&rnp->blocked_tasks[phase]) ||
+	       !list_empty(&rnp->blocked_tasks[phase + 2]);
+}
+
+/*
+ * Check for preempted RCU readers blocking the current expedited grace
+ * period for the specified rcu_node structure.  Same locking rules as
+ * for rcu_preempted_readers().
+ */
+static int rcu_preempted_readers_exp(struct rcu_node *rnp)
+{
+	return !list_empty(&rnp->blocked_tasks[2]) ||
+	       !list_empty(&rnp->blocked_tasks[3]);
 }
 
 static void rcu_read_unlock_special(struct task_struct *t)
 {
 	int empty;
+	int empty_exp;
 	unsigned long flags;
 	unsigned long mask;
 	struct rcu_node *rnp;
@@ -207,9 +227,20 @@ static void rcu_read_unlock_special(struct task_struct *t)
 			spin_unlock(&rnp->lock);  /* irqs remain disabled. */
 		}
 		empty = !rcu_preempted_readers(rnp);
+		empty_exp = !rcu_preempted_readers_exp(rnp);
 		list_del_init(&t->rcu_node_entry);
 		t->rcu_blocked_node = NULL;
 
+		/*
+		 * If this was the last task blocking an expedited grace
+		 * period here, wake up synchronize_rcu_expedited().  Not
+		 * if irqs were disabled on entry though: the caller might
+		 * hold a runqueue lock, so leave it to the waiter's timeout.
+		 */
+		if (!empty_exp && !rcu_preempted_readers_exp(rnp) &&
+		    !irqs_disabled_flags(flags))
+			wake_up(&sync_rcu_preempt_exp_wq);
+
 		/*
 		 * If this was the last task on the current list, and if
 		 * we aren't waiting on any CPUs, report the quiescent state.
@@ -274,6 +305,9 @@ static void rcu_print_task_stall(struct rcu_node *rnp)
 		spin_lock_irqsave(&rnp->lock, flags);
 		phase = rnp->gpnum & 0x1;
 		lp = &rnp->blocked_tasks[phase];
+		list_for_each_entry(t, lp, rcu_node_entry)
+			printk(" P%d", t->pid);
+		lp = &rnp->blocked_tasks[phase + 2];
 		list_for_each_entry(t, lp, rcu_node_entry)
 			printk(" P%d", t->pid);
 		spin_unlock_irqrestore(&rnp->lock, flags);
@@ -326,15 +360,18 @@ static int rcu_preempt_offline_tasks(struct rcu_state *rsp,
 	}
 	WARN_ON_ONCE(rnp != rdp->mynode &&
 		     (!list_empty(&rnp->blocked_tasks[0]) ||
-		      !list_empty(&rnp->blocked_tasks[1])));
+		      !list_empty(&rnp->blocked_tasks[1]) ||
+		      !list_empty(&rnp->blocked_tasks[2]) ||
+		      !list_empty(&rnp->blocked_tasks[3])));
 
 	/*
 	 * Move tasks up to root rcu_node.  Rely on the fact that the
 	 * root rcu_node can be at most one ahead of the rest of the
 	 * rcu_nodes in terms of gp_num value.  This fact allows us to
-	 * move the blocked_tasks[] array directly, element by element.
+	 * move the blocked_tasks[] array directly, element by element,
+	 * and the expedited elements stay visible to the waiter.
 	 */
-	for (i = 0; i < 2; i++) {
+	for (i = 0; i < 4; i++) {
 		lp = &rnp->blocked_tasks[i];
 		lp_root = &rnp_root->blocked_tasks[i];
 		while (!list_empty(lp)) {
@@ -399,13 +436,78 @@ void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 EXPORT_SYMBOL_GPL(call_rcu);
 
 /*
- * Wait for an rcu-preempt grace period.  We are supposed to expedite the
- * grace period, but this is the crude slow compatability hack, so just
- * invoke synchronize_rcu().
+ * Has every reader snapshotted by synchronize_rcu_expedited() left its
+ * RCU read-side critical section?
+ */
+static int sync_rcu_preempt_exp_done(struct rcu_state *rsp)
+{
+	struct rcu_node *rnp;
+
+	rcu_for_each_node_breadth_first(rsp, rnp)
+		if (rcu_preempted_readers_exp(rnp))
+			return 0;
+	return 1;
+}
+
+/*
+ * Wait for an rcu-preempt grace period, but expedite it.  The basic idea
+ * is to invoke synchronize_sched_expedited() to push all the tasks running
+ * an RCU read-side critical section onto the ->blocked_tasks[] lists, then
+ * to move those lists to the expedited elements and wait for them to
+ * drain.  Readers that block later started after this call, so they are
+ * not waited for.  Callers that find that an expedited grace period began
+ * and ended after they arrived just share its result.
  */
 void synchronize_rcu_expedited(void)
 {
-	synchronize_rcu();
+	unsigned long flags;
+	struct rcu_node *rnp;
+	struct rcu_state *rsp = &rcu_preempt_state;
+	long snap;
+
+	smp_mb(); /* Caller's modifications seen first by other CPUs. */
+	snap = ACCESS_ONCE(sync_rcu_preempt_exp_count) + 1;
+	smp_mb(); /* Above access cannot bleed into critical section. */
+
+	mutex_lock(&sync_rcu_preempt_exp_mutex);
+	if ((long)(ACCESS_ONCE(sync_rcu_preempt_exp_count) - snap) > 0) {
+		rsp->n_exp_shared++;
+		goto unlock_mb_ret; /* Others did our work for us. */
+	}
+
+	/* Force all RCU readers onto blocked_tasks[]. */
+	synchronize_sched_expedited();
+
+	/*
+	 * Snapshot the blocked readers.  The ->onofflock keeps CPU-hotplug
+	 * operations from migrating tasks between rcu_node structures
+	 * behind our back.
+	 */
+	spin_lock_irqsave(&rsp->onofflock, flags);
+	rcu_for_each_node_breadth_first(rsp, rnp) {
+		spin_lock(&rnp->lock); /* irqs already disabled. */
+		list_splice_init(&rnp->blocked_tasks[0],
+				 &rnp->blocked_tasks[2]);
+		list_splice_init(&rnp->blocked_tasks[1],
+				 &rnp->blocked_tasks[3]);
+		spin_unlock(&rnp->lock); /* irqs remain disabled. */
+	}
+	spin_unlock_irqrestore(&rsp->onofflock, flags);
+
+	/*
+	 * Wait for the snapshotted readers.  rcu_read_unlock_special()
+	 * cannot always wake us up, so also poll every jiffy.
+	 */
+	while (!wait_event_timeout(sync_rcu_preempt_exp_wq,
+				   sync_rcu_preempt_exp_done(rsp), 1))
+		continue;
+
+	smp_mb(); /* Readers' accesses seen before our count update. */
+	rsp->n_exp_gps++;
+	ACCESS_ONCE(sync_rcu_preempt_exp_count)++;
+unlock_mb_ret:
+	mutex_unlock(&sync_rcu_preempt_exp_mutex);
+	smp_mb(); /* ensure subsequent action seen after grace period. */
 }
 EXPORT_SYMBOL_GPL(synchronize_rcu_expedited);
 
@@ -444,6 +546,28 @@ static void __cpuinit rcu_preempt_init_percpu_data(int cpu)
 	rcu_init_percpu_data(cpu, &rcu_preempt_state, 1);
 }
 
+#ifdef CONFIG_RCU_CB_OFFLOAD
+
+/*
+ * Does the specified CPU have preemptable-RCU callbacks ready to invoke?
+ */
+static int rcu_preempt_cbs_ready(int cpu)
+{
+	return cpu_has_callbacks_ready_to_invoke(&per_cpu(rcu_preempt_data,
+							  cpu));
+}
+
+/*
+ * Invoke a batch of preemptable-RCU callbacks from the rcuc kthread.
+ */
+static int rcu_preempt_offload_batch(int cpu)
+{
+	return rcu_offload_batch(&rcu_preempt_state,
+				 &per_cpu(rcu_preempt_data, cpu));
+}
+
+#endif /* #ifdef CONFIG_RCU_CB_OFFLOAD */
+
 /*
  * Move preemptable RCU's callbacks to ->orphan_cbs_list.
  */
@@ -628,6 +752,27 @@ static void __cpuinit rcu_preempt_init_percpu_data(int cpu)
 {
 }
 
+#ifdef CONFIG_RCU_CB_OFFLOAD
+
+/*
+ * Because preemptable RCU does not exist, it never has callbacks ready.
+ */
+static int rcu_preempt_cbs_ready(int cpu)
+{
+	return 0;
+}
+
+/*
+ * Because preemptable RCU does not exist, it never has callbacks to
+ * invoke from the rcuc kthread.
+ */
+static int rcu_preempt_offload_batch(int cpu)
+{
+	return 0;
+}
+
+#endif /* #ifdef CONFIG_RCU_CB_OFFLOAD */
+
 /*
  * Because there is no preemptable RCU, there are no callbacks to move.
  */
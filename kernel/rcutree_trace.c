@@ -64,7 +64,13 @@ static void print_one_rcu_data(struct seq_file *m, struct rcu_data *rdp)
 		   rdp->dynticks_fqs);
 #endif /* #ifdef CONFIG_NO_HZ */
 	seq_printf(m, " of=%lu ri=%lu", rdp->offline_fqs, rdp->resched_ipi);
-	seq_printf(m, " ql=%ld b=%ld\n", rdp->qlen, rdp->blimit);
+	seq_printf(m, " ql=%ld qlm=%ld b=%ld ci=%lu nb=%lu",
+		   rdp->qlen, rdp->qlen_max, rdp->blimit,
+		   rdp->n_cbs_invoked, rdp->n_batches);
+#ifdef CONFIG_RCU_CB_OFFLOAD
+	seq_printf(m, " co=%lu", rdp->n_cbs_offloaded);
+#endif /* #ifdef CONFIG_RCU_CB_OFFLOAD */
+	seq_puts(m, "\n");
 }
 
 #define PRINT_RCU_DATA(name, func, m) \
@@ -119,7 +125,13 @@ static void print_one_rcu_data_csv(struct seq_file *m, struct rcu_data *rdp)
 		   rdp->dynticks_fqs);
 #endif /* #ifdef CONFIG_NO_HZ */
 	seq_printf(m, ",%lu,%lu", rdp->offline_fqs, rdp->resched_ipi);
-	seq_printf(m, ",%ld,%ld\n", rdp->qlen, rdp->blimit);
+	seq_printf(m, ",%ld,%ld,%ld,%lu,%lu",
+		   rdp->qlen, rdp->qlen_max, rdp->blimit,
+		   rdp->n_cbs_invoked, rdp->n_batches);
+#ifdef CONFIG_RCU_CB_OFFLOAD
+	seq_printf(m, ",%lu", rdp->n_cbs_offloaded);
+#endif /* #ifdef CONFIG_RCU_CB_OFFLOAD */
+	seq_puts(m, "\n");
 }
 
 static int show_rcudata_csv(struct seq_file *m, void *unused)
@@ -128,7 +140,11 @@ static int show_rcudata_csv(struct seq_file *m, void *unused)
 #ifdef CONFIG_NO_HZ
 	seq_puts(m, "\"dt\",\"dt nesting\",\"dn\",\"df\",");
 #endif /* #ifdef CONFIG_NO_HZ */
-	seq_puts(m, "\"of\",\"ri\",\"ql\",\"b\"\n");
+	seq_puts(m, "\"of\",\"ri\",\"ql\",\"qlm\",\"b\",\"ci\",\"nb\"");
+#ifdef CONFIG_RCU_CB_OFFLOAD
+	seq_puts(m, ",\"co\"");
+#endif /* #ifdef CONFIG_RCU_CB_OFFLOAD */
+	seq_puts(m, "\n");
 #ifdef CONFIG_TREE_PREEMPT_RCU
 	seq_puts(m, "\"rcu_preempt:\"\n");
 	PRINT_RCU_DATA(rcu_preempt_data, print_one_rcu_data_csv, m);
@@ -204,16 +220,27 @@ static const struct file_operations rcuhier_fops = {
 	.release = single_release,
 };
 
+static void print_one_rcu_gp(struct seq_file *m, struct rcu_state *rsp)
+{
+	unsigned long n_gps = rsp->n_gps;
+
+	seq_printf(m, "%s: completed=%ld  gpnum=%ld  "
+		      "ngp=%lu last=%lu max=%lu avg=%lu\n",
+		   rsp->name, rsp->completed, rsp->gpnum, n_gps,
+		   rsp->gp_last, rsp->gp_max,
+		   n_gps ? rsp->gp_total / n_gps : 0);
+}
+
 static int show_rcugp(struct seq_file *m, void *unused)
 {
 #ifdef CONFIG_TREE_PREEMPT_RCU
-	seq_printf(m, "rcu_preempt: completed=%ld  gpnum=%ld\n",
-		   rcu_preempt_state.completed, rcu_preempt_state.gpnum);
+	print_one_rcu_gp(m, &rcu_preempt_state);
+	seq_printf(m, "rcu_preempt_exp: ngp=%lu shared=%lu\n",
+		   rcu_preempt_state.n_exp_gps,
+		   rcu_preempt_state.n_exp_shared);
 #endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
-	seq_printf(m, "rcu_sched: completed=%ld  gpnum=%ld\n",
-		   rcu_sched_state.completed, rcu_sched_state.gpnum);
-	seq_printf(m, "rcu_bh: completed=%ld  gpnum=%ld\n",
-		   rcu_bh_state.completed, rcu_bh_state.gpnum);
+	print_one_rcu_gp(m, &rcu_sched_state);
+	print_one_rcu_gp(m, &rcu_bh_state);
 	return 0;
 }
 
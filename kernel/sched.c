@@ -71,11 +71,13 @@
 #include <linux/debugfs.h>
 #include <linux/ctype.h>
 #include <linux/ftrace.h>
+#include <linux/psrwlock-types.h>
 
 #include <asm/tlb.h>
 #include <asm/irq_regs.h>
 
 #include "sched_cpupri.h"
+#include "workqueue_sched.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/sched.h>
@@ -2421,6 +2423,9 @@ out_activate:
 	activate_task(rq, p, 1);
 	success = 1;
 
+	if (p->flags & PF_WQ_WORKER)
+		wq_worker_waking_up(p);
+
 	/*
 	 * Only attribute actual wakeups done by this task.
 	 */
@@ -2464,6 +2469,41 @@ out:
 	return success;
 }
 
+/**
+ * try_to_wake_up_local - try to wake up a local task with rq lock held
+ * @p: the thread to be awakened
+ *
+ * Put @p on the run-queue if it's not already there. The caller must
+ * ensure that this_rq() is locked, @p is bound to this_rq() and not
+ * the current task. this_rq() stays locked over invocation.
+ */
+static void try_to_wake_up_local(struct task_struct *p)
+{
+	struct rq *rq = task_rq(p);
+
+	BUG_ON(rq != this_rq());
+	BUG_ON(p == current);
+	lockdep_assert_held(&rq->lock);
+
+	if (!(p->state & TASK_NORMAL) || p->se.on_rq)
+		return;
+
+	if (task_contributes_to_load(p))
+		rq->nr_uninterruptible--;
+	schedstat_inc(p, se.nr_wakeups);
+	schedstat_inc(p, se.nr_wakeups_local);
+	activate_task(rq, p, 1);
+
+	trace_sched_wakeup(rq, p, 1);
+	check_preempt_curr(rq, p, 0);
+
+	p->state = TASK_RUNNING;
+#ifdef CONFIG_SMP
+	if (p->sched_class->task_wake_up)
+		p->sched_class->task_wake_up(rq, p);
+#endif
+}
+
 /**
  * wake_up_process - Wake up a specific process
  * @p: The process to be woken up.
@@ -5477,10 +5517,23 @@ need_resched_nonpreemptible:
 	clear_tsk_need_resched(prev);
 
 	if (prev->state && !(preempt_count() & PREEMPT_ACTIVE)) {
-		if (unlikely(signal_pending_state(prev->state, prev)))
+		if (unlikely(signal_pending_state(prev->state, prev))) {
 			prev->state = TASK_RUNNING;
-		else
+		} else {
+			/*
+			 * If a worker of the shared workqueue pool is going
+			 * to sleep, notify and ask the pool whether it wants
+			 * to wake up another worker to keep the CPU busy.
+			 */
+			if (prev->flags & PF_WQ_WORKER) {
+				struct task_struct *to_wakeup;
+
+				to_wakeup = wq_worker_sleeping(prev, cpu);
+				if (to_wakeup)
+					try_to_wake_up_local(to_wakeup);
+			}
 			deactivate_task(rq, prev, 1);
+		}
 		switch_count = &prev->nvcsw;
 	}
 
@@ -5526,7 +5579,8 @@ EXPORT_SYMBOL(schedule);
  * Look out! "owner" is an entirely speculative pointer
  * access and not reliable.
  */
-int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
+static int spin_on_owner(struct thread_info **lock_owner,
+			 struct thread_info *owner)
 {
 	unsigned int cpu;
 	struct rq *rq;
@@ -5538,7 +5592,7 @@ int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
 	/*
 	 * Need to access the cpu field knowing that
 	 * DEBUG_PAGEALLOC could have unmapped it if
-	 * the mutex owner just released it and exited.
+	 * the lock owner just released it and exited.
 	 */
 	if (probe_kernel_address(&owner->cpu, cpu))
 		goto out;
@@ -5566,7 +5620,7 @@ int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
 		/*
 		 * Owner changed, break to re-assess state.
 		 */
-		if (lock->owner != owner)
+		if (ACCESS_ONCE(*lock_owner) != owner)
 			break;
 
 		/*
@@ -5580,6 +5634,22 @@ int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
 out:
 	return 1;
 }
+
+int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
+{
+	return spin_on_owner(&lock->owner, owner);
+}
+
+#ifndef CONFIG_DEBUG_PSRWLOCK
+/*
+ * Returns 0 if the psrwlock writer "owner" is not running, in which case the
+ * caller should sleep, or 1 when the lock owner changed.
+ */
+int psrwlock_spin_on_owner(struct psrwlock *lock, struct thread_info *owner)
+{
+	return spin_on_owner(&lock->owner, owner);
+}
+#endif
 #endif
 
 #ifdef CONFIG_PREEMPT
@@ -20,11 +20,6 @@
 #define ITERATOR_SELECTOR	(0xfUL << ITERATOR_SHIFT)
 #define ITERATOR_COUNTER	(~ITERATOR_SELECTOR)
 
-void slow_work_new_thread_desc(struct slow_work *work, struct seq_file *m)
-{
-	seq_puts(m, "Slow-work: New thread");
-}
-
 /*
  * Render the time mark field on a work item into a 5-char time with units plus
  * a space
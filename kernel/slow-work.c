@@ -13,28 +13,20 @@
 
 #include <linux/module.h>
 #include <linux/slow-work.h>
-#include <linux/kthread.h>
-#include <linux/freezer.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
 #include <linux/wait.h>
 #include <linux/debugfs.h>
+#include <linux/suspend.h>
 #include "slow-work.h"
 
-static void slow_work_cull_timeout(unsigned long);
-static void slow_work_oom_timeout(unsigned long);
-
-#ifdef CONFIG_SYSCTL
-static int slow_work_min_threads_sysctl(struct ctl_table *, int,
-					void __user *, size_t *, loff_t *);
-
-static int slow_work_max_threads_sysctl(struct ctl_table *, int ,
-					void __user *, size_t *, loff_t *);
-#endif
-
 /*
- * The pool of threads has at least min threads in it as long as someone is
- * using the facility, and may have as many as max.
+ * The items are processed by runners, works queued on the shared worker pool
+ * of the workqueues.  Runners are started on demand, up to max of them, and
+ * finish as soon as there is nothing left for them to do.  The min setting is
+ * only kept for compatibility.
  *
- * A portion of the pool may be processing very slow operations.
+ * A portion of the runners may be processing very slow operations.
  */
 static unsigned slow_work_min_threads = 2;
 static unsigned slow_work_max_threads = 4;
@@ -54,7 +46,7 @@ ctl_table slow_work_sysctls[] = {
 		.data		= &slow_work_min_threads,
 		.maxlen		= sizeof(unsigned),
 		.mode		= 0644,
-		.proc_handler	= slow_work_min_threads_sysctl,
+		.proc_handler	= proc_dointvec_minmax,
 		.extra1		= (void *) &slow_work_min_min_threads,
 		.extra2		= &slow_work_max_threads,
 	},
@@ -64,7 +56,7 @@ ctl_table slow_work_sysctls[] = {
 		.data		= &slow_work_max_threads,
 		.maxlen		= sizeof(unsigned),
 		.mode		= 0644,
-		.proc_handler	= slow_work_max_threads_sysctl,
+		.proc_handler	= proc_dointvec_minmax,
 		.extra1		= &slow_work_min_threads,
 		.extra2		= (void *) &slow_work_max_max_threads,
 	},
@@ -83,21 +75,27 @@ ctl_table slow_work_sysctls[] = {
 #endif
 
 /*
- * The active state of the thread pool
+ * The active state of the runners
  */
 static atomic_t slow_work_thread_count;
 static atomic_t vslow_work_executing_count;
 
-static bool slow_work_may_not_start_new_thread;
-static bool slow_work_cull; /* cull a thread due to lack of activity */
-static DEFINE_TIMER(slow_work_cull_timer, slow_work_cull_timeout, 0, 0);
-static DEFINE_TIMER(slow_work_oom_timer, slow_work_oom_timeout, 0, 0);
-static struct slow_work slow_work_new_thread; /* new thread starter */
-
 /*
- * slow work ID allocation (use slow_work_queue_lock)
+ * slow work ID allocation, and the number of runners which are not executing
+ * an item and will look at the queues again (use slow_work_queue_lock)
  */
 static DECLARE_BITMAP(slow_work_ids, SLOW_WORK_THREAD_LIMIT);
+static unsigned slow_work_runners_looking;
+
+/*
+ * Set across suspend and hibernation: the runners are not frozen like the
+ * former threads were, so they retire instead and none is started (use
+ * slow_work_queue_lock)
+ */
+static bool slow_work_frozen;
+
+/* the runner works, indexed by ID */
+static struct work_struct slow_work_runners[SLOW_WORK_THREAD_LIMIT];
 
 /*
  * Unregistration tracking to prevent put_ref() from disappearing during module
@@ -166,18 +164,13 @@ static DECLARE_WAIT_QUEUE_HEAD(slow_work_queue_waits_for_occupation);
 static DECLARE_WAIT_QUEUE_HEAD(vslow_work_queue_waits_for_occupation);
 
 /*
- * The thread controls.  A variable used to signal to the threads that they
- * should exit when the queue is empty, a waitqueue used by the threads to wait
- * for signals, and a completion set by the last thread to exit.
+ * A waitqueue pinged when the last runner finishes.
  */
-static bool slow_work_threads_should_exit;
 static DECLARE_WAIT_QUEUE_HEAD(slow_work_thread_wq);
-static DECLARE_COMPLETION(slow_work_last_thread_exited);
 
 /*
- * The number of users of the thread pool and its lock.  Whilst this is zero we
- * have no threads hanging around, and when this reaches zero, we wait for all
- * active or queued work items to complete and kill all the threads we do have.
+ * The number of users of the facility and its lock.  When this reaches zero,
+ * we wait for the remaining runners to finish.
  */
 static int slow_work_user_count;
 static DEFINE_MUTEX(slow_work_user_lock);
@@ -197,27 +190,49 @@ static inline void slow_work_put_ref(struct slow_work *work)
 }
 
 /*
- * Calculate the maximum number of active threads in the pool that are
- * permitted to process very slow work items.
+ * Calculate the maximum number of runners that are permitted to process very
+ * slow work items.
  *
  * The answer is rounded up to at least 1, but may not equal or exceed the
- * maximum number of the threads in the pool.  This means we always have at
- * least one thread that can process slow work items, and we always have at
- * least one thread that won't get tied up doing so.
+ * maximum number of runners.  This means we always have at least one runner
+ * that can process slow work items, and we always have at least one runner
+ * that won't get tied up doing so.
  */
 static unsigned slow_work_calc_vsmax(void)
 {
 	unsigned vsmax;
 
-	vsmax = atomic_read(&slow_work_thread_count) * vslow_work_proportion;
+	vsmax = slow_work_max_threads * vslow_work_proportion;
 	vsmax /= 100;
 	vsmax = max(vsmax, 1U);
 	return min(vsmax, slow_work_max_threads - 1);
 }
 
 /*
- * Attempt to execute stuff queued on a slow thread.  Return true if we managed
- * it, false if there was nothing to do.
+ * Start a new runner if items are waiting and no runner is going to look at
+ * the queues, unless we're at the limit.  Called with slow_work_queue_lock
+ * held.
+ */
+static void slow_work_start_runner(void)
+{
+	int id;
+
+	if (slow_work_runners_looking || slow_work_frozen ||
+	    atomic_read(&slow_work_thread_count) >= slow_work_max_threads)
+		return;
+
+	id = find_first_zero_bit(slow_work_ids, SLOW_WORK_THREAD_LIMIT);
+	if (id >= SLOW_WORK_THREAD_LIMIT)
+		return;
+	__set_bit(id, slow_work_ids);
+	slow_work_runners_looking++;
+	atomic_inc(&slow_work_thread_count);
+	queue_pool_work_on(raw_smp_processor_id(), &slow_work_runners[id]);
+}
+
+/*
+ * Attempt to execute stuff queued on a runner.  Return true if we managed it,
+ * false if there was nothing to do, in which case the runner is retired.
  */
 static noinline bool slow_work_execute(int id)
 {
@@ -227,17 +242,9 @@ static noinline bool slow_work_execute(int id)
 
 	vsmax = slow_work_calc_vsmax();
 
-	/* see if we can schedule a new thread to be started if we're not
-	 * keeping up with the work */
-	if (!waitqueue_active(&slow_work_thread_wq) &&
-	    (!list_empty(&slow_work_queue) || !list_empty(&vslow_work_queue)) &&
-	    atomic_read(&slow_work_thread_count) < slow_work_max_threads &&
-	    !slow_work_may_not_start_new_thread)
-		slow_work_enqueue(&slow_work_new_thread);
-
 	/* find something to execute */
 	spin_lock_irq(&slow_work_queue_lock);
-	if (!list_empty(&vslow_work_queue) &&
+	if (!slow_work_frozen && !list_empty(&vslow_work_queue) &&
 	    atomic_read(&vslow_work_executing_count) < vsmax) {
 		work = list_entry(vslow_work_queue.next,
 				  struct slow_work, link);
@@ -246,7 +253,7 @@ static noinline bool slow_work_execute(int id)
 		list_del_init(&work->link);
 		atomic_inc(&vslow_work_executing_count);
 		very_slow = true;
-	} else if (!list_empty(&slow_work_queue)) {
+	} else if (!slow_work_frozen && !list_empty(&slow_work_queue)) {
 		work = list_entry(slow_work_queue.next,
 				  struct slow_work, link);
 		if (test_and_set_bit_lock(SLOW_WORK_EXECUTING, &work->flags))
@@ -254,20 +261,25 @@ static noinline bool slow_work_execute(int id)
 		list_del_init(&work->link);
 		very_slow = false;
 	} else {
-		very_slow = false; /* avoid the compiler warning */
+		/* retire, whilst still holding the lock so that an enqueuer
+		 * either sees us looking or starts another runner */
+		slow_work_runners_looking--;
+		slow_work_set_thread_pid(id, 0);
+		__clear_bit(id, slow_work_ids);
+		spin_unlock_irq(&slow_work_queue_lock);
+
+		if (atomic_dec_and_test(&slow_work_thread_count))
+			wake_up_all(&slow_work_thread_wq);
+		return false;
 	}
 
+	slow_work_runners_looking--;
 	slow_work_set_thread_processing(id, work);
-	if (work) {
-		slow_work_mark_time(work);
-		slow_work_begin_exec(id, work);
-	}
+	slow_work_mark_time(work);
+	slow_work_begin_exec(id, work);
 
 	spin_unlock_irq(&slow_work_queue_lock);
 
-	if (!work)
-		return false;
-
 	if (!test_and_clear_bit(SLOW_WORK_PENDING, &work->flags))
 		BUG();
 
@@ -293,15 +305,15 @@ static noinline bool slow_work_execute(int id)
 	 * flag and getting the spinlock, so we use a deferral bit to tell us
 	 * if the enqueuer got there first
 	 */
-	if (test_bit(SLOW_WORK_PENDING, &work->flags)) {
-		spin_lock_irq(&slow_work_queue_lock);
+	spin_lock_irq(&slow_work_queue_lock);
+	slow_work_runners_looking++;
 
-		if (!test_bit(SLOW_WORK_EXECUTING, &work->flags) &&
-		    test_and_clear_bit(SLOW_WORK_ENQ_DEFERRED, &work->flags))
-			goto auto_requeue;
+	if (test_bit(SLOW_WORK_PENDING, &work->flags) &&
+	    !test_bit(SLOW_WORK_EXECUTING, &work->flags) &&
+	    test_and_clear_bit(SLOW_WORK_ENQ_DEFERRED, &work->flags))
+		goto auto_requeue;
 
-		spin_unlock_irq(&slow_work_queue_lock);
-	}
+	spin_unlock_irq(&slow_work_queue_lock);
 
 	/* sort out the race between module unloading and put_ref() */
 	slow_work_put_ref(work);
@@ -312,7 +324,7 @@ static noinline bool slow_work_execute(int id)
 auto_requeue:
 	/* we must complete the enqueue operation
 	 * - we transfer our ref on the item back to the appropriate queue
-	 * - don't wake another thread up as we're awake already
+	 * - don't start another runner as we're about to look ourselves
 	 */
 	slow_work_mark_time(work);
 	if (test_bit(SLOW_WORK_VERY_SLOW, &work->flags))
@@ -324,6 +336,18 @@ auto_requeue:
 	return true;
 }
 
+/*
+ * Runner dispatcher, executes items until there is nothing left for it
+ */
+static void slow_work_runner(struct work_struct *runner)
+{
+	int id = runner - slow_work_runners;
+
+	slow_work_set_thread_pid(id, current->pid);
+	while (slow_work_execute(id))
+		cond_resched();
+}
+
 /**
  * slow_work_sleep_till_thread_needed - Sleep till thread needed by other work
  * work: The work item under execution that wants to sleep
@@ -454,7 +478,7 @@ int slow_work_enqueue(struct slow_work *work)
 				goto failed;
 			slow_work_mark_time(work);
 			list_add_tail(&work->link, queue);
-			wake_up(&slow_work_thread_wq);
+			slow_work_start_runner();
 
 			/* if someone who could be requeued is sleeping on a
 			 * thread, then ask them to yield their thread */
@@ -566,7 +590,7 @@ static void delayed_slow_work_timer(unsigned long data)
 	struct list_head *queue;
 	struct slow_work *work = (struct slow_work *) data;
 	unsigned long flags;
-	bool queued = false, put = false, first = false;
+	bool put = false, first = false;
 
 	if (test_bit(SLOW_WORK_VERY_SLOW, &work->flags)) {
 		wfo_wq = &vslow_work_queue_waits_for_occupation;
@@ -588,7 +612,7 @@ static void delayed_slow_work_timer(unsigned long data)
 		} else {
 			slow_work_mark_time(work);
 			list_add_tail(&work->link, queue);
-			queued = true;
+			slow_work_start_runner();
 			if (work->link.prev == queue)
 				first = true;
 		}
@@ -599,8 +623,6 @@ static void delayed_slow_work_timer(unsigned long data)
 		slow_work_put_ref(work);
 	if (first)
 		wake_up(wfo_wq);
-	if (queued)
-		wake_up(&slow_work_thread_wq);
 }
 
 /**
@@ -664,286 +686,19 @@ cant_get_ref:
 }
 EXPORT_SYMBOL(delayed_slow_work_enqueue);
 
-/*
- * Schedule a cull of the thread pool at some time in the near future
- */
-static void slow_work_schedule_cull(void)
-{
-	mod_timer(&slow_work_cull_timer,
-		  round_jiffies(jiffies + SLOW_WORK_CULL_TIMEOUT));
-}
-
-/*
- * Worker thread culling algorithm
- */
-static bool slow_work_cull_thread(void)
-{
-	unsigned long flags;
-	bool do_cull = false;
-
-	spin_lock_irqsave(&slow_work_queue_lock, flags);
-
-	if (slow_work_cull) {
-		slow_work_cull = false;
-
-		if (list_empty(&slow_work_queue) &&
-		    list_empty(&vslow_work_queue) &&
-		    atomic_read(&slow_work_thread_count) >
-		    slow_work_min_threads) {
-			slow_work_schedule_cull();
-			do_cull = true;
-		}
-	}
-
-	spin_unlock_irqrestore(&slow_work_queue_lock, flags);
-	return do_cull;
-}
-
-/*
- * Determine if there is slow work available for dispatch
- */
-static inline bool slow_work_available(int vsmax)
-{
-	return !list_empty(&slow_work_queue) ||
-		(!list_empty(&vslow_work_queue) &&
-		 atomic_read(&vslow_work_executing_count) < vsmax);
-}
-
-/*
- * Worker thread dispatcher
- */
-static int slow_work_thread(void *_data)
-{
-	int vsmax, id;
-
-	DEFINE_WAIT(wait);
-
-	set_freezable();
-	set_user_nice(current, -5);
-
-	/* allocate ourselves an ID */
-	spin_lock_irq(&slow_work_queue_lock);
-	id = find_first_zero_bit(slow_work_ids, SLOW_WORK_THREAD_LIMIT);
-	BUG_ON(id < 0 || id >= SLOW_WORK_THREAD_LIMIT);
-	__set_bit(id, slow_work_ids);
-	slow_work_set_thread_pid(id, current->pid);
-	spin_unlock_irq(&slow_work_queue_lock);
-
-	sprintf(current->comm, "kslowd%03u", id);
-
-	for (;;) {
-		vsmax = vslow_work_proportion;
-		vsmax *= atomic_read(&slow_work_thread_count);
-		vsmax /= 100;
-
-		prepare_to_wait_exclusive(&slow_work_thread_wq, &wait,
-					  TASK_INTERRUPTIBLE);
-		if (!freezing(current) &&
-		    !slow_work_threads_should_exit &&
-		    !slow_work_available(vsmax) &&
-		    !slow_work_cull)
-			schedule();
-		finish_wait(&slow_work_thread_wq, &wait);
-
-		try_to_freeze();
-
-		vsmax = vslow_work_proportion;
-		vsmax *= atomic_read(&slow_work_thread_count);
-		vsmax /= 100;
-
-		if (slow_work_available(vsmax) && slow_work_execute(id)) {
-			cond_resched();
-			if (list_empty(&slow_work_queue) &&
-			    list_empty(&vslow_work_queue) &&
-			    atomic_read(&slow_work_thread_count) >
-			    slow_work_min_threads)
-				slow_work_schedule_cull();
-			continue;
-		}
-
-		if (slow_work_threads_should_exit)
-			break;
-
-		if (slow_work_cull && slow_work_cull_thread())
-			break;
-	}
-
-	spin_lock_irq(&slow_work_queue_lock);
-	slow_work_set_thread_pid(id, 0);
-	__clear_bit(id, slow_work_ids);
-	spin_unlock_irq(&slow_work_queue_lock);
-
-	if (atomic_dec_and_test(&slow_work_thread_count))
-		complete_and_exit(&slow_work_last_thread_exited, 0);
-	return 0;
-}
-
-/*
- * Handle thread cull timer expiration
- */
-static void slow_work_cull_timeout(unsigned long data)
-{
-	slow_work_cull = true;
-	wake_up(&slow_work_thread_wq);
-}
-
-/*
- * Start a new slow work thread
- */
-static void slow_work_new_thread_execute(struct slow_work *work)
-{
-	struct task_struct *p;
-
-	if (slow_work_threads_should_exit)
-		return;
-
-	if (atomic_read(&slow_work_thread_count) >= slow_work_max_threads)
-		return;
-
-	if (!mutex_trylock(&slow_work_user_lock))
-		return;
-
-	slow_work_may_not_start_new_thread = true;
-	atomic_inc(&slow_work_thread_count);
-	p = kthread_run(slow_work_thread, NULL, "kslowd");
-	if (IS_ERR(p)) {
-		printk(KERN_DEBUG "Slow work thread pool: OOM\n");
-		if (atomic_dec_and_test(&slow_work_thread_count))
-			BUG(); /* we're running on a slow work thread... */
-		mod_timer(&slow_work_oom_timer,
-			  round_jiffies(jiffies + SLOW_WORK_OOM_TIMEOUT));
-	} else {
-		/* ratelimit the starting of new threads */
-		mod_timer(&slow_work_oom_timer, jiffies + 1);
-	}
-
-	mutex_unlock(&slow_work_user_lock);
-}
-
-static const struct slow_work_ops slow_work_new_thread_ops = {
-	.owner		= THIS_MODULE,
-	.execute	= slow_work_new_thread_execute,
-#ifdef CONFIG_SLOW_WORK_DEBUG
-	.desc		= slow_work_new_thread_desc,
-#endif
-};
-
-/*
- * post-OOM new thread start suppression expiration
- */
-static void slow_work_oom_timeout(unsigned long data)
-{
-	slow_work_may_not_start_new_thread = false;
-}
-
-#ifdef CONFIG_SYSCTL
-/*
- * Handle adjustment of the minimum number of threads
- */
-static int slow_work_min_threads_sysctl(struct ctl_table *table, int write,
-					void __user *buffer,
-					size_t *lenp, loff_t *ppos)
-{
-	int ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
-	int n;
-
-	if (ret == 0) {
-		mutex_lock(&slow_work_user_lock);
-		if (slow_work_user_count > 0) {
-			/* see if we need to start or stop threads */
-			n = atomic_read(&slow_work_thread_count) -
-				slow_work_min_threads;
-
-			if (n < 0 && !slow_work_may_not_start_new_thread)
-				slow_work_enqueue(&slow_work_new_thread);
-			else if (n > 0)
-				slow_work_schedule_cull();
-		}
-		mutex_unlock(&slow_work_user_lock);
-	}
-
-	return ret;
-}
-
-/*
- * Handle adjustment of the maximum number of threads
- */
-static int slow_work_max_threads_sysctl(struct ctl_table *table, int write,
-					void __user *buffer,
-					size_t *lenp, loff_t *ppos)
-{
-	int ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
-	int n;
-
-	if (ret == 0) {
-		mutex_lock(&slow_work_user_lock);
-		if (slow_work_user_count > 0) {
-			/* see if we need to stop threads */
-			n = slow_work_max_threads -
-				atomic_read(&slow_work_thread_count);
-
-			if (n < 0)
-				slow_work_schedule_cull();
-		}
-		mutex_unlock(&slow_work_user_lock);
-	}
-
-	return ret;
-}
-#endif /* CONFIG_SYSCTL */
-
 /**
  * slow_work_register_user - Register a user of the facility
  * @module: The module about to make use of the facility
  *
- * Register a user of the facility, starting up the initial threads if there
- * aren't any other users at this point.  This will return 0 if successful, or
- * an error if not.
+ * Register a user of the facility.  The runners are started on demand, so
+ * this cannot fail; it returns 0.
  */
 int slow_work_register_user(struct module *module)
 {
-	struct task_struct *p;
-	int loop;
-
 	mutex_lock(&slow_work_user_lock);
-
-	if (slow_work_user_count == 0) {
-		printk(KERN_NOTICE "Slow work thread pool: Starting up\n");
-		init_completion(&slow_work_last_thread_exited);
-
-		slow_work_threads_should_exit = false;
-		slow_work_init(&slow_work_new_thread,
-			       &slow_work_new_thread_ops);
-		slow_work_may_not_start_new_thread = false;
-		slow_work_cull = false;
-
-		/* start the minimum number of threads */
-		for (loop = 0; loop < slow_work_min_threads; loop++) {
-			atomic_inc(&slow_work_thread_count);
-			p = kthread_run(slow_work_thread, NULL, "kslowd");
-			if (IS_ERR(p))
-				goto error;
-		}
-		printk(KERN_NOTICE "Slow work thread pool: Ready\n");
-	}
-
 	slow_work_user_count++;
 	mutex_unlock(&slow_work_user_lock);
 	return 0;
-
-error:
-	if (atomic_dec_and_test(&slow_work_thread_count))
-		complete(&slow_work_last_thread_exited);
-	if (loop > 0) {
-		printk(KERN_ERR "Slow work thread pool:"
-		       " Aborting startup on ENOMEM\n");
-		slow_work_threads_should_exit = true;
-		wake_up_all(&slow_work_thread_wq);
-		wait_for_completion(&slow_work_last_thread_exited);
-		printk(KERN_ERR "Slow work thread pool: Aborted\n");
-	}
-	mutex_unlock(&slow_work_user_lock);
-	return PTR_ERR(p);
 }
 EXPORT_SYMBOL(slow_work_register_user);
 
@@ -1007,8 +762,8 @@ static void slow_work_wait_for_items(struct module *module)
  * slow_work_unregister_user - Unregister a user of the facility
  * @module: The module whose items should be cleared
  *
- * Unregister a user of the facility, killing all the threads if this was the
- * last one.
+ * Unregister a user of the facility, waiting for the runners to finish if
+ * this was the last one.
  *
  * This waits for all the work items belonging to the nominated module to go
  * away before proceeding.
@@ -1027,27 +782,63 @@ void slow_work_unregister_user(struct module *module)
 	BUG_ON(slow_work_user_count <= 0);
 
 	slow_work_user_count--;
-	if (slow_work_user_count == 0) {
-		printk(KERN_NOTICE "Slow work thread pool: Shutting down\n");
-		slow_work_threads_should_exit = true;
-		del_timer_sync(&slow_work_cull_timer);
-		del_timer_sync(&slow_work_oom_timer);
-		wake_up_all(&slow_work_thread_wq);
-		wait_for_completion(&slow_work_last_thread_exited);
-		printk(KERN_NOTICE "Slow work thread pool:"
-		       " Shut down complete\n");
-	}
+	if (slow_work_user_count == 0)
+		wait_event(slow_work_thread_wq,
+			   !atomic_read(&slow_work_thread_count));
 
 	mutex_unlock(&slow_work_user_lock);
 }
 EXPORT_SYMBOL(slow_work_unregister_user);
 
+/*
+ * Keep the items from running whilst the system sleeps: no more runner is
+ * started and those running retire once done with their current item
+ */
+static int slow_work_pm_notify(struct notifier_block *nb,
+			       unsigned long action, void *ptr)
+{
+	switch (action) {
+	case PM_HIBERNATION_PREPARE:
+	case PM_SUSPEND_PREPARE:
+	case PM_RESTORE_PREPARE:
+		spin_lock_irq(&slow_work_queue_lock);
+		slow_work_frozen = true;
+		spin_unlock_irq(&slow_work_queue_lock);
+
+		if (!wait_event_timeout(slow_work_thread_wq,
+					!atomic_read(&slow_work_thread_count),
+					SLOW_WORK_FREEZE_TIMEOUT)) {
+			printk(KERN_ERR "Slow work: items still executing,"
+			       " cannot freeze\n");
+			return NOTIFY_BAD;
+		}
+		break;
+
+	case PM_POST_HIBERNATION:
+	case PM_POST_SUSPEND:
+	case PM_POST_RESTORE:
+		spin_lock_irq(&slow_work_queue_lock);
+		slow_work_frozen = false;
+		if (!list_empty(&slow_work_queue) ||
+		    !list_empty(&vslow_work_queue))
+			slow_work_start_runner();
+		spin_unlock_irq(&slow_work_queue_lock);
+		break;
+	}
+	return NOTIFY_DONE;
+}
+
 /*
  * Initialise the slow work facility
  */
 static int __init init_slow_work(void)
 {
 	unsigned nr_cpus = num_possible_cpus();
+	int id;
+
+	for (id = 0; id < SLOW_WORK_THREAD_LIMIT; id++)
+		INIT_WORK(&slow_work_runners[id], slow_work_runner);
+	pm_notifier(slow_work_pm_notify, 0);
 
 	if (slow_work_max_threads < nr_cpus)
 		slow_work_max_threads = nr_cpus;
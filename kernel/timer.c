@@ -59,6 +59,50 @@ DEFINE_TRACE(timer_set);
 DEFINE_TRACE(timer_update_time);
 DEFINE_TRACE(timer_timeout);
 
+#ifdef CONFIG_TIMER_WHEEL_NO_CASCADE
+/*
+ * Non-cascading timer wheel.
+ *
+ * The wheel has LVL_DEPTH levels of LVL_SIZE buckets. The granularity of each
+ * level is LVL_CLK_DIV times coarser than the one of the previous level. A
+ * timer is queued in the level covering its timeout, in the bucket of the
+ * first level tick at or after its expiry time, and is never moved again: it
+ * expires late by at most the level granularity. Timers are never re-hashed
+ * into lower levels, so __run_timers() cost only depends on the number of
+ * expiring timers.
+ *
+ * With HZ=1000 and LVL_BITS=6, level 0 has 1 ms granularity up to 63 ms,
+ * level 1 has 8 ms granularity up to 504 ms, ..., level 7 has 2097 s
+ * granularity up to about 37 hours. Longer timeouts are clamped to the
+ * capacity of the wheel.
+ */
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+#define LVL_BITS	(CONFIG_BASE_SMALL ? 4 : 6)
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+#define LVL_DEPTH	8
+#define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
+
+/* Timeout where level n starts */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+/* Larger timeouts are clamped to the wheel capacity */
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+
+struct tvec_base {
+	spinlock_t lock;
+	struct timer_list *running_timer;
+	unsigned long timer_jiffies;
+	unsigned long next_timer;
+	struct list_head vectors[WHEEL_SIZE];
+} ____cacheline_aligned;
+#else
 /*
  * per-CPU timer vector definitions:
  */
@@ -88,6 +132,7 @@ struct tvec_base {
 	struct tvec tv4;
 	struct tvec tv5;
 } ____cacheline_aligned;
+#endif /* CONFIG_TIMER_WHEEL_NO_CASCADE */
 
 struct tvec_base boot_tvec_bases;
 EXPORT_SYMBOL(boot_tvec_bases);
@@ -333,6 +378,45 @@ static inline void set_running_timer(struct tvec_base *base,
 #endif
 }
 
+#ifdef CONFIG_TIMER_WHEEL_NO_CASCADE
+/*
+ * Bucket of the first level tick at or after expires.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl)
+{
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	unsigned long expires = timer->expires;
+	unsigned long clk = base->timer_jiffies;
+	unsigned long delta = expires - clk;
+	unsigned int idx, lvl;
+
+	if ((long)delta < 0) {
+		/*
+		 * Can happen if you add a timer with expires == jiffies,
+		 * or you set a timer to go off in the past
+		 */
+		idx = clk & LVL_MASK;
+	} else if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		expires = clk + WHEEL_TIMEOUT_MAX;
+		idx = calc_index(expires, LVL_DEPTH - 1);
+	} else {
+		for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++)
+			if (delta < LVL_START(lvl + 1))
+				break;
+		idx = calc_index(expires, lvl);
+	}
+	trace_timer_set(timer);
+	/*
+	 * Timers are FIFO:
+	 */
+	list_add_tail(&timer->entry, base->vectors + idx);
+}
+#else
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 {
 	unsigned long expires = timer->expires;
@@ -375,6 +459,7 @@ static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 	 */
 	list_add_tail(&timer->entry, vec);
 }
+#endif /* CONFIG_TIMER_WHEEL_NO_CASCADE */
 
 #ifdef CONFIG_TIMER_STATS
 void __timer_stats_timer_set_start_info(struct timer_list *timer, void *addr)
@@ -723,6 +808,48 @@ int mod_timer_pending(struct timer_list *timer, unsigned long expires)
 }
 EXPORT_SYMBOL(mod_timer_pending);
 
+/*
+ * Deferrable timers get an automatic slack of 1/TIMER_DEFERRABLE_SLACK of
+ * their timeout.
+ */
+#define TIMER_DEFERRABLE_SLACK	64
+
+/*
+ * Decide where to put the timer while taking the slack into account
+ *
+ * Algorithm:
+ *   1) calculate the maximum (absolute) time
+ *   2) calculate the highest bit where the expires and new max are different
+ *   3) use this bit to make a mask
+ *   4) use the bitmask to round down the maximum time, so that all last
+ *      bits are zeros
+ *
+ * Deferrable timers do not wake up idle CPUs. Rounding their expiry time
+ * groups them, so that the CPU runs them all at once when it wakes up.
+ */
+static inline
+unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
+{
+	unsigned long expires_limit, mask;
+	long delta;
+
+	if (!tbase_get_deferrable(timer->base))
+		return expires;
+
+	delta = expires - jiffies;
+	if (delta < TIMER_DEFERRABLE_SLACK)
+		return expires;
+	expires_limit = expires + delta / TIMER_DEFERRABLE_SLACK;
+
+	mask = expires ^ expires_limit;
+	if (mask == 0)
+		return expires;
+
+	mask = (1UL << __fls(mask)) - 1;
+
+	return expires_limit & ~mask;
+}
+
 /**
  * mod_timer - modify a timer's timeout
  * @timer: the timer to be modified
@@ -745,6 +872,8 @@ EXPORT_SYMBOL(mod_timer_pending);
  */
 int mod_timer(struct timer_list *timer, unsigned long expires)
 {
+	expires = apply_slack(timer, expires);
+
 	/*
 	 * This is a common optimization triggered by the
 	 * networking code - if the timer is re-modified
@@ -942,6 +1071,29 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
+#ifdef CONFIG_TIMER_WHEEL_NO_CASCADE
+/*
+ * Move the timers expiring at base->timer_jiffies to @head: the current
+ * bucket of level 0, and the current bucket of each level whose granularity
+ * boundary is crossed.
+ */
+static void collect_expired_timers(struct tvec_base *base,
+				   struct list_head *head)
+{
+	unsigned long clk = base->timer_jiffies;
+	unsigned int lvl;
+
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		list_splice_tail_init(base->vectors + LVL_OFFS(lvl)
+				      + (clk & LVL_MASK), head);
+		/* Is it time to look at the next level? */
+		if (clk & LVL_CLK_MASK)
+			break;
+		clk >>= LVL_CLK_SHIFT;
+	}
+	++base->timer_jiffies;
+}
+#else
 static int cascade(struct tvec_base *base, struct tvec *tv, int index)
 {
 	/* cascade all the timers from tv up one level */
@@ -964,6 +1116,24 @@ static int cascade(struct tvec_base *base, struct tvec *tv, int index)
 
 #define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
 
+static void collect_expired_timers(struct tvec_base *base,
+				   struct list_head *head)
+{
+	int index = base->timer_jiffies & TVR_MASK;
+
+	/*
+	 * Cascade timers:
+	 */
+	if (!index &&
+		(!cascade(base, &base->tv2, INDEX(0))) &&
+			(!cascade(base, &base->tv3, INDEX(1))) &&
+				!cascade(base, &base->tv4, INDEX(2)))
+		cascade(base, &base->tv5, INDEX(3));
+	++base->timer_jiffies;
+	list_replace_init(base->tv1.vec + index, head);
+}
+#endif /* CONFIG_TIMER_WHEEL_NO_CASCADE */
+
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
@@ -979,18 +1149,9 @@ static inline void __run_timers(struct tvec_base *base)
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
 		struct list_head work_list;
 		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
 
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
-		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
+		INIT_LIST_HEAD(head);
+		collect_expired_timers(base, head);
 		while (!list_empty(head)) {
 			void (*fn)(unsigned long);
 			unsigned long data;
@@ -1052,6 +1213,44 @@ static inline void __run_timers(struct tvec_base *base)
 }
 
 #ifdef CONFIG_NO_HZ
+#ifdef CONFIG_TIMER_WHEEL_NO_CASCADE
+/*
+ * Find out when the next timer event is due to happen. This
+ * is used on S/390 to stop all activity when a CPU is idle.
+ * This function needs to be called with interrupts disabled.
+ *
+ * Returns the time at which the first bucket holding a non-deferrable timer
+ * is processed, which is when its timers really expire.
+ */
+static unsigned long __next_timer_interrupt(struct tvec_base *base)
+{
+	unsigned long expires = base->timer_jiffies + NEXT_TIMER_MAX_DELTA;
+	unsigned long clk, slot_clk;
+	struct timer_list *nte;
+	unsigned int lvl, i;
+
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		/* First tick of this level at or after timer_jiffies */
+		clk = (base->timer_jiffies + LVL_GRAN(lvl) - 1)
+			>> LVL_SHIFT(lvl);
+		for (i = 0; i < LVL_SIZE; i++) {
+			slot_clk = (clk + i) << LVL_SHIFT(lvl);
+			if (!time_before(slot_clk, expires))
+				break;
+			list_for_each_entry(nte, base->vectors + LVL_OFFS(lvl)
+					    + ((clk + i) & LVL_MASK), entry) {
+				if (tbase_get_deferrable(nte->base))
+					continue;
+				expires = slot_clk;
+				break;
+			}
+			if (expires == slot_clk)
+				break;
+		}
+	}
+	return expires;
+}
+#else
 /*
  * Find out when the next timer event is due to happen. This
  * is used on S/390 to stop all activity when a CPU is idle.
@@ -1126,6 +1325,7 @@ cascade:
 	}
 	return expires;
 }
+#endif /* CONFIG_TIMER_WHEEL_NO_CASCADE */
 
 /*
  * Check, if the next hrtimer event is before the next timer wheel
@@ -1564,6 +1764,10 @@ static int __cpuinit init_timers_cpu(int cpu)
 
 	spin_lock_init(&base->lock);
 
+#ifdef CONFIG_TIMER_WHEEL_NO_CASCADE
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+#else
 	for (j = 0; j < TVN_SIZE; j++) {
 		INIT_LIST_HEAD(base->tv5.vec + j);
 		INIT_LIST_HEAD(base->tv4.vec + j);
@@ -1572,6 +1776,7 @@ static int __cpuinit init_timers_cpu(int cpu)
 	}
 	for (j = 0; j < TVR_SIZE; j++)
 		INIT_LIST_HEAD(base->tv1.vec + j);
+#endif
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
@@ -1612,6 +1817,10 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
+#ifdef CONFIG_TIMER_WHEEL_NO_CASCADE
+	for (i = 0; i < WHEEL_SIZE; i++)
+		migrate_timer_list(new_base, old_base->vectors + i);
+#else
 	for (i = 0; i < TVR_SIZE; i++)
 		migrate_timer_list(new_base, old_base->tv1.vec + i);
 	for (i = 0; i < TVN_SIZE; i++) {
@@ -1620,6 +1829,7 @@ static void __cpuinit migrate_timers(int cpu)
 		migrate_timer_list(new_base, old_base->tv4.vec + i);
 		migrate_timer_list(new_base, old_base->tv5.vec + i);
 	}
+#endif
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
@@ -0,0 +1,207 @@
+/*
+ * Timer wheel stress test.
+ *
+ * Keeps a large number of timers pending, the way many TCP connections or
+ * video capture timeouts would: each timer re-arms itself with a random
+ * timeout when it expires, and a kthread pushes random timers further away
+ * at every tick before they expire. The duration of each timer softirq run
+ * (__run_timers()) is measured with a kretprobe and printed as a histogram
+ * when the test ends, so the default cascading wheel can be compared with
+ * CONFIG_TIMER_WHEEL_NO_CASCADE.
+ *
+ * Copyright (C) 2009 Mathieu Desnoyers <mathieu.desnoyers@polymtl.ca>
+ *
+ * Dual LGPL v2.1/GPL v2 license.
+ */
+
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/kprobes.h>
+#include <linux/timer.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/bench.h>
+
+static int nr_timers = 20000;
+static int max_timeout_ms = 30000;
+static int nr_push = 1000;
+static int deferrable_pct;
+static int run_time = 60;
+
+module_param(nr_timers, int, 0444);
+MODULE_PARM_DESC(nr_timers, "number of timers kept pending");
+module_param(max_timeout_ms, int, 0444);
+MODULE_PARM_DESC(max_timeout_ms, "maximum timer timeout, in ms");
+module_param(nr_push, int, 0444);
+MODULE_PARM_DESC(nr_push, "timers pushed further away at every tick");
+module_param(deferrable_pct, int, 0444);
+MODULE_PARM_DESC(deferrable_pct, "percentage of deferrable timers");
+module_param(run_time, int, 0444);
+MODULE_PARM_DESC(run_time, "test duration, in seconds");
+
+static DEFINE_PER_CPU(struct bench_hist, timer_stress_hist);
+
+static struct timer_list *timer_stress_timers;
+static atomic_long_t timer_stress_expired;
+static int timer_stress_stopping;
+static struct task_struct *timer_stress_task;
+
+static unsigned long timer_stress_timeout(void)
+{
+	return 1 + random32() % msecs_to_jiffies(max_timeout_ms);
+}
+
+static void timer_stress_fn(unsigned long data)
+{
+	struct timer_list *timer = &timer_stress_timers[data];
+
+	atomic_long_inc(&timer_stress_expired);
+	if (!ACCESS_ONCE(timer_stress_stopping))
+		mod_timer(timer, jiffies + timer_stress_timeout());
+}
+
+static int timer_stress_entry(struct kretprobe_instance *ri,
+			      struct pt_regs *regs)
+{
+	*(u64 *)ri->data = sched_clock();
+	return 0;
+}
+
+static int timer_stress_ret(struct kretprobe_instance *ri,
+			    struct pt_regs *regs)
+{
+	bench_hist_record(&__get_cpu_var(timer_stress_hist),
+			  sched_clock() - *(u64 *)ri->data);
+	return 0;
+}
+
+static struct kretprobe timer_stress_probe = {
+	.kp.symbol_name = "run_timer_softirq",
+	.entry_handler = timer_stress_entry,
+	.handler = timer_stress_ret,
+	.data_size = sizeof(u64),
+};
+
+static void timer_stress_report(void)
+{
+	struct bench_hist total;
+	int cpu, i;
+
+	memset(&total, 0, sizeof(total));
+	for_each_possible_cpu(cpu)
+		bench_hist_add(&total, &per_cpu(timer_stress_hist, cpu));
+
+	printk(KERN_INFO "timer stress: %s wheel, %d timers, "
+	       "%ld expirations, %lu timer softirq runs\n",
+#ifdef CONFIG_TIMER_WHEEL_NO_CASCADE
+	       "non-cascading",
+#else
+	       "cascading",
+#endif
+	       nr_timers, atomic_long_read(&timer_stress_expired), total.count);
+	if (!total.count)
+		return;
+	printk(KERN_INFO "timer stress: softirq ns: p50 <= %llu "
+	       "p99 <= %llu p99.9 <= %llu max %llu\n",
+	       (unsigned long long)bench_hist_percentile(&total, 500),
+	       (unsigned long long)bench_hist_percentile(&total, 990),
+	       (unsigned long long)bench_hist_percentile(&total, 999),
+	       (unsigned long long)total.max);
+	for (i = 0; i < BENCH_HIST_SIZE; i++) {
+		if (!total.bucket[i])
+			continue;
+		printk(KERN_INFO "timer stress: < %llu ns: %lu\n",
+		       1ULL << i, total.bucket[i]);
+	}
+}
+
+static void timer_stress_stop(void)
+{
+	int i;
+
+	ACCESS_ONCE(timer_stress_stopping) = 1;
+	smp_mb();	/* Stop re-arming before deleting the timers */
+	for (i = 0; i < nr_timers; i++)
+		del_timer_sync(&timer_stress_timers[i]);
+	unregister_kretprobe(&timer_stress_probe);
+}
+
+static int timer_stress_thread(void *data)
+{
+	unsigned long end = jiffies + (unsigned long)run_time * HZ;
+	int i;
+
+	while (time_before(jiffies, end) && !kthread_should_stop()) {
+		for (i = 0; i < nr_push; i++)
+			mod_timer_pending(
+				&timer_stress_timers[random32() % nr_timers],
+				jiffies + timer_stress_timeout());
+		schedule_timeout_interruptible(1);
+	}
+
+	timer_stress_stop();
+	timer_stress_report();
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int __init timer_stress_init(void)
+{
+	struct timer_list *timer;
+	int i, ret;
+
+	if (nr_timers <= 0 || max_timeout_ms <= 0)
+		return -EINVAL;
+	timer_stress_timers = vmalloc(nr_timers * sizeof(struct timer_list));
+	if (!timer_stress_timers)
+		return -ENOMEM;
+
+	ret = register_kretprobe(&timer_stress_probe);
+	if (ret)
+		goto free;
+
+	for (i = 0; i < nr_timers; i++) {
+		timer = &timer_stress_timers[i];
+		if (random32() % 100 < deferrable_pct)
+			init_timer_deferrable(timer);
+		else
+			init_timer(timer);
+		timer->function = timer_stress_fn;
+		timer->data = i;
+		mod_timer(timer, jiffies + timer_stress_timeout());
+	}
+
+	timer_stress_task = kthread_run(timer_stress_thread, NULL,
+					"timer_stress");
+	if (IS_ERR(timer_stress_task)) {
+		ret = PTR_ERR(timer_stress_task);
+		timer_stress_stop();
+		goto free;
+	}
+	return 0;
+
+free:
+	vfree(timer_stress_timers);
+	return ret;
+}
+
+static void __exit timer_stress_exit(void)
+{
+	kthread_stop(timer_stress_task);
+	vfree(timer_stress_timers);
+}
+
+module_init(timer_stress_init);
+module_exit(timer_stress_exit);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("Mathieu Desnoyers");
+MODULE_DESCRIPTION("Timer wheel stress test");
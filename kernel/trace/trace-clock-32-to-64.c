@@ -59,6 +59,13 @@ struct synthetic_tsc_struct {
 
 static DEFINE_PER_CPU(struct synthetic_tsc_struct, synthetic_tsc);
 
+/*
+ * Lets tracers use trace_clock_read32() deltas as long as the epoch does not
+ * change, without reading the synthetic TSC.
+ */
+DEFINE_PER_CPU(unsigned int, synthetic_tsc_epoch);
+EXPORT_PER_CPU_SYMBOL_GPL(synthetic_tsc_epoch);
+
 /* Called from IPI or timer interrupt */
 static void update_synthetic_tsc(void)
 {
@@ -94,6 +101,7 @@ static void update_synthetic_tsc(void)
 		cpu_synth->tsc[cpu_synth->index].sel.ls32 =
 			SW_MS32(cpu_synth->tsc[cpu_synth->index].sel.ls32) | tsc;
 	}
+	__get_cpu_var(synthetic_tsc_epoch)++;
 }
 
 /*
@@ -109,6 +117,7 @@ void _trace_clock_write_synthetic_tsc(u64 value)
 	cpu_synth->tsc[new_index].val = value;
 	barrier();
 	cpu_synth->index = new_index;	/* atomic change of index */
+	__get_cpu_var(synthetic_tsc_epoch)++;
 }
 
 /* Called from buffer switch : in _any_ context (even NMI) */
@@ -185,6 +194,7 @@ static void prepare_synthetic_tsc(int cpu)
 	local_count = trace_clock_read_synthetic_tsc();
 	cpu_synth->tsc[0].val = local_count;
 	cpu_synth->index = 0;
+	per_cpu(synthetic_tsc_epoch, cpu)++;
 	smp_wmb();	/* Writing in data of CPU about to come up */
 	init_timer_deferrable(&per_cpu(tsc_timer, cpu));
 	per_cpu(tsc_timer, cpu).function = tsc_timer_fct;
@@ -315,8 +315,7 @@ static void tracepoint_update_probes(void)
 	/* tracepoints in modules. */
 	module_update_tracepoints();
 	/* Update immediate values */
-	core_imv_update();
-	module_imv_update();
+	imv_update();
 }
 
 static void *tracepoint_add_probe(const char *name, void *probe)
@@ -14,6 +14,14 @@
  *   Theodore Ts'o <tytso@mit.edu>
  *
  * Made to use alloc_percpu by Christoph Lameter.
+ *
+ * The multithreaded, non-freezeable, non-realtime workqueues are served by
+ * a shared pool of workers per CPU instead of a thread per workqueue and
+ * CPU. The scheduler tells the pool when one of its workers goes to sleep
+ * (see wq_worker_sleeping()), so that another worker is woken up only when
+ * the running work blocks, and new workers are created on demand. Each of
+ * these workqueues also has a rescuer thread, which runs its works when
+ * the pool is stuck because no new worker can be created.
  */
 
 #include <linux/module.h>
@@ -33,9 +41,101 @@
 #include <linux/kallsyms.h>
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
+#include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
 #define CREATE_TRACE_POINTS
 #include <trace/events/workqueue.h>
 
+#include "workqueue_sched.h"
+
+/* Idle workers in excess of one exit after this long. */
+#define IDLE_WORKER_TIMEOUT	(300 * HZ)
+/* A pool not dispatching any work for this long calls its rescuer. */
+#define MAYDAY_INTERVAL		(HZ / 10)
+
+/* worker flags */
+#define WORKER_IDLE		0x1	/* waiting for work */
+#define WORKER_SLEEPING		0x2	/* blocked while running a work */
+#define WORKER_NOT_RUNNING	(WORKER_IDLE | WORKER_SLEEPING)
+
+/* cwq->pool_state */
+enum {
+	CWQ_IDLE,		/* no work, or works not handed to the pool */
+	CWQ_QUEUED,		/* on pool->worklist */
+	CWQ_RUNNING,		/* a worker is running one of its works */
+};
+
+/*
+ * The shared worker pool of a CPU. The cwqs with pending works are queued
+ * on ->worklist; a worker takes the first one, runs its first work and
+ * queues it back at the tail if more works are pending, so that the works
+ * of a cwq are still run one at a time and in order.
+ *
+ * ->lock nests inside cwq->lock and is always taken with interrupts off.
+ */
+struct worker_pool {
+	spinlock_t lock;
+	unsigned int cpu;
+
+	struct list_head worklist;	/* cwqs with pending works */
+	struct list_head free_list;	/* see queue_pool_work_on() */
+	struct list_head idle_list;	/* idle workers, most recent first */
+	int nr_workers;
+	int nr_idle;
+	int next_id;
+	int creating;			/* a worker is being created */
+	unsigned int bound_gen;		/* bumped when the CPU comes up */
+
+	struct timer_list mayday_timer;
+	unsigned long mayday_seen;	/* nr_dispatched when armed */
+
+	/* statistics */
+	unsigned long nr_dispatched;
+	unsigned long nr_created;
+	unsigned long nr_mayday;
+
+	/* running workers, also updated by the scheduler hooks */
+	atomic_t nr_running ____cacheline_aligned_in_smp;
+};
+
+struct worker {
+	struct list_head entry;		/* on pool->idle_list while idle */
+	struct task_struct *task;
+	struct worker_pool *pool;
+	/* the cwq whose work is being run, for the flush checks */
+	struct cpu_workqueue_struct *cwq;
+	unsigned int flags;
+	unsigned int bound_gen;
+	int id;
+};
+
+static DEFINE_PER_CPU(struct worker_pool, worker_pools);
+
+/*
+ * A thread which runs the works of a pool stuck for lack of workers, so
+ * that the works needed for memory reclaim still make progress when no
+ * worker can be created. Each shared workqueue has its own, and a single
+ * one serves the works of queue_pool_work_on().
+ */
+struct rescuer {
+	struct task_struct *task;
+	struct workqueue_struct *wq;	/* NULL for the pool works */
+	cpumask_var_t mayday_mask;	/* cpus of the pools calling */
+	/* the cwq being run, for the flush checks */
+	struct cpu_workqueue_struct *cwq;
+};
+
+static struct rescuer *pool_rescuer;
+
+/*
+ * Serve every workqueue with dedicated threads, as before the shared pool.
+ * The pool is still used by queue_pool_work_on().
+ */
+static int dedicated_threads;
+module_param(dedicated_threads, bool, 0444);
+
 /*
  * The per-CPU workqueue (if single thread, we always use the first
  * possible cpu).
@@ -50,6 +150,18 @@ struct cpu_workqueue_struct {
 
 	struct workqueue_struct *wq;
 	struct task_struct *thread;
+
+	struct worker_pool *pool;	/* NULL if served by ->thread */
+	struct list_head pool_entry;	/* on pool->worklist */
+	int pool_state;
+	struct completion *released;	/* see cleanup_workqueue_thread() */
+
+	/* statistics, in ns, protected by ->lock */
+	u64 queued_at;			/* oldest unaccounted queueing */
+	u64 wait_total, wait_max;
+	u64 exec_total, exec_max;
+	unsigned long nr_waits;
+	unsigned long nr_executed;
 } ____cacheline_aligned;
 
 /*
@@ -59,18 +171,22 @@ struct cpu_workqueue_struct {
 struct workqueue_struct {
 	struct cpu_workqueue_struct *cpu_wq;
 	struct list_head list;
+	struct list_head all_list;
 	const char *name;
 	int singlethread;
 	int freezeable;		/* Freeze threads during suspend */
 	int rt;
+	int shared;		/* served by the worker pools */
+	struct rescuer *rescuer;	/* if shared */
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
 };
 
-/* Serializes the accesses to the list of workqueues. */
+/* Serializes the accesses to the lists of workqueues. */
 static DEFINE_SPINLOCK(workqueue_lock);
 static LIST_HEAD(workqueues);
+static LIST_HEAD(all_workqueues);
 
 static int singlethread_cpu __read_mostly;
 static const struct cpumask *cpu_singlethread_map __read_mostly;
@@ -125,10 +241,71 @@ struct cpu_workqueue_struct *get_wq_data(struct work_struct *work)
 	return (void *) (atomic_long_read(&work->data) & WORK_STRUCT_WQ_DATA_MASK);
 }
 
+static inline u64 wq_clock(void)
+{
+	return cpu_clock(raw_smp_processor_id());
+}
+
+static int pool_has_work(struct worker_pool *pool)
+{
+	return !list_empty(&pool->worklist) || !list_empty(&pool->free_list);
+}
+
+static struct worker *first_idle_worker(struct worker_pool *pool)
+{
+	if (list_empty(&pool->idle_list))
+		return NULL;
+	return list_first_entry(&pool->idle_list, struct worker, entry);
+}
+
+/*
+ * Called with pool->lock held after new works were queued. Wakes up an idle
+ * worker if none is running, or arms the mayday timer if this does not
+ * get the works going.
+ */
+static void pool_wake_worker(struct worker_pool *pool)
+{
+	struct worker *worker = first_idle_worker(pool);
+
+	/*
+	 * Pairs with the barrier of atomic_dec_and_test() in
+	 * wq_worker_sleeping(): either the last running worker sees the
+	 * new works, or we see it went to sleep.
+	 */
+	smp_mb();
+	if (!atomic_read(&pool->nr_running) && worker) {
+		wake_up_process(worker->task);
+		return;
+	}
+	if (!timer_pending(&pool->mayday_timer)) {
+		pool->mayday_seen = pool->nr_dispatched;
+		mod_timer(&pool->mayday_timer, jiffies + MAYDAY_INTERVAL);
+	}
+}
+
+/*
+ * Hands @cwq over to its pool, unless it is already queued there or being
+ * run, in which case the worker queues it back itself. Called with
+ * cwq->lock held and interrupts off.
+ */
+static void pool_queue_cwq(struct cpu_workqueue_struct *cwq)
+{
+	struct worker_pool *pool = cwq->pool;
+
+	if (cwq->pool_state != CWQ_IDLE)
+		return;
+	cwq->pool_state = CWQ_QUEUED;
+	spin_lock(&pool->lock);
+	list_add_tail(&cwq->pool_entry, &pool->worklist);
+	pool_wake_worker(pool);
+	spin_unlock(&pool->lock);
+}
+
 static void insert_work(struct cpu_workqueue_struct *cwq,
 			struct work_struct *work, struct list_head *head)
 {
-	trace_workqueue_insertion(cwq->thread, work);
+	if (cwq->thread)
+		trace_workqueue_insertion(cwq->thread, work);
 
 	set_wq_data(work, cwq);
 	/*
@@ -137,7 +314,12 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 	 */
 	smp_wmb();
 	list_add_tail(&work->entry, head);
-	wake_up(&cwq->more_work);
+	if (!cwq->queued_at)
+		cwq->queued_at = wq_clock();
+	if (cwq->pool)
+		pool_queue_cwq(cwq);
+	else
+		wake_up(&cwq->more_work);
 }
 
 static void __queue_work(struct cpu_workqueue_struct *cwq,
@@ -196,6 +378,35 @@ queue_work_on(int cpu, struct workqueue_struct *wq, struct work_struct *work)
 }
 EXPORT_SYMBOL_GPL(queue_work_on);
 
+/**
+ * queue_pool_work_on - queue work on the shared worker pool of a cpu
+ * @cpu: CPU number to execute work on
+ * @work: work to queue
+ *
+ * Returns 0 if @work was already on a queue, non-zero otherwise.
+ *
+ * Unlike the works of a workqueue, the works queued here are not serialized
+ * with each other: several of them run concurrently when they block, and
+ * they cannot be flushed or cancelled. A single rescuer serves them all
+ * when the pool is stuck. The caller must ensure the cpu can't go away and
+ * must wait for the work itself before freeing it.
+ */
+int queue_pool_work_on(int cpu, struct work_struct *work)
+{
+	struct worker_pool *pool = &per_cpu(worker_pools, cpu);
+	unsigned long flags;
+
+	if (test_and_set_bit(WORK_STRUCT_PENDING, work_data_bits(work)))
+		return 0;
+	BUG_ON(!list_empty(&work->entry));
+	spin_lock_irqsave(&pool->lock, flags);
+	list_add_tail(&work->entry, &pool->free_list);
+	pool_wake_worker(pool);
+	spin_unlock_irqrestore(&pool->lock, flags);
+	return 1;
+}
+EXPORT_SYMBOL_GPL(queue_pool_work_on);
+
 static void delayed_work_timer_fn(unsigned long __data)
 {
 	struct delayed_work *dwork = (struct delayed_work *)__data;
@@ -261,51 +472,79 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 }
 EXPORT_SYMBOL_GPL(queue_delayed_work_on);
 
-static void run_workqueue(struct cpu_workqueue_struct *cwq)
+/*
+ * Runs the first work of cwq->worklist. Called and returns with cwq->lock
+ * held and interrupts off.
+ */
+static void run_one_work(struct cpu_workqueue_struct *cwq)
 {
-	spin_lock_irq(&cwq->lock);
-	while (!list_empty(&cwq->worklist)) {
-		struct work_struct *work = list_entry(cwq->worklist.next,
-						struct work_struct, entry);
-		work_func_t f = work->func;
+	struct work_struct *work = list_entry(cwq->worklist.next,
+					struct work_struct, entry);
+	work_func_t f = work->func;
+	u64 start, delta;
 #ifdef CONFIG_LOCKDEP
-		/*
-		 * It is permissible to free the struct work_struct
-		 * from inside the function that is called from it,
-		 * this we need to take into account for lockdep too.
-		 * To avoid bogus "held lock freed" warnings as well
-		 * as problems when looking into work->lockdep_map,
-		 * make a copy and use that here.
-		 */
-		struct lockdep_map lockdep_map = work->lockdep_map;
+	/*
+	 * It is permissible to free the struct work_struct
+	 * from inside the function that is called from it,
+	 * this we need to take into account for lockdep too.
+	 * To avoid bogus "held lock freed" warnings as well
+	 * as problems when looking into work->lockdep_map,
+	 * make a copy and use that here.
+	 */
+	struct lockdep_map lockdep_map = work->lockdep_map;
 #endif
-		trace_workqueue_execution(cwq->thread, work);
-		cwq->current_work = work;
-		list_del_init(cwq->worklist.next);
-		spin_unlock_irq(&cwq->lock);
+	trace_workqueue_execution(current, work);
+	cwq->current_work = work;
+	list_del_init(cwq->worklist.next);
+
+	start = wq_clock();
+	if (cwq->queued_at) {
+		delta = start - cwq->queued_at;
+		/* the clocks of two cpus may be slightly apart */
+		if ((s64)delta < 0)
+			delta = 0;
+		cwq->wait_total += delta;
+		cwq->wait_max = max(cwq->wait_max, delta);
+		cwq->nr_waits++;
+		cwq->queued_at = 0;
+	}
+	spin_unlock_irq(&cwq->lock);
 
-		BUG_ON(get_wq_data(work) != cwq);
-		work_clear_pending(work);
-		lock_map_acquire(&cwq->wq->lockdep_map);
-		lock_map_acquire(&lockdep_map);
-		f(work);
-		lock_map_release(&lockdep_map);
-		lock_map_release(&cwq->wq->lockdep_map);
-
-		if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
-			printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
-					"%s/0x%08x/%d\n",
-					current->comm, preempt_count(),
-				       	task_pid_nr(current));
-			printk(KERN_ERR "    last function: ");
-			print_symbol("%s\n", (unsigned long)f);
-			debug_show_held_locks(current);
-			dump_stack();
-		}
+	BUG_ON(get_wq_data(work) != cwq);
+	work_clear_pending(work);
+	lock_map_acquire(&cwq->wq->lockdep_map);
+	lock_map_acquire(&lockdep_map);
+	f(work);
+	lock_map_release(&lockdep_map);
+	lock_map_release(&cwq->wq->lockdep_map);
 
-		spin_lock_irq(&cwq->lock);
-		cwq->current_work = NULL;
+	if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
+		printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
+				"%s/0x%08x/%d\n",
+				current->comm, preempt_count(),
+			       	task_pid_nr(current));
+		printk(KERN_ERR "    last function: ");
+		print_symbol("%s\n", (unsigned long)f);
+		debug_show_held_locks(current);
+		dump_stack();
 	}
+
+	delta = wq_clock() - start;
+	if ((s64)delta < 0)
+		delta = 0;
+
+	spin_lock_irq(&cwq->lock);
+	cwq->current_work = NULL;
+	cwq->exec_total += delta;
+	cwq->exec_max = max(cwq->exec_max, delta);
+	cwq->nr_executed++;
+}
+
+static void run_workqueue(struct cpu_workqueue_struct *cwq)
+{
+	spin_lock_irq(&cwq->lock);
+	while (!list_empty(&cwq->worklist))
+		run_one_work(cwq);
 	spin_unlock_irq(&cwq->lock);
 }
 
@@ -336,6 +575,438 @@ static int worker_thread(void *__cwq)
 	return 0;
 }
 
+/*
+ * Called with cwq->lock held once no worker or rescuer holds @cwq anymore.
+ */
+static void cwq_release(struct cpu_workqueue_struct *cwq)
+{
+	/* from now on, destroy_workqueue() may free the cwq */
+	cwq->pool_state = CWQ_IDLE;
+	if (cwq->released)
+		complete(cwq->released);
+}
+
+/*
+ * Runs the first work of pool->free_list. Called and returns with
+ * pool->lock held and interrupts off.
+ */
+static void pool_run_free_work(struct worker_pool *pool)
+{
+	struct work_struct *work = list_first_entry(&pool->free_list,
+					struct work_struct, entry);
+
+	pool->nr_dispatched++;
+	list_del_init(&work->entry);
+	spin_unlock_irq(&pool->lock);
+	trace_workqueue_execution(current, work);
+	work_clear_pending(work);
+	work->func(work);
+	spin_lock_irq(&pool->lock);
+}
+
+/*
+ * Runs one work of @pool: first the unserialized ones, then the first work
+ * of the first queued cwq. Called and returns with pool->lock held and
+ * interrupts off.
+ */
+static void pool_process_one(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+	struct cpu_workqueue_struct *cwq;
+
+	if (!list_empty(&pool->free_list)) {
+		pool_run_free_work(pool);
+		return;
+	}
+
+	pool->nr_dispatched++;
+	cwq = list_first_entry(&pool->worklist, struct cpu_workqueue_struct,
+			       pool_entry);
+	list_del_init(&cwq->pool_entry);
+	spin_unlock(&pool->lock);
+
+	spin_lock(&cwq->lock);
+	if (!list_empty(&cwq->worklist)) {
+		cwq->pool_state = CWQ_RUNNING;
+		worker->cwq = cwq;
+		run_one_work(cwq);
+		worker->cwq = NULL;
+	}
+	/* queue it back at the tail, to be fair with the other cwqs */
+	if (!list_empty(&cwq->worklist)) {
+		cwq->pool_state = CWQ_QUEUED;
+		spin_lock(&pool->lock);
+		list_add_tail(&cwq->pool_entry, &pool->worklist);
+		spin_unlock(&pool->lock);
+	} else {
+		cwq_release(cwq);
+	}
+	spin_unlock(&cwq->lock);
+
+	spin_lock(&pool->lock);
+}
+
+static struct worker *create_worker(struct worker_pool *pool, int bind);
+
+/*
+ * Runs the works of the pool as long as this worker is the only one running,
+ * see wq_worker_sleeping(). Called and returns with pool->lock held.
+ */
+static void worker_run(struct worker *worker)
+{
+	struct worker_pool *pool = worker->pool;
+	struct worker *new;
+
+	list_del_init(&worker->entry);
+	pool->nr_idle--;
+	worker->flags &= ~WORKER_IDLE;
+	atomic_inc(&pool->nr_running);
+
+	/* keep an idle worker at hand for when we block */
+	if (!pool->nr_idle && !pool->creating) {
+		pool->creating = 1;
+		spin_unlock_irq(&pool->lock);
+		new = create_worker(pool, 0);
+		if (new)
+			wake_up_process(new->task);
+		spin_lock_irq(&pool->lock);
+		pool->creating = 0;
+	}
+
+	for (;;) {
+		if (!pool_has_work(pool))
+			break;
+		if (atomic_read(&pool->nr_running) == 1) {
+			pool_process_one(worker);
+			continue;
+		}
+		/*
+		 * Other workers are running and will take care of the
+		 * pending works, unless they all went to sleep in between.
+		 */
+		if (!atomic_dec_and_test(&pool->nr_running))
+			goto idle;
+		atomic_inc(&pool->nr_running);
+	}
+	atomic_dec(&pool->nr_running);
+idle:
+	worker->flags |= WORKER_IDLE;
+	list_add(&worker->entry, &pool->idle_list);
+	pool->nr_idle++;
+}
+
+static int pool_worker_thread(void *__worker)
+{
+	struct worker *worker = __worker;
+	struct worker_pool *pool = worker->pool;
+	long timeout;
+
+	current->flags |= PF_WQ_WORKER;
+
+	spin_lock_irq(&pool->lock);
+	for (;;) {
+		/* the cpu came back up, see pool_online_cpu() */
+		if (worker->bound_gen != pool->bound_gen) {
+			worker->bound_gen = pool->bound_gen;
+			spin_unlock_irq(&pool->lock);
+			set_cpus_allowed_ptr(current, cpumask_of(pool->cpu));
+			spin_lock_irq(&pool->lock);
+		}
+
+		if (pool_has_work(pool) && !atomic_read(&pool->nr_running)) {
+			worker_run(worker);
+			continue;
+		}
+
+		__set_current_state(TASK_INTERRUPTIBLE);
+		spin_unlock_irq(&pool->lock);
+		timeout = schedule_timeout(IDLE_WORKER_TIMEOUT);
+		spin_lock_irq(&pool->lock);
+
+		if (!timeout && pool->nr_idle > 1 &&
+		    !pool_has_work(pool))
+			break;
+	}
+	list_del_init(&worker->entry);
+	pool->nr_idle--;
+	pool->nr_workers--;
+	spin_unlock_irq(&pool->lock);
+
+	trace_workqueue_destruction(current);
+	/*
+	 * wq_worker_sleeping() may still be looking at us through the idle
+	 * list.
+	 */
+	current->flags &= ~PF_WQ_WORKER;
+	synchronize_sched();
+	kfree(worker);
+	return 0;
+}
+
+/*
+ * Creates a worker of @pool, idle and not started yet. With @bind, it is
+ * bound to the cpu of the pool, even if it is not online yet. Otherwise
+ * it binds itself once started, if the cpu is online by then.
+ */
+static struct worker *create_worker(struct worker_pool *pool, int bind)
+{
+	struct worker *worker;
+	struct task_struct *task;
+
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	if (!worker)
+		return NULL;
+	INIT_LIST_HEAD(&worker->entry);
+	worker->pool = pool;
+	worker->flags = WORKER_IDLE;
+
+	spin_lock_irq(&pool->lock);
+	worker->id = pool->next_id++;
+	spin_unlock_irq(&pool->lock);
+
+	task = kthread_create(pool_worker_thread, worker, "kworker/%u:%d",
+			      pool->cpu, worker->id);
+	if (IS_ERR(task)) {
+		kfree(worker);
+		return NULL;
+	}
+	worker->task = task;
+
+	if (bind)
+		kthread_bind(task, pool->cpu);
+
+	spin_lock_irq(&pool->lock);
+	worker->bound_gen = pool->bound_gen - !bind;
+	pool->nr_workers++;
+	pool->nr_created++;
+	list_add_tail(&worker->entry, &pool->idle_list);
+	pool->nr_idle++;
+	spin_unlock_irq(&pool->lock);
+
+	trace_workqueue_creation(task, pool->cpu);
+	return worker;
+}
+
+static void send_mayday(struct rescuer *rescuer, unsigned int cpu)
+{
+	cpumask_set_cpu(cpu, rescuer->mayday_mask);
+	wake_up_process(rescuer->task);
+}
+
+/*
+ * The pending works of the pool made no progress for a whole interval:
+ * either all its workers are blocked and no new one could be created, or
+ * a work hogs the cpu. Call the rescuers of the workqueues waiting.
+ */
+static void pool_mayday_timeout(unsigned long __pool)
+{
+	struct worker_pool *pool = (struct worker_pool *)__pool;
+	struct cpu_workqueue_struct *cwq;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	if (pool_has_work(pool)) {
+		if (pool->nr_dispatched == pool->mayday_seen) {
+			pool->nr_mayday++;
+			list_for_each_entry(cwq, &pool->worklist, pool_entry)
+				send_mayday(cwq->wq->rescuer, pool->cpu);
+			if (!list_empty(&pool->free_list))
+				send_mayday(pool_rescuer, pool->cpu);
+		}
+		pool->mayday_seen = pool->nr_dispatched;
+		mod_timer(&pool->mayday_timer, jiffies + MAYDAY_INTERVAL);
+	}
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+/*
+ * Runs the works queued on @cwq by now, unless a worker holds it already,
+ * and hands it back to the pool if more are left.
+ */
+static void rescue_cwq(struct rescuer *rescuer,
+		       struct cpu_workqueue_struct *cwq)
+{
+	struct worker_pool *pool = cwq->pool;
+	struct list_head *pos;
+	int nr = 0;
+
+	spin_lock_irq(&cwq->lock);
+	if (cwq->pool_state != CWQ_QUEUED) {
+		spin_unlock_irq(&cwq->lock);
+		return;
+	}
+	spin_lock(&pool->lock);
+	list_del_init(&cwq->pool_entry);
+	pool->nr_dispatched++;
+	spin_unlock(&pool->lock);
+
+	cwq->pool_state = CWQ_RUNNING;
+	rescuer->cwq = cwq;
+	list_for_each(pos, &cwq->worklist)
+		nr++;
+	while (nr-- && !list_empty(&cwq->worklist))
+		run_one_work(cwq);
+	rescuer->cwq = NULL;
+
+	if (!list_empty(&cwq->worklist)) {
+		cwq->pool_state = CWQ_QUEUED;
+		spin_lock(&pool->lock);
+		list_add_tail(&cwq->pool_entry, &pool->worklist);
+		pool_wake_worker(pool);
+		spin_unlock(&pool->lock);
+	} else {
+		cwq_release(cwq);
+	}
+	spin_unlock_irq(&cwq->lock);
+}
+
+/* Runs the works queued on pool->free_list by now. */
+static void rescue_pool_works(struct worker_pool *pool)
+{
+	struct list_head *pos;
+	int nr = 0;
+
+	spin_lock_irq(&pool->lock);
+	list_for_each(pos, &pool->free_list)
+		nr++;
+	while (nr-- && !list_empty(&pool->free_list))
+		pool_run_free_work(pool);
+	spin_unlock_irq(&pool->lock);
+}
+
+static int rescuer_thread(void *__rescuer)
+{
+	struct rescuer *rescuer = __rescuer;
+	unsigned int cpu;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop()) {
+			__set_current_state(TASK_RUNNING);
+			break;
+		}
+		if (cpumask_empty(rescuer->mayday_mask))
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		for_each_cpu(cpu, rescuer->mayday_mask) {
+			cpumask_clear_cpu(cpu, rescuer->mayday_mask);
+			/* fails if the cpu went down, its works run anywhere */
+			set_cpus_allowed_ptr(current, cpumask_of(cpu));
+			if (rescuer->wq)
+				rescue_cwq(rescuer,
+					   per_cpu_ptr(rescuer->wq->cpu_wq, cpu));
+			else
+				rescue_pool_works(&per_cpu(worker_pools, cpu));
+		}
+	}
+	return 0;
+}
+
+static struct rescuer *create_rescuer(struct workqueue_struct *wq,
+				      const char *name)
+{
+	struct rescuer *rescuer;
+	struct task_struct *task;
+
+	rescuer = kzalloc(sizeof(*rescuer), GFP_KERNEL);
+	if (!rescuer)
+		return NULL;
+	if (!zalloc_cpumask_var(&rescuer->mayday_mask, GFP_KERNEL))
+		goto free;
+	rescuer->wq = wq;
+
+	task = kthread_run(rescuer_thread, rescuer, "%s", name);
+	if (IS_ERR(task))
+		goto free_mask;
+	rescuer->task = task;
+	return rescuer;
+
+free_mask:
+	free_cpumask_var(rescuer->mayday_mask);
+free:
+	kfree(rescuer);
+	return NULL;
+}
+
+static void destroy_rescuer(struct rescuer *rescuer)
+{
+	kthread_stop(rescuer->task);
+	free_cpumask_var(rescuer->mayday_mask);
+	kfree(rescuer);
+}
+
+/**
+ * wq_worker_waking_up - a worker is waking up
+ * @task: task waking up
+ *
+ * Called from try_to_wake_up() with the runqueue of @task locked.
+ */
+void wq_worker_waking_up(struct task_struct *task)
+{
+	struct worker *worker = kthread_data(task);
+
+	if (worker->flags & WORKER_SLEEPING) {
+		worker->flags &= ~WORKER_SLEEPING;
+		atomic_inc(&worker->pool->nr_running);
+	}
+}
+
+/**
+ * wq_worker_sleeping - a worker is going to sleep
+ * @task: task going to sleep
+ * @cpu: cpu in question, must be the current cpu
+ *
+ * Called from schedule() with the runqueue of @cpu locked. Returns the
+ * idle worker to wake up if @task was the last running worker of its pool
+ * and works are pending, NULL otherwise.
+ */
+struct task_struct *wq_worker_sleeping(struct task_struct *task,
+				       unsigned int cpu)
+{
+	struct worker *worker = kthread_data(task), *to_wakeup;
+	struct worker_pool *pool = worker->pool;
+	struct list_head *first;
+
+	/* no concurrency management while the cpu is down */
+	if ((worker->flags & WORKER_NOT_RUNNING) || pool->cpu != cpu)
+		return NULL;
+
+	worker->flags |= WORKER_SLEEPING;
+	/* see pool_wake_worker() */
+	if (!atomic_dec_and_test(&pool->nr_running) || !pool_has_work(pool))
+		return NULL;
+
+	/*
+	 * The idle list is changed under pool->lock, which we cannot take
+	 * here. An exiting worker is only freed after synchronize_sched(),
+	 * so whatever we find here stays valid while we hold the rq lock.
+	 */
+	first = ACCESS_ONCE(pool->idle_list.next);
+	if (first == &pool->idle_list)
+		return NULL;
+	to_wakeup = list_entry(first, struct worker, entry);
+	if (task_cpu(to_wakeup->task) != cpu)
+		return NULL;
+	return to_wakeup->task;
+}
+
+/* Is current running works of @cwq? */
+static int cwq_is_current(struct cpu_workqueue_struct *cwq)
+{
+	struct rescuer *rescuer = cwq->wq->rescuer;
+	struct worker *worker;
+
+	if (cwq->thread)
+		return cwq->thread == current;
+	if (rescuer && rescuer->task == current)
+		return rescuer->cwq == cwq;
+	if (!(current->flags & PF_WQ_WORKER))
+		return 0;
+	worker = kthread_data(current);
+	return worker->cwq == cwq;
+}
+
 struct wq_barrier {
 	struct work_struct	work;
 	struct completion	done;
@@ -363,7 +1034,7 @@ static int flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
 	int active = 0;
 	struct wq_barrier barr;
 
-	WARN_ON(cwq->thread == current);
+	WARN_ON(cwq_is_current(cwq));
 
 	spin_lock_irq(&cwq->lock);
 	if (!list_empty(&cwq->worklist) || cwq->current_work != NULL) {
@@ -766,7 +1437,7 @@ int current_is_keventd(void)
 	BUG_ON(!keventd_wq);
 
 	cwq = per_cpu_ptr(keventd_wq->cpu_wq, cpu);
-	if (current == cwq->thread)
+	if (cwq_is_current(cwq))
 		ret = 1;
 
 	return ret;
@@ -782,6 +1453,9 @@ init_cpu_workqueue(struct workqueue_struct *wq, int cpu)
 	spin_lock_init(&cwq->lock);
 	INIT_LIST_HEAD(&cwq->worklist);
 	init_waitqueue_head(&cwq->more_work);
+	INIT_LIST_HEAD(&cwq->pool_entry);
+	if (wq->shared)
+		cwq->pool = &per_cpu(worker_pools, cpu);
 
 	return cwq;
 }
@@ -793,6 +1467,9 @@ static int create_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
 	const char *fmt = is_wq_single_threaded(wq) ? "%s" : "%s/%d";
 	struct task_struct *p;
 
+	if (cwq->pool)
+		return 0;
+
 	p = kthread_create(worker_thread, cwq, fmt, wq->name, cpu);
 	/*
 	 * Nobody can add the work_struct to this cwq,
@@ -850,8 +1527,22 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 	wq->singlethread = singlethread;
 	wq->freezeable = freezeable;
 	wq->rt = rt;
+	wq->shared = !singlethread && !freezeable && !rt && !dedicated_threads;
 	INIT_LIST_HEAD(&wq->list);
 
+	if (wq->shared) {
+		wq->rescuer = create_rescuer(wq, name);
+		if (!wq->rescuer) {
+			free_percpu(wq->cpu_wq);
+			kfree(wq);
+			return NULL;
+		}
+	}
+
+	spin_lock(&workqueue_lock);
+	list_add_tail(&wq->all_list, &all_workqueues);
+	spin_unlock(&workqueue_lock);
+
 	if (singlethread) {
 		cwq = init_cpu_workqueue(wq, singlethread_cpu);
 		err = create_workqueue_thread(cwq, singlethread_cpu);
@@ -893,6 +1584,28 @@ EXPORT_SYMBOL_GPL(__create_workqueue_key);
 
 static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
 {
+	/*
+	 * The works of a dead cpu are run by its unbound workers, we only
+	 * need to wait for them. The cwq may still be handled by a worker
+	 * once they are done, wait until it is released.
+	 */
+	if (cwq->pool) {
+		DECLARE_COMPLETION_ONSTACK(released);
+
+		flush_cpu_workqueue(cwq);
+		spin_lock_irq(&cwq->lock);
+		if (cwq->pool_state != CWQ_IDLE) {
+			cwq->released = &released;
+			spin_unlock_irq(&cwq->lock);
+			wait_for_completion(&released);
+			/* cwq_release() completes it under the lock */
+			spin_lock_irq(&cwq->lock);
+			cwq->released = NULL;
+		}
+		spin_unlock_irq(&cwq->lock);
+		return;
+	}
+
 	/*
 	 * Our caller is either destroy_workqueue() or CPU_POST_DEAD,
 	 * cpu_add_remove_lock protects cwq->thread.
@@ -933,17 +1646,48 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	cpu_maps_update_begin();
 	spin_lock(&workqueue_lock);
 	list_del(&wq->list);
+	list_del(&wq->all_list);
 	spin_unlock(&workqueue_lock);
 
 	for_each_cpu(cpu, cpu_map)
 		cleanup_workqueue_thread(per_cpu_ptr(wq->cpu_wq, cpu));
  	cpu_maps_update_done();
 
+	if (wq->rescuer)
+		destroy_rescuer(wq->rescuer);
 	free_percpu(wq->cpu_wq);
 	kfree(wq);
 }
 EXPORT_SYMBOL_GPL(destroy_workqueue);
 
+/*
+ * Creates a first idle worker of a cpu coming up, unless it was up before.
+ */
+static int pool_prepare_cpu(unsigned int cpu)
+{
+	struct worker_pool *pool = &per_cpu(worker_pools, cpu);
+
+	if (!pool->nr_idle && !create_worker(pool, 1))
+		return -ENOMEM;
+	return 0;
+}
+
+/*
+ * Starts the new workers of a cpu now online, and has the workers which
+ * ran unbound while it was down bind themselves back to it.
+ */
+static void pool_online_cpu(unsigned int cpu)
+{
+	struct worker_pool *pool = &per_cpu(worker_pools, cpu);
+	struct worker *worker;
+
+	spin_lock_irq(&pool->lock);
+	pool->bound_gen++;
+	list_for_each_entry(worker, &pool->idle_list, entry)
+		wake_up_process(worker->task);
+	spin_unlock_irq(&pool->lock);
+}
+
 static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 						unsigned long action,
 						void *hcpu)
@@ -957,7 +1701,15 @@ static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 
 	switch (action) {
 	case CPU_UP_PREPARE:
+		if (pool_prepare_cpu(cpu)) {
+			printk(KERN_ERR "workqueue pool for %i failed\n", cpu);
+			return NOTIFY_BAD;
+		}
 		cpumask_set_cpu(cpu, cpu_populated_map);
+		break;
+	case CPU_ONLINE:
+		pool_online_cpu(cpu);
+		break;
 	}
 undo:
 	list_for_each_entry(wq, &workqueues, list) {
@@ -1041,13 +1793,120 @@ long work_on_cpu(unsigned int cpu, long (*fn)(void *), void *arg)
 EXPORT_SYMBOL_GPL(work_on_cpu);
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_DEBUG_FS
+static void workqueue_stats_cwq(struct seq_file *m,
+				struct cpu_workqueue_struct *cwq, int cpu)
+{
+	unsigned long nr_waits, nr_executed;
+	u64 wait_total, wait_max, exec_total, exec_max;
+
+	spin_lock_irq(&cwq->lock);
+	nr_waits = cwq->nr_waits;
+	nr_executed = cwq->nr_executed;
+	wait_total = cwq->wait_total;
+	wait_max = cwq->wait_max;
+	exec_total = cwq->exec_total;
+	exec_max = cwq->exec_max;
+	spin_unlock_irq(&cwq->lock);
+
+	if (nr_waits)
+		do_div(wait_total, nr_waits);
+	if (nr_executed)
+		do_div(exec_total, nr_executed);
+	seq_printf(m, "%-16s %3d %6s %10lu %10llu %10llu %10llu %10llu\n",
+		   cwq->wq->name, cpu, cwq->pool ? "pool" : "thread",
+		   nr_executed,
+		   (unsigned long long)div_u64(wait_total, NSEC_PER_USEC),
+		   (unsigned long long)div_u64(wait_max, NSEC_PER_USEC),
+		   (unsigned long long)div_u64(exec_total, NSEC_PER_USEC),
+		   (unsigned long long)div_u64(exec_max, NSEC_PER_USEC));
+}
+
+static int workqueue_stats_show(struct seq_file *m, void *v)
+{
+	struct workqueue_struct *wq;
+	struct worker_pool *pool;
+	int cpu;
+
+	seq_printf(m, "# %-14s %3s %6s %10s %10s %10s %10s %10s\n",
+		   "workqueue", "cpu", "served", "executed", "avg wait",
+		   "max wait", "avg exec", "max exec");
+	spin_lock(&workqueue_lock);
+	list_for_each_entry(wq, &all_workqueues, all_list) {
+		if (is_wq_single_threaded(wq)) {
+			workqueue_stats_cwq(m, wq_per_cpu(wq, 0),
+					    singlethread_cpu);
+			continue;
+		}
+		for_each_cpu(cpu, cpu_populated_map)
+			workqueue_stats_cwq(m, per_cpu_ptr(wq->cpu_wq, cpu),
+					    cpu);
+	}
+	spin_unlock(&workqueue_lock);
+
+	seq_printf(m, "\n# %-4s %7s %7s %7s %10s %10s %10s\n",
+		   "pool", "workers", "idle", "running", "created",
+		   "dispatched", "mayday");
+	for_each_cpu(cpu, cpu_populated_map) {
+		pool = &per_cpu(worker_pools, cpu);
+		seq_printf(m, "%6d %7d %7d %7d %10lu %10lu %10lu\n", cpu,
+			   pool->nr_workers, pool->nr_idle,
+			   atomic_read(&pool->nr_running), pool->nr_created,
+			   pool->nr_dispatched, pool->nr_mayday);
+	}
+	return 0;
+}
+
+static int workqueue_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, workqueue_stats_show, NULL);
+}
+
+static const struct file_operations workqueue_stats_fops = {
+	.open = workqueue_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init workqueue_debugfs_init(void)
+{
+	debugfs_create_file("workqueue_stats", S_IRUGO, NULL, NULL,
+			    &workqueue_stats_fops);
+	return 0;
+}
+__initcall(workqueue_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
 void __init init_workqueues(void)
 {
+	struct worker_pool *pool;
+	int cpu;
+
 	alloc_cpumask_var(&cpu_populated_map, GFP_KERNEL);
 
 	cpumask_copy(cpu_populated_map, cpu_online_mask);
 	singlethread_cpu = cpumask_first(cpu_possible_mask);
 	cpu_singlethread_map = cpumask_of(singlethread_cpu);
+
+	for_each_possible_cpu(cpu) {
+		pool = &per_cpu(worker_pools, cpu);
+		spin_lock_init(&pool->lock);
+		pool->cpu = cpu;
+		INIT_LIST_HEAD(&pool->worklist);
+		INIT_LIST_HEAD(&pool->free_list);
+		INIT_LIST_HEAD(&pool->idle_list);
+		setup_timer(&pool->mayday_timer, pool_mayday_timeout,
+			    (unsigned long)pool);
+		atomic_set(&pool->nr_running, 0);
+	}
+	for_each_online_cpu(cpu) {
+		BUG_ON(pool_prepare_cpu(cpu));
+		pool_online_cpu(cpu);
+	}
+	pool_rescuer = create_rescuer(NULL, "kworker/R");
+	BUG_ON(!pool_rescuer);
+
 	hotcpu_notifier(workqueue_cpu_callback, 0);
 	keventd_wq = create_workqueue("events");
 	BUG_ON(!keventd_wq);
@@ -0,0 +1,11 @@
+/*
+ * kernel/workqueue_sched.h
+ *
+ * Scheduler hooks for the concurrency managed worker pool of the
+ * workqueues.  Only to be included from kernel/sched.c and
+ * kernel/workqueue.c.
+ */
+
+void wq_worker_waking_up(struct task_struct *task);
+struct task_struct *wq_worker_sleeping(struct task_struct *task,
+				       unsigned int cpu);
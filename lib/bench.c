@@ -0,0 +1,188 @@
+/*
+ * Helpers shared by the benchmark and stress test modules.
+ *
+ * Copyright (C) 2009 Mathieu Desnoyers <mathieu.desnoyers@polymtl.ca>
+ *
+ * Dual LGPL v2.1/GPL v2 license.
+ */
+
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/ktime.h>
+#include <linux/cpumask.h>
+#include <linux/math64.h>
+#include <linux/bench.h>
+
+struct bench_worker {
+	struct task_struct *task;
+	void (*fn)(void *data);
+	void *data;
+};
+
+void bench_hist_add(struct bench_hist *dst, const struct bench_hist *src)
+{
+	int i;
+
+	dst->count += src->count;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	for (i = 0; i < BENCH_HIST_SIZE; i++)
+		dst->bucket[i] += src->bucket[i];
+}
+EXPORT_SYMBOL_GPL(bench_hist_add);
+
+/*
+ * Returns the upper bound, in ns, of the bucket holding the given permille
+ * of the samples.
+ */
+u64 bench_hist_percentile(const struct bench_hist *hist, unsigned int permille)
+{
+	u64 target, sum = 0;
+	int i;
+
+	target = div_u64((u64)hist->count * permille + 999, 1000);
+	for (i = 0; i < BENCH_HIST_SIZE; i++) {
+		sum += hist->bucket[i];
+		if (sum >= target)
+			return i ? 1ULL << i : 0;
+	}
+	return hist->max;
+}
+EXPORT_SYMBOL_GPL(bench_hist_percentile);
+
+/* kthread_stop() must not be called on a kthread which already returned */
+static void bench_wait_stop(void)
+{
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+}
+
+static int bench_worker_fn(void *data)
+{
+	struct bench_worker *w = data;
+
+	w->fn(w->data);
+	bench_wait_stop();
+	return 0;
+}
+
+/**
+ * bench_run_threads - run worker kthreads for a given time
+ * @bench: the benchmark, from its run callback
+ * @fn: worker function, loops until bench_should_stop()
+ * @base: array of per thread data, passed to @fn
+ * @nr: number of elements of @base, and of threads
+ * @size: size of an element of @base
+ * @run_time: run time, in seconds
+ *
+ * The time the workers ran, in ns, is left in bench->elapsed. Returns -EINTR
+ * if the benchmark is being stopped, in which case the results should be
+ * discarded.
+ */
+int bench_run_threads(struct bench *bench, void (*fn)(void *data),
+		      void *base, int nr, size_t size, int run_time)
+{
+	struct bench_worker *workers;
+	ktime_t start;
+	long timeout;
+	int i, cpu = -1, ret = 0;
+
+	bench->elapsed = 0;
+	bench->stop = 0;
+	workers = kcalloc(nr, sizeof(*workers), GFP_KERNEL);
+	if (!workers)
+		return -ENOMEM;
+
+	/* Spread the threads over the online CPUs, round-robin */
+	for (i = 0; i < nr; i++) {
+		workers[i].fn = fn;
+		workers[i].data = base + i * size;
+		workers[i].task = kthread_create(bench_worker_fn, &workers[i],
+						 "%s/%d", bench->thread_name,
+						 i);
+		if (IS_ERR(workers[i].task)) {
+			ret = PTR_ERR(workers[i].task);
+			workers[i].task = NULL;
+			goto stop;
+		}
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		kthread_bind(workers[i].task, cpu);
+	}
+
+	start = ktime_get();
+	for (i = 0; i < nr; i++)
+		wake_up_process(workers[i].task);
+
+	timeout = (long)run_time * HZ;
+	while (timeout > 0 && !kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		timeout = schedule_timeout(timeout);
+	}
+	__set_current_state(TASK_RUNNING);
+	if (timeout > 0)
+		ret = -EINTR;
+	bench->elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+stop:
+	ACCESS_ONCE(bench->stop) = 1;
+	smp_mb();
+	for (i = 0; i < nr; i++)
+		if (workers[i].task)
+			kthread_stop(workers[i].task);
+	kfree(workers);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(bench_run_threads);
+
+static int bench_control_fn(void *data)
+{
+	struct bench *bench = data;
+	int variant, ret;
+
+	for (variant = 0; variant < bench->nr_variants; variant++) {
+		if (!(bench->variants & (1UL << variant)))
+			continue;
+		ret = bench->run(variant);
+		if (ret == -EINTR)
+			break;
+		if (ret)
+			printk(KERN_ERR "%s: %s failed (%d)\n", bench->name,
+			       bench->variant_names[variant], ret);
+	}
+	bench_wait_stop();
+	return 0;
+}
+
+/*
+ * Runs the variants of the benchmark set in the variants bitmask, from a
+ * control kthread.
+ */
+int bench_start(struct bench *bench, unsigned long variants)
+{
+	bench->variants = variants;
+	bench->control = kthread_run(bench_control_fn, bench, "%s",
+				     bench->thread_name);
+	if (IS_ERR(bench->control))
+		return PTR_ERR(bench->control);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bench_start);
+
+/* Waits for the variant being run to stop, the remaining ones are skipped */
+void bench_stop(struct bench *bench)
+{
+	kthread_stop(bench->control);
+}
+EXPORT_SYMBOL_GPL(bench_stop);
+
+MODULE_LICENSE("GPL and additional rights");
+MODULE_AUTHOR("Mathieu Desnoyers");
+MODULE_DESCRIPTION("Benchmark helpers");
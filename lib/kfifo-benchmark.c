@@ -0,0 +1,299 @@
+/*
+ * Multi-producer FIFO Benchmark
+ *
+ * Runs producer threads putting fixed-size records, with interrupts off as
+ * an interrupt handler would, against consumer threads, first on a kfifo
+ * protected by a spinlock and then on a lockless multi-producer kfifo_mp.
+ * Measures the put rate, the put latency distribution and how often the
+ * FIFO was full. Several consumers are serialized by the FIFO lock in both
+ * cases.
+ *
+ * Results are printed in the kernel log at the end of each run.
+ *
+ * Copyright 2009 Mathieu Desnoyers <mathieu.desnoyers@polymtl.ca>
+ */
+
+#include <linux/module.h>
+#include <linux/kfifo.h>
+#include <linux/kfifo_mp.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/bench.h>
+
+enum bench_fifo {
+	BENCH_KFIFO,
+	BENCH_KFIFO_MP,
+	NR_BENCH_FIFOS,
+};
+
+static const char * const bench_fifo_name[NR_BENCH_FIFOS] = {
+	[BENCH_KFIFO] = "spinlocked kfifo",
+	[BENCH_KFIFO_MP] = "kfifo_mp",
+};
+
+struct bench_stats {
+	unsigned long full;		/* Puts failed on a full FIFO */
+	unsigned long gets;
+	struct bench_hist put;		/* Put latencies */
+};
+
+struct bench_thread {
+	enum bench_fifo fifo;
+	int producer;
+	struct bench_stats stats;
+};
+
+static int nr_producers = 4;
+static int nr_consumers = 1;
+static int rec_len = 64;
+static int fifo_size = 65536;
+static int batch = 32;
+static int run_time = 10;
+static int fifos = (1 << NR_BENCH_FIFOS) - 1;
+
+module_param(nr_producers, int, 0644);
+MODULE_PARM_DESC(nr_producers, "number of producer threads");
+module_param(nr_consumers, int, 0644);
+MODULE_PARM_DESC(nr_consumers, "number of consumer threads");
+module_param(rec_len, int, 0644);
+MODULE_PARM_DESC(rec_len, "record length, in bytes");
+module_param(fifo_size, int, 0644);
+MODULE_PARM_DESC(fifo_size, "FIFO size, in bytes");
+module_param(batch, int, 0644);
+MODULE_PARM_DESC(batch, "records dequeued per consumer call");
+module_param(run_time, int, 0644);
+MODULE_PARM_DESC(run_time, "run time of each FIFO, in seconds");
+module_param(fifos, int, 0644);
+MODULE_PARM_DESC(fifos, "bitmask of the FIFOs to run: 1 kfifo, 2 kfifo_mp");
+
+static int bench_run(int fifo);
+
+static struct bench kfifo_bench = {
+	.name = "kfifo benchmark",
+	.thread_name = "kfifo_bench",
+	.variant_names = bench_fifo_name,
+	.nr_variants = NR_BENCH_FIFOS,
+	.run = bench_run,
+};
+
+static struct bench_thread *bench_threads;
+static int bench_nr_threads;
+
+static DEFINE_SPINLOCK(bench_lock);
+static struct kfifo *bench_kfifo;
+static struct kfifo_mp *bench_kfifo_mp;
+
+static int bench_put(enum bench_fifo fifo, const unsigned char *rec)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	switch (fifo) {
+	case BENCH_KFIFO:
+		spin_lock_irqsave(&bench_lock, flags);
+		if (bench_kfifo->size - __kfifo_len(bench_kfifo) >= rec_len)
+			ret = __kfifo_put(bench_kfifo, rec, rec_len);
+		spin_unlock_irqrestore(&bench_lock, flags);
+		break;
+	case BENCH_KFIFO_MP:
+		local_irq_save(flags);
+		ret = kfifo_mp_put(bench_kfifo_mp, rec, rec_len);
+		local_irq_restore(flags);
+		break;
+	default:
+		BUG();
+	}
+	return ret;
+}
+
+static void bench_consume_rec(void *priv, const void *rec, unsigned int len)
+{
+	struct bench_stats *stats = priv;
+
+	stats->gets++;
+}
+
+static void bench_get(enum bench_fifo fifo, struct bench_stats *stats,
+		      unsigned char *rec)
+{
+	unsigned long flags;
+	int i;
+
+	switch (fifo) {
+	case BENCH_KFIFO:
+		spin_lock_irqsave(&bench_lock, flags);
+		for (i = 0; i < batch; i++) {
+			if (__kfifo_len(bench_kfifo) < rec_len)
+				break;
+			__kfifo_get(bench_kfifo, rec, rec_len);
+			stats->gets++;
+		}
+		spin_unlock_irqrestore(&bench_lock, flags);
+		break;
+	case BENCH_KFIFO_MP:
+		if (nr_consumers > 1)
+			kfifo_mp_consume(bench_kfifo_mp, batch,
+					 bench_consume_rec, stats);
+		else
+			__kfifo_mp_consume(bench_kfifo_mp, batch,
+					   bench_consume_rec, stats);
+		break;
+	default:
+		BUG();
+	}
+}
+
+static void bench_thread_fn(void *data)
+{
+	struct bench_thread *bt = data;
+	unsigned char *rec;
+	ktime_t start;
+	u64 lat;
+
+	rec = kzalloc(rec_len, GFP_KERNEL);
+	if (!rec)
+		return;
+
+	while (!bench_should_stop(&kfifo_bench)) {
+		if (!bt->producer) {
+			bench_get(bt->fifo, &bt->stats, rec);
+			cond_resched();
+			continue;
+		}
+		start = ktime_get();
+		if (!bench_put(bt->fifo, rec)) {
+			bt->stats.full++;
+			cpu_relax();
+		} else {
+			lat = ktime_to_ns(ktime_sub(ktime_get(), start));
+			bench_hist_record(&bt->stats.put, lat);
+		}
+		cond_resched();
+	}
+	kfree(rec);
+}
+
+static void bench_report(enum bench_fifo fifo, u64 elapsed)
+{
+	struct bench_stats stats;
+	int i;
+
+	memset(&stats, 0, sizeof(stats));
+	for (i = 0; i < bench_nr_threads; i++) {
+		struct bench_stats *ts = &bench_threads[i].stats;
+
+		stats.full += ts->full;
+		stats.gets += ts->gets;
+		bench_hist_add(&stats.put, &ts->put);
+	}
+
+	printk(KERN_INFO "kfifo benchmark: %s, %d producers, %d consumers, "
+	       "%d byte records, %llu ms\n",
+	       bench_fifo_name[fifo], nr_producers, nr_consumers, rec_len,
+	       (unsigned long long)div_u64(elapsed, NSEC_PER_MSEC));
+	printk(KERN_INFO "  puts %lu (%llu/s) full %lu gets %lu "
+	       "put ns: p50 <= %llu p99 <= %llu p99.9 <= %llu max %llu\n",
+	       stats.put.count,
+	       (unsigned long long)div64_u64((u64)stats.put.count
+					      * NSEC_PER_SEC, elapsed ? : 1),
+	       stats.full, stats.gets,
+	       (unsigned long long)bench_hist_percentile(&stats.put, 500),
+	       (unsigned long long)bench_hist_percentile(&stats.put, 990),
+	       (unsigned long long)bench_hist_percentile(&stats.put, 999),
+	       (unsigned long long)stats.put.max);
+}
+
+static int bench_alloc_fifo(enum bench_fifo fifo)
+{
+	switch (fifo) {
+	case BENCH_KFIFO:
+		bench_kfifo = kfifo_alloc(fifo_size, GFP_KERNEL, &bench_lock);
+		if (IS_ERR(bench_kfifo))
+			return PTR_ERR(bench_kfifo);
+		break;
+	case BENCH_KFIFO_MP:
+		bench_kfifo_mp = kfifo_mp_alloc(fifo_size, GFP_KERNEL,
+						&bench_lock);
+		if (IS_ERR(bench_kfifo_mp))
+			return PTR_ERR(bench_kfifo_mp);
+		break;
+	default:
+		BUG();
+	}
+	return 0;
+}
+
+static void bench_free_fifo(enum bench_fifo fifo)
+{
+	switch (fifo) {
+	case BENCH_KFIFO:
+		kfifo_free(bench_kfifo);
+		bench_kfifo = NULL;
+		break;
+	case BENCH_KFIFO_MP:
+		kfifo_mp_free(bench_kfifo_mp);
+		bench_kfifo_mp = NULL;
+		break;
+	default:
+		BUG();
+	}
+}
+
+/*
+ * Runs one FIFO for run_time seconds. Returns -EINTR if the module is being
+ * unloaded.
+ */
+static int bench_run(int fifo)
+{
+	int i, ret;
+
+	bench_nr_threads = nr_producers + nr_consumers;
+	if (nr_producers <= 0 || nr_consumers <= 0)
+		return -EINVAL;
+	ret = bench_alloc_fifo(fifo);
+	if (ret)
+		return ret;
+	bench_threads = kcalloc(bench_nr_threads, sizeof(*bench_threads),
+				GFP_KERNEL);
+	if (!bench_threads) {
+		ret = -ENOMEM;
+		goto free_fifo;
+	}
+	for (i = 0; i < bench_nr_threads; i++) {
+		bench_threads[i].fifo = fifo;
+		bench_threads[i].producer = i < nr_producers;
+	}
+
+	ret = bench_run_threads(&kfifo_bench, bench_thread_fn, bench_threads,
+				bench_nr_threads, sizeof(*bench_threads),
+				run_time);
+	if (!ret)
+		bench_report(fifo, kfifo_bench.elapsed);
+	kfree(bench_threads);
+	bench_threads = NULL;
+free_fifo:
+	bench_free_fifo(fifo);
+	return ret;
+}
+
+static int __init kfifo_bench_init(void)
+{
+	if (rec_len <= 0 || fifo_size <= 0 || batch <= 0)
+		return -EINVAL;
+	return bench_start(&kfifo_bench, fifos);
+}
+
+static void __exit kfifo_bench_exit(void)
+{
+	bench_stop(&kfifo_bench);
+}
+
+module_init(kfifo_bench_init);
+module_exit(kfifo_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Mathieu Desnoyers");
+MODULE_DESCRIPTION("Multi-producer FIFO Benchmark");
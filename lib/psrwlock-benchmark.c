@@ -0,0 +1,395 @@
+/*
+ * Priority Sifting Reader-Writer Lock Benchmark
+ *
+ * Runs reader threads in each psrwlock reader context (irq off, softirq off,
+ * preemption off and preemptable) against writer threads, and measures the
+ * acquisition rate, the acquisition wait distribution and the writer
+ * starvation. The same load is then run on a rwlock_t and a rw_semaphore for
+ * comparison. The rw_semaphore can sleep, so only its preemptable readers are
+ * run.
+ *
+ * Results are printed in the kernel log at the end of each run.
+ *
+ * Copyright 2009 Mathieu Desnoyers <mathieu.desnoyers@polymtl.ca>
+ */
+
+#include <linux/module.h>
+#include <linux/psrwlock.h>
+#include <linux/spinlock.h>
+#include <linux/rwsem.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/interrupt.h>
+#include <linux/bench.h>
+
+#define BENCH_WCTX	PSRW_PRIO_P
+#define BENCH_RCTX	(PSR_IRQ | PSR_BH | PSR_NPTHREAD | PSR_PTHREAD)
+
+static DEFINE_PSRWLOCK(bench_psrwlock, BENCH_WCTX, BENCH_RCTX);
+CHECK_PSRWLOCK_MAP(bench_psrwlock, BENCH_WCTX, BENCH_RCTX);
+static DEFINE_RWLOCK(bench_rwlock);
+static DECLARE_RWSEM(bench_rwsem);
+
+enum bench_lock {
+	BENCH_PSRWLOCK,
+	BENCH_RWLOCK,
+	BENCH_RWSEM,
+	NR_BENCH_LOCKS,
+};
+
+static const char * const bench_lock_name[NR_BENCH_LOCKS] = {
+	[BENCH_PSRWLOCK] = "psrwlock",
+	[BENCH_RWLOCK] = "rwlock_t",
+	[BENCH_RWSEM] = "rw_semaphore",
+};
+
+enum bench_class {
+	BENCH_READ_IRQ,
+	BENCH_READ_BH,
+	BENCH_READ_INATOMIC,
+	BENCH_READ_PREEMPT,
+	BENCH_WRITE,
+	NR_BENCH_CLASSES,
+};
+
+static const char *bench_class_name[NR_BENCH_CLASSES] = {
+	[BENCH_READ_IRQ] = "reader irq",
+	[BENCH_READ_BH] = "reader bh",
+	[BENCH_READ_INATOMIC] = "reader inatomic",
+	[BENCH_READ_PREEMPT] = "reader preempt",
+	[BENCH_WRITE] = "writer",
+};
+
+struct bench_stats {
+	unsigned long starved;		/* Waits longer than starve_ms */
+	struct bench_hist wait;		/* Acquisition waits */
+};
+
+struct bench_thread {
+	enum bench_lock lock;
+	enum bench_class class;
+	struct bench_stats stats;
+};
+
+static int nr_irq_readers = 1;
+static int nr_bh_readers = 1;
+static int nr_inatomic_readers = 1;
+static int nr_preempt_readers = 1;
+static int nr_writers = 1;
+static int run_time = 10;
+static int read_hold = 100;
+static int write_hold = 1000;
+static int think_time = 1000;
+static int starve_ms = 10;
+static int locks = (1 << NR_BENCH_LOCKS) - 1;
+
+module_param(nr_irq_readers, int, 0644);
+MODULE_PARM_DESC(nr_irq_readers, "readers with interrupts disabled");
+module_param(nr_bh_readers, int, 0644);
+MODULE_PARM_DESC(nr_bh_readers, "readers with softirqs disabled");
+module_param(nr_inatomic_readers, int, 0644);
+MODULE_PARM_DESC(nr_inatomic_readers, "readers with preemption disabled");
+module_param(nr_preempt_readers, int, 0644);
+MODULE_PARM_DESC(nr_preempt_readers, "preemptable readers");
+module_param(nr_writers, int, 0644);
+MODULE_PARM_DESC(nr_writers, "preemptable writers");
+module_param(run_time, int, 0644);
+MODULE_PARM_DESC(run_time, "seconds each lock is run");
+module_param(read_hold, int, 0644);
+MODULE_PARM_DESC(read_hold, "loops spent in the read-side critical section");
+module_param(write_hold, int, 0644);
+MODULE_PARM_DESC(write_hold, "loops spent in the write-side critical section");
+module_param(think_time, int, 0644);
+MODULE_PARM_DESC(think_time, "loops spent between two acquisitions");
+module_param(starve_ms, int, 0644);
+MODULE_PARM_DESC(starve_ms, "wait, in ms, after which a writer is starved");
+module_param(locks, int, 0644);
+MODULE_PARM_DESC(locks, "locks to run (1: psrwlock, 2: rwlock_t, "
+		 "4: rw_semaphore)");
+
+static int bench_run(int lock);
+
+static struct bench psrwlock_bench = {
+	.name = "psrwlock benchmark",
+	.thread_name = "psrwlock_bench",
+	.variant_names = bench_lock_name,
+	.nr_variants = NR_BENCH_LOCKS,
+	.run = bench_run,
+};
+
+static struct bench_thread *bench_threads;
+static int bench_nr_threads;
+
+static void bench_delay(int loops)
+{
+	while (loops-- > 0)
+		cpu_relax();
+}
+
+static void bench_context_enter(enum bench_class class)
+{
+	switch (class) {
+	case BENCH_READ_IRQ:
+		local_irq_disable();
+		break;
+	case BENCH_READ_BH:
+		local_bh_disable();
+		break;
+	case BENCH_READ_INATOMIC:
+		preempt_disable();
+		break;
+	default:
+		break;
+	}
+}
+
+static void bench_context_exit(enum bench_class class)
+{
+	switch (class) {
+	case BENCH_READ_IRQ:
+		local_irq_enable();
+		break;
+	case BENCH_READ_BH:
+		local_bh_enable();
+		break;
+	case BENCH_READ_INATOMIC:
+		preempt_enable();
+		break;
+	default:
+		break;
+	}
+}
+
+static void bench_psrwlock_lock(enum bench_class class)
+{
+	switch (class) {
+	case BENCH_READ_IRQ:
+		psread_lock_irq(&bench_psrwlock, BENCH_WCTX, BENCH_RCTX);
+		break;
+	case BENCH_READ_BH:
+		psread_lock_bh(&bench_psrwlock, BENCH_WCTX, BENCH_RCTX);
+		break;
+	case BENCH_READ_INATOMIC:
+		psread_lock_inatomic(&bench_psrwlock, BENCH_WCTX, BENCH_RCTX);
+		break;
+	case BENCH_READ_PREEMPT:
+		psread_lock(&bench_psrwlock, BENCH_WCTX, BENCH_RCTX);
+		break;
+	case BENCH_WRITE:
+		pswrite_lock(&bench_psrwlock, BENCH_WCTX, BENCH_RCTX);
+		break;
+	default:
+		BUG();
+	}
+}
+
+static void bench_psrwlock_unlock(enum bench_class class)
+{
+	if (class == BENCH_WRITE)
+		pswrite_unlock(&bench_psrwlock, BENCH_WCTX, BENCH_RCTX);
+	else
+		psread_unlock(&bench_psrwlock, BENCH_WCTX, BENCH_RCTX);
+}
+
+/*
+ * The rwlock_t writer disables interrupts, as it would have to if the
+ * interrupt-off readers were real interrupt handlers. The psrwlock writer
+ * does the same internally through write_context_disable().
+ */
+static void bench_lock(enum bench_lock lock, enum bench_class class)
+{
+	switch (lock) {
+	case BENCH_PSRWLOCK:
+		bench_psrwlock_lock(class);
+		break;
+	case BENCH_RWLOCK:
+		if (class == BENCH_WRITE)
+			write_lock_irq(&bench_rwlock);
+		else
+			read_lock(&bench_rwlock);
+		break;
+	case BENCH_RWSEM:
+		if (class == BENCH_WRITE)
+			down_write(&bench_rwsem);
+		else
+			down_read(&bench_rwsem);
+		break;
+	default:
+		BUG();
+	}
+}
+
+static void bench_unlock(enum bench_lock lock, enum bench_class class)
+{
+	switch (lock) {
+	case BENCH_PSRWLOCK:
+		bench_psrwlock_unlock(class);
+		break;
+	case BENCH_RWLOCK:
+		if (class == BENCH_WRITE)
+			write_unlock_irq(&bench_rwlock);
+		else
+			read_unlock(&bench_rwlock);
+		break;
+	case BENCH_RWSEM:
+		if (class == BENCH_WRITE)
+			up_write(&bench_rwsem);
+		else
+			up_read(&bench_rwsem);
+		break;
+	default:
+		BUG();
+	}
+}
+
+static void bench_record(struct bench_stats *stats, u64 wait)
+{
+	bench_hist_record(&stats->wait, wait);
+	if (wait > (u64)starve_ms * NSEC_PER_MSEC)
+		stats->starved++;
+}
+
+static void bench_thread_fn(void *data)
+{
+	struct bench_thread *bt = data;
+	ktime_t start;
+	u64 wait;
+
+	while (!bench_should_stop(&psrwlock_bench)) {
+		bench_context_enter(bt->class);
+		start = ktime_get();
+		bench_lock(bt->lock, bt->class);
+		wait = ktime_to_ns(ktime_sub(ktime_get(), start));
+		bench_delay(bt->class == BENCH_WRITE ? write_hold : read_hold);
+		bench_unlock(bt->lock, bt->class);
+		bench_context_exit(bt->class);
+
+		bench_record(&bt->stats, wait);
+		bench_delay(think_time);
+		cond_resched();
+	}
+}
+
+static int bench_class_threads(enum bench_lock lock, enum bench_class class)
+{
+	switch (class) {
+	case BENCH_READ_IRQ:
+		return lock == BENCH_RWSEM ? 0 : nr_irq_readers;
+	case BENCH_READ_BH:
+		return lock == BENCH_RWSEM ? 0 : nr_bh_readers;
+	case BENCH_READ_INATOMIC:
+		return lock == BENCH_RWSEM ? 0 : nr_inatomic_readers;
+	case BENCH_READ_PREEMPT:
+		return nr_preempt_readers;
+	case BENCH_WRITE:
+		return nr_writers;
+	default:
+		return 0;
+	}
+}
+
+static void bench_report(enum bench_lock lock, u64 elapsed)
+{
+	struct bench_stats stats;
+	enum bench_class class;
+	int i, nr;
+
+	printk(KERN_INFO "psrwlock benchmark: %s, %llu ms\n",
+	       bench_lock_name[lock],
+	       (unsigned long long)div_u64(elapsed, NSEC_PER_MSEC));
+
+	for (class = 0; class < NR_BENCH_CLASSES; class++) {
+		memset(&stats, 0, sizeof(stats));
+		nr = 0;
+		for (i = 0; i < bench_nr_threads; i++) {
+			struct bench_stats *ts = &bench_threads[i].stats;
+
+			if (bench_threads[i].class != class)
+				continue;
+			nr++;
+			stats.starved += ts->starved;
+			bench_hist_add(&stats.wait, &ts->wait);
+		}
+		if (!nr) {
+			printk(KERN_INFO "  %-16s not run\n",
+			       bench_class_name[class]);
+			continue;
+		}
+		printk(KERN_INFO "  %-16s threads %d acquisitions %lu "
+		       "(%llu/s) wait ns: p50 <= %llu p99 <= %llu "
+		       "p99.9 <= %llu max %llu\n",
+		       bench_class_name[class], nr, stats.wait.count,
+		       (unsigned long long)div64_u64((u64)stats.wait.count
+						      * NSEC_PER_SEC,
+						      elapsed ? : 1),
+		       (unsigned long long)bench_hist_percentile(&stats.wait,
+								 500),
+		       (unsigned long long)bench_hist_percentile(&stats.wait,
+								 990),
+		       (unsigned long long)bench_hist_percentile(&stats.wait,
+								 999),
+		       (unsigned long long)stats.wait.max);
+		if (class == BENCH_WRITE)
+			printk(KERN_INFO "  %-16s starved %lu times "
+			       "(wait > %d ms)\n",
+			       bench_class_name[class], stats.starved,
+			       starve_ms);
+	}
+}
+
+/*
+ * Runs one lock for run_time seconds. Returns -EINTR if the module is being
+ * unloaded.
+ */
+static int bench_run(int lock)
+{
+	enum bench_class class;
+	struct bench_thread *bt;
+	int i, n, ret;
+
+	bench_nr_threads = 0;
+	for (class = 0; class < NR_BENCH_CLASSES; class++)
+		bench_nr_threads += bench_class_threads(lock, class);
+	if (!bench_nr_threads)
+		return 0;
+	bench_threads = kcalloc(bench_nr_threads, sizeof(*bench_threads),
+				GFP_KERNEL);
+	if (!bench_threads)
+		return -ENOMEM;
+
+	bt = bench_threads;
+	for (class = 0; class < NR_BENCH_CLASSES; class++) {
+		n = bench_class_threads(lock, class);
+		for (i = 0; i < n; i++, bt++) {
+			bt->lock = lock;
+			bt->class = class;
+		}
+	}
+
+	ret = bench_run_threads(&psrwlock_bench, bench_thread_fn,
+				bench_threads, bench_nr_threads,
+				sizeof(*bench_threads), run_time);
+	if (!ret)
+		bench_report(lock, psrwlock_bench.elapsed);
+	kfree(bench_threads);
+	bench_threads = NULL;
+	return ret;
+}
+
+static int __init psrwlock_bench_init(void)
+{
+	return bench_start(&psrwlock_bench, locks);
+}
+
+static void __exit psrwlock_bench_exit(void)
+{
+	bench_stop(&psrwlock_bench);
+}
+
+module_init(psrwlock_bench_init);
+module_exit(psrwlock_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Mathieu Desnoyers");
+MODULE_DESCRIPTION("psrwlock benchmark");
@@ -16,6 +16,7 @@
 #include <linux/freezer.h>
 #include <linux/module.h>
 #include <linux/debug_locks.h>
+#include <linux/sched.h>
 
 #include <asm/processor.h>
 
@@ -52,6 +53,43 @@ static int rwlock_wait(void *vptr, psrwlock_t *rwlock,
 		enum v_type vtype, enum lock_type ltype, long state,
 		unsigned long ip);
 
+#if defined(CONFIG_SMP) && !defined(CONFIG_DEBUG_PSRWLOCK)
+/*
+ * Adaptive spinning, called by preemptable waiters once their busy-loop budget
+ * is exhausted. If a writer holds the lock and is running on another CPU, spin
+ * until it releases the lock, as mutex_lock() does, instead of going to the
+ * wait queue. Stop spinning as soon as the owner is preempted or we need to
+ * reschedule. The OWNER_SPIN scheduler feature turns spinning off.
+ *
+ * Returns 1 if the lock owner changed and the lock state should be checked
+ * again, 0 if the caller should go to the wait queue.
+ */
+static int psrwlock_spin_on_writer(psrwlock_t *rwlock)
+{
+	struct thread_info *owner;
+	int ret;
+
+	/*
+	 * If we own the BKL, then don't spin. The lock owner might be waiting
+	 * on us to release the BKL.
+	 */
+	if (unlikely(current->lock_depth >= 0) || need_resched())
+		return 0;
+	owner = ACCESS_ONCE(rwlock->owner);
+	if (!owner)
+		return 0;
+	preempt_disable();
+	ret = psrwlock_spin_on_owner(rwlock, owner);
+	preempt_enable();
+	return ret;
+}
+#else
+static inline int psrwlock_spin_on_writer(psrwlock_t *rwlock)
+{
+	return 0;
+}
+#endif
+
 /***
  * psrwlock_init - initialize the psrwlock
  * @lock: the psrwlock to be initialized
@@ -75,6 +113,7 @@ __psrwlock_init(struct psrwlock *lock, const char *name,
 	lock->wctx = wctx;
 	INIT_LIST_HEAD(&lock->wait_list_r);
 	INIT_LIST_HEAD(&lock->wait_list_w);
+	psrwlock_clear_owner(lock);
 
 	debug_psrwlock_init(lock, name, key);
 }
@@ -120,11 +159,14 @@ static int _pswrite_lock_ctx_wait_sub(void *v_inout,
 			if (trylock)
 				return 0;
 			if (ptype == PSRW_PREEMPT && unlikely(!(--try))) {
-				ret = rwlock_wait(vptr, rwlock, wait_mask,
-					test_mask, full_mask, 1,
-					vtype, ltype, state, ip);
-				if (ret < 0)
-					return ret;
+				if (!psrwlock_spin_on_writer(rwlock)) {
+					ret = rwlock_wait(vptr, rwlock,
+						wait_mask, test_mask,
+						full_mask, 1,
+						vtype, ltype, state, ip);
+					if (ret < 0)
+						return ret;
+				}
 				try = NR_PREEMPT_BUSY_LOOPS;
 			} else
 				cpu_relax();	/* Order v reads */
@@ -184,10 +226,12 @@ static int _pswrite_lock_ctx_wait(unsigned long v_in, void *vptr,
 			lock_contended(&rwlock->dep_map, ip);
 			if (trylock)
 				return 0;
-			ret = rwlock_wait(vptr, rwlock, wait_mask, 0, 0, 0,
-				vtype, ltype, state, ip);
-			if (ret < 0)
-				return ret;
+			if (!psrwlock_spin_on_writer(rwlock)) {
+				ret = rwlock_wait(vptr, rwlock, wait_mask,
+					0, 0, 0, vtype, ltype, state, ip);
+				if (ret < 0)
+					return ret;
+			}
 			try = NR_PREEMPT_BUSY_LOOPS;
 		} else
 			cpu_relax();	/* Order v reads */
@@ -778,6 +822,7 @@ static int __pswrite_lock_slow_common(unsigned int uc, psrwlock_t *rwlock,
 
 	lock_acquired(&rwlock->dep_map, ip);
 	debug_psrwlock_set_owner(rwlock, task_thread_info(task));
+	psrwlock_set_owner(rwlock);
 
 	return 1;	/* success */
 
@@ -862,6 +907,7 @@ void _pswrite_unlock_slow(unsigned int uc, psrwlock_t *rwlock)
 	mutex_release(&rwlock->dep_map, nested, _RET_IP_);
 	debug_psrwlock_unlock(rwlock, 0);
 	debug_psrwlock_clear_owner(rwlock);
+	psrwlock_clear_owner(rwlock);
 
 	/*
 	 * We get here either :
@@ -0,0 +1,168 @@
+/*
+ * Slab Bulk Allocation Benchmark
+ *
+ * Compares kmem_cache_alloc()/kmem_cache_free() called once per object with
+ * kmem_cache_alloc_bulk()/kmem_cache_free_bulk() for batches of 1 to 64
+ * objects. Two patterns are run for each batch size:
+ *
+ *  - recycle: a batch is allocated and freed again right away, so that the
+ *    objects keep coming from and going back to the per cpu freelist;
+ *  - fill: batches are allocated until working_set objects are held, then
+ *    freed batch by batch, which goes through the slow paths and the
+ *    partial lists.
+ *
+ * The cost of one allocation plus one free, in nanoseconds per object, is
+ * printed in the kernel log when the module is loaded. The load then fails
+ * with -EAGAIN on purpose, so the module never stays loaded and can simply
+ * be loaded again to repeat the measurements.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/math64.h>
+
+#define BENCH_MAX_BATCH	64
+
+static int obj_size = 256;
+static int nr_objects = 1 << 20;
+static int working_set = 4096;
+
+module_param(obj_size, int, 0444);
+MODULE_PARM_DESC(obj_size, "object size, in bytes");
+module_param(nr_objects, int, 0444);
+MODULE_PARM_DESC(nr_objects, "objects allocated and freed per measurement");
+module_param(working_set, int, 0444);
+MODULE_PARM_DESC(working_set, "objects held at once by the fill pattern");
+
+static struct kmem_cache *bench_cache;
+static void **bench_objs;
+
+static int bench_alloc(int n, int bulk, void **p)
+{
+	int i;
+
+	if (bulk)
+		return kmem_cache_alloc_bulk(bench_cache, GFP_KERNEL, n, p) ?
+								0 : -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		p[i] = kmem_cache_alloc(bench_cache, GFP_KERNEL);
+		if (!p[i]) {
+			while (i--)
+				kmem_cache_free(bench_cache, p[i]);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static void bench_free(int n, int bulk, void **p)
+{
+	int i;
+
+	if (bulk) {
+		kmem_cache_free_bulk(bench_cache, n, p);
+		return;
+	}
+
+	for (i = 0; i < n; i++)
+		kmem_cache_free(bench_cache, p[i]);
+}
+
+/* Returns the time per object in tenths of nanoseconds, 0 on failure */
+static u64 bench_recycle(int batch, int bulk)
+{
+	int rounds = nr_objects / batch;
+	ktime_t start;
+	int r;
+
+	start = ktime_get();
+	for (r = 0; r < rounds; r++) {
+		if (bench_alloc(batch, bulk, bench_objs))
+			return 0;
+		bench_free(batch, bulk, bench_objs);
+		if (!(r & 1023))
+			cond_resched();
+	}
+	return div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)) * 10,
+		       rounds * batch);
+}
+
+static u64 bench_fill(int batch, int bulk)
+{
+	int held = working_set / batch * batch;
+	int rounds = max(nr_objects / held, 1);
+	ktime_t start;
+	int r, off;
+
+	start = ktime_get();
+	for (r = 0; r < rounds; r++) {
+		for (off = 0; off < held; off += batch) {
+			if (bench_alloc(batch, bulk, bench_objs + off)) {
+				bench_free(off, 0, bench_objs);
+				return 0;
+			}
+		}
+		for (off = 0; off < held; off += batch)
+			bench_free(batch, bulk, bench_objs + off);
+		cond_resched();
+	}
+	return div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)) * 10,
+		       rounds * held);
+}
+
+static void bench_print(u64 t)
+{
+	u32 rem;
+
+	if (t) {
+		t = div_u64_rem(t, 10, &rem);
+		printk(KERN_CONT " %7llu.%u", (unsigned long long)t, rem);
+	} else
+		printk(KERN_CONT " %9s", "failed");
+}
+
+static int __init slab_bulk_bench_init(void)
+{
+	int batch;
+
+	if (obj_size <= 0 || nr_objects < BENCH_MAX_BATCH ||
+	    working_set < BENCH_MAX_BATCH)
+		return -EINVAL;
+
+	bench_objs = vmalloc(working_set * sizeof(void *));
+	if (!bench_objs)
+		return -ENOMEM;
+
+	bench_cache = kmem_cache_create("slab_bulk_bench", obj_size, 0, 0,
+					NULL);
+	if (!bench_cache) {
+		vfree(bench_objs);
+		return -ENOMEM;
+	}
+
+	printk(KERN_INFO "slab bulk benchmark: %d byte objects, "
+	       "ns per object (alloc + free)\n", obj_size);
+	printk(KERN_INFO "batch   recycle      bulk      fill      bulk\n");
+	for (batch = 1; batch <= BENCH_MAX_BATCH; batch <<= 1) {
+		printk(KERN_INFO "%5d", batch);
+		bench_print(bench_recycle(batch, 0));
+		bench_print(bench_recycle(batch, 1));
+		bench_print(bench_fill(batch, 0));
+		bench_print(bench_fill(batch, 1));
+		printk(KERN_CONT "\n");
+	}
+
+	kmem_cache_destroy(bench_cache);
+	vfree(bench_objs);
+	/* Nothing is left to keep loaded, refuse the load */
+	return -EAGAIN;
+}
+
+module_init(slab_bulk_bench_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Slab Bulk Allocation Benchmark");
@@ -28,6 +28,7 @@
  * considered afterward (not removed from the queue).
  *
  * - Create a ascii/tracename/ALL file to merge-sort all active channels.
+ *   (ascii/tracename/binary does it, without text formatting)
  * - Create a ascii/tracename/README file to contain the text output legend.
  * - Remove leading zeroes from timestamps.
  * - Enhance pretty-printing to make sure all types used for addesses output in
@@ -41,6 +42,7 @@
 #include <linux/module.h>
 #include <linux/ltt-tracer.h>
 #include <linux/ltt-relay.h>
+#include <linux/ltt-binary.h>
 #include <linux/seq_file.h>
 #include <linux/debugfs.h>
 #include <linux/module.h>
@@ -48,6 +50,7 @@
 #include <linux/slab.h>
 #include <linux/cpu.h>
 #include <linux/fs.h>
+#include <linux/vmalloc.h>
 
 #include "ltt-relay-select.h"
 
@@ -80,10 +83,13 @@ struct ltt_relay_cpu_iter {
 };
 
 struct ltt_relay_iter {
-	struct ltt_relay_cpu_iter iter_cpu[NR_CPUS];
+	struct ltt_relay_cpu_iter *iter_cpu;	/* nr_cpu_ids per channel */
+	unsigned int nr_citers;
+	struct ltt_relay_cpu_iter **heap;	/* Min-heap on tsc */
+	unsigned int heap_len;
+	struct ltt_relay_cpu_iter *curr;	/* Iterator to show */
 	struct ltt_chan *chan;
 	loff_t pos;
-	int cpu;
 	int nr_refs;
 };
 
@@ -124,10 +130,13 @@ static inline long calculate_payload_offset(long offset, u16 chID, u16 eID)
 	if (!ltt_get_alignment())
 		return offset;
 
+	rcu_read_lock_sched();
 	fmt = marker_get_fmt_from_id(chID, eID);
 	BUG_ON(!fmt);
+	offset += ltt_fmt_largest_align(offset, fmt);
+	rcu_read_unlock_sched();
 
-	return offset + ltt_fmt_largest_align(offset, fmt);
+	return offset;
 }
 
 static void update_new_event(struct ltt_relay_cpu_iter *citer, long hdr_offset)
@@ -157,10 +166,12 @@ static void update_event_size(struct ltt_relay_cpu_iter *citer, long hdr_offset)
 	if (citer->data_size != INT_MAX)
 		return;
 
+	rcu_read_lock_sched();
 	fmt = marker_get_fmt_from_id(citer->chID, citer->eID);
 	BUG_ON(!fmt);
 	ltt_serialize_printf(citer->buf, citer->payload_offset,
 			     &data_size, output, 0, fmt);
+	rcu_read_unlock_sched();
 	citer->data_size = data_size;
 }
 
@@ -261,34 +272,67 @@ static int ltt_relay_iter_eof(struct ltt_relay_iter *iter)
 	return iter->nr_refs == 0;
 }
 
-static void ltt_relay_advance_iter(struct ltt_relay_iter *iter)
+/*
+ * The heap holds the cpu iterators having a current event, the one with the
+ * smallest tsc at the root.
+ */
+static void ltt_relay_heap_down(struct ltt_relay_iter *iter, unsigned int i)
 {
-	int i;
-	struct ltt_relay_cpu_iter *curr, *min = NULL;
-	iter->cpu = -1;
+	struct ltt_relay_cpu_iter **heap = iter->heap;
+	struct ltt_relay_cpu_iter *tmp;
+	unsigned int child;
 
-	/*
-	 * find the event with the minimum tsc.
-	 * TODO: use min-heep for 4096CPUS
-	 */
-	for_each_possible_cpu(i) {
-		curr = &iter->iter_cpu[i];
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= iter->heap_len)
+			break;
+		if (child + 1 < iter->heap_len
+		    && heap[child + 1]->tsc < heap[child]->tsc)
+			child++;
+		if (heap[i]->tsc <= heap[child]->tsc)
+			break;
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
 
-		if (!curr->buf->a.allocated || !curr->header)
-			continue;
+static void ltt_relay_heap_init(struct ltt_relay_iter *iter)
+{
+	struct ltt_relay_cpu_iter *citer;
+	unsigned int i;
 
-		if (cpu_iter_eof(curr))
+	iter->heap_len = 0;
+	for (i = 0; i < iter->nr_citers; i++) {
+		citer = &iter->iter_cpu[i];
+		if (!citer->buf || !citer->buf->a.allocated || !citer->header)
 			continue;
-
-		if (!min || curr->tsc < min->tsc) {
-			min = curr;
-			iter->cpu = i;
-		}
+		if (cpu_iter_eof(citer))
+			continue;
+		iter->heap[iter->heap_len++] = citer;
 	}
+	for (i = iter->heap_len / 2; i-- > 0;)
+		ltt_relay_heap_down(iter, i);
+}
+
+static void ltt_relay_advance_iter(struct ltt_relay_iter *iter)
+{
+	struct ltt_relay_cpu_iter *min;
+
+	iter->curr = NULL;
+	if (!iter->heap_len)
+		return;
+
+	/* the event with the minimum tsc is at the root of the heap */
+	min = iter->heap[0];
+	iter->curr = min;
 
 	/* update cpu_iter for next ltt_relay_advance_iter() */
-	if (min)
-		ltt_relay_advance_cpu_iter(min);
+	ltt_relay_advance_cpu_iter(min);
+	if (cpu_iter_eof(min) || !min->header)
+		iter->heap[0] = iter->heap[--iter->heap_len];
+	ltt_relay_heap_down(iter, 0);
 }
 
 static void *ascii_next(struct seq_file *m, void *v, loff_t *ppos)
@@ -345,10 +389,9 @@ static int ascii_show(struct seq_file *m, void *v)
 	unsigned long long tsc;
 	size_t data_size;
 
-	if (iter->cpu == -1)
+	citer = iter->curr;
+	if (!citer)
 		return 0;
-
-	citer = &iter->iter_cpu[iter->cpu];
 	WARN_ON_ONCE(!citer->sb_ref);
 	/*
 	 * Nothing to show, we are at the end of the last subbuffer currently
@@ -358,19 +401,21 @@ static int ascii_show(struct seq_file *m, void *v)
 		return 0;
 
 	tsc = citer->tsc;
+	rcu_read_lock_sched();
 	name = marker_get_name_from_id(citer->chID, citer->eID);
 	fmt = marker_get_fmt_from_id(citer->chID, citer->eID);
 
 	if (!name || !fmt)
-		return 0;
+		goto end;
 
 	seq_printf(m, "event:%16.16s: cpu:%2d time:%20.20llu ",
-		   name, iter->cpu, tsc);
+		   name, citer->buf->a.cpu, tsc);
 	seq_serialize(m, citer->buf, citer->payload_offset, fmt, &data_size);
 	seq_puts(m, "\n");
 	if (citer->data_size == INT_MAX)
 		citer->data_size = data_size;
-
+end:
+	rcu_read_unlock_sched();
 	return 0;
 }
 
@@ -383,14 +428,15 @@ static struct seq_operations ascii_seq_ops = {
 
 /* FIXME : cpu hotplug support */
 static int ltt_relay_iter_open_channel(struct ltt_relay_iter *iter,
-				       struct ltt_chan *chan)
+				       struct ltt_chan *chan,
+				       struct ltt_relay_cpu_iter *iter_cpu)
 {
 	int i, ret;
 	u16 chID = ltt_channels_get_index_from_name(chan->a.filename);
 
 	/* we don't need lock relay_channels_mutex */
 	for_each_possible_cpu(i) {
-		struct ltt_relay_cpu_iter *citer = &iter->iter_cpu[i];
+		struct ltt_relay_cpu_iter *citer = &iter_cpu[i];
 
 		citer->buf = per_cpu_ptr(chan->a.buf, i);
 		if (!citer->buf->a.allocated)
@@ -423,19 +469,20 @@ static int ltt_relay_iter_open_channel(struct ltt_relay_iter *iter,
 		}
 		update_cpu_iter(citer, citer->hdr_offset);
 	}
-	if (!iter->nr_refs)
-		return -ENODATA; /* no data available */
 	return 0;
 
 error:
 	for_each_possible_cpu(i) {
-		struct ltt_relay_cpu_iter *citer = &iter->iter_cpu[i];
+		struct ltt_relay_cpu_iter *citer = &iter_cpu[i];
 
 		if (!citer->buf)
 			break;
 
+		if (citer->sb_ref)
+			subbuffer_stop(citer, citer->read_sb_offset);
 		if (citer->buf->a.allocated)
 			ltt_chanbuf_release_read(citer->buf);
+		citer->buf = NULL;
 	}
 	return ret;
 }
@@ -443,18 +490,19 @@ error:
 /* FIXME : cpu hotplug support */
 static int ltt_relay_iter_release_channel(struct ltt_relay_iter *iter)
 {
-	int i;
+	unsigned int i;
 
-	for_each_possible_cpu(i) {
+	for (i = 0; i < iter->nr_citers; i++) {
 		struct ltt_relay_cpu_iter *citer = &iter->iter_cpu[i];
 
+		if (!citer->buf)
+			continue;
 		if (citer->sb_ref) {
 			WARN_ON_ONCE(!citer->buf->a.allocated);
 			DEBUGP(KERN_DEBUG
 				"LTT ASCII release stop cpu %d offset %lX\n",
 				citer->buf->a.cpu, citer->read_sb_offset);
-			subbuffer_stop(&iter->iter_cpu[i],
-				       citer->read_sb_offset);
+			subbuffer_stop(citer, citer->read_sb_offset);
 		}
 		if (citer->buf->a.allocated)
 			ltt_chanbuf_release_read(citer->buf);
@@ -463,18 +511,51 @@ static int ltt_relay_iter_release_channel(struct ltt_relay_iter *iter)
 	return 0;
 }
 
+static struct ltt_relay_iter *ltt_relay_iter_alloc(unsigned int nr_chans)
+{
+	struct ltt_relay_iter *iter;
+
+	iter = kzalloc(sizeof(*iter), GFP_KERNEL);
+	if (!iter)
+		return NULL;
+	iter->nr_citers = nr_chans * nr_cpu_ids;
+	iter->iter_cpu = kcalloc(iter->nr_citers, sizeof(*iter->iter_cpu),
+				 GFP_KERNEL);
+	iter->heap = kcalloc(iter->nr_citers, sizeof(*iter->heap),
+			     GFP_KERNEL);
+	if (!iter->iter_cpu || !iter->heap) {
+		kfree(iter->iter_cpu);
+		kfree(iter->heap);
+		kfree(iter);
+		return NULL;
+	}
+	return iter;
+}
+
+static void ltt_relay_iter_free(struct ltt_relay_iter *iter)
+{
+	kfree(iter->iter_cpu);
+	kfree(iter->heap);
+	kfree(iter);
+}
+
 static int ltt_relay_ascii_open(struct inode *inode, struct file *file)
 {
 	int ret;
 	struct ltt_chan *chan = inode->i_private;
-	struct ltt_relay_iter *iter = kzalloc(sizeof(*iter), GFP_KERNEL);
+	struct ltt_relay_iter *iter = ltt_relay_iter_alloc(1);
 	if (!iter)
 		return -ENOMEM;
 
 	iter->chan = chan;
-	ret = ltt_relay_iter_open_channel(iter, chan);
+	ret = ltt_relay_iter_open_channel(iter, chan, iter->iter_cpu);
 	if (ret)
 		goto error_free_alloc;
+	if (!iter->nr_refs) {
+		ret = -ENODATA; /* no data available */
+		goto error_release_channel;
+	}
+	ltt_relay_heap_init(iter);
 
 	ret = seq_open(file, &ascii_seq_ops);
 	if (ret)
@@ -485,7 +566,7 @@ static int ltt_relay_ascii_open(struct inode *inode, struct file *file)
 error_release_channel:
 	ltt_relay_iter_release_channel(iter);
 error_free_alloc:
-	kfree(iter);
+	ltt_relay_iter_free(iter);
 	return ret;
 }
 
@@ -495,7 +576,7 @@ static int ltt_relay_ascii_release(struct inode *inode, struct file *file)
 	struct ltt_relay_iter *iter = seq->private;
 
 	ltt_relay_iter_release_channel(iter);
-	kfree(iter);
+	ltt_relay_iter_free(iter);
 	return 0;
 }
 
@@ -508,6 +589,240 @@ static struct file_operations ltt_ascii_fops =
 	.owner = THIS_MODULE,
 };
 
+/*
+ * Merged binary stream of all the channels of a trace. See
+ * include/linux/ltt-binary.h for the format.
+ */
+struct ltt_binary_reader {
+	struct ltt_relay_iter *iter;
+	struct ltt_trace *trace;
+	unsigned long **described;	/* Per channel event id bitmaps */
+	unsigned int nr_described;
+	int header_done;
+	char *rec;			/* Record being read */
+	size_t rec_size, rec_len, rec_pos;
+	loff_t pos;			/* Stream offset of rec */
+};
+
+/* returns 1 if the (channel, event) pair needs a metadata record */
+static int ltt_binary_describe(struct ltt_binary_reader *reader,
+			       u16 chID, u16 eID)
+{
+	unsigned long *bitmap;
+
+	if (chID >= reader->nr_described)
+		return 0;
+	bitmap = reader->described[chID];
+	if (!bitmap) {
+		bitmap = kzalloc(BITS_TO_LONGS(EVENTS_PER_CHANNEL)
+				 * sizeof(long), GFP_KERNEL);
+		if (!bitmap)
+			return 0;
+		reader->described[chID] = bitmap;
+	}
+	return !test_and_set_bit(eID, bitmap);
+}
+
+static size_t ltt_binary_put_str(char *dest, size_t avail, const char *str)
+{
+	size_t len = min(strlen(str) + 1, avail);
+
+	memcpy(dest, str, len);
+	if (len)
+		dest[len - 1] = '\0';
+	return len;
+}
+
+/*
+ * Fill reader->rec with the next record. Returns 0 at the end of the stream.
+ */
+static int ltt_binary_fill(struct ltt_binary_reader *reader)
+{
+	struct ltt_relay_iter *iter = reader->iter;
+	struct ltt_relay_cpu_iter *citer;
+	struct ltt_binary_event_header *hdr;
+	const char *name, *fmt;
+	size_t avail, pad;
+	char *payload;
+
+	reader->pos += reader->rec_len;
+	reader->rec_len = reader->rec_pos = 0;
+
+	if (!reader->header_done) {
+		struct ltt_binary_stream_header *shdr =
+			(struct ltt_binary_stream_header *)reader->rec;
+
+		shdr->magic = LTT_BINARY_MAGIC;
+		shdr->alignment = ltt_get_alignment();
+		shdr->header_size = sizeof(*hdr);
+		shdr->reserved = 0;
+		reader->rec_len = sizeof(*shdr);
+		reader->header_done = 1;
+		return 1;
+	}
+
+	if (ltt_relay_iter_eof(iter) || !iter->heap_len)
+		return 0;
+	citer = iter->heap[0];
+	hdr = (struct ltt_binary_event_header *)reader->rec;
+	hdr->channel = citer->chID;
+	hdr->event = citer->eID;
+	hdr->reserved = 0;
+	payload = reader->rec + sizeof(*hdr);
+	avail = reader->rec_size - sizeof(*hdr);
+
+	if (ltt_binary_describe(reader, citer->chID, citer->eID)) {
+		rcu_read_lock_sched();
+		name = marker_get_name_from_id(citer->chID, citer->eID);
+		fmt = marker_get_fmt_from_id(citer->chID, citer->eID);
+		hdr->tsc = 0;
+		hdr->cpu = LTT_BINARY_METADATA;
+		hdr->pad = 0;
+		hdr->size = ltt_binary_put_str(payload, avail,
+					       citer->buf->a.chan->filename);
+		hdr->size += ltt_binary_put_str(payload + hdr->size,
+						avail - hdr->size,
+						name ? name : "");
+		hdr->size += ltt_binary_put_str(payload + hdr->size,
+						avail - hdr->size,
+						fmt ? fmt : "");
+		rcu_read_unlock_sched();
+		reader->rec_len = sizeof(*hdr) + hdr->size;
+		return 1;
+	}
+
+	pad = 0;
+	if (ltt_get_alignment())
+		pad = (citer->payload_offset - (reader->pos + sizeof(*hdr)))
+		      & (sizeof(void *) - 1);
+	hdr->tsc = citer->tsc;
+	hdr->cpu = citer->buf->a.cpu;
+	hdr->pad = pad;
+	hdr->size = min_t(size_t, citer->data_size, avail - pad);
+	memset(payload, 0, pad);
+	ltt_relay_read(&citer->buf->a, citer->payload_offset, payload + pad,
+		       hdr->size);
+	reader->rec_len = sizeof(*hdr) + pad + hdr->size;
+
+	ltt_relay_advance_iter(iter);
+	return 1;
+}
+
+static int ltt_relay_binary_open(struct inode *inode, struct file *file)
+{
+	struct ltt_trace *trace = inode->i_private;
+	struct ltt_binary_reader *reader;
+	struct ltt_relay_iter *iter;
+	struct ltt_chan *chan;
+	size_t max_sb_size = 0;
+	unsigned int i, n = 0;
+	int ret;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+	iter = ltt_relay_iter_alloc(trace->nr_channels);
+	if (!iter) {
+		ret = -ENOMEM;
+		goto error_free_reader;
+	}
+	reader->iter = iter;
+	reader->trace = trace;
+	reader->nr_described = trace->nr_channels;
+	reader->described = kcalloc(trace->nr_channels,
+				    sizeof(*reader->described), GFP_KERNEL);
+	if (!reader->described) {
+		ret = -ENOMEM;
+		goto error_free_iter;
+	}
+
+	for (i = 0; i < trace->nr_channels; i++) {
+		chan = &trace->channels[i];
+		if (!chan->active)
+			continue;
+		max_sb_size = max_t(size_t, max_sb_size, chan->a.sb_size);
+		ret = ltt_relay_iter_open_channel(iter, chan,
+				&iter->iter_cpu[n++ * nr_cpu_ids]);
+		if (ret)
+			goto error_release;
+	}
+	if (!iter->nr_refs) {
+		ret = -ENODATA; /* no data available */
+		goto error_release;
+	}
+	ltt_relay_heap_init(iter);
+
+	reader->rec_size = sizeof(struct ltt_binary_event_header)
+			   + sizeof(void *) + max_sb_size;
+	reader->rec = vmalloc(reader->rec_size);
+	if (!reader->rec) {
+		ret = -ENOMEM;
+		goto error_release;
+	}
+	file->private_data = reader;
+	return nonseekable_open(inode, file);
+
+error_release:
+	ltt_relay_iter_release_channel(iter);
+	kfree(reader->described);
+error_free_iter:
+	ltt_relay_iter_free(iter);
+error_free_reader:
+	kfree(reader);
+	return ret;
+}
+
+static int ltt_relay_binary_release(struct inode *inode, struct file *file)
+{
+	struct ltt_binary_reader *reader = file->private_data;
+	unsigned int i;
+
+	ltt_relay_iter_release_channel(reader->iter);
+	ltt_relay_iter_free(reader->iter);
+	for (i = 0; i < reader->nr_described; i++)
+		kfree(reader->described[i]);
+	kfree(reader->described);
+	vfree(reader->rec);
+	kfree(reader);
+	return 0;
+}
+
+static ssize_t ltt_relay_binary_read(struct file *file, char __user *user_buf,
+				     size_t count, loff_t *ppos)
+{
+	struct ltt_binary_reader *reader = file->private_data;
+	size_t len;
+	ssize_t copied = 0;
+
+	while (count) {
+		if (reader->rec_pos == reader->rec_len) {
+			if (!ltt_binary_fill(reader))
+				break;
+		}
+		len = min(count, reader->rec_len - reader->rec_pos);
+		if (copy_to_user(user_buf + copied,
+				 reader->rec + reader->rec_pos, len))
+			return copied ? copied : -EFAULT;
+		reader->rec_pos += len;
+		copied += len;
+		count -= len;
+		if (signal_pending(current))
+			break;
+	}
+	if (!copied && signal_pending(current))
+		return -ERESTARTSYS;
+	*ppos += copied;
+	return copied;
+}
+
+static const struct file_operations ltt_binary_fops = {
+	.read = ltt_relay_binary_read,
+	.open = ltt_relay_binary_open,
+	.release = ltt_relay_binary_release,
+	.llseek = no_llseek,
+	.owner = THIS_MODULE,
+};
+
 int ltt_ascii_create(struct ltt_chan *chan)
 {
 	struct dentry *dentry;
@@ -540,13 +855,19 @@ int ltt_ascii_create_dir(struct ltt_trace *new_trace)
 							  ltt_ascii_dir_dentry);
 	if (!new_trace->dentry.ascii_root)
 		return -EEXIST;
+	if (!debugfs_create_file("binary", S_IRUSR | S_IRGRP,
+				 new_trace->dentry.ascii_root, new_trace,
+				 &ltt_binary_fops)) {
+		debugfs_remove(new_trace->dentry.ascii_root);
+		return -ENOMEM;
+	}
 	return 0;
 }
 EXPORT_SYMBOL_GPL(ltt_ascii_create_dir);
 
 void ltt_ascii_remove_dir(struct ltt_trace *trace)
 {
-	debugfs_remove(trace->dentry.ascii_root);
+	debugfs_remove_recursive(trace->dentry.ascii_root);
 }
 EXPORT_SYMBOL_GPL(ltt_ascii_remove_dir);
 
@@ -85,7 +85,8 @@ EXPORT_SYMBOL_GPL(ltt_unlock_traces);
 DEFINE_PER_CPU(unsigned int, ltt_nesting);
 EXPORT_PER_CPU_SYMBOL(ltt_nesting);
 
-int ltt_run_filter_default(void *trace, uint16_t eID)
+int ltt_run_filter_default(void *trace, const struct marker *mdata,
+			   const void *data, va_list *args)
 {
 	return 1;
 }
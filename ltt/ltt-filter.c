@@ -1,4 +1,27 @@
 /*
+ * LTTng in-kernel event filter.
+ *
+ * Filters are predicate expressions attached to a marker (channel and name)
+ * through debugfs. Each expression is compiled once, against the marker
+ * format string, into a small stack machine program evaluated by ltt_vtrace
+ * and the specialized probes before space is reserved in the trace buffers.
+ *
+ * Expression syntax :
+ *
+ *   expr := and ( "||" and )*
+ *   and  := unary ( "&&" unary )*
+ *   unary := "!" unary | "(" expr ")" | field op value
+ *   op := "==" | "!=" | "<" | "<=" | ">" | ">=" | "&"
+ *
+ * Fields are the names of the marker format string fields (e.g. "irq_id" in
+ * "irq_id #2u%u"). "pid", "tgid" and "cpu" refer to the current context when
+ * the format has no field with that name. Values are integers, or quoted
+ * strings for string fields (== and != only). A string ending with '*' is a
+ * prefix match. "&" is true when the field has any bit of the value set.
+ *
+ *   echo "kernel irq_entry irq_id == 17 || irq_id == 42" > filter/set
+ *   echo "kernel irq_entry" > filter/clear
+ *
  * Copyright (C) 2008 Mathieu Desnoyers
  *
  * Dual LGPL v2.1/GPL v2 license.
@@ -9,15 +32,122 @@
 #include <linux/fs.h>
 #include <linux/ltt-tracer.h>
 #include <linux/mutex.h>
+#include <linux/ctype.h>
+#include <linux/hash.h>
+#include <linux/marker.h>
+#include <linux/notifier.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <asm/unaligned.h>
 
 #define LTT_FILTER_DIR	"filter"
+#define LTT_FILTER_SET	"set"
+#define LTT_FILTER_CLEAR	"clear"
+#define LTT_FILTER_LIST	"list"
+
+/* Limits of a compiled filter */
+#define LTT_FILTER_MAX_FIELDS	16
+#define LTT_FILTER_MAX_INSNS	64
+#define LTT_FILTER_MAX_DEPTH	32	/* Boolean stack is a u32 */
+#define LTT_FILTER_STRTAB_SIZE	256
+
+enum ltt_filter_op {
+	LTT_FILTER_OP_EQ,		/* Push (src == imm) */
+	LTT_FILTER_OP_NE,
+	LTT_FILTER_OP_LT,		/* Unsigned comparisons */
+	LTT_FILTER_OP_LE,
+	LTT_FILTER_OP_GT,
+	LTT_FILTER_OP_GE,
+	LTT_FILTER_OP_LT_S,		/* Signed comparisons */
+	LTT_FILTER_OP_LE_S,
+	LTT_FILTER_OP_GT_S,
+	LTT_FILTER_OP_GE_S,
+	LTT_FILTER_OP_MASK,		/* Push ((src & imm) != 0) */
+	LTT_FILTER_OP_STR_EQ,		/* Push (!strcmp(src, strtab + imm)) */
+	LTT_FILTER_OP_STR_PREFIX,	/* Push (!strncmp(src, ..., len)) */
+	LTT_FILTER_OP_AND,		/* Pop two, push logical and */
+	LTT_FILTER_OP_OR,		/* Pop two, push logical or */
+	LTT_FILTER_OP_NOT,		/* Invert top of stack */
+};
+
+/* Context sources, used when the format has no field by that name */
+#define LTT_FILTER_SRC_PID	0xFD
+#define LTT_FILTER_SRC_TGID	0xFE
+#define LTT_FILTER_SRC_CPU	0xFF
+
+struct ltt_filter_insn {
+	u8 op;			/* enum ltt_filter_op */
+	u8 src;			/* Field index or LTT_FILTER_SRC_* */
+	u16 len;		/* String operand length */
+	u64 imm;		/* Integer operand or string table offset */
+};
+
+/*
+ * How to fetch a field from the variable argument list or from a specialized
+ * probe binary payload. offset is the position of the field in the binary
+ * payload, or -1 when it follows a string.
+ */
+struct ltt_filter_fetch {
+	u8 c_type;
+	u8 c_size;
+	u8 trace_type;
+	u8 trace_size;
+	int offset;
+};
+
+struct ltt_filter_prog {
+	struct rcu_head rcu;
+	unsigned int nr_insns;
+	unsigned int nr_fields;	/* Fields 0 to nr_fields - 1 are fetched */
+	struct ltt_filter_fetch fetch[LTT_FILTER_MAX_FIELDS];
+	char *strtab;
+	struct ltt_filter_insn insns[0];
+};
+
+union ltt_filter_value {
+	u64 v;
+	const char *s;
+};
 
 /*
- * Protects the ltt_filter_dir allocation.
+ * A filter definition, attached to every marker site (struct marker) with
+ * the same channel and name, including those of modules loaded later on.
+ */
+struct ltt_filter {
+	struct list_head list;		/* ltt_filters list */
+	struct list_head sites;		/* Sites this filter is attached to */
+	char *name;
+	char *expr;
+	char channel[0];		/* Contains channel'\0'name'\0'expr'\0' */
+};
+
+struct ltt_filter_site {
+	struct hlist_node hlist;	/* ltt_filter_site_table node */
+	struct list_head list;		/* Owner filter sites list */
+	const struct marker *mdata;
+	struct ltt_filter_prog *prog;
+	struct rcu_head rcu;
+};
+
+/*
+ * Protects the ltt_filter_dir allocation, the filters list and updates of the
+ * sites hash table. The sites hash table is read with preemption disabled
+ * from the tracing fast path.
  */
 static DEFINE_MUTEX(ltt_filter_mutex);
 
-static struct dentry *ltt_filter_dir;
+static struct dentry *ltt_filter_dir, *ltt_filter_set_dentry,
+		     *ltt_filter_clear_dentry, *ltt_filter_list_dentry;
+
+static LIST_HEAD(ltt_filters);
+
+#define LTT_FILTER_HASH_BITS	6
+#define LTT_FILTER_TABLE_SIZE	(1 << LTT_FILTER_HASH_BITS)
+static struct hlist_head ltt_filter_site_table[LTT_FILTER_TABLE_SIZE];
 
 struct dentry *get_filter_root(void)
 {
@@ -42,8 +172,999 @@ err_no_root:
 }
 EXPORT_SYMBOL_GPL(get_filter_root);
 
+/*
+ * Filter compiler.
+ */
+
+struct ltt_filter_compiler {
+	const char *pos;		/* Current parsing position */
+	struct ltt_fmt_field *fields;	/* NULL : syntax check only */
+	int nr_fields;
+	int max_field;			/* Highest field index referenced */
+	int depth, max_depth;
+	unsigned int nr_insns;
+	struct ltt_filter_insn insns[LTT_FILTER_MAX_INSNS];
+	unsigned int strtab_len;
+	char strtab[LTT_FILTER_STRTAB_SIZE];
+};
+
+static int compile_expr(struct ltt_filter_compiler *c);
+
+static void skip_ws(struct ltt_filter_compiler *c)
+{
+	while (isspace(*c->pos))
+		c->pos++;
+}
+
+static int match_token(struct ltt_filter_compiler *c, const char *token)
+{
+	size_t len = strlen(token);
+
+	skip_ws(c);
+	if (strncmp(c->pos, token, len))
+		return 0;
+	c->pos += len;
+	return 1;
+}
+
+static int emit(struct ltt_filter_compiler *c, u8 op, u8 src, u16 len,
+		u64 imm)
+{
+	struct ltt_filter_insn *insn;
+
+	if (c->nr_insns >= LTT_FILTER_MAX_INSNS)
+		return -E2BIG;
+	insn = &c->insns[c->nr_insns++];
+	insn->op = op;
+	insn->src = src;
+	insn->len = len;
+	insn->imm = imm;
+
+	switch (op) {
+	case LTT_FILTER_OP_AND:
+	case LTT_FILTER_OP_OR:
+		c->depth--;
+		break;
+	case LTT_FILTER_OP_NOT:
+		break;
+	default:
+		c->depth++;
+		c->max_depth = max(c->max_depth, c->depth);
+		if (c->max_depth > LTT_FILTER_MAX_DEPTH)
+			return -E2BIG;
+	}
+	return 0;
+}
+
+/*
+ * Resolve a field name to a field index or a context source. Sets *type to
+ * the trace type of the field.
+ */
+static int resolve_field(struct ltt_filter_compiler *c, const char *name,
+			 size_t len, enum ltt_type *type)
+{
+	int i;
+
+	*type = LTT_TYPE_UNSIGNED_INT;
+	if (!c->fields)
+		return 0;
+	for (i = 0; i < min(c->nr_fields, LTT_FILTER_MAX_FIELDS); i++) {
+		if (c->fields[i].name_len == len
+		    && !strncmp(c->fields[i].name, name, len)) {
+			*type = c->fields[i].trace_type;
+			c->max_field = max(c->max_field, i);
+			return i;
+		}
+	}
+	if (len == 3 && !strncmp(name, "pid", len))
+		return LTT_FILTER_SRC_PID;
+	if (len == 4 && !strncmp(name, "tgid", len))
+		return LTT_FILTER_SRC_TGID;
+	if (len == 3 && !strncmp(name, "cpu", len)) {
+		*type = LTT_TYPE_SIGNED_INT;
+		return LTT_FILTER_SRC_CPU;
+	}
+	printk(KERN_INFO "LTT filter : unknown field %.*s\n", (int)len, name);
+	return -ENOENT;
+}
+
+static int compile_string(struct ltt_filter_compiler *c, u8 src, int negate)
+{
+	const char *end;
+	size_t len;
+	u8 op = LTT_FILTER_OP_STR_EQ;
+	int ret;
+
+	end = strchr(c->pos, '"');
+	if (!end)
+		return -EINVAL;
+	len = end - c->pos;
+	if (c->strtab_len + len + 1 > LTT_FILTER_STRTAB_SIZE)
+		return -E2BIG;
+	memcpy(c->strtab + c->strtab_len, c->pos, len);
+	c->strtab[c->strtab_len + len] = '\0';
+	c->pos = end + 1;
+	if (len && c->strtab[c->strtab_len + len - 1] == '*') {
+		op = LTT_FILTER_OP_STR_PREFIX;
+		len--;
+	}
+	ret = emit(c, op, src, len, c->strtab_len);
+	c->strtab_len += len + 1;
+	if (ret)
+		return ret;
+	if (negate)
+		return emit(c, LTT_FILTER_OP_NOT, 0, 0, 0);
+	return 0;
+}
+
+static int compile_predicate(struct ltt_filter_compiler *c)
+{
+	const char *name, *end;
+	enum ltt_type type;
+	int src, sign;
+	u8 op;
+	u64 imm;
+
+	skip_ws(c);
+	name = c->pos;
+	while (isalnum(*c->pos) || *c->pos == '_')
+		c->pos++;
+	if (c->pos == name)
+		return -EINVAL;
+	src = resolve_field(c, name, c->pos - name, &type);
+	if (src < 0)
+		return src;
+	sign = (type == LTT_TYPE_SIGNED_INT);
+
+	if (match_token(c, "=="))
+		op = LTT_FILTER_OP_EQ;
+	else if (match_token(c, "!="))
+		op = LTT_FILTER_OP_NE;
+	else if (match_token(c, "<="))
+		op = sign ? LTT_FILTER_OP_LE_S : LTT_FILTER_OP_LE;
+	else if (match_token(c, ">="))
+		op = sign ? LTT_FILTER_OP_GE_S : LTT_FILTER_OP_GE;
+	else if (match_token(c, "<"))
+		op = sign ? LTT_FILTER_OP_LT_S : LTT_FILTER_OP_LT;
+	else if (match_token(c, ">"))
+		op = sign ? LTT_FILTER_OP_GT_S : LTT_FILTER_OP_GT;
+	else if (match_token(c, "&") && *c->pos != '&')
+		op = LTT_FILTER_OP_MASK;
+	else
+		return -EINVAL;
+
+	if (match_token(c, "\"")) {
+		if (c->fields && type != LTT_TYPE_STRING)
+			return -EINVAL;
+		if (op != LTT_FILTER_OP_EQ && op != LTT_FILTER_OP_NE)
+			return -EINVAL;
+		return compile_string(c, src, op == LTT_FILTER_OP_NE);
+	}
+	if (type == LTT_TYPE_STRING)
+		return -EINVAL;
+	if (*c->pos == '-')
+		imm = (u64)simple_strtoll(c->pos, (char **)&end, 0);
+	else
+		imm = simple_strtoull(c->pos, (char **)&end, 0);
+	if (end == c->pos)
+		return -EINVAL;
+	c->pos = end;
+	return emit(c, op, src, 0, imm);
+}
+
+static int compile_unary(struct ltt_filter_compiler *c)
+{
+	int ret;
+
+	if (match_token(c, "!")) {
+		ret = compile_unary(c);
+		if (ret)
+			return ret;
+		return emit(c, LTT_FILTER_OP_NOT, 0, 0, 0);
+	} else if (match_token(c, "(")) {
+		ret = compile_expr(c);
+		if (ret)
+			return ret;
+		if (!match_token(c, ")"))
+			return -EINVAL;
+		return 0;
+	}
+	return compile_predicate(c);
+}
+
+static int compile_and(struct ltt_filter_compiler *c)
+{
+	int ret;
+
+	ret = compile_unary(c);
+	while (!ret && match_token(c, "&&")) {
+		ret = compile_unary(c);
+		if (!ret)
+			ret = emit(c, LTT_FILTER_OP_AND, 0, 0, 0);
+	}
+	return ret;
+}
+
+static int compile_expr(struct ltt_filter_compiler *c)
+{
+	int ret;
+
+	ret = compile_and(c);
+	while (!ret && match_token(c, "||")) {
+		ret = compile_and(c);
+		if (!ret)
+			ret = emit(c, LTT_FILTER_OP_OR, 0, 0, 0);
+	}
+	return ret;
+}
+
+/*
+ * ltt_filter_compile - Compile a filter expression against a marker format
+ * @expr: filter expression
+ * @format: marker format string, or NULL to only check the syntax
+ *
+ * Returns the compiled program, NULL for a syntax check, or an ERR_PTR.
+ */
+static struct ltt_filter_prog *ltt_filter_compile(const char *expr,
+						  const char *format)
+{
+	struct ltt_filter_compiler *c;
+	struct ltt_fmt_field fields[LTT_FILTER_MAX_FIELDS];
+	struct ltt_filter_prog *prog = NULL;
+	int ret, i, offset = 0;
+
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (!c)
+		return ERR_PTR(-ENOMEM);
+	c->pos = expr;
+	c->max_field = -1;
+	if (format) {
+		c->fields = fields;
+		c->nr_fields = ltt_fmt_get_fields(format, fields,
+						  LTT_FILTER_MAX_FIELDS);
+	}
+	ret = compile_expr(c);
+	skip_ws(c);
+	if (!ret && *c->pos)
+		ret = -EINVAL;
+	if (ret) {
+		printk(KERN_INFO "LTT filter : error %d at \"%s\"\n",
+		       ret, c->pos);
+		prog = ERR_PTR(ret);
+		goto end;
+	}
+	if (!format)
+		goto end;
+
+	prog = kzalloc(sizeof(*prog)
+		       + c->nr_insns * sizeof(struct ltt_filter_insn)
+		       + c->strtab_len, GFP_KERNEL);
+	if (!prog) {
+		prog = ERR_PTR(-ENOMEM);
+		goto end;
+	}
+	INIT_RCU_HEAD(&prog->rcu);
+	prog->nr_insns = c->nr_insns;
+	prog->nr_fields = c->max_field + 1;
+	memcpy(prog->insns, c->insns,
+	       c->nr_insns * sizeof(struct ltt_filter_insn));
+	prog->strtab = (char *)&prog->insns[c->nr_insns];
+	memcpy(prog->strtab, c->strtab, c->strtab_len);
+	for (i = 0; i < prog->nr_fields; i++) {
+		struct ltt_filter_fetch *fetch = &prog->fetch[i];
+
+		fetch->c_type = fields[i].c_type;
+		fetch->c_size = fields[i].c_size;
+		fetch->trace_type = fields[i].trace_type;
+		fetch->trace_size = fields[i].trace_size;
+		/*
+		 * Specialized probes serialize the fields following the
+		 * trace types, with ltt_align() alignment.
+		 */
+		if (offset >= 0 && fields[i].trace_type != LTT_TYPE_STRING) {
+			offset += ltt_align(offset, fields[i].trace_size);
+			fetch->offset = offset;
+			offset += fields[i].trace_size;
+		} else {
+			fetch->offset = offset = -1;
+		}
+	}
+end:
+	kfree(c);
+	return prog;
+}
+
+/*
+ * Filter evaluation.
+ */
+
+/* Truncate or sign-extend a value to an integer type size. */
+static inline u64 convert_value(u64 v, unsigned int size, enum ltt_type type)
+{
+	int sign = (type == LTT_TYPE_SIGNED_INT);
+
+	switch (size) {
+	case 1:
+		return sign ? (u64)(s64)(s8)v : (u64)(u8)v;
+	case 2:
+		return sign ? (u64)(s64)(s16)v : (u64)(u16)v;
+	case 4:
+		return sign ? (u64)(s64)(s32)v : (u64)(u32)v;
+	default:
+		return v;
+	}
+}
+
+/*
+ * Fetch the fields from the variable argument list, converted to the value
+ * written in the trace.
+ */
+static notrace void fetch_args(const struct ltt_filter_prog *prog,
+			       union ltt_filter_value *vals, va_list *args)
+{
+	const struct ltt_filter_fetch *fetch;
+	va_list args_copy;
+	u64 v;
+	int i;
+
+	va_copy(args_copy, *args);
+	for (i = 0; i < prog->nr_fields; i++) {
+		fetch = &prog->fetch[i];
+		if (fetch->c_type == LTT_TYPE_STRING) {
+			vals[i].s = va_arg(args_copy, const char *);
+			if ((unsigned long)vals[i].s < PAGE_SIZE)
+				vals[i].s = "<NULL>";
+			continue;
+		}
+		if (fetch->c_size == 8)
+			v = va_arg(args_copy, u64);
+		else
+			v = convert_value(va_arg(args_copy, unsigned int),
+					  fetch->c_size, fetch->c_type);
+		vals[i].v = convert_value(v, fetch->trace_size,
+					  fetch->trace_type);
+	}
+	va_end(args_copy);
+}
+
+/*
+ * Returns -1 if a field cannot be found in the binary payload.
+ */
+static notrace int fetch_data(const struct ltt_filter_prog *prog,
+			      union ltt_filter_value *vals, const char *data)
+{
+	const struct ltt_filter_fetch *fetch;
+	int i;
+
+	for (i = 0; i < prog->nr_fields; i++) {
+		fetch = &prog->fetch[i];
+		if (fetch->offset < 0)
+			return -1;
+		switch (fetch->trace_size) {
+		case 1:
+			vals[i].v = *(u8 *)(data + fetch->offset);
+			break;
+		case 2:
+			vals[i].v = get_unaligned((u16 *)(data + fetch->offset));
+			break;
+		case 4:
+			vals[i].v = get_unaligned((u32 *)(data + fetch->offset));
+			break;
+		case 8:
+			vals[i].v = get_unaligned((u64 *)(data + fetch->offset));
+			break;
+		default:
+			return -1;
+		}
+		vals[i].v = convert_value(vals[i].v, fetch->trace_size,
+					  fetch->trace_type);
+	}
+	return 0;
+}
+
+static notrace int ltt_filter_eval(const struct ltt_filter_prog *prog,
+				   const void *data, va_list *args)
+{
+	union ltt_filter_value vals[LTT_FILTER_MAX_FIELDS];
+	const struct ltt_filter_insn *insn;
+	u32 stack = 0;
+	u64 v = 0;
+	int i, res;
+
+	if (args)
+		fetch_args(prog, vals, args);
+	else if (fetch_data(prog, vals, data))
+		return 1;
+
+	for (i = 0; i < prog->nr_insns; i++) {
+		insn = &prog->insns[i];
+		switch (insn->src) {
+		case LTT_FILTER_SRC_PID:
+			v = current->pid;
+			break;
+		case LTT_FILTER_SRC_TGID:
+			v = current->tgid;
+			break;
+		case LTT_FILTER_SRC_CPU:
+			v = smp_processor_id();
+			break;
+		default:
+			v = vals[insn->src].v;
+		}
+		switch (insn->op) {
+		case LTT_FILTER_OP_EQ:
+			res = (v == insn->imm);
+			break;
+		case LTT_FILTER_OP_NE:
+			res = (v != insn->imm);
+			break;
+		case LTT_FILTER_OP_LT:
+			res = (v < insn->imm);
+			break;
+		case LTT_FILTER_OP_LE:
+			res = (v <= insn->imm);
+			break;
+		case LTT_FILTER_OP_GT:
+			res = (v > insn->imm);
+			break;
+		case LTT_FILTER_OP_GE:
+			res = (v >= insn->imm);
+			break;
+		case LTT_FILTER_OP_LT_S:
+			res = ((s64)v < (s64)insn->imm);
+			break;
+		case LTT_FILTER_OP_LE_S:
+			res = ((s64)v <= (s64)insn->imm);
+			break;
+		case LTT_FILTER_OP_GT_S:
+			res = ((s64)v > (s64)insn->imm);
+			break;
+		case LTT_FILTER_OP_GE_S:
+			res = ((s64)v >= (s64)insn->imm);
+			break;
+		case LTT_FILTER_OP_MASK:
+			res = !!(v & insn->imm);
+			break;
+		case LTT_FILTER_OP_STR_EQ:
+			res = !strcmp(vals[insn->src].s,
+				      prog->strtab + insn->imm);
+			break;
+		case LTT_FILTER_OP_STR_PREFIX:
+			res = !strncmp(vals[insn->src].s,
+				       prog->strtab + insn->imm, insn->len);
+			break;
+		/* The boolean stack top is the least significant bit. */
+		case LTT_FILTER_OP_AND:
+			stack = (stack >> 1) & (stack | ~1U);
+			continue;
+		case LTT_FILTER_OP_OR:
+			stack = (stack >> 1) | (stack & 1U);
+			continue;
+		case LTT_FILTER_OP_NOT:
+			stack ^= 1U;
+			continue;
+		default:
+			res = 1;
+		}
+		stack = (stack << 1) | res;
+	}
+	return stack & 1U;
+}
+
+static notrace struct ltt_filter_site *find_site(const struct marker *mdata)
+{
+	struct hlist_head *head;
+	struct hlist_node *node;
+	struct ltt_filter_site *site;
+
+	head = &ltt_filter_site_table[hash_ptr((void *)mdata,
+					       LTT_FILTER_HASH_BITS)];
+	hlist_for_each_entry_rcu(site, node, head, hlist)
+		if (site->mdata == mdata)
+			return site;
+	return NULL;
+}
+
+/*
+ * Called from the tracing fast path with preemption disabled.
+ */
+static notrace int ltt_filter_run(void *trace, const struct marker *mdata,
+				  const void *data, va_list *args)
+{
+	struct ltt_filter_site *site;
+	struct ltt_filter_prog *prog;
+
+	site = find_site(mdata);
+	if (likely(!site)) {
+		if (likely(!((struct ltt_trace *)trace)->filter_reject))
+			return 1;
+		/* Never discard the trace metadata. */
+		return !strcmp(mdata->channel, "metadata");
+	}
+	prog = rcu_dereference(site->prog);
+	return ltt_filter_eval(prog, data, args);
+}
+
+/*
+ * Filter attachment to marker sites.
+ */
+
+static void free_site_rcu(struct rcu_head *head)
+{
+	struct ltt_filter_site *site =
+		container_of(head, struct ltt_filter_site, rcu);
+
+	kfree(site->prog);
+	kfree(site);
+}
+
+static void detach_site(struct ltt_filter_site *site)
+{
+	hlist_del_rcu(&site->hlist);
+	list_del(&site->list);
+	call_rcu_sched(&site->rcu, free_site_rcu);
+}
+
+/*
+ * Compile the filter program of a marker site and add the site to the filter,
+ * without publishing it yet. Returns NULL if the filter does not apply to the
+ * marker. Called with ltt_filter_mutex held.
+ */
+static struct ltt_filter_site *prepare_site(struct ltt_filter *filter,
+					    struct marker *mdata)
+{
+	struct ltt_filter_site *site;
+	struct ltt_filter_prog *prog;
+
+	if (strcmp(mdata->channel, filter->channel)
+	    || strcmp(mdata->name, filter->name))
+		return NULL;
+	prog = ltt_filter_compile(filter->expr, mdata->format);
+	if (IS_ERR(prog))
+		return ERR_CAST(prog);
+	site = kzalloc(sizeof(*site), GFP_KERNEL);
+	if (!site) {
+		kfree(prog);
+		return ERR_PTR(-ENOMEM);
+	}
+	INIT_RCU_HEAD(&site->rcu);
+	site->mdata = mdata;
+	site->prog = prog;
+	list_add(&site->list, &filter->sites);
+	return site;
+}
+
+/*
+ * Make a prepared site visible to the tracing fast path, in place of the site
+ * of the previous filter of the marker if any. Called with ltt_filter_mutex
+ * held.
+ */
+static void publish_site(struct ltt_filter_site *site)
+{
+	struct ltt_filter_site *old;
+
+	old = find_site(site->mdata);
+	if (old) {
+		hlist_replace_rcu(&old->hlist, &site->hlist);
+		list_del(&old->list);
+		call_rcu_sched(&old->rcu, free_site_rcu);
+		return;
+	}
+	hlist_add_head_rcu(&site->hlist,
+		&ltt_filter_site_table[hash_ptr((void *)site->mdata,
+						LTT_FILTER_HASH_BITS)]);
+}
+
+/*
+ * Free the sites of a filter which were never published.
+ */
+static void discard_sites(struct ltt_filter *filter)
+{
+	struct ltt_filter_site *site, *tmp;
+
+	list_for_each_entry_safe(site, tmp, &filter->sites, list) {
+		list_del(&site->list);
+		kfree(site->prog);
+		kfree(site);
+	}
+}
+
+/*
+ * Attach filter to a marker site. Called with ltt_filter_mutex held.
+ */
+static int attach_site(struct ltt_filter *filter, struct marker *mdata)
+{
+	struct ltt_filter_site *site;
+
+	if (find_site(mdata))
+		return 0;
+	site = prepare_site(filter, mdata);
+	if (IS_ERR(site))
+		return PTR_ERR(site);
+	if (site)
+		publish_site(site);
+	return 0;
+}
+
+static struct ltt_filter *find_filter(const char *channel, const char *name)
+{
+	struct ltt_filter *filter;
+
+	list_for_each_entry(filter, &ltt_filters, list)
+		if (!strcmp(filter->channel, channel)
+		    && !strcmp(filter->name, name))
+			return filter;
+	return NULL;
+}
+
+static void free_filter(struct ltt_filter *filter)
+{
+	struct ltt_filter_site *site, *tmp;
+
+	list_for_each_entry_safe(site, tmp, &filter->sites, list)
+		detach_site(site);
+	list_del(&filter->list);
+	kfree(filter);
+}
+
+/*
+ * Called with ltt_filter_mutex held.
+ */
+static int ltt_filter_set(const char *channel, const char *name,
+			  const char *expr)
+{
+	struct ltt_filter *filter, *old;
+	struct ltt_filter_site *site;
+	struct ltt_filter_prog *prog;
+	struct marker_iter iter;
+	size_t channel_len = strlen(channel) + 1;
+	size_t name_len = strlen(name) + 1;
+	size_t expr_len = strlen(expr) + 1;
+	int ret = 0;
+
+	/* Check the syntax before touching the current filter. */
+	prog = ltt_filter_compile(expr, NULL);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+	kfree(prog);
+
+	filter = kzalloc(sizeof(*filter) + channel_len + name_len + expr_len,
+			 GFP_KERNEL);
+	if (!filter)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&filter->sites);
+	memcpy(filter->channel, channel, channel_len);
+	filter->name = &filter->channel[channel_len];
+	memcpy(filter->name, name, name_len);
+	filter->expr = &filter->name[name_len];
+	memcpy(filter->expr, expr, expr_len);
+
+	/*
+	 * Compile the programs of all the sites before replacing anything, so
+	 * that the current filter stays in place on failure.
+	 */
+	marker_iter_reset(&iter);
+	marker_iter_start(&iter);
+	for (; iter.marker != NULL; marker_iter_next(&iter)) {
+		site = prepare_site(filter, iter.marker);
+		if (IS_ERR(site)) {
+			ret = PTR_ERR(site);
+			break;
+		}
+	}
+	marker_iter_stop(&iter);
+	if (ret) {
+		discard_sites(filter);
+		kfree(filter);
+		return ret;
+	}
+
+	old = find_filter(channel, name);
+	list_for_each_entry(site, &filter->sites, list)
+		publish_site(site);
+	if (old)
+		free_filter(old);
+	list_add(&filter->list, &ltt_filters);
+	return 0;
+}
+
+/*
+ * Called with ltt_filter_mutex held.
+ */
+static int ltt_filter_clear(const char *channel, const char *name)
+{
+	struct ltt_filter *filter;
+
+	filter = find_filter(channel, name);
+	if (!filter)
+		return -ENOENT;
+	free_filter(filter);
+	return 0;
+}
+
+#ifdef CONFIG_MODULES
+
+static int ltt_filter_module_notify(struct notifier_block *self,
+				    unsigned long val, void *data)
+{
+	struct module *mod = data;
+	struct ltt_filter *filter;
+	struct ltt_filter_site *site, *tmp;
+	struct marker *iter;
+	int ret;
+
+	mutex_lock(&ltt_filter_mutex);
+	switch (val) {
+	case MODULE_STATE_COMING:
+		list_for_each_entry(filter, &ltt_filters, list) {
+			for (iter = mod->markers;
+			     iter < mod->markers + mod->num_markers; iter++) {
+				ret = attach_site(filter, iter);
+				if (ret)
+					printk(KERN_NOTICE
+					       "LTT filter : cannot attach %s.%s "
+					       "filter in module %s (%d)\n",
+					       filter->channel, filter->name,
+					       mod->name, ret);
+			}
+		}
+		break;
+	case MODULE_STATE_GOING:
+		list_for_each_entry(filter, &ltt_filters, list) {
+			list_for_each_entry_safe(site, tmp, &filter->sites,
+						 list) {
+				if (site->mdata >= mod->markers
+				    && site->mdata < mod->markers
+							+ mod->num_markers)
+					detach_site(site);
+			}
+		}
+		break;
+	}
+	mutex_unlock(&ltt_filter_mutex);
+	return 0;
+}
+
+static struct notifier_block ltt_filter_module_nb = {
+	.notifier_call = ltt_filter_module_notify,
+	.priority = 0,
+};
+
+#endif /* CONFIG_MODULES */
+
+/*
+ * Filter control functor, sets the per-trace policy for markers without
+ * filter. Called with the traces lock held.
+ */
+static int ltt_filter_control_run(enum ltt_filter_control_msg msg,
+				  struct ltt_trace *trace)
+{
+	switch (msg) {
+	case LTT_FILTER_DEFAULT_ACCEPT:
+		trace->filter_reject = 0;
+		break;
+	case LTT_FILTER_DEFAULT_REJECT:
+		trace->filter_reject = 1;
+		break;
+	default:
+		return -EPERM;
+	}
+	return 0;
+}
+
+/*
+ * debugfs interface.
+ */
+
+/*
+ * Split "channel name [expr]" in place. Returns the number of words found
+ * before the expression (2 when everything is present).
+ */
+static int split_filter_cmd(char *buf, char **channel, char **name,
+			    char **expr)
+{
+	char *end;
+
+	end = strchr(buf, '\n');
+	if (end)
+		*end = '\0';
+	*channel = strstrip(buf);
+	*name = strchr(*channel, ' ');
+	if (!*name || !**channel)
+		return 0;
+	*(*name)++ = '\0';
+	while (isspace(**name))
+		(*name)++;
+	*expr = strchr(*name, ' ');
+	if (*expr) {
+		*(*expr)++ = '\0';
+		while (isspace(**expr))
+			(*expr)++;
+	} else {
+		*expr = *name + strlen(*name);
+	}
+	return **name ? 2 : 1;
+}
+
+static ssize_t filter_write(struct file *file, const char __user *user_buf,
+			    size_t count, loff_t *ppos, int set)
+{
+	char *buf, *channel, *name, *expr;
+	int err, buf_size;
+
+	buf = (char *)__get_free_page(GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	buf_size = min_t(size_t, count, PAGE_SIZE - 1);
+	err = copy_from_user(buf, user_buf, buf_size);
+	if (err) {
+		err = -EFAULT;
+		goto end;
+	}
+	buf[buf_size] = '\0';
+	if (split_filter_cmd(buf, &channel, &name, &expr) != 2) {
+		err = -EINVAL;
+		goto end;
+	}
+	mutex_lock(&ltt_filter_mutex);
+	if (set) {
+		if (*expr)
+			err = ltt_filter_set(channel, name, expr);
+		else
+			err = -EINVAL;
+	} else {
+		err = ltt_filter_clear(channel, name);
+	}
+	mutex_unlock(&ltt_filter_mutex);
+end:
+	free_page((unsigned long)buf);
+	return err ? err : count;
+}
+
+static ssize_t set_op_write(struct file *file, const char __user *user_buf,
+			    size_t count, loff_t *ppos)
+{
+	return filter_write(file, user_buf, count, ppos, 1);
+}
+
+static const struct file_operations ltt_filter_set_fops = {
+	.write = set_op_write,
+};
+
+static ssize_t clear_op_write(struct file *file, const char __user *user_buf,
+			      size_t count, loff_t *ppos)
+{
+	return filter_write(file, user_buf, count, ppos, 0);
+}
+
+static const struct file_operations ltt_filter_clear_fops = {
+	.write = clear_op_write,
+};
+
+static void *lf_start(struct seq_file *m, loff_t *pos)
+{
+	mutex_lock(&ltt_filter_mutex);
+	return seq_list_start(&ltt_filters, *pos);
+}
+
+static void *lf_next(struct seq_file *m, void *p, loff_t *pos)
+{
+	return seq_list_next(p, &ltt_filters, pos);
+}
+
+static void lf_stop(struct seq_file *m, void *p)
+{
+	mutex_unlock(&ltt_filter_mutex);
+}
+
+static int lf_show(struct seq_file *m, void *p)
+{
+	struct ltt_filter *filter = list_entry(p, struct ltt_filter, list);
+	struct ltt_filter_site *site;
+	unsigned int nr_sites = 0, nr_insns = 0;
+
+	list_for_each_entry(site, &filter->sites, list) {
+		nr_sites++;
+		nr_insns = site->prog->nr_insns;
+	}
+	seq_printf(m, "%s %s %s (sites %u insns %u)\n", filter->channel,
+		   filter->name, filter->expr, nr_sites, nr_insns);
+	return 0;
+}
+
+static const struct seq_operations ltt_filter_list_op = {
+	.start = lf_start,
+	.next = lf_next,
+	.stop = lf_stop,
+	.show = lf_show,
+};
+
+static int ltt_filter_list_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &ltt_filter_list_op);
+}
+
+static const struct file_operations ltt_filter_list_fops = {
+	.open = ltt_filter_list_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = seq_release,
+};
+
+static int __init ltt_filter_init(void)
+{
+	struct dentry *filter_root;
+	int ret;
+
+	filter_root = get_filter_root();
+	if (!filter_root)
+		return -ENOENT;
+
+	ltt_filter_set_dentry = debugfs_create_file(LTT_FILTER_SET, S_IWUSR,
+						    filter_root, NULL,
+						    &ltt_filter_set_fops);
+	ltt_filter_clear_dentry = debugfs_create_file(LTT_FILTER_CLEAR,
+						      S_IWUSR, filter_root,
+						      NULL,
+						      &ltt_filter_clear_fops);
+	ltt_filter_list_dentry = debugfs_create_file(LTT_FILTER_LIST, S_IRUSR,
+						     filter_root, NULL,
+						     &ltt_filter_list_fops);
+	if (!ltt_filter_set_dentry || !ltt_filter_clear_dentry
+	    || !ltt_filter_list_dentry) {
+		printk(KERN_ERR "ltt_filter_init: failed to create files\n");
+		ret = -ENOMEM;
+		goto err_files;
+	}
+
+#ifdef CONFIG_MODULES
+	ret = register_module_notifier(&ltt_filter_module_nb);
+	if (ret)
+		goto err_files;
+#endif
+	ret = ltt_module_register(LTT_FUNCTION_RUN_FILTER, ltt_filter_run,
+				  THIS_MODULE);
+	if (ret)
+		goto err_run_filter;
+	ret = ltt_module_register(LTT_FUNCTION_FILTER_CONTROL,
+				  ltt_filter_control_run, THIS_MODULE);
+	if (ret)
+		goto err_filter_control;
+	return 0;
+
+err_filter_control:
+	ltt_module_unregister(LTT_FUNCTION_RUN_FILTER);
+err_run_filter:
+#ifdef CONFIG_MODULES
+	unregister_module_notifier(&ltt_filter_module_nb);
+#endif
+err_files:
+	debugfs_remove(ltt_filter_list_dentry);
+	debugfs_remove(ltt_filter_clear_dentry);
+	debugfs_remove(ltt_filter_set_dentry);
+	return ret;
+}
+
+module_init(ltt_filter_init);
+
 static void __exit ltt_filter_exit(void)
 {
+	struct ltt_filter *filter, *tmp;
+
+	ltt_module_unregister(LTT_FUNCTION_FILTER_CONTROL);
+	/* Waits for the fast path users */
+	ltt_module_unregister(LTT_FUNCTION_RUN_FILTER);
+#ifdef CONFIG_MODULES
+	unregister_module_notifier(&ltt_filter_module_nb);
+#endif
+	debugfs_remove(ltt_filter_list_dentry);
+	debugfs_remove(ltt_filter_clear_dentry);
+	debugfs_remove(ltt_filter_set_dentry);
+	mutex_lock(&ltt_filter_mutex);
+	list_for_each_entry_safe(filter, tmp, &ltt_filters, list)
+		free_filter(filter);
+	mutex_unlock(&ltt_filter_mutex);
+	rcu_barrier_sched();
 	debugfs_remove(ltt_filter_dir);
 }
 
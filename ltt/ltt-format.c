@@ -0,0 +1,167 @@
+/*
+ * ltt/ltt-format.c
+ *
+ * (C) Copyright 2007 - Mathieu Desnoyers (mathieu.desnoyers@polymtl.ca)
+ *
+ * LTTng marker format string description and serialization plans. Built in
+ * the kernel with the markers, so plans can be compiled at marker
+ * registration.
+ *
+ * Dual LGPL v2.1/GPL v2 license.
+ */
+
+#include <linux/module.h>
+#include <linux/ctype.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/ltt-tracer.h>
+
+#include "ltt-format.h"
+
+/**
+ * ltt_fmt_get_fields - Describe the fields of a marker format string
+ * @fmt: marker format string
+ * @fields: array of field descriptions to fill
+ * @max_fields: number of entries in @fields
+ *
+ * Fields are described in the order of the variable argument list. Returns
+ * the number of fields in the format string, which may be larger than
+ * @max_fields, in which case only the first @max_fields are described.
+ */
+int ltt_fmt_get_fields(const char *fmt, struct ltt_fmt_field *fields,
+		       int max_fields)
+{
+	char trace_size = 0, c_size = 0;
+	enum ltt_type trace_type = LTT_TYPE_NONE, c_type = LTT_TYPE_NONE;
+	unsigned long attributes = 0;
+	const char *word = NULL, *name = NULL;
+	unsigned int name_len = 0;
+	int nr_fields = 0;
+
+	for (; *fmt ; ++fmt) {
+		switch (*fmt) {
+		case '#':
+			/* tracetypes (#) */
+			++fmt;			/* skip first '#' */
+			if (*fmt == '#')	/* Escaped ## */
+				break;
+			word = NULL;
+			attributes = 0;
+			fmt = parse_trace_type(fmt, &trace_size, &trace_type,
+					       &attributes);
+			break;
+		case '%':
+			/* c types (%) */
+			++fmt;			/* skip first '%' */
+			if (*fmt == '%')	/* Escaped %% */
+				break;
+			word = NULL;
+			fmt = parse_c_type(fmt, &c_size, &c_type, NULL);
+			if (!trace_size)
+				trace_size = c_size;
+			if (trace_type == LTT_TYPE_NONE)
+				trace_type = c_type;
+			if (c_type == LTT_TYPE_STRING)
+				trace_type = LTT_TYPE_STRING;
+			if (nr_fields < max_fields) {
+				fields[nr_fields].name = name;
+				fields[nr_fields].name_len = name ? name_len : 0;
+				fields[nr_fields].c_type = c_type;
+				fields[nr_fields].c_size = c_size;
+				fields[nr_fields].trace_type = trace_type;
+				fields[nr_fields].trace_size = trace_size;
+			}
+			nr_fields++;
+			name = NULL;
+			trace_size = 0;
+			c_size = 0;
+			trace_type = LTT_TYPE_NONE;
+			c_type = LTT_TYPE_NONE;
+			attributes = 0;
+			break;
+		default:
+			if (isspace(*fmt)) {
+				if (word) {
+					name = word;
+					name_len = fmt - word;
+					word = NULL;
+				}
+			} else if (!word)
+				word = fmt;
+			break;
+		}
+	}
+	return nr_fields;
+}
+EXPORT_SYMBOL_GPL(ltt_fmt_get_fields);
+
+/**
+ * ltt_serialize_plan_create - Compile a marker format string
+ * @fmt: marker format string
+ *
+ * Returns a serialization plan describing the argument list of @fmt, or NULL
+ * if memory is lacking or if the format string uses types the plan does not
+ * handle, in which case the serializer walks the format string at each event.
+ * The plan is freed with kfree().
+ */
+struct ltt_serialize_plan *ltt_serialize_plan_create(const char *fmt)
+{
+	struct ltt_serialize_plan *plan;
+	struct ltt_fmt_field *fields;
+	size_t data_size = 0;
+	int nr_fields, i, largest_align = 1;
+
+	nr_fields = ltt_fmt_get_fields(fmt, NULL, 0);
+	plan = kzalloc(sizeof(*plan) + nr_fields * sizeof(plan->fields[0]),
+		       GFP_KERNEL);
+	if (!plan)
+		return NULL;
+	if (!nr_fields)
+		goto end;
+	fields = kmalloc(nr_fields * sizeof(*fields), GFP_KERNEL);
+	if (!fields)
+		goto error;
+	ltt_fmt_get_fields(fmt, fields, nr_fields);
+
+	for (i = 0; i < nr_fields; i++) {
+		struct ltt_plan_field *field = &plan->fields[i];
+
+		field->c_type = fields[i].c_type;
+		field->c_size = fields[i].c_size;
+		field->trace_type = fields[i].trace_type;
+		field->trace_size = fields[i].trace_size;
+
+		switch (field->trace_type) {
+		case LTT_TYPE_STRING:
+			plan->nr_strings++;
+			continue;
+		case LTT_TYPE_SIGNED_INT:
+		case LTT_TYPE_UNSIGNED_INT:
+			break;
+		default:
+			goto error_fields;
+		}
+		if (!is_power_of_2(field->c_size) || field->c_size > 8
+		    || !is_power_of_2(field->trace_size)
+		    || field->trace_size > 8)
+			goto error_fields;
+		if (ltt_get_alignment()) {
+			data_size += ltt_align(data_size, field->trace_size);
+			largest_align = max_t(int, largest_align,
+					      field->trace_size);
+		}
+		data_size += field->trace_size;
+	}
+	kfree(fields);
+end:
+	plan->nr_fields = nr_fields;
+	plan->data_size = data_size;
+	plan->largest_align = min_t(int, largest_align, sizeof(void *));
+	return plan;
+
+error_fields:
+	kfree(fields);
+error:
+	kfree(plan);
+	return NULL;
+}
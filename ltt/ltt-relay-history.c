@@ -0,0 +1,687 @@
+/*
+ * ltt/ltt-relay-history.c
+ *
+ * Compressed flight recorder history.
+ *
+ * Copyright (C) 2009 - Mathieu Desnoyers (mathieu.desnoyers@polymtl.ca)
+ *
+ * Dual LGPL v2.1/GPL v2 license.
+ *
+ * In flight recorder mode, the oldest sub-buffers are overwritten as soon as
+ * the writer wraps around the buffer. The history consumes the sub-buffers of
+ * the overwrite channels as soon as they are complete, compresses them with
+ * LZO and keeps them in a pool bounded in size, dropping the oldest compressed
+ * sub-buffers when it is full. Taking a snapshot stops the trace and freezes
+ * the pool: the live buffers are then read by lttd as usual, and the older
+ * sub-buffers are read, uncompressed, from
+ * /debugfs/ltt/history/<trace>/<channel>_<cpu>, in the lttd file layout.
+ *
+ * The compressed sub-buffers are packed one after the other in large blocks.
+ * Once the pool is full, its oldest block is emptied and reused, so the pool
+ * stops allocating memory.
+ *
+ * On panic, the pool is frozen so it can be extracted from the crash dump,
+ * starting from trace->history.
+ *
+ * Open history files hold a reference on the history, so a discarded history
+ * stays readable, frozen, until they are closed.
+ */
+
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/debugfs.h>
+#include <linux/kthread.h>
+#include <linux/kref.h>
+#include <linux/notifier.h>
+#include <linux/lzo.h>
+#include <linux/ltt-tracer.h>
+#include <linux/ltt-relay.h>
+
+#include "ltt-relay-select.h"
+
+/* Poll period of the compression thread, when no reader wakeup happens */
+#define LTT_HISTORY_POLL_INTERVAL	(HZ / 10)
+
+/* Pool allocation unit, larger if a sub-buffer may not fit once compressed */
+#define LTT_HISTORY_BLOCK_SIZE		(256 * 1024)
+
+struct ltt_history_chunk {
+	struct list_head buf_list;	/* Buffer history, oldest first */
+	size_t len;			/* Compressed size */
+	size_t data_size;		/* Uncompressed size */
+	unsigned char data[0];
+};
+
+struct ltt_history_block {
+	struct list_head list;		/* Pool blocks, oldest first */
+	size_t used;			/* Bytes of data used by chunks */
+	unsigned char data[0];
+};
+
+struct ltt_history_buf {
+	struct ltt_chanbuf *buf;
+	struct ltt_relay_history *history;
+	wait_queue_t wait;		/* Entry in the buffer read_wait queue */
+	struct list_head chunks;
+	struct dentry *dentry;
+	unsigned int done:1;		/* Buffer finalized and consumed */
+};
+
+struct ltt_relay_history {
+	struct ltt_trace *trace;
+	struct kref kref;		/* Trace and open files references */
+	struct list_head list;		/* ltt_history_list */
+	struct task_struct *thread;
+	wait_queue_head_t wait;
+	int wakeup;
+	int stop;
+	int frozen;			/* Thread stopped, no more changes */
+	struct completion done;
+	struct mutex lock;		/* Protects the pool and stats */
+	struct list_head blocks;
+	size_t block_size;
+	size_t size;			/* Memory used by the pool */
+	size_t max_size;
+	unsigned long nr_chunks;	/* Sub-buffers in the pool */
+	unsigned long compressed;	/* Sub-buffers compressed */
+	unsigned long evicted;		/* Sub-buffers dropped from the pool */
+	unsigned long failed;		/* Sub-buffers not kept, no memory */
+	u64 bytes_in, bytes_out;
+	void *src, *dst, *wrkmem;	/* Compression buffers */
+	size_t max_data_size;
+	struct dentry *dentry;
+	struct dentry *stats_dentry;
+	unsigned int nr_bufs;
+	struct ltt_history_buf bufs[0];
+};
+
+struct ltt_history_reader {
+	struct ltt_history_buf *hbuf;
+	struct ltt_history_chunk *chunk; /* Chunk uncompressed in data */
+	void *data;
+};
+
+/* Protects trace->history, ltt_history_list and the files i_private */
+static DEFINE_MUTEX(ltt_history_mutex);
+static LIST_HEAD(ltt_history_list);
+static struct dentry *ltt_history_dir;
+static int ltt_history_panic;
+
+static int ltt_history_wake(wait_queue_t *wait, unsigned mode, int sync,
+			    void *key)
+{
+	struct ltt_history_buf *hbuf =
+		container_of(wait, struct ltt_history_buf, wait);
+	struct ltt_relay_history *history = hbuf->history;
+
+	history->wakeup = 1;
+	wake_up(&history->wait);
+	return 0;
+}
+
+/* Block space used by a chunk of len compressed bytes */
+static size_t ltt_history_chunk_size(size_t len)
+{
+	return ALIGN(sizeof(struct ltt_history_chunk) + len, sizeof(long));
+}
+
+/* Drops the chunks of the oldest block and returns it, empty */
+static struct ltt_history_block *
+ltt_history_evict(struct ltt_relay_history *history)
+{
+	struct ltt_history_block *block;
+	struct ltt_history_chunk *chunk;
+	size_t offset;
+
+	block = list_first_entry(&history->blocks, struct ltt_history_block,
+				 list);
+	for (offset = 0; offset < block->used;
+	     offset += ltt_history_chunk_size(chunk->len)) {
+		chunk = (struct ltt_history_chunk *)(block->data + offset);
+		list_del(&chunk->buf_list);
+		history->nr_chunks--;
+		history->evicted++;
+	}
+	list_del(&block->list);
+	block->used = 0;
+	return block;
+}
+
+/*
+ * Returns room for a chunk of len compressed bytes at the end of the pool,
+ * taking the oldest block back if the pool is full. NULL if out of memory.
+ * Called with the history lock held.
+ */
+static struct ltt_history_chunk *
+ltt_history_alloc_chunk(struct ltt_relay_history *history, size_t len)
+{
+	struct ltt_history_block *block = NULL;
+	size_t size = ltt_history_chunk_size(len);
+	void *chunk;
+
+	if (!list_empty(&history->blocks))
+		block = list_entry(history->blocks.prev,
+				   struct ltt_history_block, list);
+	if (!block || block->used + size
+		      > history->block_size - sizeof(*block)) {
+		if (history->size + history->block_size > history->max_size) {
+			block = ltt_history_evict(history);
+		} else {
+			block = vmalloc(history->block_size);
+			if (!block)
+				return NULL;
+			block->used = 0;
+			history->size += history->block_size;
+		}
+		list_add_tail(&block->list, &history->blocks);
+	}
+	chunk = block->data + block->used;
+	block->used += size;
+	history->nr_chunks++;
+	return chunk;
+}
+
+/*
+ * Copy the oldest complete sub-buffer of the buffer out of it, release it and
+ * add it, compressed, to the pool. Returns 1 if a sub-buffer was consumed.
+ */
+static int ltt_history_buf_consume(struct ltt_relay_history *history,
+				   struct ltt_history_buf *hbuf)
+{
+	struct ltt_chanbuf *buf = hbuf->buf;
+	struct ltt_history_chunk *chunk;
+	unsigned long consumed;
+	size_t sb_size, data_size, len;
+	int ret;
+
+	ret = ltt_chanbuf_get_subbuf(buf, &consumed);
+	if (ret) {
+		if (ltt_chanbuf_is_finalized(buf))
+			hbuf->done = 1;
+		return 0;
+	}
+	sb_size = min_t(size_t, get_read_sb_size(buf), buf->a.chan->sb_size);
+	data_size = PAGE_ALIGN(sb_size);
+	ltt_relay_read(&buf->a, consumed, history->src, sb_size);
+	ltt_chanbuf_put_subbuf(buf, consumed);
+	memset(history->src + sb_size, 0, data_size - sb_size);
+
+	ret = lzo1x_1_compress(history->src, data_size, history->dst, &len,
+			       history->wrkmem);
+
+	mutex_lock(&history->lock);
+	chunk = NULL;
+	if (ret == LZO_E_OK)
+		chunk = ltt_history_alloc_chunk(history, len);
+	if (!chunk) {
+		history->failed++;
+		goto end;
+	}
+	chunk->len = len;
+	chunk->data_size = data_size;
+	memcpy(chunk->data, history->dst, len);
+	list_add_tail(&chunk->buf_list, &hbuf->chunks);
+	history->compressed++;
+	history->bytes_in += data_size;
+	history->bytes_out += len;
+end:
+	mutex_unlock(&history->lock);
+	return 1;
+}
+
+static int ltt_relay_history_thread(void *data)
+{
+	struct ltt_relay_history *history = data;
+	struct ltt_history_buf *hbuf;
+	int progress, remaining;
+	unsigned int i;
+
+	for (;;) {
+		progress = remaining = 0;
+		for (i = 0; i < history->nr_bufs; i++) {
+			hbuf = &history->bufs[i];
+			if (hbuf->done)
+				continue;
+			if (history->stop || ltt_history_panic)
+				break;
+			progress |= ltt_history_buf_consume(history, hbuf);
+			if (!hbuf->done)
+				remaining = 1;
+		}
+		if (!remaining || history->stop || ltt_history_panic)
+			break;
+		if (progress) {
+			cond_resched();
+			continue;
+		}
+		wait_event_interruptible_timeout(history->wait,
+			history->wakeup || history->stop,
+			LTT_HISTORY_POLL_INTERVAL);
+		history->wakeup = 0;
+	}
+
+	for (i = 0; i < history->nr_bufs; i++) {
+		hbuf = &history->bufs[i];
+		remove_wait_queue(&hbuf->buf->read_wait, &hbuf->wait);
+		ltt_chanbuf_release_read(hbuf->buf);
+	}
+	complete_all(&history->done);
+	return 0;
+}
+
+static void ltt_history_release_kref(struct kref *kref)
+{
+	struct ltt_relay_history *history =
+		container_of(kref, struct ltt_relay_history, kref);
+	struct ltt_history_block *block, *tmp;
+
+	list_for_each_entry_safe(block, tmp, &history->blocks, list)
+		vfree(block);
+	vfree(history->src);
+	vfree(history->dst);
+	vfree(history->wrkmem);
+	kfree(history);
+}
+
+static void ltt_history_put(struct ltt_relay_history *history)
+{
+	kref_put(&history->kref, ltt_history_release_kref);
+}
+
+/*
+ * The files i_private is cleared with ltt_history_mutex held before they are
+ * removed, as removing them does not wait for their users. Opening a file
+ * takes a reference on the history.
+ */
+static int ltt_history_open(struct inode *inode, struct file *file)
+{
+	struct ltt_history_buf *hbuf;
+	struct ltt_history_reader *reader;
+
+	mutex_lock(&ltt_history_mutex);
+	hbuf = inode->i_private;
+	if (hbuf)
+		kref_get(&hbuf->history->kref);
+	mutex_unlock(&ltt_history_mutex);
+	if (!hbuf)
+		return -ENOENT;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		goto error;
+	reader->data = vmalloc(hbuf->history->max_data_size);
+	if (!reader->data) {
+		kfree(reader);
+		goto error;
+	}
+	reader->hbuf = hbuf;
+	file->private_data = reader;
+	return 0;
+
+error:
+	ltt_history_put(hbuf->history);
+	return -ENOMEM;
+}
+
+static int ltt_history_release(struct inode *inode, struct file *file)
+{
+	struct ltt_history_reader *reader = file->private_data;
+
+	ltt_history_put(reader->hbuf->history);
+	vfree(reader->data);
+	kfree(reader);
+	return 0;
+}
+
+/*
+ * The file is the sequence of the uncompressed sub-buffers of the buffer,
+ * oldest first. It can only be read once the pool is frozen.
+ */
+static ssize_t ltt_history_read(struct file *file, char __user *user_buf,
+				size_t count, loff_t *ppos)
+{
+	struct ltt_history_reader *reader = file->private_data;
+	struct ltt_history_buf *hbuf = reader->hbuf;
+	struct ltt_relay_history *history = hbuf->history;
+	struct ltt_history_chunk *chunk;
+	loff_t pos = 0;
+	size_t len, offset;
+	ssize_t ret = 0;
+	int err;
+
+	if (!history->frozen)
+		return -EBUSY;
+
+	mutex_lock(&history->lock);
+	list_for_each_entry(chunk, &hbuf->chunks, buf_list) {
+		if (*ppos < pos + chunk->data_size)
+			break;
+		pos += chunk->data_size;
+	}
+	if (&chunk->buf_list == &hbuf->chunks)
+		goto end;
+	if (reader->chunk != chunk) {
+		len = chunk->data_size;
+		err = lzo1x_decompress_safe(chunk->data, chunk->len,
+					    reader->data, &len);
+		if (err != LZO_E_OK || len != chunk->data_size) {
+			reader->chunk = NULL;
+			ret = -EIO;
+			goto end;
+		}
+		reader->chunk = chunk;
+	}
+	offset = *ppos - pos;
+	len = min_t(size_t, count, chunk->data_size - offset);
+	if (copy_to_user(user_buf, reader->data + offset, len)) {
+		ret = -EFAULT;
+		goto end;
+	}
+	*ppos += len;
+	ret = len;
+end:
+	mutex_unlock(&history->lock);
+	return ret;
+}
+
+static const struct file_operations ltt_history_fops = {
+	.open = ltt_history_open,
+	.read = ltt_history_read,
+	.release = ltt_history_release,
+};
+
+static int ltt_history_stats_open(struct inode *inode, struct file *file)
+{
+	struct ltt_relay_history *history;
+
+	mutex_lock(&ltt_history_mutex);
+	history = inode->i_private;
+	if (history)
+		kref_get(&history->kref);
+	mutex_unlock(&ltt_history_mutex);
+	if (!history)
+		return -ENOENT;
+	file->private_data = history;
+	return 0;
+}
+
+static int ltt_history_stats_release(struct inode *inode, struct file *file)
+{
+	ltt_history_put(file->private_data);
+	return 0;
+}
+
+static ssize_t ltt_history_stats_read(struct file *file,
+				      char __user *user_buf,
+				      size_t count, loff_t *ppos)
+{
+	struct ltt_relay_history *history = file->private_data;
+	char buf[256];
+	int len;
+
+	mutex_lock(&history->lock);
+	len = scnprintf(buf, sizeof(buf),
+			"frozen %d\nsize %zu\nmax_size %zu\nsubbufs %lu\n"
+			"compressed %lu\nevicted %lu\nfailed %lu\n"
+			"bytes_in %llu\nbytes_out %llu\n",
+			history->frozen, history->size, history->max_size,
+			history->nr_chunks, history->compressed,
+			history->evicted, history->failed,
+			(unsigned long long)history->bytes_in,
+			(unsigned long long)history->bytes_out);
+	mutex_unlock(&history->lock);
+	return simple_read_from_buffer(user_buf, count, ppos, buf, len);
+}
+
+static const struct file_operations ltt_history_stats_fops = {
+	.open = ltt_history_stats_open,
+	.read = ltt_history_stats_read,
+	.release = ltt_history_stats_release,
+};
+
+static void ltt_history_stop_thread(struct ltt_relay_history *history)
+{
+	history->stop = 1;
+	wake_up(&history->wait);
+	wait_for_completion(&history->done);
+}
+
+/*
+ * Removes the files of a history whose thread is stopped, and drops the
+ * reference of the trace. The open files keep it until they are closed.
+ * Called with ltt_history_mutex held.
+ */
+static void _ltt_relay_history_free(struct ltt_relay_history *history)
+{
+	unsigned int i;
+
+	for (i = 0; i < history->nr_bufs; i++)
+		if (history->bufs[i].dentry)
+			history->bufs[i].dentry->d_inode->i_private = NULL;
+	if (history->stats_dentry)
+		history->stats_dentry->d_inode->i_private = NULL;
+	debugfs_remove_recursive(history->dentry);
+	list_del(&history->list);
+	ltt_history_put(history);
+}
+
+/**
+ * ltt_relay_history_start - Keep a compressed history of the trace
+ * @trace: allocated trace
+ * @max_size: pool size, in bytes
+ *
+ * Consumes the sub-buffers of the overwrite channels of the trace as they
+ * complete. The pool must hold at least one sub-buffer which does not
+ * compress, and at most half of the memory. Called with the traces lock held.
+ */
+int ltt_relay_history_start(struct ltt_trace *trace, size_t max_size)
+{
+	struct ltt_relay_history *history;
+	struct ltt_history_buf *hbuf;
+	struct ltt_chanbuf *buf;
+	struct ltt_chan *chan;
+	unsigned int nr_bufs = 0, i;
+	size_t max_data_size = 0, block_size;
+	char name[NAME_MAX];
+	int cpu, ret;
+
+	mutex_lock(&ltt_history_mutex);
+	if (trace->history) {
+		ret = -EBUSY;
+		goto end;
+	}
+	for (i = 0; i < trace->nr_channels; i++) {
+		chan = &trace->channels[i];
+		if (!chan->active || !chan->overwrite)
+			continue;
+		max_data_size = max_t(size_t, max_data_size, chan->a.sb_size);
+		for_each_possible_cpu(cpu)
+			if (per_cpu_ptr(chan->a.buf, cpu)->a.allocated)
+				nr_bufs++;
+	}
+	if (!nr_bufs) {
+		ret = -EINVAL;
+		goto end;
+	}
+	block_size = sizeof(struct ltt_history_block) + ltt_history_chunk_size(
+			lzo1x_worst_compress(PAGE_ALIGN(max_data_size)));
+	block_size = max_t(size_t, block_size,
+			   min_t(size_t, max_size, LTT_HISTORY_BLOCK_SIZE));
+	if (max_size < block_size
+	    || max_size / PAGE_SIZE > totalram_pages / 2) {
+		ret = -EINVAL;
+		goto end;
+	}
+	history = kzalloc(sizeof(*history) + nr_bufs * sizeof(*hbuf),
+			  GFP_KERNEL);
+	if (!history) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	history->trace = trace;
+	kref_init(&history->kref);
+	list_add(&history->list, &ltt_history_list);
+	history->max_size = max_size;
+	history->block_size = block_size;
+	history->max_data_size = max_data_size;
+	init_waitqueue_head(&history->wait);
+	init_completion(&history->done);
+	mutex_init(&history->lock);
+	INIT_LIST_HEAD(&history->blocks);
+
+	ret = -ENOMEM;
+	history->src = vmalloc(max_data_size);
+	history->dst = vmalloc(lzo1x_worst_compress(max_data_size));
+	history->wrkmem = vmalloc(LZO1X_1_MEM_COMPRESS);
+	if (!history->src || !history->dst || !history->wrkmem)
+		goto free_history;
+	history->dentry = debugfs_create_dir(trace->trace_name,
+					     ltt_history_dir);
+	if (!history->dentry)
+		goto free_history;
+	history->stats_dentry = debugfs_create_file("stats", S_IRUSR,
+						    history->dentry, history,
+						    &ltt_history_stats_fops);
+	if (!history->stats_dentry)
+		goto free_history;
+
+	for (i = 0; i < trace->nr_channels; i++) {
+		chan = &trace->channels[i];
+		if (!chan->active || !chan->overwrite)
+			continue;
+		for_each_possible_cpu(cpu) {
+			buf = per_cpu_ptr(chan->a.buf, cpu);
+			if (!buf->a.allocated)
+				continue;
+			hbuf = &history->bufs[history->nr_bufs];
+			hbuf->buf = buf;
+			hbuf->history = history;
+			INIT_LIST_HEAD(&hbuf->chunks);
+			snprintf(name, sizeof(name), "%s_%d",
+				 chan->a.filename, cpu);
+			ret = ltt_chanbuf_open_read(buf);
+			if (ret)
+				goto release_bufs;
+			hbuf->dentry = debugfs_create_file(name, S_IRUSR,
+							   history->dentry,
+							   hbuf,
+							   &ltt_history_fops);
+			if (!hbuf->dentry) {
+				ltt_chanbuf_release_read(buf);
+				ret = -ENOMEM;
+				goto release_bufs;
+			}
+			init_waitqueue_func_entry(&hbuf->wait,
+						  ltt_history_wake);
+			add_wait_queue(&buf->read_wait, &hbuf->wait);
+			history->nr_bufs++;
+		}
+	}
+
+	history->thread = kthread_run(ltt_relay_history_thread, history,
+				      "ltt_history");
+	if (IS_ERR(history->thread)) {
+		ret = PTR_ERR(history->thread);
+		goto release_bufs;
+	}
+	trace->history = history;
+	mutex_unlock(&ltt_history_mutex);
+	return 0;
+
+release_bufs:
+	for (i = 0; i < history->nr_bufs; i++) {
+		hbuf = &history->bufs[i];
+		remove_wait_queue(&hbuf->buf->read_wait, &hbuf->wait);
+		ltt_chanbuf_release_read(hbuf->buf);
+	}
+free_history:
+	_ltt_relay_history_free(history);
+end:
+	mutex_unlock(&ltt_history_mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ltt_relay_history_start);
+
+/**
+ * ltt_relay_history_snapshot - Freeze the history of a stopped trace
+ * @trace: trace
+ *
+ * Stops consuming the sub-buffers, which leaves the live buffers to lttd, and
+ * makes the history files readable.
+ */
+int ltt_relay_history_snapshot(struct ltt_trace *trace)
+{
+	struct ltt_relay_history *history;
+	int ret = 0;
+
+	mutex_lock(&ltt_history_mutex);
+	history = trace->history;
+	if (!history) {
+		ret = -ENOENT;
+		goto end;
+	}
+	ltt_history_stop_thread(history);
+	history->frozen = 1;
+end:
+	mutex_unlock(&ltt_history_mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ltt_relay_history_snapshot);
+
+/**
+ * ltt_relay_history_free - Discard the history of a trace
+ * @trace: trace
+ *
+ * Called by the relay when the trace is released, and to discard a history
+ * after a snapshot has been saved.
+ */
+void ltt_relay_history_free(struct ltt_trace *trace)
+{
+	struct ltt_relay_history *history;
+
+	mutex_lock(&ltt_history_mutex);
+	history = trace->history;
+	if (history) {
+		ltt_history_stop_thread(history);
+		history->frozen = 1;
+		trace->history = NULL;
+		_ltt_relay_history_free(history);
+	}
+	mutex_unlock(&ltt_history_mutex);
+}
+EXPORT_SYMBOL_GPL(ltt_relay_history_free);
+
+/*
+ * The other CPUs are stopped when the panic notifiers run, so the history
+ * threads can no longer change the pools: freeze them all. ltt_history_mutex
+ * may be held by a stopped CPU and is not taken.
+ */
+static int ltt_history_panic_notify(struct notifier_block *nb,
+				    unsigned long event, void *unused)
+{
+	struct ltt_relay_history *history;
+
+	ltt_history_panic = 1;
+	list_for_each_entry(history, &ltt_history_list, list)
+		history->frozen = 1;
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block ltt_history_panic_nb = {
+	.notifier_call = ltt_history_panic_notify,
+};
+
+static __init int ltt_relay_history_init(void)
+{
+	ltt_history_dir = debugfs_create_dir("history", get_ltt_root());
+	put_ltt_root();
+	if (!ltt_history_dir)
+		return -EFAULT;
+	atomic_notifier_chain_register(&panic_notifier_list,
+				       &ltt_history_panic_nb);
+	return 0;
+}
+
+module_init(ltt_relay_history_init);
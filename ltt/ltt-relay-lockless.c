@@ -111,6 +111,7 @@ void ltt_buffer_end(struct ltt_chanbuf *buf, u64 tsc, unsigned int offset,
 	header->cycle_count_end = tsc;
 	header->events_lost = local_read(&buf->events_lost);
 	header->subbuf_corrupt = local_read(&buf->corrupted_subbuffers);
+	ltt_chanbuf_stat_inc(buf, switches);
 }
 
 /*
@@ -190,6 +191,9 @@ int ltt_chanbuf_create(struct ltt_chanbuf *buf, struct ltt_chan_alloc *chana,
 
 	local_set(&buf->events_lost, 0);
 	local_set(&buf->corrupted_subbuffers, 0);
+#ifdef CONFIG_LTT_RELAY_STATS
+	memset(&buf->stats, 0, sizeof(buf->stats));
+#endif
 	buf->finalized = 0;
 
 	ret = ltt_chanbuf_create_file(chan->a.filename, chan->a.parent,
@@ -694,6 +698,8 @@ void ltt_relay_print_buffer_errors(struct ltt_chan *chan, unsigned int cpu)
 
 static void ltt_relay_remove_dirs(struct ltt_trace *trace)
 {
+	ltt_relay_history_free(trace);
+	ltt_relay_stats_remove_dir(trace);
 	ltt_ascii_remove_dir(trace);
 	debugfs_remove(trace->dentry.trace_root);
 }
@@ -719,6 +725,10 @@ static int ltt_relay_create_dirs(struct ltt_trace *new_trace)
 	if (ret)
 		printk(KERN_WARNING "LTT : Unable to create ascii output file "
 				    "for trace %s\n", new_trace->trace_name);
+	ret = ltt_relay_stats_create_dir(new_trace);
+	if (ret)
+		printk(KERN_WARNING "LTT : Unable to create statistics files "
+				    "for trace %s\n", new_trace->trace_name);
 
 	return 0;
 }
@@ -1042,6 +1052,7 @@ int ltt_relay_try_switch_slow(enum force_switch_mode mode,
 		 * Next subbuffer corrupted. Force pushing reader even in normal
 		 * mode
 		 */
+		ltt_chanbuf_stat_inc(buf, commit_mismatch);
 	}
 	offsets->end = offsets->begin;
 	return 0;
@@ -1189,6 +1200,7 @@ int ltt_relay_try_reserve_slow(struct ltt_chanbuf *buf, struct ltt_chan *chan,
 			 * overwrite mode. Caused by either a writer OOPS or
 			 * too many nested writes over a reserve/commit pair.
 			 */
+			ltt_chanbuf_stat_inc(buf, commit_mismatch);
 			local_inc(&buf->events_lost);
 			return -1;
 		}
@@ -1256,6 +1268,7 @@ int ltt_reserve_slot_lockless_slow(struct ltt_chan *chan,
 	struct ltt_reserve_switch_offsets offsets;
 
 	offsets.size = 0;
+	ltt_chanbuf_stat_inc(buf, slow_path);
 
 	do {
 		if (unlikely(ltt_relay_try_reserve_slow(buf, chan, &offsets,
@@ -72,6 +72,30 @@ struct commit_counters {
 	local_t events;			/* Event count */
 };
 
+/*
+ * Live buffer statistics, exported through /debugfs/ltt/stats. Updated by the
+ * writers of the buffer.
+ */
+struct ltt_chanbuf_stats {
+	local_t events;			/* Events committed */
+	local_t bytes;			/* Bytes reserved for events */
+	local_t switches;		/* Sub-buffers closed */
+	local_t slow_path;		/* Reservations through the slow path */
+	local_t commit_mismatch;	/*
+					 * Sub-buffers found not fully
+					 * committed when switching to them
+					 */
+	local_t overruns;		/* Unread sub-buffers overwritten */
+};
+
+#ifdef CONFIG_LTT_RELAY_STATS
+#define ltt_chanbuf_stat_inc(buf, field)	local_inc(&(buf)->stats.field)
+#define ltt_chanbuf_stat_add(buf, field, v)	local_add(v, &(buf)->stats.field)
+#else
+#define ltt_chanbuf_stat_inc(buf, field)
+#define ltt_chanbuf_stat_add(buf, field, v)
+#endif
+
 /* LTTng lockless logging buffer info */
 struct ltt_chanbuf {
 	struct ltt_chanbuf_alloc a;	/* Parent. First field. */
@@ -86,6 +110,9 @@ struct ltt_chanbuf {
 	unsigned long last_tsc;		/*
 					 * Last timestamp written in the buffer.
 					 */
+#ifdef CONFIG_HAVE_TRACE_CLOCK_SYNTHETIC_TSC
+	unsigned int last_tsc_epoch;	/* Synthetic TSC epoch of last_tsc */
+#endif
 	/* End of first 32 bytes cacheline */
 #ifdef CONFIG_LTT_VMCORE
 	local_t *commit_seq;		/* Consecutive commits */
@@ -96,6 +123,9 @@ struct ltt_chanbuf {
 					 */
 	local_t events_lost;
 	local_t corrupted_subbuffers;
+#ifdef CONFIG_LTT_RELAY_STATS
+	struct ltt_chanbuf_stats stats;
+#endif
 	spinlock_t full_lock;		/*
 					 * buffer full condition spinlock, only
 					 * for userspace tracing blocking mode
@@ -133,7 +163,30 @@ extern void ltt_force_switch_lockless_slow(struct ltt_chanbuf *buf,
  * atomically.
  */
 
-#if (BITS_PER_LONG == 32)
+#ifdef CONFIG_HAVE_TRACE_CLOCK_SYNTHETIC_TSC
+/*
+ * Only the low 32 bits of the TSC are compared, along with the synthetic TSC
+ * epoch : while the epoch is unchanged, the 32-bit clock cannot have wrapped
+ * since last_tsc was saved. This lets the fast path compare a
+ * trace_clock_read32() value and read the 64-bit clock only when a full TSC
+ * event header is needed.
+ */
+static __inline__ void save_last_tsc(struct ltt_chanbuf *buf, u64 tsc)
+{
+	buf->last_tsc = (u32)tsc >> LTT_TSC_BITS;
+	buf->last_tsc_epoch = __get_cpu_var(synthetic_tsc_epoch);
+}
+
+static __inline__ int last_tsc_overflow(struct ltt_chanbuf *buf, u64 tsc)
+{
+	if (unlikely(((u32)tsc >> LTT_TSC_BITS) != buf->last_tsc
+		     || __get_cpu_var(synthetic_tsc_epoch)
+			!= buf->last_tsc_epoch))
+		return 1;
+	else
+		return 0;
+}
+#elif (BITS_PER_LONG == 32)
 static __inline__ void save_last_tsc(struct ltt_chanbuf *buf, u64 tsc)
 {
 	buf->last_tsc = (unsigned long)(tsc >> LTT_TSC_BITS);
@@ -228,6 +281,7 @@ void ltt_reserve_push_reader(struct ltt_chanbuf *buf, struct ltt_chan *chan,
 			return;
 	} while (unlikely(atomic_long_cmpxchg(&buf->consumed, consumed_old,
 					      consumed_new) != consumed_old));
+	ltt_chanbuf_stat_inc(buf, overruns);
 }
 
 #ifdef CONFIG_LTT_VMCORE
@@ -335,7 +389,15 @@ int ltt_relay_try_reserve(struct ltt_chanbuf *buf, struct ltt_chan *chan,
 	*o_begin = local_read(&buf->offset);
 	*o_old = *o_begin;
 
+#ifdef CONFIG_HAVE_TRACE_CLOCK_SYNTHETIC_TSC
+	/*
+	 * Compact event headers only hold the low LTT_TSC_BITS of the TSC. Read
+	 * the 64-bit synthetic clock only when a full TSC must be written.
+	 */
+	*tsc = trace_clock_read32();
+#else
 	*tsc = trace_clock_read64();
+#endif
 
 #ifdef CONFIG_LTT_VMCORE
 	prefetch(&buf->commit_count[SUBBUF_INDEX(*o_begin, chan)]);
@@ -343,8 +405,12 @@ int ltt_relay_try_reserve(struct ltt_chanbuf *buf, struct ltt_chan *chan,
 #else
 	prefetchw(&buf->commit_count[SUBBUF_INDEX(*o_begin, chan)]);
 #endif
-	if (last_tsc_overflow(buf, *tsc))
+	if (last_tsc_overflow(buf, *tsc)) {
 		*rflags = LTT_RFLAG_ID_SIZE_TSC;
+#ifdef CONFIG_HAVE_TRACE_CLOCK_SYNTHETIC_TSC
+		*tsc = trace_clock_read64();
+#endif
+	}
 
 	if (unlikely(SUBBUF_OFFSET(*o_begin, chan) == 0))
 		return 1;
@@ -513,6 +579,8 @@ void ltt_commit_slot(struct ltt_chanbuf *buf, struct ltt_chan *chan,
 #endif
 	local_add(slot_size, &buf->commit_count[endidx].cc);
 	local_inc(&buf->commit_count[endidx].events);
+	ltt_chanbuf_stat_inc(buf, events);
+	ltt_chanbuf_stat_add(buf, bytes, slot_size);
 	/*
 	 * commit count read can race with concurrent OOO commit count updates.
 	 * This is only needed for ltt_check_deliver (for non-polling delivery
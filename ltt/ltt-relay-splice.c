@@ -20,6 +20,11 @@
 #include <linux/splice.h>
 #include <linux/pipe_fs_i.h>
 #include <linux/bitops.h>
+#include <linux/kthread.h>
+#include <linux/net.h>
+#include <linux/socket.h>
+#include <linux/wait.h>
+#include <linux/ltt-tracer.h>
 
 #include "ltt-relay-select.h"
 
@@ -152,3 +157,324 @@ ssize_t ltt_relay_file_splice_read(struct file *in, loff_t *ppos,
 
 	return ret;
 }
+
+#ifdef CONFIG_NET
+
+/*
+ * Kernel streaming consumer.
+ *
+ * A kernel thread per trace consumes the sub-buffers of every channel buffer
+ * like lttd does, but sends them to a socket instead of splicing them to a
+ * file. The data is copied to the socket rather than handing it the buffer
+ * pages: the network may keep references on gifted pages for as long as the
+ * receiver does not read or acknowledge them, and the writers must not reuse
+ * a sub-buffer until then, which a stop or a trace destroy cannot wait for.
+ * The sub-buffer is put back as soon as it is sent. A slow receiver fills the
+ * socket buffer and blocks the send, so the writers still see a full buffer,
+ * exactly as with a slow lttd.
+ */
+
+/* Largest datagram payload, header excluded */
+#define LTT_STREAM_DGRAM_SIZE		32768
+/* Poll period of the consumer thread, when no reader wakeup happens */
+#define LTT_STREAM_POLL_INTERVAL	(HZ / 10)
+
+struct ltt_stream_buf {
+	struct ltt_chanbuf *buf;
+	struct ltt_relay_stream *stream;
+	wait_queue_t wait;		/* Entry in the buffer read_wait queue */
+	unsigned int done:1;		/* Buffer finalized and consumed */
+};
+
+struct ltt_relay_stream {
+	struct kref kref;
+	struct ltt_trace *trace;
+	struct socket *sock;
+	size_t max_payload;
+	struct task_struct *thread;
+	wait_queue_head_t wait;
+	int wakeup;
+	int stop;
+	struct completion done;
+	unsigned int nr_bufs;
+	struct ltt_stream_buf bufs[0];
+};
+
+/* Protects trace->stream */
+static DEFINE_MUTEX(ltt_stream_mutex);
+
+static void ltt_relay_stream_release(struct kref *kref)
+{
+	struct ltt_relay_stream *stream =
+		container_of(kref, struct ltt_relay_stream, kref);
+
+	kfree(stream);
+}
+
+static int ltt_stream_wake(wait_queue_t *wait, unsigned mode, int sync,
+			   void *key)
+{
+	struct ltt_stream_buf *sbuf =
+		container_of(wait, struct ltt_stream_buf, wait);
+	struct ltt_relay_stream *stream = sbuf->stream;
+
+	stream->wakeup = 1;
+	wake_up(&stream->wait);
+	return 0;
+}
+
+/*
+ * Send the sub-buffer at consumed, in one packet, or in datagrams of at most
+ * max_payload bytes.
+ */
+static int ltt_stream_send(struct ltt_relay_stream *stream,
+			   struct ltt_stream_buf *sbuf, unsigned long consumed,
+			   size_t sb_size)
+{
+	struct ltt_chanbuf *buf = sbuf->buf;
+	const char *name = buf->a.chan->filename;
+	struct ltt_stream_header hdr;
+	struct kvec iov[2], data;
+	struct msghdr msg;
+	size_t offset, chunk, len, this_len, poff;
+	struct page *page;
+	int ret;
+
+	hdr.magic = htonl(LTT_STREAM_MAGIC);
+	hdr.cpu = htons(buf->a.cpu);
+	hdr.name_len = htons(strlen(name));
+	hdr.sb_size = htonl(sb_size);
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = (void *)name;
+	iov[1].iov_len = strlen(name);
+
+	for (offset = 0; offset < sb_size; offset += chunk) {
+		chunk = min(sb_size - offset, stream->max_payload);
+		hdr.offset = htonl(offset);
+		hdr.len = htonl(chunk);
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_flags = MSG_MORE | MSG_NOSIGNAL;
+		ret = kernel_sendmsg(stream->sock, &msg, iov, 2,
+				     iov[0].iov_len + iov[1].iov_len);
+		if (ret != iov[0].iov_len + iov[1].iov_len)
+			return ret < 0 ? ret : -EIO;
+
+		for (len = 0; len < chunk; len += this_len) {
+			poff = (offset + len) & ~PAGE_MASK;
+			this_len = min_t(size_t, PAGE_SIZE - poff, chunk - len);
+			page = ltt_relay_read_get_page(&buf->a,
+					consumed + offset + len);
+			/* The buffer pages are never in highmem */
+			data.iov_base = page_address(page) + poff;
+			data.iov_len = this_len;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_flags = MSG_NOSIGNAL;
+			if (len + this_len < chunk)
+				msg.msg_flags |= MSG_MORE;
+			ret = kernel_sendmsg(stream->sock, &msg, &data, 1,
+					     this_len);
+			if (ret != this_len)
+				return ret < 0 ? ret : -EIO;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Returns 1 if a sub-buffer has been sent, 0 if the buffer is idle, or a
+ * negative error value if the send failed.
+ */
+static int ltt_stream_buf_process(struct ltt_relay_stream *stream,
+				  struct ltt_stream_buf *sbuf)
+{
+	struct ltt_chanbuf *buf = sbuf->buf;
+	unsigned long consumed;
+	int ret, err;
+
+	ret = ltt_chanbuf_get_subbuf(buf, &consumed);
+	if (ret) {
+		if (ltt_chanbuf_is_finalized(buf))
+			sbuf->done = 1;
+		return 0;
+	}
+	ret = ltt_stream_send(stream, sbuf, consumed, get_read_sb_size(buf));
+	err = ltt_chanbuf_put_subbuf(buf, consumed);
+	WARN_ON_ONCE(err);
+	return ret ? ret : 1;
+}
+
+static int ltt_relay_stream_thread(void *data)
+{
+	struct ltt_relay_stream *stream = data;
+	struct ltt_stream_buf *sbuf;
+	int ret, progress, remaining;
+	unsigned int i;
+
+	while (!stream->stop) {
+		progress = remaining = 0;
+		for (i = 0; i < stream->nr_bufs && !stream->stop; i++) {
+			sbuf = &stream->bufs[i];
+			if (sbuf->done)
+				continue;
+			ret = ltt_stream_buf_process(stream, sbuf);
+			if (ret > 0)
+				progress = 1;
+			else if (ret < 0 && !stream->stop) {
+				printk(KERN_ERR "LTT : streaming of trace %s "
+				       "failed with error %d\n",
+				       stream->trace->trace_name, ret);
+				stream->stop = 1;
+			}
+			if (!sbuf->done)
+				remaining = 1;
+		}
+		if (!remaining)
+			break;
+		if (progress) {
+			cond_resched();
+			continue;
+		}
+		wait_event_interruptible_timeout(stream->wait,
+			stream->wakeup || stream->stop,
+			LTT_STREAM_POLL_INTERVAL);
+		stream->wakeup = 0;
+	}
+
+	/* The trace can be freed once the buffers are released */
+	mutex_lock(&ltt_stream_mutex);
+	stream->trace->stream = NULL;
+	mutex_unlock(&ltt_stream_mutex);
+
+	for (i = 0; i < stream->nr_bufs; i++) {
+		sbuf = &stream->bufs[i];
+		remove_wait_queue(&sbuf->buf->read_wait, &sbuf->wait);
+		ltt_chanbuf_release_read(sbuf->buf);
+	}
+	sock_release(stream->sock);
+	complete(&stream->done);
+	kref_put(&stream->kref, ltt_relay_stream_release);
+	return 0;
+}
+
+/**
+ * ltt_relay_stream_start - Stream the trace buffers to a connected socket
+ * @trace: allocated trace
+ * @sock: connected socket, owned by the stream on success
+ *
+ * Holds the readers of every channel buffer of the trace until the trace is
+ * destroyed, the stream is stopped or the socket fails. Called with the
+ * traces lock held.
+ */
+int ltt_relay_stream_start(struct ltt_trace *trace, struct socket *sock)
+{
+	struct ltt_relay_stream *stream;
+	struct ltt_stream_buf *sbuf;
+	struct ltt_chanbuf *buf;
+	struct ltt_chan *chan;
+	unsigned int nr_bufs = 0, i;
+	int cpu, ret;
+
+	mutex_lock(&ltt_stream_mutex);
+	if (trace->stream) {
+		ret = -EBUSY;
+		goto end;
+	}
+	for (i = 0; i < trace->nr_channels; i++) {
+		chan = &trace->channels[i];
+		if (!chan->active)
+			continue;
+		for_each_possible_cpu(cpu)
+			if (per_cpu_ptr(chan->a.buf, cpu)->a.allocated)
+				nr_bufs++;
+	}
+	stream = kzalloc(sizeof(*stream) + nr_bufs * sizeof(*sbuf),
+			 GFP_KERNEL);
+	if (!stream) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	kref_init(&stream->kref);
+	stream->trace = trace;
+	stream->sock = sock;
+	if (sock->type == SOCK_DGRAM)
+		stream->max_payload = LTT_STREAM_DGRAM_SIZE;
+	else
+		stream->max_payload = ULONG_MAX;
+	init_waitqueue_head(&stream->wait);
+	init_completion(&stream->done);
+
+	for (i = 0; i < trace->nr_channels; i++) {
+		chan = &trace->channels[i];
+		if (!chan->active)
+			continue;
+		for_each_possible_cpu(cpu) {
+			buf = per_cpu_ptr(chan->a.buf, cpu);
+			if (!buf->a.allocated)
+				continue;
+			sbuf = &stream->bufs[stream->nr_bufs];
+			ret = ltt_chanbuf_open_read(buf);
+			if (ret)
+				goto error;
+			sbuf->buf = buf;
+			sbuf->stream = stream;
+			init_waitqueue_func_entry(&sbuf->wait, ltt_stream_wake);
+			add_wait_queue(&buf->read_wait, &sbuf->wait);
+			stream->nr_bufs++;
+		}
+	}
+
+	stream->thread = kthread_run(ltt_relay_stream_thread, stream,
+				     "ltt_stream");
+	if (IS_ERR(stream->thread)) {
+		ret = PTR_ERR(stream->thread);
+		goto error;
+	}
+	trace->stream = stream;
+	mutex_unlock(&ltt_stream_mutex);
+	return 0;
+
+error:
+	for (i = 0; i < stream->nr_bufs; i++) {
+		sbuf = &stream->bufs[i];
+		remove_wait_queue(&sbuf->buf->read_wait, &sbuf->wait);
+		ltt_chanbuf_release_read(sbuf->buf);
+	}
+	kref_put(&stream->kref, ltt_relay_stream_release);
+end:
+	mutex_unlock(&ltt_stream_mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ltt_relay_stream_start);
+
+/**
+ * ltt_relay_stream_stop - Stop streaming the trace buffers
+ * @trace: streamed trace
+ *
+ * Shuts the socket down, so that a send blocked by a slow receiver fails
+ * right away, and waits for the stream readers to be released. Called with
+ * the traces lock held.
+ */
+int ltt_relay_stream_stop(struct ltt_trace *trace)
+{
+	struct ltt_relay_stream *stream;
+
+	mutex_lock(&ltt_stream_mutex);
+	stream = trace->stream;
+	if (!stream) {
+		mutex_unlock(&ltt_stream_mutex);
+		return -ENOENT;
+	}
+	kref_get(&stream->kref);
+	stream->stop = 1;
+	kernel_sock_shutdown(stream->sock, SHUT_RDWR);
+	wake_up(&stream->wait);
+	mutex_unlock(&ltt_stream_mutex);
+
+	wait_for_completion(&stream->done);
+	kref_put(&stream->kref, ltt_relay_stream_release);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ltt_relay_stream_stop);
+
+#endif /* CONFIG_NET */
@@ -0,0 +1,240 @@
+/*
+ * ltt/ltt-relay-stats.c
+ *
+ * Live relay buffer statistics.
+ *
+ * Copyright (C) 2009 - Mathieu Desnoyers (mathieu.desnoyers@polymtl.ca)
+ *
+ * Dual LGPL v2.1/GPL v2 license.
+ *
+ * Exports the counters of each channel buffer of a trace while it runs, in
+ * /debugfs/ltt/stats/<trace>/text, one line per buffer, and in
+ * /debugfs/ltt/stats/<trace>/binary, one struct ltt_relay_stats_record per
+ * buffer. The snapshot is taken by the first read after the file is opened;
+ * reopen the file, or seek back to 0, to take a new one.
+ */
+
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ltt-tracer.h>
+#include <linux/ltt-relay.h>
+
+#include "ltt-relay-select.h"
+
+static struct dentry *ltt_stats_dir;
+
+/*
+ * Compares the pointers only: the caller holds a reference on @trace, so that
+ * its memory cannot be reused by another trace. Called with the traces lock
+ * held.
+ */
+static int ltt_relay_stats_trace_active(struct ltt_trace *trace)
+{
+	struct ltt_trace *iter;
+
+	list_for_each_entry(iter, &ltt_traces.head, list)
+		if (iter == trace)
+			return 1;
+	return 0;
+}
+
+static void ltt_relay_stats_fill(struct ltt_relay_stats_record *rec,
+				 struct ltt_chan *chan, const char *name,
+				 struct ltt_chanbuf *buf)
+{
+	memset(rec, 0, sizeof(*rec));
+	strlcpy(rec->channel, name, sizeof(rec->channel));
+	rec->cpu = buf->a.cpu;
+	rec->overwrite = chan->overwrite;
+	rec->events = local_read(&buf->stats.events);
+	rec->bytes = local_read(&buf->stats.bytes);
+	rec->switches = local_read(&buf->stats.switches);
+	rec->slow_path = local_read(&buf->stats.slow_path);
+	rec->commit_mismatch = local_read(&buf->stats.commit_mismatch);
+	rec->overruns = local_read(&buf->stats.overruns);
+	rec->events_lost = local_read(&buf->events_lost);
+	rec->corrupted_subbuffers = local_read(&buf->corrupted_subbuffers);
+	rec->reader_lag = local_read(&buf->offset)
+			  - atomic_long_read(&buf->consumed);
+	rec->buf_size = chan->a.buf_size;
+}
+
+static int ltt_relay_stats_show(struct seq_file *m, int binary)
+{
+	struct ltt_trace *trace = m->private;
+	struct ltt_relay_stats_record rec;
+	struct ltt_chan *chan;
+	struct ltt_chanbuf *buf;
+	const char *name;
+	unsigned int i;
+	int cpu;
+
+	if (!binary)
+		seq_printf(m, "#channel cpu events bytes switches slow_path "
+			   "commit_mismatch overruns events_lost "
+			   "corrupted_subbuffers reader_lag buf_size\n");
+
+	/*
+	 * The channel buffers are only freed after the trace is removed from
+	 * the trace list, which is done with the traces lock held.
+	 */
+	ltt_lock_traces();
+	if (!ltt_relay_stats_trace_active(trace))
+		goto end;
+	for (i = 0; i < trace->nr_channels; i++) {
+		chan = &trace->channels[i];
+		if (!chan->active || !chan->a.buf)
+			continue;
+		name = ltt_channels_get_name_from_index(i);
+		if (!name)
+			continue;
+		for_each_possible_cpu(cpu) {
+			buf = per_cpu_ptr(chan->a.buf, cpu);
+			if (!buf->a.allocated)
+				continue;
+			ltt_relay_stats_fill(&rec, chan, name, buf);
+			if (binary) {
+				/* seq_file retries with a larger buffer */
+				if (seq_write(m, &rec, sizeof(rec)))
+					goto end;
+				continue;
+			}
+			seq_printf(m, "%s %u %llu %llu %llu %llu %llu %llu "
+				   "%llu %llu %llu %llu\n",
+				   name, rec.cpu,
+				   (unsigned long long)rec.events,
+				   (unsigned long long)rec.bytes,
+				   (unsigned long long)rec.switches,
+				   (unsigned long long)rec.slow_path,
+				   (unsigned long long)rec.commit_mismatch,
+				   (unsigned long long)rec.overruns,
+				   (unsigned long long)rec.events_lost,
+				   (unsigned long long)rec.corrupted_subbuffers,
+				   (unsigned long long)rec.reader_lag,
+				   (unsigned long long)rec.buf_size);
+		}
+	}
+end:
+	ltt_unlock_traces();
+	return 0;
+}
+
+static int ltt_relay_stats_text_show(struct seq_file *m, void *v)
+{
+	return ltt_relay_stats_show(m, 0);
+}
+
+static int ltt_relay_stats_binary_show(struct seq_file *m, void *v)
+{
+	return ltt_relay_stats_show(m, 1);
+}
+
+/*
+ * Holds a reference on the trace while the file is open, so that the trace
+ * structure stays valid even once the trace is destroyed.
+ */
+static int ltt_relay_stats_open(struct inode *inode, struct file *file,
+				int (*show)(struct seq_file *, void *))
+{
+	struct ltt_trace *trace = inode->i_private;
+	int ret;
+
+	ltt_lock_traces();
+	if (!ltt_relay_stats_trace_active(trace)) {
+		ltt_unlock_traces();
+		return -ENOENT;
+	}
+	kref_get(&trace->kref);
+	ltt_unlock_traces();
+
+	ret = single_open(file, show, trace);
+	if (ret) {
+		ltt_lock_traces();
+		if (!kref_put(&trace->kref, ltt_release_trace))
+			wake_up_interruptible(&trace->kref_wq);
+		ltt_unlock_traces();
+	}
+	return ret;
+}
+
+static int ltt_relay_stats_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+	struct ltt_trace *trace = m->private;
+
+	single_release(inode, file);
+	/*
+	 * ltt_trace_destroy() waits for the last references to be dropped,
+	 * then takes the traces lock to put its own: waking it up with the
+	 * lock held keeps the trace around until we are done.
+	 */
+	ltt_lock_traces();
+	if (!kref_put(&trace->kref, ltt_release_trace))
+		wake_up_interruptible(&trace->kref_wq);
+	ltt_unlock_traces();
+	return 0;
+}
+
+static int ltt_relay_stats_text_open(struct inode *inode, struct file *file)
+{
+	return ltt_relay_stats_open(inode, file, ltt_relay_stats_text_show);
+}
+
+static int ltt_relay_stats_binary_open(struct inode *inode, struct file *file)
+{
+	return ltt_relay_stats_open(inode, file, ltt_relay_stats_binary_show);
+}
+
+static const struct file_operations ltt_relay_stats_text_fops = {
+	.owner = THIS_MODULE,
+	.open = ltt_relay_stats_text_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = ltt_relay_stats_release,
+};
+
+static const struct file_operations ltt_relay_stats_binary_fops = {
+	.owner = THIS_MODULE,
+	.open = ltt_relay_stats_binary_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = ltt_relay_stats_release,
+};
+
+int ltt_relay_stats_create_dir(struct ltt_trace *trace)
+{
+	if (!ltt_stats_dir)
+		return -ENOENT;
+	trace->dentry.stats_root = debugfs_create_dir(trace->trace_name,
+						      ltt_stats_dir);
+	if (!trace->dentry.stats_root)
+		return -ENOMEM;
+	if (!debugfs_create_file("text", S_IRUSR | S_IRGRP,
+				 trace->dentry.stats_root, trace,
+				 &ltt_relay_stats_text_fops)
+	    || !debugfs_create_file("binary", S_IRUSR | S_IRGRP,
+				    trace->dentry.stats_root, trace,
+				    &ltt_relay_stats_binary_fops)) {
+		ltt_relay_stats_remove_dir(trace);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void ltt_relay_stats_remove_dir(struct ltt_trace *trace)
+{
+	debugfs_remove_recursive(trace->dentry.stats_root);
+	trace->dentry.stats_root = NULL;
+}
+
+static __init int ltt_relay_stats_init(void)
+{
+	ltt_stats_dir = debugfs_create_dir("stats", get_ltt_root());
+	put_ltt_root();
+	if (!ltt_stats_dir)
+		printk(KERN_ERR "LTT : Unable to create stats directory\n");
+	return 0;
+}
+
+module_init(ltt_relay_stats_init);
@@ -16,311 +16,10 @@
 #include <linux/string.h>
 #include <linux/module.h>
 #include <linux/ltt-tracer.h>
+#include <asm/unaligned.h>
 
 #include "ltt-relay-select.h"
-
-enum ltt_type {
-	LTT_TYPE_SIGNED_INT,
-	LTT_TYPE_UNSIGNED_INT,
-	LTT_TYPE_STRING,
-	LTT_TYPE_NONE,
-};
-
-#define LTT_ATTRIBUTE_NETWORK_BYTE_ORDER (1<<1)
-
-/*
- * Inspired from vsnprintf
- *
- * The serialization format string supports the basic printf format strings.
- * In addition, it defines new formats that can be used to serialize more
- * complex/non portable data structures.
- *
- * Typical use:
- *
- * field_name %ctype
- * field_name #tracetype %ctype
- * field_name #tracetype %ctype1 %ctype2 ...
- *
- * A conversion is performed between format string types supported by GCC and
- * the trace type requested. GCC type is used to perform type checking on format
- * strings. Trace type is used to specify the exact binary representation
- * in the trace. A mapping is done between one or more GCC types to one trace
- * type. Sign extension, if required by the conversion, is performed following
- * the trace type.
- *
- * If a gcc format is not declared with a trace format, the gcc format is
- * also used as binary representation in the trace.
- *
- * Strings are supported with %s.
- * A single tracetype (sequence) can take multiple c types as parameter.
- *
- * c types:
- *
- * see printf(3).
- *
- * Note: to write a uint32_t in a trace, the following expression is recommended
- * si it can be portable:
- *
- * ("#4u%lu", (unsigned long)var)
- *
- * trace types:
- *
- * Serialization specific formats :
- *
- * Fixed size integers
- * #1u     writes uint8_t
- * #2u     writes uint16_t
- * #4u     writes uint32_t
- * #8u     writes uint64_t
- * #1d     writes int8_t
- * #2d     writes int16_t
- * #4d     writes int32_t
- * #8d     writes int64_t
- * i.e.:
- * #1u%lu #2u%lu #4d%lu #8d%lu #llu%hu #d%lu
- *
- * * Attributes:
- *
- * n:  (for network byte order)
- * #ntracetype%ctype
- *            is written in the trace in network byte order.
- *
- * i.e.: #bn4u%lu, #n%lu, #b%u
- *
- * TODO (eventually)
- * Variable length sequence
- * #a #tracetype1 #tracetype2 %array_ptr %elem_size %num_elems
- *            In the trace:
- *            #a specifies that this is a sequence
- *            #tracetype1 is the type of elements in the sequence
- *            #tracetype2 is the type of the element count
- *            GCC input:
- *            array_ptr is a pointer to an array that contains members of size
- *            elem_size.
- *            num_elems is the number of elements in the array.
- * i.e.: #a #lu #lu %p %lu %u
- *
- * Callback
- * #k         callback (taken from the probe data)
- *            The following % arguments are exepected by the callback
- *
- * i.e.: #a #lu #lu #k %p
- *
- * Note: No conversion is done from floats to integers, nor from integers to
- * floats between c types and trace types. float conversion from double to float
- * or from float to double is also not supported.
- *
- * REMOVE
- * %*b     expects sizeof(data), data
- *         where sizeof(data) is 1, 2, 4 or 8
- *
- * Fixed length struct, union or array.
- * FIXME: unable to extract those sizes statically.
- * %*r     expects sizeof(*ptr), ptr
- * %*.*r   expects sizeof(*ptr), __alignof__(*ptr), ptr
- * struct and unions removed.
- * Fixed length array:
- * [%p]#a[len #tracetype]
- * i.e.: [%p]#a[12 #lu]
- *
- * Variable length sequence
- * %*.*:*v expects sizeof(*ptr), __alignof__(*ptr), elem_num, ptr
- *         where elem_num is the number of elements in the sequence
- */
-static inline
-const char *parse_trace_type(const char *fmt, char *trace_size,
-			     enum ltt_type *trace_type,
-			     unsigned long *attributes)
-{
-	int qualifier;		/* 'h', 'l', or 'L' for integer fields */
-				/* 'z' support added 23/7/1999 S.H.    */
-				/* 'z' changed to 'Z' --davidm 1/25/99 */
-				/* 't' added for ptrdiff_t */
-
-	/* parse attributes. */
-repeat:
-	switch (*fmt) {
-	case 'n':
-		*attributes |= LTT_ATTRIBUTE_NETWORK_BYTE_ORDER;
-		++fmt;
-		goto repeat;
-	}
-
-	/* get the conversion qualifier */
-	qualifier = -1;
-	if (*fmt == 'h' || *fmt == 'l' || *fmt == 'L' ||
-	    *fmt == 'Z' || *fmt == 'z' || *fmt == 't' ||
-	    *fmt == 'S' || *fmt == '1' || *fmt == '2' ||
-	    *fmt == '4' || *fmt == 8) {
-		qualifier = *fmt;
-		++fmt;
-		if (qualifier == 'l' && *fmt == 'l') {
-			qualifier = 'L';
-			++fmt;
-		}
-	}
-
-	switch (*fmt) {
-	case 'c':
-		*trace_type = LTT_TYPE_UNSIGNED_INT;
-		*trace_size = sizeof(unsigned char);
-		goto parse_end;
-	case 's':
-		*trace_type = LTT_TYPE_STRING;
-		goto parse_end;
-	case 'p':
-		*trace_type = LTT_TYPE_UNSIGNED_INT;
-		*trace_size = sizeof(void *);
-		goto parse_end;
-	case 'd':
-	case 'i':
-		*trace_type = LTT_TYPE_SIGNED_INT;
-		break;
-	case 'o':
-	case 'u':
-	case 'x':
-	case 'X':
-		*trace_type = LTT_TYPE_UNSIGNED_INT;
-		break;
-	default:
-		if (!*fmt)
-			--fmt;
-		goto parse_end;
-	}
-	switch (qualifier) {
-	case 'L':
-		*trace_size = sizeof(long long);
-		break;
-	case 'l':
-		*trace_size = sizeof(long);
-		break;
-	case 'Z':
-	case 'z':
-		*trace_size = sizeof(size_t);
-		break;
-	case 't':
-		*trace_size = sizeof(ptrdiff_t);
-		break;
-	case 'h':
-		*trace_size = sizeof(short);
-		break;
-	case '1':
-		*trace_size = sizeof(uint8_t);
-		break;
-	case '2':
-		*trace_size = sizeof(uint16_t);
-		break;
-	case '4':
-		*trace_size = sizeof(uint32_t);
-		break;
-	case '8':
-		*trace_size = sizeof(uint64_t);
-		break;
-	default:
-		*trace_size = sizeof(int);
-	}
-
-parse_end:
-	return fmt;
-}
-
-/*
- * Restrictions:
- * Field width and precision are *not* supported.
- * %n not supported.
- */
-static inline
-const char *parse_c_type(const char *fmt, char *c_size, enum ltt_type *c_type,
-			 char *outfmt)
-{
-	int qualifier;		/* 'h', 'l', or 'L' for integer fields */
-				/* 'z' support added 23/7/1999 S.H.    */
-				/* 'z' changed to 'Z' --davidm 1/25/99 */
-				/* 't' added for ptrdiff_t */
-
-	/* process flags : ignore standard print formats for now. */
-repeat:
-	switch (*fmt) {
-	case '-':
-	case '+':
-	case ' ':
-	case '#':
-	case '0':
-		++fmt;
-		goto repeat;
-	}
-
-	/* get the conversion qualifier */
-	qualifier = -1;
-	if (*fmt == 'h' || *fmt == 'l' || *fmt == 'L' ||
-	    *fmt == 'Z' || *fmt == 'z' || *fmt == 't' ||
-	    *fmt == 'S') {
-		qualifier = *fmt;
-		++fmt;
-		if (qualifier == 'l' && *fmt == 'l') {
-			qualifier = 'L';
-			++fmt;
-		}
-	}
-
-	if (outfmt) {
-		if (qualifier != -1)
-			*outfmt++ = (char)qualifier;
-		*outfmt++ = *fmt;
-		*outfmt = 0;
-	}
-
-	switch (*fmt) {
-	case 'c':
-		*c_type = LTT_TYPE_UNSIGNED_INT;
-		*c_size = sizeof(unsigned char);
-		goto parse_end;
-	case 's':
-		*c_type = LTT_TYPE_STRING;
-		goto parse_end;
-	case 'p':
-		*c_type = LTT_TYPE_UNSIGNED_INT;
-		*c_size = sizeof(void *);
-		goto parse_end;
-	case 'd':
-	case 'i':
-		*c_type = LTT_TYPE_SIGNED_INT;
-		break;
-	case 'o':
-	case 'u':
-	case 'x':
-	case 'X':
-		*c_type = LTT_TYPE_UNSIGNED_INT;
-		break;
-	default:
-		if (!*fmt)
-			--fmt;
-		goto parse_end;
-	}
-	switch (qualifier) {
-	case 'L':
-		*c_size = sizeof(long long);
-		break;
-	case 'l':
-		*c_size = sizeof(long);
-		break;
-	case 'Z':
-	case 'z':
-		*c_size = sizeof(size_t);
-		break;
-	case 't':
-		*c_size = sizeof(ptrdiff_t);
-		break;
-	case 'h':
-		*c_size = sizeof(short);
-		break;
-	default:
-		*c_size = sizeof(int);
-	}
-
-parse_end:
-	return fmt;
-}
+#include "ltt-format.h"
 
 static inline
 size_t serialize_trace_data(struct ltt_chanbuf *buf, size_t buf_offset,
@@ -797,6 +496,135 @@ void ltt_write_event_data(struct ltt_chanbuf *buf, size_t buf_offset,
 	cb(buf, buf_offset, closure, serialize_private, NULL, fmt, args);
 }
 
+/*
+ * Fetch the next integer argument described by a plan field. Sign extension is
+ * done with the trace type, as in serialize_trace_data().
+ */
+static inline
+uint64_t plan_fetch_int(const struct ltt_plan_field *field, va_list *args)
+{
+	if (field->c_size == 8)
+		return va_arg(*args, uint64_t);
+	if (field->trace_type == LTT_TYPE_SIGNED_INT) {
+		switch (field->c_size) {
+		case 1:
+			return (int64_t)(int8_t)va_arg(*args, int);
+		case 2:
+			return (int64_t)(int16_t)va_arg(*args, int);
+		default:
+			return (int64_t)(int32_t)va_arg(*args, int);
+		}
+	} else {
+		switch (field->c_size) {
+		case 1:
+			return (uint8_t)va_arg(*args, unsigned int);
+		case 2:
+			return (uint16_t)va_arg(*args, unsigned int);
+		default:
+			return (uint32_t)va_arg(*args, unsigned int);
+		}
+	}
+}
+
+static inline
+const char *plan_fetch_string(va_list *args)
+{
+	const char *s = va_arg(*args, const char *);
+
+	if ((unsigned long)s < PAGE_SIZE)
+		s = "<NULL>";
+	return s;
+}
+
+/*
+ * Calculate data size from a serialization plan, for plans containing strings.
+ * Assume that the padding for alignment starts at a sizeof(void *) address.
+ */
+static notrace
+size_t ltt_plan_get_data_size(const struct ltt_serialize_plan *plan,
+			      va_list *args)
+{
+	const struct ltt_plan_field *field;
+	size_t data_size = 0;
+	unsigned int i;
+
+	for (i = 0; i < plan->nr_fields; i++) {
+		field = &plan->fields[i];
+		if (field->trace_type == LTT_TYPE_STRING) {
+			data_size += strlen(plan_fetch_string(args)) + 1;
+			continue;
+		}
+		plan_fetch_int(field, args);
+		data_size += ltt_align(data_size, field->trace_size);
+		data_size += field->trace_size;
+	}
+	return data_size;
+}
+
+/*
+ * Integer fields are staged on the stack and copied to the buffer with a single
+ * ltt_relay_write() per run of integers, rather than one per field.
+ */
+#define LTT_PLAN_STAGE_SIZE	64
+
+static notrace
+void ltt_plan_write_event_data(struct ltt_chanbuf *buf, size_t buf_offset,
+			       const struct ltt_serialize_plan *plan,
+			       int largest_align, va_list *args)
+{
+	const struct ltt_plan_field *field;
+	char stage[LTT_PLAN_STAGE_SIZE];
+	size_t len = 0, padding;
+	unsigned int i;
+	uint64_t v;
+
+	buf_offset += ltt_align(buf_offset, largest_align);
+	for (i = 0; i < plan->nr_fields; i++) {
+		field = &plan->fields[i];
+		if (field->trace_type == LTT_TYPE_STRING) {
+			const char *s = plan_fetch_string(args);
+			size_t slen = strlen(s) + 1;
+
+			if (len) {
+				ltt_relay_write(&buf->a, buf->a.chan,
+						buf_offset, stage, len);
+				buf_offset += len;
+				len = 0;
+			}
+			ltt_relay_write(&buf->a, buf->a.chan, buf_offset,
+					s, slen);
+			buf_offset += slen;
+			continue;
+		}
+		v = plan_fetch_int(field, args);
+		padding = ltt_align(buf_offset + len, field->trace_size);
+		if (len + padding + field->trace_size > LTT_PLAN_STAGE_SIZE) {
+			ltt_relay_write(&buf->a, buf->a.chan, buf_offset,
+					stage, len);
+			buf_offset += len;
+			len = 0;
+		}
+		memset(stage + len, 0, padding);
+		len += padding;
+		switch (field->trace_size) {
+		case 1:
+			stage[len] = (uint8_t)v;
+			break;
+		case 2:
+			put_unaligned((uint16_t)v, (uint16_t *)(stage + len));
+			break;
+		case 4:
+			put_unaligned((uint32_t)v, (uint32_t *)(stage + len));
+			break;
+		case 8:
+			put_unaligned(v, (uint64_t *)(stage + len));
+			break;
+		}
+		len += field->trace_size;
+	}
+	if (len)
+		ltt_relay_write(&buf->a, buf->a.chan, buf_offset, stage, len);
+}
 
 notrace
 void ltt_vtrace(const struct marker *mdata, void *probe_data, void *call_data,
@@ -815,6 +643,7 @@ void ltt_vtrace(const struct marker *mdata, void *probe_data, void *call_data,
 	va_list args_copy;
 	struct ltt_serialize_closure closure;
 	struct ltt_probe_private_data *private_data = call_data;
+	const struct ltt_serialize_plan *plan;
 	void *serialize_private = NULL;
 	int cpu;
 	unsigned int rflags;
@@ -848,16 +677,20 @@ void ltt_vtrace(const struct marker *mdata, void *probe_data, void *call_data,
 			closure.callbacks = &private_data->serializer;
 		serialize_private = private_data->serialize_private;
 	}
+	/*
+	 * The serialization plan describes the format string, which only
+	 * helps the default serializer.
+	 */
+	plan = mdata->plan;
+	if (closure.callbacks[0] != ltt_serialize_data)
+		plan = NULL;
 
-	va_copy(args_copy, *args);
 	/*
-	 * Assumes event payload to start on largest_align alignment.
+	 * The payload size is only computed once the first trace accepted the
+	 * event, so filtered out events do not pay for the format string walk.
 	 */
-	largest_align = 1;	/* must be non-zero for ltt_align */
-	data_size = ltt_get_data_size(&closure, serialize_private,
-				      &largest_align, fmt, &args_copy);
-	largest_align = min_t(int, largest_align, sizeof(void *));
-	va_end(args_copy);
+	largest_align = 0;
+	data_size = 0;
 
 	/* Iterate on each trace */
 	list_for_each_entry_rcu(trace, &ltt_traces.head, list) {
@@ -869,7 +702,7 @@ void ltt_vtrace(const struct marker *mdata, void *probe_data, void *call_data,
 			continue;
 		if (unlikely(!trace->active))
 			continue;
-		if (unlikely(!ltt_run_filter(trace, eID)))
+		if (unlikely(!ltt_run_filter(trace, mdata, NULL, args)))
 			continue;
 #ifdef CONFIG_LTT_DEBUG_EVENT_SIZE
 		rflags = LTT_RFLAG_ID_SIZE;
@@ -888,6 +721,32 @@ void ltt_vtrace(const struct marker *mdata, void *probe_data, void *call_data,
 		if (!chan->active)
 			continue;
 
+		if (unlikely(!largest_align) && likely(plan)) {
+			largest_align = plan->largest_align;
+			if (!plan->nr_strings) {
+				data_size = plan->data_size;
+			} else {
+				va_copy(args_copy, *args);
+				data_size = ltt_plan_get_data_size(plan,
+								   &args_copy);
+				va_end(args_copy);
+			}
+		} else if (unlikely(!largest_align)) {
+			va_copy(args_copy, *args);
+			/*
+			 * Assumes event payload to start on largest_align
+			 * alignment.
+			 */
+			largest_align = 1; /* must be non-zero for ltt_align */
+			data_size = ltt_get_data_size(&closure,
+						      serialize_private,
+						      &largest_align, fmt,
+						      &args_copy);
+			largest_align = min_t(int, largest_align,
+					      sizeof(void *));
+			va_end(args_copy);
+		}
+
 		/* reserve space : header and data */
 		ret = ltt_reserve_slot(chan, trace, data_size, largest_align,
 				       cpu, &buf, &slot_size, &buf_offset,
@@ -900,9 +759,13 @@ void ltt_vtrace(const struct marker *mdata, void *probe_data, void *call_data,
 		buf_offset = ltt_write_event_header(&buf->a, &chan->a,
 						    buf_offset, eID, data_size,
 						    tsc, rflags);
-		ltt_write_event_data(buf, buf_offset, &closure,
-				     serialize_private, largest_align, fmt,
-				     &args_copy);
+		if (likely(plan))
+			ltt_plan_write_event_data(buf, buf_offset, plan,
+						  largest_align, &args_copy);
+		else
+			ltt_write_event_data(buf, buf_offset, &closure,
+					     serialize_private, largest_align,
+					     fmt, &args_copy);
 		va_end(args_copy);
 		/* Out-of-order commit */
 		ltt_commit_slot(buf, chan, buf_offset, data_size, slot_size);
@@ -33,12 +33,41 @@
 #include <linux/swap.h>
 #include <linux/wait.h>
 #include <linux/mutex.h>
+#include <linux/pid.h>
+#include <linux/pid_namespace.h>
+#include <linux/delay.h>
+
+#include "ltt-relay-select.h"
 
 #ifdef CONFIG_GENERIC_HARDIRQS
 #include <linux/irq.h>
 #endif
 
+/*
+ * The state dump walks processes, file descriptors and memory maps in batches
+ * of at most this many items, yielding the CPU between batches.
+ */
 #define NB_PROC_CHUNK 20
+#define NB_FD_CHUNK 64
+#define NB_VMA_CHUNK 64
+
+/*
+ * Between batches, wait for the readers while a buffer of the current CPU is
+ * more than half full. Readers consuming nothing for LTT_STATEDUMP_STALL stop
+ * the throttling for the rest of the state dump.
+ */
+#define LTT_STATEDUMP_FILL_SHIFT	1
+#define LTT_STATEDUMP_STALL		(HZ / 10)
+
+struct ltt_statedump {
+	struct ltt_probe_private_data call_data;
+	int throttle;			/* Cleared when the readers stall */
+	/* Parallel memory map dump */
+	spinlock_t vm_lock;		/* Protects vm_cursor */
+	pid_t vm_cursor;		/* Next pid to dump */
+	atomic_t vm_threads;		/* Running dump threads */
+	struct completion vm_done;
+};
 
 /*
  * Protected by the trace lock.
@@ -84,6 +113,100 @@ enum lttng_process_status {
 	LTTNG_DEAD = 7,
 };
 
+/*
+ * Returns whether a non flight recorder buffer of the current CPU is more than
+ * half full, and the sum of the consumed counts of these buffers.
+ */
+static int ltt_statedump_buffers_full(struct ltt_trace *trace,
+				      unsigned long *consumed)
+{
+	struct ltt_chan *chan;
+	struct ltt_chanbuf *buf;
+	unsigned int i;
+	int cpu, full = 0;
+
+	*consumed = 0;
+	cpu = get_cpu();
+	for (i = 0; i < trace->nr_channels; i++) {
+		chan = &trace->channels[i];
+		if (!chan->active || chan->overwrite)
+			continue;
+		buf = per_cpu_ptr(chan->a.buf, cpu);
+		if (!buf->a.allocated)
+			continue;
+		*consumed += atomic_long_read(&buf->consumed);
+		if (local_read(&buf->offset) - atomic_long_read(&buf->consumed)
+		    > (chan->a.buf_size >> LTT_STATEDUMP_FILL_SHIFT))
+			full = 1;
+	}
+	put_cpu();
+	return full;
+}
+
+/*
+ * Called between batches, without locks held.
+ */
+static void ltt_statedump_yield(struct ltt_statedump *sd)
+{
+	unsigned long consumed, last_consumed, stall;
+
+	cond_resched();
+	if (!sd->throttle)
+		return;
+	if (!ltt_statedump_buffers_full(sd->call_data.trace, &last_consumed))
+		return;
+	stall = jiffies + LTT_STATEDUMP_STALL;
+	do {
+		msleep(1);
+		if (!ltt_statedump_buffers_full(sd->call_data.trace, &consumed))
+			return;
+		if (consumed != last_consumed) {
+			last_consumed = consumed;
+			stall = jiffies + LTT_STATEDUMP_STALL;
+		}
+	} while (time_before(jiffies, stall));
+	printk(KERN_DEBUG "LTT state dump : readers stalled, "
+	       "not throttling\n");
+	sd->throttle = 0;
+}
+
+/*
+ * Returns the task with the lowest pid greater than or equal to *cursor and
+ * moves the cursor past it, or NULL at the end of the walk. The pid cursor
+ * stays valid across batches, whatever tasks exit in between. Must be called
+ * with rcu_read_lock held.
+ */
+static struct task_struct *ltt_statedump_next_task(pid_t *cursor)
+{
+	struct task_struct *t;
+	struct pid *pid;
+
+	for (;;) {
+		pid = find_ge_pid(*cursor, &init_pid_ns);
+		if (!pid)
+			return NULL;
+		*cursor = pid_nr(pid) + 1;
+		t = pid_task(pid, PIDTYPE_PID);
+		if (t)
+			return t;
+	}
+}
+
+/*
+ * Same as ltt_statedump_next_task(), skipping the threads which are not a
+ * thread group leader : the file descriptors and memory maps are shared by
+ * the whole thread group, dump them once.
+ */
+static struct task_struct *ltt_statedump_next_process(pid_t *cursor)
+{
+	struct task_struct *t;
+
+	do {
+		t = ltt_statedump_next_task(cursor);
+	} while (t && !thread_group_leader(t));
+	return t;
+}
+
 #ifdef CONFIG_INET
 static void ltt_enumerate_device(struct ltt_probe_private_data *call_data,
 				 struct net_device *dev)
@@ -132,104 +255,190 @@ ltt_enumerate_network_ip_interface(struct ltt_probe_private_data *call_data)
 #endif /* CONFIG_INET */
 
 
-static inline void
-ltt_enumerate_task_fd(struct ltt_probe_private_data *call_data,
-		      struct task_struct *t, char *tmp)
+/*
+ * The fd index is the cursor between batches : file_lock is released while
+ * yielding.
+ */
+static void
+ltt_enumerate_task_fd(struct ltt_statedump *sd, pid_t pid,
+		      struct files_struct *files, char *tmp)
 {
 	struct fdtable *fdt;
 	struct file *filp;
-	unsigned int i;
+	unsigned int i = 0, n;
 	const unsigned char *path;
+	int more;
 
-	if (!t->files)
-		return;
-
-	spin_lock(&t->files->file_lock);
-	fdt = files_fdtable(t->files);
-	for (i = 0; i < fdt->max_fds; i++) {
-		filp = fcheck_files(t->files, i);
-		if (!filp)
-			continue;
-		path = d_path(&filp->f_path, tmp, PAGE_SIZE);
-		/* Make sure we give at least some info */
-		__trace_mark(0, fd_state, file_descriptor, call_data,
-			     "filename %s pid %d fd %u",
-			     (IS_ERR(path))?(filp->f_dentry->d_name.name):(path),
-			     t->pid, i);
-	}
-	spin_unlock(&t->files->file_lock);
+	do {
+		spin_lock(&files->file_lock);
+		fdt = files_fdtable(files);
+		for (n = 0; i < fdt->max_fds && n < NB_FD_CHUNK; i++) {
+			filp = fcheck_files(files, i);
+			if (!filp)
+				continue;
+			path = d_path(&filp->f_path, tmp, PAGE_SIZE);
+			/* Make sure we give at least some info */
+			__trace_mark(0, fd_state, file_descriptor,
+				     &sd->call_data,
+				     "filename %s pid %d fd %u",
+				     (IS_ERR(path)) ?
+				      (filp->f_dentry->d_name.name) : (path),
+				     pid, i);
+			n++;
+		}
+		more = i < fdt->max_fds;
+		spin_unlock(&files->file_lock);
+		if (more)
+			ltt_statedump_yield(sd);
+	} while (more);
 }
 
-static inline int
-ltt_enumerate_file_descriptors(struct ltt_probe_private_data *call_data)
+static int ltt_enumerate_file_descriptors(struct ltt_statedump *sd)
 {
-	struct task_struct *t = &init_task;
+	struct task_struct *t;
+	struct files_struct *files;
+	pid_t cursor = 1, pid;
 	char *tmp = (char *)__get_free_page(GFP_KERNEL);
 
-	/* Enumerate active file descriptors */
-	do {
-		read_lock(&tasklist_lock);
-		if (t != &init_task)
-			atomic_dec(&t->usage);
-		t = next_task(t);
-		atomic_inc(&t->usage);
-		read_unlock(&tasklist_lock);
-		task_lock(t);
-		ltt_enumerate_task_fd(call_data, t, tmp);
-		task_unlock(t);
-	} while (t != &init_task);
+	if (!tmp)
+		return -ENOMEM;
+	/* Enumerate active file descriptors, init_task last */
+	for (;;) {
+		rcu_read_lock();
+		t = ltt_statedump_next_process(&cursor);
+		if (!t)
+			t = &init_task;
+		pid = t->pid;
+		files = get_files_struct(t);
+		rcu_read_unlock();
+		if (files) {
+			ltt_enumerate_task_fd(sd, pid, files, tmp);
+			put_files_struct(files);
+		}
+		if (t == &init_task)
+			break;
+		ltt_statedump_yield(sd);
+	}
 	free_page((unsigned long)tmp);
 	return 0;
 }
 
-static inline void
-ltt_enumerate_task_vm_maps(struct ltt_probe_private_data *call_data,
-		struct task_struct *t)
+/*
+ * The end address of the last map dumped is the cursor between batches :
+ * mmap_sem is released while yielding.
+ */
+static void
+ltt_enumerate_task_vm_maps(struct ltt_statedump *sd, pid_t pid,
+			   struct mm_struct *mm)
 {
-	struct mm_struct *mm;
 	struct vm_area_struct *map;
-	unsigned long ino;
-
-	/* get_task_mm does a task_lock... */
-	mm = get_task_mm(t);
-	if (!mm)
-		return;
+	unsigned long ino, start;
+	unsigned int n = 0;
 
+	down_read(&mm->mmap_sem);
 	map = mm->mmap;
-	if (map) {
-		down_read(&mm->mmap_sem);
-		while (map) {
-			if (map->vm_file)
-				ino = map->vm_file->f_dentry->d_inode->i_ino;
-			else
-				ino = 0;
-			__trace_mark(0, vm_state, vm_map, call_data,
-				     "pid %d start %lu end %lu flags %lu "
-				     "pgoff %lu inode %lu",
-				     t->pid, map->vm_start, map->vm_end,
-				     map->vm_flags, map->vm_pgoff << PAGE_SHIFT,
-				     ino);
-			map = map->vm_next;
+	while (map) {
+		if (map->vm_file)
+			ino = map->vm_file->f_dentry->d_inode->i_ino;
+		else
+			ino = 0;
+		__trace_mark(0, vm_state, vm_map, &sd->call_data,
+			     "pid %d start %lu end %lu flags %lu "
+			     "pgoff %lu inode %lu",
+			     pid, map->vm_start, map->vm_end,
+			     map->vm_flags, map->vm_pgoff << PAGE_SHIFT,
+			     ino);
+		if (++n == NB_VMA_CHUNK && map->vm_next) {
+			start = map->vm_end;
+			up_read(&mm->mmap_sem);
+			ltt_statedump_yield(sd);
+			down_read(&mm->mmap_sem);
+			map = find_vma(mm, start);
+			n = 0;
+			continue;
 		}
-		up_read(&mm->mmap_sem);
+		map = map->vm_next;
 	}
-	mmput(mm);
+	up_read(&mm->mmap_sem);
 }
 
-static inline int
-ltt_enumerate_vm_maps(struct ltt_probe_private_data *call_data)
+/*
+ * Memory maps are dumped by one thread per online CPU, each thread taking
+ * batches of tasks from the shared pid cursor and writing into the buffers of
+ * its own CPU.
+ */
+static void ltt_enumerate_vm_maps_batches(struct ltt_statedump *sd)
 {
-	struct task_struct *t = &init_task;
+	struct task_struct *t;
+	struct mm_struct *mm;
+	pid_t pids[NB_PROC_CHUNK];
+	unsigned int i, n;
 
 	do {
-		read_lock(&tasklist_lock);
-		if (t != &init_task)
-			atomic_dec(&t->usage);
-		t = next_task(t);
-		atomic_inc(&t->usage);
-		read_unlock(&tasklist_lock);
-		ltt_enumerate_task_vm_maps(call_data, t);
-	} while (t != &init_task);
+		n = 0;
+		spin_lock(&sd->vm_lock);
+		rcu_read_lock();
+		while (n < NB_PROC_CHUNK) {
+			t = ltt_statedump_next_process(&sd->vm_cursor);
+			if (!t)
+				break;
+			pids[n++] = t->pid;
+		}
+		rcu_read_unlock();
+		spin_unlock(&sd->vm_lock);
+
+		for (i = 0; i < n; i++) {
+			rcu_read_lock();
+			t = pid_task(find_pid_ns(pids[i], &init_pid_ns),
+				     PIDTYPE_PID);
+			/* get_task_mm does a task_lock... */
+			mm = t ? get_task_mm(t) : NULL;
+			rcu_read_unlock();
+			if (!mm)
+				continue;
+			ltt_enumerate_task_vm_maps(sd, pids[i], mm);
+			mmput(mm);
+		}
+		ltt_statedump_yield(sd);
+	} while (n == NB_PROC_CHUNK);
+}
+
+static int ltt_statedump_vm_thread(void *data)
+{
+	struct ltt_statedump *sd = data;
+
+	ltt_enumerate_vm_maps_batches(sd);
+	if (atomic_dec_and_test(&sd->vm_threads))
+		complete(&sd->vm_done);
+	return 0;
+}
+
+static int ltt_enumerate_vm_maps(struct ltt_statedump *sd)
+{
+	struct task_struct *thread;
+	int cpu;
+
+	spin_lock_init(&sd->vm_lock);
+	sd->vm_cursor = 1;
+	/* The caller holds one reference until all the threads are started */
+	atomic_set(&sd->vm_threads, 1);
+	init_completion(&sd->vm_done);
+
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		thread = kthread_create(ltt_statedump_vm_thread, sd,
+					"ltt_statedump/%d", cpu);
+		if (IS_ERR(thread))
+			continue;
+		kthread_bind(thread, cpu);
+		atomic_inc(&sd->vm_threads);
+		wake_up_process(thread);
+	}
+	/* Also covers the case where no thread could be created */
+	ltt_enumerate_vm_maps_batches(sd);
+	if (!atomic_dec_and_test(&sd->vm_threads))
+		wait_for_completion(&sd->vm_done);
+	put_online_cpus();
 	return 0;
 }
 
@@ -260,74 +469,79 @@ static inline void list_interrupts(struct ltt_probe_private_data *call_data)
 }
 #endif
 
-static inline int
-ltt_enumerate_process_states(struct ltt_probe_private_data *call_data)
+static void ltt_dump_process_state(struct ltt_statedump *sd,
+				   struct task_struct *t)
 {
-	struct task_struct *t = &init_task;
-	struct task_struct *p = t;
 	enum lttng_process_status status;
 	enum lttng_thread_type type;
 	enum lttng_execution_mode mode;
 	enum lttng_execution_submode submode;
 
-	do {
-		mode = LTTNG_MODE_UNKNOWN;
-		submode = LTTNG_UNKNOWN;
+	mode = LTTNG_MODE_UNKNOWN;
+	submode = LTTNG_UNKNOWN;
 
-		read_lock(&tasklist_lock);
-		if (t != &init_task) {
-			atomic_dec(&t->usage);
-			t = next_thread(t);
-		}
-		if (t == p) {
-			p = next_task(t);
-			t = p;
-		}
-		atomic_inc(&t->usage);
-		read_unlock(&tasklist_lock);
-
-		task_lock(t);
-
-		if (t->exit_state == EXIT_ZOMBIE)
-			status = LTTNG_ZOMBIE;
-		else if (t->exit_state == EXIT_DEAD)
-			status = LTTNG_DEAD;
-		else if (t->state == TASK_RUNNING) {
-			/* Is this a forked child that has not run yet? */
-			if (list_empty(&t->rt.run_list))
-				status = LTTNG_WAIT_FORK;
-			else
-				/*
-				 * All tasks are considered as wait_cpu;
-				 * the viewer will sort out if the task was
-				 * really running at this time.
-				 */
-				status = LTTNG_WAIT_CPU;
-		} else if (t->state &
-			(TASK_INTERRUPTIBLE | TASK_UNINTERRUPTIBLE)) {
-			/* Task is waiting for something to complete */
-			status = LTTNG_WAIT;
-		} else
-			status = LTTNG_UNNAMED;
-		submode = LTTNG_NONE;
-
-		/*
-		 * Verification of t->mm is to filter out kernel threads;
-		 * Viewer will further filter out if a user-space thread was
-		 * in syscall mode or not.
-		 */
-		if (t->mm)
-			type = LTTNG_USER_THREAD;
+	task_lock(t);
+
+	if (t->exit_state == EXIT_ZOMBIE)
+		status = LTTNG_ZOMBIE;
+	else if (t->exit_state == EXIT_DEAD)
+		status = LTTNG_DEAD;
+	else if (t->state == TASK_RUNNING) {
+		/* Is this a forked child that has not run yet? */
+		if (list_empty(&t->rt.run_list))
+			status = LTTNG_WAIT_FORK;
 		else
-			type = LTTNG_KERNEL_THREAD;
+			/*
+			 * All tasks are considered as wait_cpu;
+			 * the viewer will sort out if the task was
+			 * really running at this time.
+			 */
+			status = LTTNG_WAIT_CPU;
+	} else if (t->state &
+		(TASK_INTERRUPTIBLE | TASK_UNINTERRUPTIBLE)) {
+		/* Task is waiting for something to complete */
+		status = LTTNG_WAIT;
+	} else
+		status = LTTNG_UNNAMED;
+	submode = LTTNG_NONE;
+
+	/*
+	 * Verification of t->mm is to filter out kernel threads;
+	 * Viewer will further filter out if a user-space thread was
+	 * in syscall mode or not.
+	 */
+	if (t->mm)
+		type = LTTNG_USER_THREAD;
+	else
+		type = LTTNG_KERNEL_THREAD;
+
+	__trace_mark(0, task_state, process_state, &sd->call_data,
+		     "pid %d parent_pid %d name %s type %d mode %d "
+		     "submode %d status %d tgid %d",
+		     t->pid, t->parent->pid, t->comm,
+		     type, mode, submode, status, t->tgid);
+	task_unlock(t);
+}
+
+static int ltt_enumerate_process_states(struct ltt_statedump *sd)
+{
+	struct task_struct *t;
+	pid_t cursor = 1;
+	unsigned int n;
 
-		__trace_mark(0, task_state, process_state, call_data,
-			     "pid %d parent_pid %d name %s type %d mode %d "
-			     "submode %d status %d tgid %d",
-			     t->pid, t->parent->pid, t->comm,
-			     type, mode, submode, status, t->tgid);
-		task_unlock(t);
-	} while (t != &init_task);
+	do {
+		rcu_read_lock();
+		for (n = 0; n < NB_PROC_CHUNK; n++) {
+			t = ltt_statedump_next_task(&cursor);
+			if (!t)
+				break;
+			ltt_dump_process_state(sd, t);
+		}
+		rcu_read_unlock();
+		ltt_statedump_yield(sd);
+	} while (n == NB_PROC_CHUNK);
+	/* The idle task is not hashed */
+	ltt_dump_process_state(sd, &init_task);
 
 	return 0;
 }
@@ -355,16 +569,17 @@ void ltt_statedump_work_func(struct work_struct *work)
 		wake_up(&statedump_wq);
 }
 
-static int do_ltt_statedump(struct ltt_probe_private_data *call_data)
+static int do_ltt_statedump(struct ltt_statedump *sd)
 {
+	struct ltt_probe_private_data *call_data = &sd->call_data;
 	int cpu;
 	struct module *cb_owner;
 
 	printk(KERN_DEBUG "LTT state dump thread start\n");
-	ltt_enumerate_process_states(call_data);
-	ltt_enumerate_file_descriptors(call_data);
+	ltt_enumerate_process_states(sd);
+	ltt_enumerate_file_descriptors(sd);
 	list_modules(call_data);
-	ltt_enumerate_vm_maps(call_data);
+	ltt_enumerate_vm_maps(sd);
 	list_interrupts(call_data);
 	ltt_enumerate_network_ip_interface(call_data);
 	ltt_dump_swap_files(call_data);
@@ -407,12 +622,13 @@ static int do_ltt_statedump(struct ltt_probe_private_data *call_data)
  */
 int ltt_statedump_start(struct ltt_trace *trace)
 {
-	struct ltt_probe_private_data call_data;
+	struct ltt_statedump sd;
 	printk(KERN_DEBUG "LTT state dump begin\n");
 
-	call_data.trace = trace;
-	call_data.serializer = NULL;
-	return do_ltt_statedump(&call_data);
+	sd.call_data.trace = trace;
+	sd.call_data.serializer = NULL;
+	sd.throttle = 1;
+	return do_ltt_statedump(&sd);
 }
 
 static int __init statedump_init(void)
@@ -23,6 +23,10 @@
 #include <linux/notifier.h>
 #include <linux/jiffies.h>
 #include <linux/marker.h>
+#include <linux/net.h>
+#include <linux/in.h>
+#include <linux/inet.h>
+#include <linux/ltt-relay.h>
 
 #define LTT_CONTROL_DIR "control"
 #define MARKERS_CONTROL_DIR "markers"
@@ -243,6 +247,202 @@ static const struct file_operations ltt_trans_operations = {
 	.write = trans_write,
 };
 
+#ifdef CONFIG_NET
+/*
+ * Accepts "tcp A.B.C.D:port", "udp A.B.C.D:port" or "none". The socket is
+ * connected before the traces lock is taken.
+ */
+static ssize_t stream_write(struct file *file, const char __user *user_buf,
+			    size_t count, loff_t *ppos)
+{
+	char *buf = (char *)__get_free_page(GFP_KERNEL);
+	char proto[5], addr[32];
+	const char *trace_name = file->f_dentry->d_parent->d_name.name;
+	const char *end;
+	struct sockaddr_in sin;
+	struct socket *sock;
+	struct ltt_trace *trace;
+	unsigned long port;
+	int err = 0;
+	int buf_size, nr;
+
+	if (!buf)
+		return -ENOMEM;
+	buf_size = min_t(size_t, count, PAGE_SIZE - 1);
+	if (copy_from_user(buf, user_buf, buf_size)) {
+		err = -EFAULT;
+		goto err_copy_from_user;
+	}
+	buf[buf_size] = 0;
+
+	nr = sscanf(buf, "%4s %31s", proto, addr);
+	if (nr < 1) {
+		err = -EPERM;
+		goto err_get_cmd;
+	}
+
+	if (!strcmp(proto, "none")) {
+		mutex_lock(&control_lock);
+		ltt_lock_traces();
+		trace = _ltt_trace_find(trace_name);
+		err = trace ? ltt_relay_stream_stop(trace) : -ENOENT;
+		ltt_unlock_traces();
+		mutex_unlock(&control_lock);
+		if (err)
+			goto err_stream;
+		goto end;
+	}
+
+	if (nr < 2 || (strcmp(proto, "tcp") && strcmp(proto, "udp"))) {
+		err = -EINVAL;
+		goto err_get_cmd;
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	if (!in4_pton(addr, -1, (u8 *)&sin.sin_addr.s_addr, ':', &end)
+	    || *end != ':') {
+		err = -EINVAL;
+		goto err_get_cmd;
+	}
+	port = simple_strtoul(end + 1, NULL, 10);
+	if (!port || port > 65535) {
+		err = -EINVAL;
+		goto err_get_cmd;
+	}
+	sin.sin_port = htons(port);
+
+	if (!strcmp(proto, "tcp"))
+		err = sock_create_kern(PF_INET, SOCK_STREAM, IPPROTO_TCP, &sock);
+	else
+		err = sock_create_kern(PF_INET, SOCK_DGRAM, IPPROTO_UDP, &sock);
+	if (err)
+		goto err_get_cmd;
+
+	err = kernel_connect(sock, (struct sockaddr *)&sin, sizeof(sin), 0);
+	if (err) {
+		printk(KERN_ERR "stream_write: connect to %s failed: %d\n",
+		       addr, err);
+		goto err_sock;
+	}
+
+	mutex_lock(&control_lock);
+	ltt_lock_traces();
+	trace = _ltt_trace_find(trace_name);
+	err = trace ? ltt_relay_stream_start(trace, sock) : -ENOENT;
+	ltt_unlock_traces();
+	mutex_unlock(&control_lock);
+	if (err) {
+		printk(KERN_ERR "stream_write: ltt_relay_stream_start failed: "
+		       "%d\n", err);
+		goto err_sock;
+	}
+
+end:
+	free_page((unsigned long)buf);
+	return count;
+
+err_sock:
+	sock_release(sock);
+err_stream:
+err_get_cmd:
+err_copy_from_user:
+	free_page((unsigned long)buf);
+	return err;
+}
+
+static const struct file_operations ltt_stream_operations = {
+	.write = stream_write,
+};
+#endif /* CONFIG_NET */
+
+#ifdef CONFIG_LTT_RELAY_HISTORY
+/*
+ * Size of the compressed history pool, in kB. 0 discards the history.
+ */
+static ssize_t history_write(struct file *file, const char __user *user_buf,
+			     size_t count, loff_t *ppos)
+{
+	char buf[NAME_MAX];
+	const char *trace_name = file->f_dentry->d_parent->d_name.name;
+	struct ltt_trace *trace;
+	unsigned long size;
+	int err = 0;
+	int buf_size;
+
+	buf_size = min_t(size_t, count, sizeof(buf) - 1);
+	err = copy_from_user(buf, user_buf, buf_size);
+	if (err)
+		return -EFAULT;
+	buf[buf_size] = 0;
+
+	if (sscanf(buf, "%lu", &size) != 1)
+		return -EPERM;
+	if (size > ULONG_MAX >> 10)
+		return -EINVAL;
+
+	mutex_lock(&control_lock);
+	ltt_lock_traces();
+	trace = _ltt_trace_find(trace_name);
+	if (!trace)
+		err = -ENOENT;
+	else if (size)
+		err = ltt_relay_history_start(trace, (size_t)size << 10);
+	else
+		ltt_relay_history_free(trace);
+	ltt_unlock_traces();
+	mutex_unlock(&control_lock);
+	if (err) {
+		printk(KERN_ERR "history_write: ltt_relay_history_start failed: "
+		       "%d\n", err);
+		return err;
+	}
+	return count;
+}
+
+static const struct file_operations ltt_history_operations = {
+	.write = history_write,
+};
+
+/*
+ * Stops the trace and freezes its history. The live buffers are then read by
+ * lttd, and the history from /debugfs/ltt/history/<trace>.
+ */
+static ssize_t snapshot_write(struct file *file, const char __user *user_buf,
+			      size_t count, loff_t *ppos)
+{
+	const char *trace_name = file->f_dentry->d_parent->d_name.name;
+	struct ltt_trace *trace;
+	int active, err;
+
+	mutex_lock(&control_lock);
+	ltt_lock_traces();
+	trace = _ltt_trace_find(trace_name);
+	active = trace ? trace->active : 0;
+	ltt_unlock_traces();
+	if (active) {
+		err = ltt_trace_stop(trace_name);
+		if (err)
+			goto end;
+	}
+	ltt_lock_traces();
+	trace = _ltt_trace_find(trace_name);
+	err = trace ? ltt_relay_history_snapshot(trace) : -ENOENT;
+	ltt_unlock_traces();
+end:
+	mutex_unlock(&control_lock);
+	if (err) {
+		printk(KERN_ERR "snapshot_write: snapshot of trace %s failed: "
+		       "%d\n", trace_name, err);
+		return err;
+	}
+	return count;
+}
+
+static const struct file_operations ltt_snapshot_operations = {
+	.write = snapshot_write,
+};
+#endif /* CONFIG_LTT_RELAY_HISTORY */
+
 
 static ssize_t channel_subbuf_num_write(struct file *file,
 		const char __user *user_buf, size_t count, loff_t *ppos)
@@ -592,6 +792,40 @@ static int _create_trace_control_dir(const char *trace_name,
 		goto err_create_subdir;
 	}
 
+#ifdef CONFIG_NET
+	/* debugfs/control/trace_name/stream */
+	tmp_den = debugfs_create_file("stream", S_IWUSR, trace_root, NULL,
+				      &ltt_stream_operations);
+	if (IS_ERR(tmp_den) || !tmp_den) {
+		printk(KERN_ERR "_create_trace_control_dir: "
+		       "create file of stream failed\n");
+		err = -ENOMEM;
+		goto err_create_subdir;
+	}
+#endif
+
+#ifdef CONFIG_LTT_RELAY_HISTORY
+	/* debugfs/control/trace_name/history */
+	tmp_den = debugfs_create_file("history", S_IWUSR, trace_root, NULL,
+				      &ltt_history_operations);
+	if (IS_ERR(tmp_den) || !tmp_den) {
+		printk(KERN_ERR "_create_trace_control_dir: "
+		       "create file of history failed\n");
+		err = -ENOMEM;
+		goto err_create_subdir;
+	}
+
+	/* debugfs/control/trace_name/snapshot */
+	tmp_den = debugfs_create_file("snapshot", S_IWUSR, trace_root, NULL,
+				      &ltt_snapshot_operations);
+	if (IS_ERR(tmp_den) || !tmp_den) {
+		printk(KERN_ERR "_create_trace_control_dir: "
+		       "create file of snapshot failed\n");
+		err = -ENOMEM;
+		goto err_create_subdir;
+	}
+#endif
+
 	/* debugfs/control/trace_name/channel/ */
 	channel_root = debugfs_create_dir("channel", trace_root);
 	if (IS_ERR(channel_root) || !channel_root) {
@@ -455,7 +455,7 @@ static void async_wakeup(unsigned long data)
  *
  * Returns a pointer to the trace structure, NULL if not found.
  */
-static struct ltt_trace *_ltt_trace_find(const char *trace_name)
+struct ltt_trace *_ltt_trace_find(const char *trace_name)
 {
 	struct ltt_trace *trace;
 
@@ -465,6 +465,7 @@ static struct ltt_trace *_ltt_trace_find(const char *trace_name)
 
 	return NULL;
 }
+EXPORT_SYMBOL_GPL(_ltt_trace_find);
 
 /* _ltt_trace_find_setup :
  * find a trace in setup list by given name.
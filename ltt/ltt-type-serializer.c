@@ -56,7 +56,8 @@ void _ltt_specialized_trace(const struct marker *mdata, void *probe_data,
 	__list_for_each_entry_rcu(trace, &ltt_traces.head, list) {
 		if (unlikely(!trace->active))
 			continue;
-		if (unlikely(!ltt_run_filter(trace, eID)))
+		if (unlikely(!ltt_run_filter(trace, mdata, serialize_private,
+					     NULL)))
 			continue;
 #ifdef CONFIG_LTT_DEBUG_EVENT_SIZE
 		rflags = LTT_RFLAG_ID_SIZE;
@@ -10,12 +10,54 @@
 #include <linux/gfp.h>
 #include <linux/fs.h>
 #include <linux/debugfs.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
 #include <linux/ltt-type-serializer.h>
+#include <linux/ltt-userspace-event.h>
 
 #define LTT_WRITE_EVENT_FILE	"write_event"
+#define LTT_URING_FILE		"userspace_ring"
+
+/* Period of the ring drain timer */
+#define LTT_URING_DRAIN_INTERVAL	(HZ / 10)
+/* Records drained per acquisition of the ring lock */
+#define LTT_URING_DRAIN_BATCH		64
 
 DEFINE_MARKER(userspace, event, "string %s");
-static struct dentry *ltt_event_file;
+DEFINE_MARKER(userspace, ring_string, "timestamp %llu id %u string %s");
+DEFINE_MARKER(userspace, ring_u64,
+	"timestamp %llu v0 %llu v1 %llu v2 %llu v3 %llu id %u");
+static struct dentry *ltt_event_file, *ltt_uring_file;
+
+/*
+ * The 64-bit fields come first so the structure layout matches the trace
+ * layout on architectures aligning u64 on 8 bytes with 4-byte pointers.
+ */
+struct serialize_uring_string {
+	u64 timestamp;
+	u32 id;
+	char string[0];
+} LTT_ALIGN;
+
+struct serialize_uring_u64 {
+	u64 timestamp;
+	u64 v[LTT_UREC_U64_MAX];
+	u32 id;
+	unsigned char end_field[0];
+} LTT_ALIGN;
+
+struct ltt_uring {
+	struct mutex mmap_mutex;	/* Serializes ring creation */
+	spinlock_t lock;		/* Serializes draining */
+	struct ltt_uring_ctl *ctl;	/* NULL until the file is mapped */
+	char *data;
+	u32 data_size;
+	u32 tail;			/* Trusted copy of ctl->tail */
+	struct timer_list timer;
+	char *scratch;			/* Record being traced */
+};
 
 /**
  * write_event - write a userspace string into the trace system
@@ -75,6 +117,245 @@ static const struct file_operations ltt_userspace_operations = {
 	.write = write_event,
 };
 
+/*
+ * Trace one record. The payload is copied out of the shared ring before being
+ * interpreted, because userspace can modify it concurrently. Returns 0 if the
+ * record has been consumed, -EINVAL if it is malformed.
+ */
+static int ltt_uring_emit(struct ltt_uring *uring,
+			  const struct ltt_urec_header *hdr,
+			  const char *payload)
+{
+	size_t len = hdr->size - sizeof(*hdr);
+	struct marker *marker;
+
+	switch (hdr->type) {
+	case LTT_UREC_PAD:
+		return 0;
+	case LTT_UREC_STRING:
+	{
+		struct serialize_uring_string *data = (void *)uring->scratch;
+
+		if (len < sizeof(u64)
+		    || len > LTT_UREC_MAX_SIZE - sizeof(*hdr))
+			return -EINVAL;
+		memcpy(&data->timestamp, payload, sizeof(u64));
+		len -= sizeof(u64);
+		memcpy(data->string, payload + sizeof(u64), len);
+		data->string[len] = '\0';
+		data->id = hdr->id;
+		marker = &GET_MARKER(userspace, ring_string);
+		if (!_imv_read(marker->state))
+			return 0;
+		ltt_specialized_trace(marker, marker->single.probe_private,
+			data, offsetof(struct serialize_uring_string, string)
+			+ strlen(data->string) + 1, sizeof(u64));
+		return 0;
+	}
+	case LTT_UREC_U64:
+	{
+		struct serialize_uring_u64 *data = (void *)uring->scratch;
+
+		if (len < sizeof(u64)
+		    || len > sizeof(u64) * (LTT_UREC_U64_MAX + 1))
+			return -EINVAL;
+		memset(data, 0, sizeof(*data));
+		memcpy(&data->timestamp, payload, len);
+		data->id = hdr->id;
+		marker = &GET_MARKER(userspace, ring_u64);
+		if (!_imv_read(marker->state))
+			return 0;
+		ltt_specialized_trace(marker, marker->single.probe_private,
+			data, serialize_sizeof(*data), sizeof(u64));
+		return 0;
+	}
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Drain at most LTT_URING_DRAIN_BATCH of the records published by userspace
+ * into the trace. A corrupted ring (inconsistent head or record size) has all
+ * its published records dropped. Returns 1 if published records are left.
+ */
+static int ltt_uring_drain_batch(struct ltt_uring *uring)
+{
+	struct ltt_uring_ctl *ctl;
+	struct ltt_urec_header hdr;
+	u32 head, tail, offset;
+	unsigned int nr = 0;
+	int more = 0;
+
+	spin_lock_bh(&uring->lock);
+	ctl = uring->ctl;
+	if (!ctl)
+		goto end;
+	head = ACCESS_ONCE(ctl->head);
+	/* Read head before the records */
+	smp_rmb();
+	tail = uring->tail;
+	if (head - tail > uring->data_size) {
+		ctl->lost++;
+		tail = head;
+	}
+	while (tail != head) {
+		if (nr++ == LTT_URING_DRAIN_BATCH) {
+			more = 1;
+			break;
+		}
+		offset = tail & (uring->data_size - 1);
+		memcpy(&hdr, uring->data + offset, sizeof(hdr));
+		if (hdr.size < sizeof(hdr)
+		    || hdr.size & (LTT_UREC_ALIGN - 1)
+		    || hdr.size > head - tail
+		    || hdr.size > uring->data_size - offset) {
+			ctl->lost++;
+			tail = head;
+			break;
+		}
+		if (ltt_uring_emit(uring, &hdr,
+				   uring->data + offset + sizeof(hdr)))
+			ctl->lost++;
+		tail += hdr.size;
+	}
+	uring->tail = tail;
+	/* Finish reading the records before releasing their space */
+	smp_mb();
+	ctl->tail = tail;
+end:
+	spin_unlock_bh(&uring->lock);
+	return more;
+}
+
+/*
+ * Drain the ring up to the records published by now, from process context.
+ */
+static void ltt_uring_drain(struct ltt_uring *uring)
+{
+	while (ltt_uring_drain_batch(uring))
+		cond_resched();
+}
+
+/*
+ * Drain one batch per tick while the ring is behind, rather than the whole
+ * ring from softirq context.
+ */
+static void ltt_uring_timer(unsigned long data)
+{
+	struct ltt_uring *uring = (struct ltt_uring *)data;
+
+	if (ltt_uring_drain_batch(uring))
+		mod_timer(&uring->timer, jiffies + 1);
+	else
+		mod_timer(&uring->timer, jiffies + LTT_URING_DRAIN_INTERVAL);
+}
+
+static int ltt_uring_open(struct inode *inode, struct file *file)
+{
+	struct ltt_uring *uring;
+
+	uring = kzalloc(sizeof(*uring), GFP_KERNEL);
+	if (!uring)
+		return -ENOMEM;
+	uring->scratch = kmalloc(LTT_UREC_MAX_SIZE
+				 + sizeof(struct serialize_uring_string),
+				 GFP_KERNEL);
+	if (!uring->scratch) {
+		kfree(uring);
+		return -ENOMEM;
+	}
+	mutex_init(&uring->mmap_mutex);
+	spin_lock_init(&uring->lock);
+	init_timer_deferrable(&uring->timer);
+	uring->timer.function = ltt_uring_timer;
+	uring->timer.data = (unsigned long)uring;
+	file->private_data = uring;
+	return 0;
+}
+
+static int ltt_uring_release(struct inode *inode, struct file *file)
+{
+	struct ltt_uring *uring = file->private_data;
+
+	del_timer_sync(&uring->timer);
+	ltt_uring_drain(uring);
+	vfree(uring->ctl);
+	kfree(uring->scratch);
+	kfree(uring);
+	return 0;
+}
+
+/*
+ * The ring is created by the first mapping of the file. Its length is the
+ * control page followed by a power of two number of pages of records.
+ */
+static int ltt_uring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct ltt_uring *uring = file->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	struct ltt_uring_ctl *ctl;
+	int ret;
+
+	if (vma->vm_pgoff || size < 2 * PAGE_SIZE
+	    || !is_power_of_2(size - PAGE_SIZE)
+	    || size - PAGE_SIZE > LTT_URING_MAX_DATA_SIZE)
+		return -EINVAL;
+
+	mutex_lock(&uring->mmap_mutex);
+	if (uring->ctl) {
+		ret = -EBUSY;
+		goto end;
+	}
+	ctl = vmalloc_user(size);
+	if (!ctl) {
+		ret = -ENOMEM;
+		goto end;
+	}
+	ret = remap_vmalloc_range(vma, ctl, 0);
+	if (ret) {
+		vfree(ctl);
+		goto end;
+	}
+	ctl->data_size = size - PAGE_SIZE;
+
+	spin_lock_bh(&uring->lock);
+	uring->data = (char *)ctl + PAGE_SIZE;
+	uring->data_size = size - PAGE_SIZE;
+	uring->ctl = ctl;
+	spin_unlock_bh(&uring->lock);
+	mod_timer(&uring->timer, jiffies + LTT_URING_DRAIN_INTERVAL);
+end:
+	mutex_unlock(&uring->mmap_mutex);
+	return ret;
+}
+
+static long ltt_uring_ioctl(struct file *file, unsigned int cmd,
+			    unsigned long arg)
+{
+	struct ltt_uring *uring = file->private_data;
+
+	switch (cmd) {
+	case LTT_URING_FLUSH:
+		if (!uring->ctl)
+			return -EINVAL;
+		ltt_uring_drain(uring);
+		return 0;
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+
+static const struct file_operations ltt_uring_operations = {
+	.open = ltt_uring_open,
+	.release = ltt_uring_release,
+	.mmap = ltt_uring_mmap,
+	.unlocked_ioctl = ltt_uring_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl = ltt_uring_ioctl,
+#endif
+};
+
 static int __init ltt_userspace_init(void)
 {
 	struct dentry *ltt_root_dentry;
@@ -99,7 +380,26 @@ static int __init ltt_userspace_init(void)
 		goto err_no_file;
 	}
 
+	/*
+	 * Each open file can pin a ring of kernel memory: root only, unless
+	 * the administrator opens it to a tracing group.
+	 */
+	ltt_uring_file = debugfs_create_file(LTT_URING_FILE,
+					     S_IRUSR | S_IWUSR,
+					     ltt_root_dentry,
+					     NULL,
+					     &ltt_uring_operations);
+	if (IS_ERR(ltt_uring_file) || !ltt_uring_file) {
+		printk(KERN_ERR
+			"ltt_userspace_init: failed to create file %s\n",
+			LTT_URING_FILE);
+		err = -EPERM;
+		goto err_no_uring_file;
+	}
+
 	return err;
+err_no_uring_file:
+	debugfs_remove(ltt_event_file);
 err_no_file:
 	put_ltt_root();
 err_no_root:
@@ -108,6 +408,7 @@ err_no_root:
 
 static void __exit ltt_userspace_exit(void)
 {
+	debugfs_remove(ltt_uring_file);
 	debugfs_remove(ltt_event_file);
 	put_ltt_root();
 }
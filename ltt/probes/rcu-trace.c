@@ -29,6 +29,27 @@ void probe_rcu_tree_call_rcu_bh(struct rcu_head *head, unsigned long ip)
 		probe_rcu_tree_call_rcu_bh, "func %p ip 0x%lX",
 		head->func, ip);
 }
+
+void probe_rcu_tree_gp_start(const char *flavor, long gpnum)
+{
+	trace_mark_tp(rcu, tree_gp_start, rcu_tree_gp_start,
+		probe_rcu_tree_gp_start, "flavor %s gpnum %ld", flavor, gpnum);
+}
+
+void probe_rcu_tree_gp_end(const char *flavor, long gpnum,
+		unsigned long duration)
+{
+	trace_mark_tp(rcu, tree_gp_end, rcu_tree_gp_end,
+		probe_rcu_tree_gp_end, "flavor %s gpnum %ld duration %lu",
+		flavor, gpnum, duration);
+}
+
+void probe_rcu_tree_batch(const char *flavor, int cpu, int count, long qlen)
+{
+	trace_mark_tp(rcu, tree_batch, rcu_tree_batch,
+		probe_rcu_tree_batch, "flavor %s cpu %d count %d qlen %ld",
+		flavor, cpu, count, qlen);
+}
 #endif
 
 MODULE_LICENSE("GPL and additional rights");
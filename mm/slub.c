@@ -28,6 +28,9 @@
 #include <linux/memory.h>
 #include <linux/math64.h>
 #include <linux/fault-inject.h>
+#include <linux/debugfs.h>
+#include <linux/hash.h>
+#include <linux/sort.h>
 
 /*
  * Lock order:
@@ -224,6 +227,136 @@ static inline void stat(struct kmem_cache_cpu *c, enum stat_item si)
 #endif
 }
 
+/*
+ * Runtime profiling (CONFIG_SLUB_PROFILE).
+ *
+ * Unlike the SLUB_STATS counters this costs a single test of s->profile
+ * per operation unless profiling has been switched on for the cache via
+ * /sys/kernel/slab/<cache>/profile. The counters then live in a per cpu
+ * area of their own so that the kmem_cache_cpu structures are not bloated.
+ * The profile is only looked at with interrupts or preemption disabled and
+ * is freed after synchronize_sched().
+ */
+enum prof_item {
+	PROF_ALLOC_FASTPATH,	/* Allocation from cpu slab */
+	PROF_ALLOC_SLOWPATH,	/* Allocation not from the cpu freelist */
+	PROF_ALLOC_FROM_PARTIAL,/* Cpu slab acquired from partial list */
+	PROF_ALLOC_SLAB,	/* Cpu slab acquired from page allocator */
+	PROF_FREE_FASTPATH,	/* Free to cpu slab */
+	PROF_FREE_SLOWPATH,	/* Freeing not to cpu slab */
+	PROF_FREE_ADD_PARTIAL,	/* Freeing moves slab to partial list */
+	PROF_FREE_SLAB,		/* Slab freed to the page allocator */
+	PROF_LIST_LOCK,		/* Partial list lock taken */
+	PROF_LIST_CONTENDED,	/* Partial list lock found busy */
+	NR_PROF_ITEMS };
+
+#ifdef CONFIG_SLUB_PROFILE
+struct kmem_cache_profile_cpu {
+	unsigned long event[NR_PROF_ITEMS];
+	unsigned int site_count;	/* Allocations since the last sample */
+};
+
+#define PROF_SITE_BITS	7
+#define PROF_SITES	(1 << PROF_SITE_BITS)
+
+struct prof_site {
+	unsigned long addr;
+	unsigned long count;
+};
+
+struct kmem_cache_profile {
+	struct kmem_cache_profile_cpu *cpu;
+	unsigned int site_period;	/* Sample every nth alloc, 0 = off */
+	spinlock_t site_lock;		/* Protects site[] and site_missed */
+	unsigned long site_missed;	/* Samples not fitting into site[] */
+	struct prof_site site[PROF_SITES];
+	struct kmem_cache_profile *next;	/* For freeing in bulk */
+};
+
+/*
+ * Allocation site histogram. A small open addressed hash table keyed by
+ * the caller address; a full table only counts the missed samples.
+ * Called with interrupts disabled.
+ */
+static noinline void prof_sample_site(struct kmem_cache_profile *p,
+							unsigned long addr)
+{
+	unsigned long h = hash_long(addr, PROF_SITE_BITS);
+	int i;
+
+	spin_lock(&p->site_lock);
+	for (i = 0; i < PROF_SITES; i++) {
+		struct prof_site *site = p->site + ((h + i) & (PROF_SITES - 1));
+
+		if (site->addr == addr) {
+			site->count++;
+			goto out;
+		}
+		if (!site->addr) {
+			site->addr = addr;
+			site->count = 1;
+			goto out;
+		}
+	}
+	p->site_missed++;
+out:
+	spin_unlock(&p->site_lock);
+}
+
+static __always_inline void prof(struct kmem_cache *s, enum prof_item item)
+{
+	struct kmem_cache_profile *p = rcu_dereference(s->profile);
+
+	if (unlikely(p))
+		per_cpu_ptr(p->cpu, smp_processor_id())->event[item]++;
+}
+
+static __always_inline void prof_alloc(struct kmem_cache *s,
+				enum prof_item item, unsigned long addr)
+{
+	struct kmem_cache_profile *p = rcu_dereference(s->profile);
+	struct kmem_cache_profile_cpu *pc;
+
+	if (likely(!p))
+		return;
+
+	pc = per_cpu_ptr(p->cpu, smp_processor_id());
+	pc->event[item]++;
+	if (unlikely(p->site_period) && ++pc->site_count >= p->site_period) {
+		pc->site_count = 0;
+		prof_sample_site(p, addr);
+	}
+}
+
+/*
+ * Take the partial list lock, noting whether somebody else was holding it
+ * if the cache is being profiled.
+ */
+static inline void lock_partial_list(struct kmem_cache *s,
+					struct kmem_cache_node *n)
+{
+	if (unlikely(s->profile)) {
+		if (!spin_trylock(&n->list_lock)) {
+			spin_lock(&n->list_lock);
+			prof(s, PROF_LIST_CONTENDED);
+		}
+		prof(s, PROF_LIST_LOCK);
+		return;
+	}
+	spin_lock(&n->list_lock);
+}
+#else
+static inline void prof(struct kmem_cache *s, enum prof_item item) {}
+static inline void prof_alloc(struct kmem_cache *s, enum prof_item item,
+						unsigned long addr) {}
+
+static inline void lock_partial_list(struct kmem_cache *s,
+					struct kmem_cache_node *n)
+{
+	spin_lock(&n->list_lock);
+}
+#endif
+
 /********************************************************************
  * 			Core slab cache functions
  *******************************************************************/
@@ -1281,10 +1414,10 @@ static __always_inline int slab_trylock(struct page *page)
 /*
  * Management of partially allocated slabs
  */
-static void add_partial(struct kmem_cache_node *n,
+static void add_partial(struct kmem_cache *s, struct kmem_cache_node *n,
 				struct page *page, int tail)
 {
-	spin_lock(&n->list_lock);
+	lock_partial_list(s, n);
 	n->nr_partial++;
 	if (tail)
 		list_add_tail(&page->lru, &n->partial);
@@ -1297,7 +1430,7 @@ static void remove_partial(struct kmem_cache *s, struct page *page)
 {
 	struct kmem_cache_node *n = get_node(s, page_to_nid(page));
 
-	spin_lock(&n->list_lock);
+	lock_partial_list(s, n);
 	list_del(&page->lru);
 	n->nr_partial--;
 	spin_unlock(&n->list_lock);
@@ -1323,7 +1456,8 @@ static inline int lock_and_freeze_slab(struct kmem_cache_node *n,
 /*
  * Try to allocate a partial slab from a specific node.
  */
-static struct page *get_partial_node(struct kmem_cache_node *n)
+static struct page *get_partial_node(struct kmem_cache *s,
+					struct kmem_cache_node *n)
 {
 	struct page *page;
 
@@ -1336,7 +1470,7 @@ static struct page *get_partial_node(struct kmem_cache_node *n)
 	if (!n || !n->nr_partial)
 		return NULL;
 
-	spin_lock(&n->list_lock);
+	lock_partial_list(s, n);
 	list_for_each_entry(page, &n->partial, lru)
 		if (lock_and_freeze_slab(n, page))
 			goto out;
@@ -1388,7 +1522,7 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 
 		if (n && cpuset_zone_allowed_hardwall(zone, flags) &&
 				n->nr_partial > s->min_partial) {
-			page = get_partial_node(n);
+			page = get_partial_node(s, n);
 			if (page)
 				return page;
 		}
@@ -1405,7 +1539,7 @@ static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node)
 	struct page *page;
 	int searchnode = (node == -1) ? numa_node_id() : node;
 
-	page = get_partial_node(get_node(s, searchnode));
+	page = get_partial_node(s, get_node(s, searchnode));
 	if (page || (flags & __GFP_THISNODE))
 		return page;
 
@@ -1428,7 +1562,7 @@ static void unfreeze_slab(struct kmem_cache *s, struct page *page, int tail)
 	if (page->inuse) {
 
 		if (page->freelist) {
-			add_partial(n, page, tail);
+			add_partial(s, n, page, tail);
 			stat(c, tail ? DEACTIVATE_TO_TAIL : DEACTIVATE_TO_HEAD);
 		} else {
 			stat(c, DEACTIVATE_FULL);
@@ -1450,11 +1584,12 @@ static void unfreeze_slab(struct kmem_cache *s, struct page *page, int tail)
 			 * kmem_cache_shrink can reclaim any empty slabs from
 			 * the partial list.
 			 */
-			add_partial(n, page, 1);
+			add_partial(s, n, page, 1);
 			slab_unlock(page);
 		} else {
 			slab_unlock(page);
 			stat(get_cpu_slab(s, raw_smp_processor_id()), FREE_SLAB);
+			prof(s, PROF_FREE_SLAB);
 			discard_slab(s, page);
 		}
 	}
@@ -1651,6 +1786,7 @@ load_freelist:
 unlock_out:
 	slab_unlock(c->page);
 	stat(c, ALLOC_SLOWPATH);
+	prof_alloc(s, PROF_ALLOC_SLOWPATH, addr);
 	return object;
 
 another_slab:
@@ -1661,6 +1797,7 @@ new_slab:
 	if (new) {
 		c->page = new;
 		stat(c, ALLOC_FROM_PARTIAL);
+		prof(s, PROF_ALLOC_FROM_PARTIAL);
 		goto load_freelist;
 	}
 
@@ -1675,6 +1812,7 @@ new_slab:
 	if (new) {
 		c = get_cpu_slab(s, smp_processor_id());
 		stat(c, ALLOC_SLAB);
+		prof(s, PROF_ALLOC_SLAB);
 		if (c->page)
 			flush_slab(s, c);
 		slab_lock(new);
@@ -1732,6 +1870,7 @@ static __always_inline void *slab_alloc(struct kmem_cache *s,
 		object = c->freelist;
 		c->freelist = object[c->offset];
 		stat(c, ALLOC_FASTPATH);
+		prof_alloc(s, PROF_ALLOC_FASTPATH, addr);
 	}
 	local_irq_restore(flags);
 
@@ -1802,6 +1941,7 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 	c = get_cpu_slab(s, raw_smp_processor_id());
 	stat(c, FREE_SLOWPATH);
+	prof(s, PROF_FREE_SLOWPATH);
 	slab_lock(page);
 
 	if (unlikely(SLABDEBUG && PageSlubDebug(page)))
@@ -1825,8 +1965,9 @@ checks_ok:
 	 * then add it.
 	 */
 	if (unlikely(!prior)) {
-		add_partial(get_node(s, page_to_nid(page)), page, 1);
+		add_partial(s, get_node(s, page_to_nid(page)), page, 1);
 		stat(c, FREE_ADD_PARTIAL);
+		prof(s, PROF_FREE_ADD_PARTIAL);
 	}
 
 out_unlock:
@@ -1843,6 +1984,7 @@ slab_empty:
 	}
 	slab_unlock(page);
 	stat(c, FREE_SLAB);
+	prof(s, PROF_FREE_SLAB);
 	discard_slab(s, page);
 	return;
 
@@ -1863,16 +2005,12 @@ debug:
  * If fastpath is not possible then fall back to __slab_free where we deal
  * with all sorts of special processing.
  */
-static __always_inline void slab_free(struct kmem_cache *s,
-			struct page *page, void *x, unsigned long addr)
+static __always_inline void slab_free_irqoff(struct kmem_cache *s,
+			struct kmem_cache_cpu *c, struct page *page, void *x,
+			unsigned long addr)
 {
 	void **object = (void *)x;
-	struct kmem_cache_cpu *c;
-	unsigned long flags;
 
-	kmemleak_free_recursive(x, s->flags);
-	local_irq_save(flags);
-	c = get_cpu_slab(s, smp_processor_id());
 	kmemcheck_slab_free(s, object, c->objsize);
 	debug_check_no_locks_freed(object, c->objsize);
 	if (!(s->flags & SLAB_DEBUG_OBJECTS))
@@ -1881,9 +2019,20 @@ static __always_inline void slab_free(struct kmem_cache *s,
 		object[c->offset] = c->freelist;
 		c->freelist = object;
 		stat(c, FREE_FASTPATH);
+		prof(s, PROF_FREE_FASTPATH);
 	} else
 		__slab_free(s, page, x, addr, c->offset);
+}
 
+static __always_inline void slab_free(struct kmem_cache *s,
+			struct page *page, void *x, unsigned long addr)
+{
+	unsigned long flags;
+
+	kmemleak_free_recursive(x, s->flags);
+	local_irq_save(flags);
+	slab_free_irqoff(s, get_cpu_slab(s, smp_processor_id()), page, x,
+								addr);
 	local_irq_restore(flags);
 }
 
@@ -1899,6 +2048,89 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Bulk allocation and freeing. The whole array is handled in a single
+ * interrupt disabled section. Allocation takes objects off the cpu freelist
+ * and, when it runs dry, refills it with the freelist of a whole slab in
+ * one go. Frees to the cpu slab go onto the cpu freelist, the others take
+ * the usual slow path.
+ *
+ * Returns the number of objects allocated, which is either size or 0.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t gfpflags, size_t size,
+								void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i, j;
+
+	gfpflags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(gfpflags);
+	might_sleep_if(gfpflags & __GFP_WAIT);
+
+	if (should_failslab(s->objsize, gfpflags))
+		return 0;
+
+	local_irq_save(flags);
+	c = get_cpu_slab(s, smp_processor_id());
+	for (i = 0; i < size; i++) {
+		void **object = c->freelist;
+
+		if (unlikely(!object)) {
+			p[i] = __slab_alloc(s, gfpflags, -1, _RET_IP_, c);
+			if (unlikely(!p[i]))
+				break;
+			/* We may have been rescheduled with __GFP_WAIT */
+			c = get_cpu_slab(s, smp_processor_id());
+			continue;
+		}
+		c->freelist = object[c->offset];
+		p[i] = object;
+		stat(c, ALLOC_FASTPATH);
+		prof_alloc(s, PROF_ALLOC_FASTPATH, _RET_IP_);
+	}
+	local_irq_restore(flags);
+
+	for (j = 0; j < i; j++) {
+		if (unlikely(gfpflags & __GFP_ZERO))
+			memset(p[j], 0, s->objsize);
+
+		kmemcheck_slab_alloc(s, gfpflags, p[j], s->objsize);
+		kmemleak_alloc_recursive(p[j], s->objsize, 1, s->flags,
+								gfpflags);
+		trace_kmem_cache_alloc(_RET_IP_, p[j], s->objsize, s->size,
+								gfpflags);
+	}
+
+	if (unlikely(i < size)) {
+		kmem_cache_free_bulk(s, i, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i;
+
+	local_irq_save(flags);
+	c = get_cpu_slab(s, smp_processor_id());
+	for (i = 0; i < size; i++) {
+		kmemleak_free_recursive(p[i], s->flags);
+		slab_free_irqoff(s, c, virt_to_head_page(p[i]), p[i],
+								_RET_IP_);
+	}
+	local_irq_restore(flags);
+
+	for (i = 0; i < size; i++)
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /* Figure out on which slab page the object resides */
 static struct page *get_object_page(const void *x)
 {
@@ -2266,7 +2498,7 @@ static void early_kmem_cache_node_alloc(gfp_t gfpflags, int node)
 	 * the boot sequence, we still disable irqs.
 	 */
 	local_irq_save(flags);
-	add_partial(n, page, 0);
+	add_partial(kmalloc_caches, n, page, 0);
 	local_irq_restore(flags);
 }
 
@@ -4398,6 +4630,226 @@ STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
 #endif
 
+#ifdef CONFIG_SLUB_PROFILE
+static const char *prof_names[NR_PROF_ITEMS] = {
+	[PROF_ALLOC_FASTPATH]		= "alloc_fastpath",
+	[PROF_ALLOC_SLOWPATH]		= "alloc_slowpath",
+	[PROF_ALLOC_FROM_PARTIAL]	= "alloc_from_partial",
+	[PROF_ALLOC_SLAB]		= "alloc_slab",
+	[PROF_FREE_FASTPATH]		= "free_fastpath",
+	[PROF_FREE_SLOWPATH]		= "free_slowpath",
+	[PROF_FREE_ADD_PARTIAL]		= "free_add_partial",
+	[PROF_FREE_SLAB]		= "free_slab",
+	[PROF_LIST_LOCK]		= "list_lock",
+	[PROF_LIST_CONTENDED]		= "list_lock_contended",
+};
+
+/* Serializes enabling, disabling and reading out of profiles */
+static DEFINE_MUTEX(prof_mutex);
+
+static int prof_enable(struct kmem_cache *s)
+{
+	struct kmem_cache_profile *p;
+
+	if (s->profile)
+		return 0;
+
+	p = kzalloc(sizeof(struct kmem_cache_profile), GFP_KERNEL);
+	if (!p)
+		return -ENOMEM;
+
+	p->cpu = alloc_percpu(struct kmem_cache_profile_cpu);
+	if (!p->cpu) {
+		kfree(p);
+		return -ENOMEM;
+	}
+	spin_lock_init(&p->site_lock);
+	rcu_assign_pointer(s->profile, p);
+	return 0;
+}
+
+static void prof_free(struct kmem_cache_profile *p)
+{
+	free_percpu(p->cpu);
+	kfree(p);
+}
+
+static void prof_disable(struct kmem_cache *s)
+{
+	struct kmem_cache_profile *p = s->profile;
+
+	if (!p)
+		return;
+
+	rcu_assign_pointer(s->profile, NULL);
+	/* The hooks only run with interrupts or preemption disabled */
+	synchronize_sched();
+	prof_free(p);
+}
+
+static void prof_reset(struct kmem_cache_profile *p)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(p->cpu, cpu), 0,
+				sizeof(struct kmem_cache_profile_cpu));
+}
+
+static void prof_sum(struct kmem_cache_profile *p, unsigned long *sum)
+{
+	int cpu;
+	int i;
+
+	memset(sum, 0, NR_PROF_ITEMS * sizeof(unsigned long));
+	for_each_possible_cpu(cpu) {
+		struct kmem_cache_profile_cpu *pc = per_cpu_ptr(p->cpu, cpu);
+
+		for (i = 0; i < NR_PROF_ITEMS; i++)
+			sum[i] += pc->event[i];
+	}
+}
+
+static ssize_t profile_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", s->profile != NULL);
+}
+
+/*
+ * Writing 1 enables profiling or clears the counters if it was already
+ * enabled. Writing 0 disables profiling and discards the data.
+ */
+static ssize_t profile_store(struct kmem_cache *s,
+				const char *buf, size_t length)
+{
+	int err = 0;
+
+	mutex_lock(&prof_mutex);
+	if (buf[0] == '1') {
+		if (s->profile)
+			prof_reset(s->profile);
+		else
+			err = prof_enable(s);
+	} else if (buf[0] == '0')
+		prof_disable(s);
+	else
+		err = -EINVAL;
+	mutex_unlock(&prof_mutex);
+
+	return err ? err : length;
+}
+SLAB_ATTR(profile);
+
+static ssize_t profile_stats_show(struct kmem_cache *s, char *buf)
+{
+	unsigned long sum[NR_PROF_ITEMS];
+	int len = 0;
+	int i;
+
+	mutex_lock(&prof_mutex);
+	if (s->profile) {
+		prof_sum(s->profile, sum);
+		for (i = 0; i < NR_PROF_ITEMS; i++)
+			len += sprintf(buf + len, "%s %lu\n",
+						prof_names[i], sum[i]);
+	}
+	mutex_unlock(&prof_mutex);
+	return len;
+}
+SLAB_ATTR_RO(profile_stats);
+
+static int cmp_site(const void *a, const void *b)
+{
+	const struct prof_site *x = a, *y = b;
+
+	if (x->count == y->count)
+		return 0;
+	return x->count < y->count ? 1 : -1;
+}
+
+static ssize_t alloc_sites_show(struct kmem_cache *s, char *buf)
+{
+	struct kmem_cache_profile *p;
+	struct prof_site *sites;
+	unsigned long missed = 0;
+	unsigned int period = 0;
+	int len = 0;
+	int n = 0;
+	int i;
+
+	sites = kmalloc(sizeof(struct prof_site) * PROF_SITES, GFP_KERNEL);
+	if (!sites)
+		return -ENOMEM;
+
+	mutex_lock(&prof_mutex);
+	p = s->profile;
+	if (p) {
+		spin_lock_irq(&p->site_lock);
+		for (i = 0; i < PROF_SITES; i++)
+			if (p->site[i].addr)
+				sites[n++] = p->site[i];
+		missed = p->site_missed;
+		period = p->site_period;
+		spin_unlock_irq(&p->site_lock);
+	}
+	mutex_unlock(&prof_mutex);
+
+	sort(sites, n, sizeof(struct prof_site), cmp_site, NULL);
+
+	for (i = 0; i < n; i++) {
+		if (len > PAGE_SIZE - KSYM_SYMBOL_LEN - 100)
+			break;
+		len += sprintf(buf + len, "%7lu %pS\n",
+				sites[i].count, (void *)sites[i].addr);
+	}
+	kfree(sites);
+
+	if (!n && !missed)
+		return sprintf(buf, "No data\n");
+	return len + sprintf(buf + len, "sampled 1/%u, %lu missed\n",
+							period, missed);
+}
+
+/*
+ * Writing n samples the caller of every nth allocation from now on,
+ * enabling profiling if necessary. Previous samples are discarded.
+ * Writing 0 stops sampling but keeps the histogram around.
+ */
+static ssize_t alloc_sites_store(struct kmem_cache *s,
+				const char *buf, size_t length)
+{
+	struct kmem_cache_profile *p;
+	unsigned long period;
+	int err;
+
+	err = strict_strtoul(buf, 10, &period);
+	if (err)
+		return err;
+	if (period > UINT_MAX)
+		return -EINVAL;
+
+	mutex_lock(&prof_mutex);
+	p = s->profile;
+	if (!p && period) {
+		err = prof_enable(s);
+		p = s->profile;
+	}
+	if (p) {
+		spin_lock_irq(&p->site_lock);
+		if (period) {
+			memset(p->site, 0, sizeof(p->site));
+			p->site_missed = 0;
+		}
+		p->site_period = period;
+		spin_unlock_irq(&p->site_lock);
+	}
+	mutex_unlock(&prof_mutex);
+
+	return err ? err : length;
+}
+SLAB_ATTR(alloc_sites);
+#endif
+
 static struct attribute *slab_attrs[] = {
 	&slab_size_attr.attr,
 	&object_size_attr.attr,
@@ -4450,6 +4902,11 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_to_tail_attr.attr,
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
+#endif
+#ifdef CONFIG_SLUB_PROFILE
+	&profile_attr.attr,
+	&profile_stats_attr.attr,
+	&alloc_sites_attr.attr,
 #endif
 	NULL
 };
@@ -4500,6 +4957,11 @@ static void kmem_cache_release(struct kobject *kobj)
 {
 	struct kmem_cache *s = to_slab(kobj);
 
+#ifdef CONFIG_SLUB_PROFILE
+	/* The cache is gone, nobody can be looking at the profile anymore */
+	if (s->profile)
+		prof_free(s->profile);
+#endif
 	kfree(s);
 }
 
@@ -4691,6 +5153,112 @@ static int __init slab_sysfs_init(void)
 }
 
 __initcall(slab_sysfs_init);
+
+#if defined(CONFIG_SLUB_PROFILE) && defined(CONFIG_DEBUG_FS)
+/*
+ * /sys/kernel/debug/slub_profile: one line per profiled cache so that the
+ * caches bouncing between the cpu slabs and the partial lists stand out.
+ * Writing 1 or 0 switches profiling on or off for all caches.
+ */
+static int slub_profile_show(struct seq_file *m, void *v)
+{
+	unsigned long sum[NR_PROF_ITEMS];
+	struct kmem_cache *s;
+	int i;
+
+	seq_printf(m, "%-20s", "# name");
+	for (i = 0; i < NR_PROF_ITEMS; i++)
+		seq_printf(m, " %s", prof_names[i]);
+	seq_puts(m, " fast%\n");
+
+	down_read(&slub_lock);
+	mutex_lock(&prof_mutex);
+	list_for_each_entry(s, &slab_caches, list) {
+		u64 fast, ops;
+
+		if (!s->profile)
+			continue;
+
+		prof_sum(s->profile, sum);
+		seq_printf(m, "%-20s", s->name);
+		for (i = 0; i < NR_PROF_ITEMS; i++)
+			seq_printf(m, " %lu", sum[i]);
+
+		/* The sums and the scaling overflow an unsigned long on 32-bit */
+		fast = (u64)sum[PROF_ALLOC_FASTPATH] + sum[PROF_FREE_FASTPATH];
+		ops = fast + sum[PROF_ALLOC_SLOWPATH] + sum[PROF_FREE_SLOWPATH];
+		seq_printf(m, " %llu\n", ops ?
+			   (unsigned long long)div64_u64(fast * 100, ops) : 0ULL);
+	}
+	mutex_unlock(&prof_mutex);
+	up_read(&slub_lock);
+	return 0;
+}
+
+static int slub_profile_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, slub_profile_show, NULL);
+}
+
+static ssize_t slub_profile_write(struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	struct kmem_cache_profile *p, *dead = NULL;
+	struct kmem_cache *s;
+	char c;
+	int err = 0;
+
+	if (!count)
+		return 0;
+	if (get_user(c, ubuf))
+		return -EFAULT;
+	if (c != '0' && c != '1')
+		return -EINVAL;
+
+	down_read(&slub_lock);
+	mutex_lock(&prof_mutex);
+	list_for_each_entry(s, &slab_caches, list) {
+		p = s->profile;
+		if (c == '1') {
+			if (!p && !err)
+				err = prof_enable(s);
+		} else if (p) {
+			rcu_assign_pointer(s->profile, NULL);
+			p->next = dead;
+			dead = p;
+		}
+	}
+	mutex_unlock(&prof_mutex);
+	up_read(&slub_lock);
+
+	/* One grace period for all of them, see prof_disable() */
+	if (dead)
+		synchronize_sched();
+	while (dead) {
+		p = dead->next;
+		prof_free(dead);
+		dead = p;
+	}
+
+	return err ? err : count;
+}
+
+static const struct file_operations slub_profile_fops = {
+	.open		= slub_profile_open,
+	.read		= seq_read,
+	.write		= slub_profile_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init slub_profile_debugfs_init(void)
+{
+	debugfs_create_file("slub_profile", S_IRUSR | S_IWUSR, NULL, NULL,
+				&slub_profile_fops);
+	return 0;
+}
+__initcall(slub_profile_debugfs_init);
+#endif
 #endif
 
 /*